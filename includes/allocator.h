@@ -284,6 +284,27 @@ static inline char *allocator_sprintf_dbg(Allocator *arena, const char *format,
 #define allocator_sprintf(arena, fmt, ...)                                     \
   allocator_sprintf_dbg((arena), (fmt), __FILE__, __LINE__, __VA_ARGS__)
 
+// Hands every region of `src` over to `dst`, so that what was allocated
+// from `src` lives as long as `dst`. `src` is left empty.
+static inline void allocator_adopt(Allocator *dst, Allocator *src) {
+  if (src->base.begin == NULL)
+    return;
+
+  if (dst->base.begin == NULL) {
+    dst->base = src->base;
+  } else {
+    Region *last = dst->base.end;
+    while (last->next != NULL)
+      last = last->next;
+    last->next = src->base.begin;
+  }
+#if ARENA_DEBUG_MODE
+  dst->stats.current_usage += src->stats.current_usage;
+  src->stats.current_usage = 0;
+#endif
+  memset(&src->base, 0, sizeof(src->base));
+}
+
 // ---- Init/Reset ----
 static inline void allocator_init(Allocator *allocator, const char *tag) {
   memset(allocator, 0, sizeof(*allocator));
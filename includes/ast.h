@@ -0,0 +1,130 @@
+#ifndef AST_H_
+#define AST_H_
+
+#pragma once
+
+#include "utils.h"
+#include <stdint.h>
+
+typedef struct ASTNode ASTNode;
+
+// Position of a node in AST.nodes, counted in AST_NODE_ALIGN byte words.
+// Word 0 is never handed out so that a zero index can mean "no node".
+typedef uint32_t NodeIndex;
+
+#define NODE_NONE ((NodeIndex)0)
+
+#define AST_NODE_ALIGN 8
+
+// Words reserved per token. No node takes more than 7 words and the parser,
+// semantic analysis and TAC lowering allocate fewer than two nodes per token,
+// so a tree reserved this way never has to grow while it is being built.
+#define AST_WORDS_PER_TOKEN 16
+
+// Children of a node: `count` indices stored from `start` in AST.children
+typedef struct NodeSpan {
+  uint32_t start;
+  uint32_t count;
+} NodeSpan;
+
+// Flat tree storage. Nodes live back to back in one contiguous block reserved
+// up front, so their addresses stay valid while the tree grows within it. Each
+// node only takes the room its kind needs and refers to other nodes by index.
+// Every child list is a span of the shared `children` array.
+//
+// Lists are built on the `scratch` stack: remember AST_list_begin, push the
+// children (nested lists are pushed and popped above them) and AST_list_end
+// copies them into `children` as one span.
+typedef struct AST {
+  Allocator allocator; // Backs the child arrays and data hanging off nodes
+  uint64_t *nodes;
+  uint32_t size;     // Words in use, including NODE_NONE
+  uint32_t capacity; // Words reserved
+  NodeIndex *children;
+  uint32_t children_size;
+  uint32_t children_capacity;
+  NodeIndex *scratch;
+  uint32_t scratch_size;
+  uint32_t scratch_capacity;
+} AST;
+
+// Reserves room for at least `words` words. Only the pages actually used are
+// backed by memory.
+AST AST_new(size_t words);
+
+// Words to reserve for a tree built from `tokens` tokens
+static inline size_t AST_words_for(size_t tokens) {
+  return tokens * AST_WORDS_PER_TOKEN;
+}
+
+// Makes room for `words` more words, remapping the nodes if the reservation
+// is too small. Node pointers taken before are stale once the nodes move, so
+// only call this where the tree is held through indices alone.
+bool AST_reserve(AST *ast, size_t words);
+
+// Returns `size` zeroed bytes for a node, or NULL once the reservation is
+// exhausted
+ASTNode *AST_alloc(AST *ast, size_t size);
+
+static inline ASTNode *AST_node(const AST *ast, NodeIndex index) {
+  return (ASTNode *)(ast->nodes + index);
+}
+
+static inline NodeIndex AST_index(const AST *ast, const ASTNode *node) {
+  return (NodeIndex)((const uint64_t *)node - ast->nodes);
+}
+
+// Node at `index`, NULL for NODE_NONE
+static inline ASTNode *AST_get(const AST *ast, NodeIndex index) {
+  return index != NODE_NONE ? AST_node(ast, index) : NULL;
+}
+
+// Index of `node`, NODE_NONE for NULL
+static inline NodeIndex AST_ref(const AST *ast, const ASTNode *node) {
+  return node != NULL ? AST_index(ast, node) : NODE_NONE;
+}
+
+static inline ASTNode *AST_child(const AST *ast, NodeSpan span, uint32_t i) {
+  return AST_node(ast, ast->children[span.start + i]);
+}
+
+static inline ASTNode *AST_last(const AST *ast, NodeSpan span) {
+  return span.count ? AST_child(ast, span, span.count - 1) : NULL;
+}
+
+// Removes the last child of `span` and returns it
+static inline ASTNode *AST_pop(const AST *ast, NodeSpan *span) {
+  ASTNode *last = AST_last(ast, *span);
+  if (last)
+    span->count--;
+  return last;
+}
+
+static inline uint32_t AST_list_begin(const AST *ast) {
+  return ast->scratch_size;
+}
+
+void AST_list_push(AST *ast, const ASTNode *node);
+
+// Commits everything pushed since `mark` as one span and pops it
+NodeSpan AST_list_end(AST *ast, uint32_t mark);
+
+// Drops everything pushed since `mark`
+static inline void AST_list_discard(AST *ast, uint32_t mark) {
+  ast->scratch_size = mark;
+}
+
+// Appends to a committed span. Spans that do not end the children array are
+// moved to its end first, so prefer building lists on the scratch stack.
+void AST_append(AST *ast, NodeSpan *span, const ASTNode *node);
+
+// Copies the nodes and child lists of `other` after ours, growing the
+// reservation as AST_reserve() does, and takes over its allocator. Node `i` of
+// `other` becomes node `i + *shift` and its child spans start `*children`
+// entries later. The links of the copied nodes are left for the caller to
+// shift, and `other` must be freed afterwards.
+bool AST_adopt(AST *ast, AST *other, NodeIndex *shift, uint32_t *children);
+
+void AST_free(AST *ast);
+
+#endif // AST_H_
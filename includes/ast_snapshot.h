@@ -0,0 +1,34 @@
+#ifndef AST_SNAPSHOT_H_
+#define AST_SNAPSHOT_H_
+
+#pragma once
+
+#include "parser.h"
+
+// Binary image of a parsed program: the source text, its tokens, lines,
+// decoded literals and interned names, and the node pool with its child
+// lists. Nodes refer to each other by index in the file. Loading maps the
+// file and turns those indices back into pointers, so later phases can start
+// from a cached parse without lexing or parsing again.
+typedef struct ASTSnapshot {
+  const char *path;
+  void *base; // Mapping of the whole file
+  size_t size;
+} ASTSnapshot;
+
+// Writes the program of a parser that has not been through semantic
+// analysis yet
+bool ast_snapshot_save(Parser *parser, const char *path);
+
+// Whether the file starts like a snapshot
+bool ast_snapshot_detect(const char *path);
+
+// Maps a snapshot written by ast_snapshot_save() and builds `parser` on top
+// of it. The snapshot must outlive the parser, which is freed with
+// parser_free() as usual.
+bool ast_snapshot_open(ASTSnapshot *snapshot, const char *path,
+                       Parser *parser);
+
+void ast_snapshot_close(ASTSnapshot *snapshot);
+
+#endif // AST_SNAPSHOT_H_
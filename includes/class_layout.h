@@ -0,0 +1,48 @@
+#ifndef CLASS_LAYOUT_H_
+#define CLASS_LAYOUT_H_
+
+#pragma once
+
+#include "semantic.h"
+
+// A field or method as seen from one class, inherited ones included
+typedef struct ClassMember {
+  Symbol *symbol;
+  Symbol *owner;   // Class that declares it
+  uint32_t offset; // Position in the field or the method table
+  bool is_method;
+  bool takes_self; // Methods only: the first parameter is the instance
+} ClassMember;
+
+// Members of a class, built once per CLASS_DEF. The fields of the base class
+// come first, at the offsets they have there, followed by the fields the
+// class declares. A method overriding an inherited one takes its slot in the
+// method table. Every name the class can resolve, its own or inherited, is
+// in a single open addressing index.
+typedef struct ClassLayout {
+  Symbol *class_sym;
+  ClassMember *fields;
+  uint32_t field_count;
+  uint32_t field_capacity;
+  ClassMember *methods;
+  uint32_t method_count;
+  uint32_t method_capacity;
+  uint32_t *slots;     // CLASS_MEMBER_NONE marks an empty slot
+  uint32_t slot_count; // power of two
+  uint32_t count;      // distinct names in the index
+  Allocator *allocator;
+} ClassLayout;
+
+#define CLASS_MEMBER_NONE UINT32_MAX
+
+// Starts the layout of `class_sym` from the one of its base class, if any
+ClassLayout *class_layout_new(Allocator *allocator, Symbol *class_sym,
+                              const ClassLayout *base);
+
+// Adds a member the class declares, whose declaration lives in `ast`. A later
+// member with the same name hides the earlier one.
+bool class_layout_add(ClassLayout *layout, const AST *ast, Symbol *member);
+
+const ClassMember *class_layout_find(const ClassLayout *layout, NameId name);
+
+#endif // CLASS_LAYOUT_H_
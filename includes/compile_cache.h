@@ -0,0 +1,41 @@
+#ifndef COMPILE_CACHE_H_
+#define COMPILE_CACHE_H_
+
+#pragma once
+
+#include "source_file.h"
+
+#ifndef CEEIFY_VERSION
+#define CEEIFY_VERSION "dev"
+#endif
+
+#define COMPILE_CACHE_PATH 4096
+
+// One entry of an on-disk cache of compiler output. Entries are named by a
+// 128-bit hash of the source bytes, the compiler version and the options,
+// and are only ever replaced whole by rename(), so readers never see a
+// partial file. A job that misses holds a lock on the entry until it has
+// stored its output, so parallel jobs compiling the same source wait for
+// the first one instead of repeating its work.
+typedef struct CompileCache {
+  char path[COMPILE_CACHE_PATH];
+  char lock_path[COMPILE_CACHE_PATH];
+  int lock; // Descriptor holding the entry lock, -1 when not held
+} CompileCache;
+
+// Names the entry for `source` compiled with `options` under `dir`, which is
+// created if needed
+bool compile_cache_open(CompileCache *cache, const char *dir,
+                        const char *source, size_t length,
+                        const char *options);
+
+// Maps the stored output into `entry`. On a miss, returns false with the
+// entry locked: the caller compiles and calls compile_cache_store().
+bool compile_cache_fetch(CompileCache *cache, SourceFile *entry);
+
+bool compile_cache_store(CompileCache *cache, const char *text, size_t length);
+
+// Releases the entry lock, if held, and removes its file
+void compile_cache_close(CompileCache *cache);
+
+#endif // COMPILE_CACHE_H_
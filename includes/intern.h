@@ -0,0 +1,50 @@
+#ifndef INTERN_H_
+#define INTERN_H_
+
+#pragma once
+
+#include "arena.h"
+#include "utils.h"
+#include <stdint.h>
+
+// Dense id of an interned identifier. Ids start at 1 so that zero can be used
+// as "not a name".
+typedef uint32_t NameId;
+
+#define NAME_NONE ((NameId)0)
+
+// Maps each distinct identifier to a NameId and keeps a single NUL-terminated
+// copy of it. Lookups hash the text once; afterwards names are compared by id.
+typedef struct InternTable {
+  const char **names; // Text of each id, names[NAME_NONE] is unused
+  uint32_t *hashes;   // Hash of each id, kept to rehash without the text
+  uint32_t size;      // Number of ids handed out, including NAME_NONE
+  uint32_t capacity;
+  NameId *slots; // Open addressing table, NAME_NONE marks an empty slot
+  uint32_t slot_count;
+  Allocator allocator;
+} InternTable;
+
+InternTable InternTable_new(uint32_t capacity);
+
+// Returns the id of `text[0, length)`, adding it to the table if needed.
+// Returns NAME_NONE when out of memory.
+NameId InternTable_intern(InternTable *table, const char *text, size_t length);
+
+// Returns the id of `text[0, length)` or NAME_NONE if it was never interned
+NameId InternTable_find(const InternTable *table, const char *text,
+                        size_t length);
+
+static inline const char *InternTable_name(const InternTable *table,
+                                           NameId id) {
+  return id != NAME_NONE && id < table->size ? table->names[id] : NULL;
+}
+
+// Number of distinct names in the table
+static inline uint32_t InternTable_count(const InternTable *table) {
+  return table->size - 1;
+}
+
+void InternTable_free(InternTable *table);
+
+#endif // INTERN_H_
@@ -0,0 +1,74 @@
+#ifndef JSON_WRITER_H_
+#define JSON_WRITER_H_
+
+#pragma once
+
+#include "utils.h"
+
+// Emits JSON text as it is produced instead of building a document first.
+// With a file, output goes through a fixed buffer, so memory stays constant
+// however large the dump. Without one, it collects into a growing string.
+// The layout is the one cJSON_Print() uses (tabs and newlines), or no
+// whitespace at all when compact.
+typedef struct JsonWriter {
+  FILE *file; // NULL when writing into `buffer` only
+  char *buffer;
+  size_t size;
+  size_t capacity;
+  uint32_t depth;
+  bool compact;
+  bool first;     // Nothing written yet in the innermost container
+  bool after_key; // The next value belongs to an object key
+  bool failed;
+} JsonWriter;
+
+JsonWriter json_writer_file(FILE *file, bool compact);
+
+JsonWriter json_writer_string(bool compact);
+
+// Writes out what is buffered. Returns false if any write failed.
+bool json_writer_flush(JsonWriter *json);
+
+// Flushes a file writer and releases it. Returns false if any write failed.
+bool json_writer_finish(JsonWriter *json);
+
+// Text of a string writer, NUL-terminated and released with free()
+char *json_writer_take(JsonWriter *json);
+
+void json_writer_free(JsonWriter *json);
+
+void json_begin_object(JsonWriter *json);
+
+void json_end_object(JsonWriter *json);
+
+void json_begin_array(JsonWriter *json);
+
+void json_end_array(JsonWriter *json);
+
+void json_key(JsonWriter *json, const char *key);
+
+void json_string(JsonWriter *json, const char *value);
+
+// String of `length` bytes, which may hold NULs
+void json_string_n(JsonWriter *json, const char *value, size_t length);
+
+void json_number(JsonWriter *json, double value);
+
+void json_bool(JsonWriter *json, bool value);
+
+void json_null(JsonWriter *json);
+
+// Key and value in one call. Like cJSON_AddStringToObject(), a NULL string
+// leaves the member out.
+void json_field_string(JsonWriter *json, const char *key, const char *value);
+
+void json_field_string_n(JsonWriter *json, const char *key, const char *value,
+                         size_t length);
+
+void json_field_number(JsonWriter *json, const char *key, double value);
+
+void json_field_bool(JsonWriter *json, const char *key, bool value);
+
+void json_field_null(JsonWriter *json, const char *key);
+
+#endif // JSON_WRITER_H_
@@ -2,15 +2,16 @@
 #define LEXER_H_
 #pragma once
 
+#include "json_writer.h"
+#include "lexer_scan.h"
 #include "token_arraylist.h"
+#include "token_stream.h"
 #include "utils.h"
-#include <cJSON.h>
 #include <ctype.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-typedef struct Token_ArrayList Token_ArrayList;
-
 typedef enum TokenType {
   IDENTIFIER = 0,
   STRING,
@@ -30,35 +31,216 @@ typedef enum TokenType {
   ENDMARKER
 } TokenType;
 
-typedef struct __attribute__((packed)) __attribute__((aligned(64))) Token {
-  TokenType type;
-  char *lexeme;
-  size_t line;
-  size_t col;
-  size_t ident;
-} Token;
+// Which keyword, operator or delimiter a token is, so later phases can switch
+// on it instead of comparing lexemes. Operators are named after the
+// characters they are spelled with.
+typedef enum TokenSubkind {
+  SUB_NONE = 0, // Identifiers, literals, newlines and the end marker
+
+  // Operators, in the order the lexer's recognizer reaches them
+  OP_PLUS,
+  OP_MINUS,
+  OP_STAR,
+  OP_STAR_STAR,
+  OP_SLASH,
+  OP_SLASH_SLASH,
+  OP_PERCENT,
+  OP_GT,
+  OP_LT,
+  OP_BANG,
+  OP_EQ,
+  OP_AMP,
+  OP_PIPE,
+  OP_CARET,
+  OP_TILDE,
+  OP_DOT,
+  OP_ARROW,
+  OP_PLUS_EQ,
+  OP_MINUS_EQ,
+  OP_STAR_EQ,
+  OP_STAR_STAR_EQ,
+  OP_SLASH_EQ,
+  OP_SLASH_SLASH_EQ,
+  OP_PERCENT_EQ,
+  OP_GT_GT,
+  OP_GT_EQ,
+  OP_LT_LT,
+  OP_LT_EQ,
+  OP_BANG_EQ,
+  OP_EQ_EQ,
+  OP_AMP_AMP,
+  OP_PIPE_PIPE,
+  OP_LAST = OP_PIPE_PIPE,
+
+  // Delimiters
+  OP_LPAR,
+  OP_RPAR,
+  OP_LSQB,
+  OP_RSQB,
+  OP_COMMA,
+  OP_COLON,
+
+  // Keywords
+  KW_FALSE,
+  KW_NONE,
+  KW_TRUE,
+  KW_AND,
+  KW_AS,
+  KW_ASSERT,
+  KW_ASYNC,
+  KW_AWAIT,
+  KW_BREAK,
+  KW_CLASS,
+  KW_CONTINUE,
+  KW_DEF,
+  KW_DEL,
+  KW_ELIF,
+  KW_ELSE,
+  KW_EXCEPT,
+  KW_FINALLY,
+  KW_FOR,
+  KW_FROM,
+  KW_GLOBAL,
+  KW_IF,
+  KW_IMPORT,
+  KW_IN,
+  KW_IS,
+  KW_LAMBDA,
+  KW_NONLOCAL,
+  KW_NOT,
+  KW_OR,
+  KW_PASS,
+  KW_RAISE,
+  KW_RETURN,
+  KW_TRY,
+  KW_WHILE,
+  KW_WITH,
+  KW_YIELD,
+  KW_MATCH,
+  KW_CASE,
+  SUBKIND_COUNT
+} TokenSubkind;
 
 typedef struct Lexer {
   const char *source;
   const char *filename;
   size_t position;
-  size_t token_idx;
+  TokenIndex token_idx;
+  TokenIndex token_end; // One past the ENDMARKER; synthetic tokens follow it
   size_t source_length;
-  Token_ArrayList tokens;
+  TokenStream tokens;
+  const ScanKernels *scan; // Bulk scanning kernels picked for this CPU
+  struct LexStream *stream; // Background lexer still producing tokens
 } Lexer;
 
 Lexer tokenize(const char *source, const char *filename);
 
-Token *create_token_from_str(Lexer *lexer, char *lexeme, TokenType type);
+// Same as tokenize(), but large sources are split into chunks lexed on up to
+// `jobs` threads (0 uses every online CPU). The resulting tokens are
+// identical to the serial lexer's.
+Lexer tokenize_parallel(const char *source, const char *filename, size_t jobs);
+
+// Same as tokenize(), but the tokens are produced on a background thread and
+// handed over in blocks through a bounded ring, so that parsing can start
+// right away. The returned lexer holds no tokens yet: lexer_stream_pull()
+// brings them in as they are needed. The parser does so by itself.
+Lexer tokenize_streaming(const char *source, const char *filename);
+
+// Takes lexed blocks until `token` exists or every token, the end marker
+// included, has been taken. Blocks while the lexer thread is behind.
+void lexer_stream_pull(Lexer *lexer, TokenIndex token);
+
+// Takes every remaining token and stops the lexer thread
+static inline void lexer_stream_finish(Lexer *lexer) {
+  lexer_stream_pull(lexer, UINT32_MAX);
+}
+
+// Replacement of `old_length` bytes at `start` by `new_length` new ones
+typedef struct SourceEdit {
+  size_t start;
+  size_t old_length;
+  size_t new_length;
+} SourceEdit;
+
+// Brings the tokens up to date with `source`, the previous source after
+// `edit`. Only the lines from the one the edit starts on are lexed again,
+// until the new tokens fall back in step with the old ones. Synthetic tokens
+// are dropped. Returns which tokens were replaced.
+TokenSplice retokenize(Lexer *lexer, const char *source, SourceEdit edit);
+
+// Appends a synthetic token whose text does not come from the source
+TokenIndex create_token_from_str(Lexer *lexer, const char *lexeme,
+                                 TokenType type);
+
+// Sets the source position reported for the token
+void token_locate(Lexer *lexer, TokenIndex token, size_t offset,
+                  size_t ident);
+
+// 1-based line and column of the token, looked up in the line table
+size_t token_line(const Lexer *lexer, TokenIndex token);
+
+size_t token_col(const Lexer *lexer, TokenIndex token);
+
+// Text of a 1-based source line, without its newline
+const char *source_line(const Lexer *lexer, size_t line, size_t *length);
+
+// Returns the NUL-terminated text of the token, copying it out of the source
+// the first time it is requested.
+const char *token_lexeme(Lexer *lexer, TokenIndex token);
+
+// Compares the token text against `text` without materializing the lexeme
+bool token_is(const Lexer *lexer, TokenIndex token, const char *text);
+
+static inline TokenType token_type(const Lexer *lexer, TokenIndex token) {
+  return (TokenType)lexer->tokens.kinds[token];
+}
+
+static inline TokenSubkind token_subkind(const Lexer *lexer,
+                                         TokenIndex token) {
+  return (TokenSubkind)lexer->tokens.subkinds[token];
+}
+
+// Decoded value of a NUMBER or STRING token, NULL for other tokens
+static inline const TokenValue *token_value(const Lexer *lexer,
+                                            TokenIndex token) {
+  uint32_t slot = lexer->tokens.literals[token];
+  return slot ? &lexer->tokens.values[slot] : NULL;
+}
+
+static inline size_t token_offset(const Lexer *lexer, TokenIndex token) {
+  return lexer->tokens.offsets[token];
+}
+
+// Text of the value of a STRING token, `value->length` bytes long and not
+// NUL-terminated when it is read in place from the source
+static inline const char *token_string(const Lexer *lexer, TokenIndex token) {
+  const TokenValue *value = token_value(lexer, token);
+  if (value == NULL || value->kind != VALUE_STR)
+    return NULL;
+  return value->str_val ? value->str_val
+                        : lexer->source + lexer->tokens.offsets[token];
+}
+
+static inline size_t token_ident(const Lexer *lexer, TokenIndex token) {
+  return lexer->tokens.idents[token];
+}
+
+// Interned id of an identifier or keyword, NAME_NONE for other tokens
+static inline NameId token_name(const Lexer *lexer, TokenIndex token) {
+  return lexer->tokens.names[token];
+}
+
+void serialize_token(JsonWriter *json, Lexer *lexer, TokenIndex token);
 
-cJSON *serialize_token(Token *token);
+void serialize_tokens(JsonWriter *json, Lexer *lexer);
 
-cJSON *serialize_tokens(Token_ArrayList *tokens);
+void serialize_lexer(JsonWriter *json, Lexer *lexer);
 
-cJSON *serialize_lexer(Lexer *lexer);
+TokenIndex peek_token(Lexer *lexer);
 
-Token *peek_token(Lexer *lexer);
+char *dump_tokens(Lexer *lexer);
 
-char *dump_tokens(Token_ArrayList *tokens);
+// Streams the tokens to `file`. Returns false if a write failed.
+bool dump_tokens_to(Lexer *lexer, FILE *file, bool compact);
 
 #endif // !LEXER_H_
@@ -0,0 +1,29 @@
+#ifndef LEXER_SCAN_H_
+#define LEXER_SCAN_H_
+
+#pragma once
+
+#include "utils.h"
+
+// Bulk scanning kernels used by the lexer hot loops. Every kernel looks at
+// `src[pos, end)` and returns the position where the scan stopped, or `end`
+// when it ran out of input. Vector kernels never read past `end`.
+typedef struct ScanKernels {
+  const char *name;
+  // Position of the next `target` byte
+  size_t (*find_byte)(const char *src, size_t pos, size_t end, char target);
+  // End of a run of identifier characters ([A-Za-z0-9_])
+  size_t (*ident_end)(const char *src, size_t pos, size_t end);
+  // End of a run of spaces and tabs. `width` receives its column width, with
+  // a tab counting as four columns.
+  size_t (*blank_end)(const char *src, size_t pos, size_t end, size_t *width);
+} ScanKernels;
+
+// Returns the fastest kernels supported by the running CPU
+const ScanKernels *scan_kernels(void);
+
+// Lists every kernel set usable on the running CPU, scalar first. Returns the
+// number of entries written to `out`.
+size_t scan_kernels_available(const ScanKernels **out, size_t capacity);
+
+#endif // LEXER_SCAN_H_
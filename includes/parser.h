@@ -4,7 +4,7 @@
 
 // TODO: Implement error handling in the parser (e.g., unexpected tokens)
 
-#include "ASTNode_linkedlist.h"
+#include "ast.h"
 #include "lexer.h"
 #include "utils.h"
 #include <stdbool.h>
@@ -52,88 +52,107 @@ typedef enum DataType {
   UNKNOWN
 } DataType;
 
-typedef struct __attribute__((aligned(16))) BinOp {
-  ASTNode *left;
-  ASTNode *right;
+typedef struct BinOp {
+  NodeIndex left;
+  NodeIndex right;
 } BinOp;
 
 typedef struct Assign {
-  ASTNode_LinkedList targets;
-  ASTNode *value;
+  NodeSpan targets;
+  NodeIndex value;
   char *type_comment;
-} __attribute__((aligned(128))) Assign;
+} Assign;
 
 typedef struct {
-  ASTNode *target;
-  Token *op;
-  ASTNode *value;
+  NodeIndex target;
+  TokenIndex op;
+  NodeIndex value;
 } AugAssign;
 
 typedef struct Attribute {
-  ASTNode *value; // The object (e.g., the 'snake' Name node)
-  char *attr;     // The name of the attribute (e.g., "bite")
+  NodeIndex value;  // The object (e.g., the 'snake' Name node)
+  const char *attr; // The name of the attribute (e.g., "bite")
 } Attribute;
 
 typedef struct Compare {
-  ASTNode *left;
-  Token_ArrayList ops;
-  ASTNode_LinkedList comparators;
+  NodeIndex left;
+  Token_ArrayList *ops;
+  NodeSpan comparators;
 } Compare;
 
 typedef struct Parser {
   Lexer lexer;
-  Token *current;
-  Token *next;
-  ASTNode_LinkedList ast;
+  TokenIndex current;
+  TokenIndex next;
+  AST ast;          // Owns every node and child list
+  NodeSpan program; // Top-level statements
+  // Every top-level statement in source order, before `program` splits them
+  // from the synthetic main, and the token each one starts at
+  NodeSpan statements;
+  TokenIndex *statement_starts;
+  // Operators and brackets waiting for an operand, see parse_expression()
+  struct ExprFrame *frames;
+  uint32_t frame_count;
+  uint32_t frame_capacity;
+  uint32_t nesting; // Recursive parsing routines currently running
 } Parser;
 
 typedef struct ControlFlowStatement {
-  ASTNode *test;
-  ASTNode_LinkedList body;
-  ASTNode_LinkedList orelse;
+  NodeIndex test;
+  NodeSpan body;
+  NodeSpan orelse;
 } ControlFlowStatement;
 
 typedef struct {
-  ASTNode *name;
-  ASTNode_LinkedList params;
-  ASTNode_LinkedList body;
-  ASTNode *returns;
+  NodeIndex name;
+  NodeSpan params;
+  NodeSpan body;
+  NodeIndex returns;
 } FunctionDef;
 
 typedef struct {
-  ASTNode *func;
-  ASTNode_LinkedList args;
+  NodeIndex func;
+  NodeSpan args;
 } CallExpr;
 
 typedef struct {
-  ASTNode *key;  // dict comp only, NULL otherwise
-  ASTNode *expr; // The expression being evaluated (e.g., 'i'). Value if it's a
-                 // dictionary comprehension
-  ASTNode *target; // The target variable(s) (e.g., 'i' in the for-clause)
-  ASTNode *iter;   // The iterable (e.g., 'x')
-  ASTNode_LinkedList ifs; // (Optional) Guards, e.g., 'if i > 2'
+  NodeIndex key;  // dict comp only, NODE_NONE otherwise
+  NodeIndex expr; // The expression being evaluated (e.g., 'i'). Value if it's
+                  // a dictionary comprehension
+  NodeIndex target; // The target variable(s) (e.g., 'i' in the for-clause)
+  NodeIndex iter;   // The iterable (e.g., 'x')
+  NodeSpan ifs;     // (Optional) Guards, e.g., 'if i > 2'
 } Comprehension;
 
 typedef struct {
-  ASTNode *value; // the object being subscripted, e.g. `item`
-  ASTNode *slice; // the key/index expression, e.g. `'amount'`
+  NodeIndex value; // the object being subscripted, e.g. `item`
+  NodeIndex slice; // the key/index expression, e.g. `'amount'`
 } Subscript;
 
+// Common header followed by the payload of the node kind. Nodes are allocated
+// with node_size(type) bytes, so only the union member matching `type` may be
+// used.
 typedef struct ASTNode {
   NodeType type;
-  size_t depth;
-  Token *token;
-  ASTNode *parent;
   Context ctx; // I'm out of ideas for this will sufice
+  // Filled by semantic analysis. UNKNOWN means not inferred yet.
+  DataType dtype;
+  TokenIndex token;
+  uint32_t depth;
+  NodeIndex parent;
+  // Binding left by semantic analysis: the symbol a name, call or attribute
+  // resolved to, whose scope depth and index locate it. Later passes read it
+  // instead of looking names up again.
+  struct Symbol *symbol;
   union {
     BinOp bin_op;
     Assign assign;
     AugAssign aug_assign;
     FunctionDef def;
     CallExpr call;
-    ASTNode *child; // Types that use this: RETURN
+    NodeIndex child; // Types that use this: RETURN
     Compare compare;
-    ASTNode_LinkedList collection;
+    NodeSpan collection;
     ControlFlowStatement ctrl_stmt;
     Attribute attribute;
     Subscript subscript;
@@ -143,31 +162,69 @@ typedef struct ASTNode {
 
 Parser parse(Lexer *lexer);
 
-ASTNode *node_new(Parser *parser, Token *token, NodeType type);
+// Same as parse(), but large inputs are split at top-level definitions into
+// chunks parsed on up to `jobs` threads (0 uses every online CPU). The
+// resulting tree is the same as the serial parser's.
+Parser parse_parallel(Lexer *lexer, size_t jobs);
+
+// Updates the tree after `edit` turned the parsed source into `source`. Only
+// the top-level statements whose tokens changed are parsed again, the others
+// are kept with their token indices moved. Trees already handed to semantic
+// analysis or codegen, which rewrite some nodes, cannot be updated. The nodes
+// may move, so node pointers taken before are stale afterwards.
+void reparse(Parser *parser, const char *source, SourceEdit edit);
+
+ASTNode *node_new(Parser *parser, TokenIndex token, NodeType type);
+
+// Bytes allocated for a node of the given kind
+size_t node_size(NodeType type);
+
+// Words of the node pool taken by a node of the given kind
+uint32_t node_words(NodeType type);
+
+// Node links and child spans a node holds, its parent included
+typedef struct NodeLinks {
+  NodeIndex *nodes[5];
+  uint32_t node_count;
+  NodeSpan *spans[2];
+  uint32_t span_count;
+} NodeLinks;
+
+NodeLinks node_links(ASTNode *node);
 
 void parser_free(Parser *parser);
 
-Token *advance(Parser *parser);
+TokenIndex advance(Parser *parser);
 
-Token *consume(Parser *parser, TokenType expected_type);
+TokenIndex consume(Parser *parser, TokenType expected_type);
 
-int8_t get_infix_precedence(const char *op);
+int8_t get_infix_precedence(TokenSubkind op);
 
-int8_t get_prefix_precedence(const char *op);
+int8_t get_prefix_precedence(TokenSubkind op);
 
-cJSON *serialize_program(ASTNode_LinkedList *program);
+void serialize_program(JsonWriter *json, Parser *parser, NodeSpan program);
 
-cJSON *serialize_node(ASTNode *node);
+void serialize_node(JsonWriter *json, Parser *parser, ASTNode *node);
 
-char *dump_program(ASTNode_LinkedList *program);
+char *dump_program(Parser *parser, NodeSpan program);
 
-char *dump_node(ASTNode *node);
+// Streams the tree to `file`. Returns false if a write failed.
+bool dump_program_to(Parser *parser, NodeSpan program, FILE *file,
+                     bool compact);
+
+char *dump_node(Parser *parser, ASTNode *node);
 
 const char *node_type_to_string(NodeType type);
 
-static inline bool is_boolean_operator(Token *t) {
-  return strcmp(t->lexeme, "and") == 0 || strcmp(t->lexeme, "or") == 0 ||
-         strcmp(t->lexeme, "not") == 0;
+static inline bool is_boolean_operator(const Lexer *lexer, TokenIndex t) {
+  switch (token_subkind(lexer, t)) {
+  case KW_AND:
+  case KW_OR:
+  case KW_NOT:
+    return true;
+  default:
+    return false;
+  }
 }
 
 static inline bool is_executable(NodeType type) {
@@ -1,5 +1,5 @@
 typedef struct PatternBindings {
-  const char **names;
+  NameId *names;
   size_t count;
   size_t capacity;
   Allocator *allocator;
@@ -8,23 +8,23 @@ typedef struct PatternBindings {
 static void pb_init(PatternBindings *pb, Allocator *allocator) {
   pb->count = 0;
   pb->capacity = 4;
-  pb->names = allocator_alloc(allocator, pb->capacity * sizeof(char *));
+  pb->names = allocator_alloc(allocator, pb->capacity * sizeof(NameId));
   pb->allocator = allocator;
 }
 
-static bool pb_contains(PatternBindings *pb, const char *name) {
+static bool pb_contains(PatternBindings *pb, NameId name) {
   for (size_t i = 0; i < pb->count; i++) {
-    if (strcmp(pb->names[i], name) == 0)
+    if (pb->names[i] == name)
       return true;
   }
   return false;
 }
 
-static void pb_add(PatternBindings *pb, const char *name) {
+static void pb_add(PatternBindings *pb, NameId name) {
   if (pb->count == pb->capacity) {
     pb->capacity *= 2;
     pb->names = allocator_realloc(pb->allocator, pb->names, pb->count,
-                                  pb->capacity * sizeof(char *));
+                                  pb->capacity * sizeof(NameId));
   }
   pb->names[pb->count++] = name;
 }
\ No newline at end of file
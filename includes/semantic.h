@@ -28,37 +28,83 @@ typedef struct SemanticError {
   SemanticErrorType type;
   char *detail;  // new: dynamic message body ("name 'x' is not defined")
   char *message; // final formatted traceback (Python-like)
-  Token *token;  // where the error occurred
+  TokenIndex token;  // where the error occurred
 } SemanticError;
 
+#define SA_MAX_DIAGNOSTIC_ARGS 4
+
+// Argument of a diagnostic, a %s or a %zu of its format
+typedef union DiagnosticArg {
+  const char *text;
+  size_t number;
+} DiagnosticArg;
+
+// An error as analysis records it. Text arguments are lexemes, symbol names
+// or type names, which live as long as the parser, so nothing is formatted
+// until the error is read.
+typedef struct Diagnostic {
+  SemanticErrorType type;
+  TokenIndex token;
+  const char *format;
+  struct Symbol *function; // Frame of the traceback, NULL for <module>
+  DiagnosticArg args[SA_MAX_DIAGNOSTIC_ARGS];
+  uint8_t arg_count;
+} Diagnostic;
+
+typedef struct DiagnosticList {
+  Diagnostic *items;
+  size_t count;
+  size_t capacity;
+} DiagnosticList;
+
 /* -----------------------------
  *  SYMBOL TABLE
  * ----------------------------- */
 
 typedef struct Symbol {
-  size_t id; // unique identifier
-  char *name;
+  size_t id;                 // unique identifier
+  NameId name_id;            // interned name, symbols are looked up by it
+  const char *name;          // text of name_id, shared with the lexer
   SymbolType kind;           // VAR, FUNCTION, MODULE, CLASS, BLOCK
   DataType dtype;            // INT, STR, BOOL, LIST, etc.
   ASTNode *decl_node;        // node where it was declared
   size_t scope_level;        // lexical depth / nesting
+  uint32_t index;            // position among the symbols of its scope
   struct SymbolTable *scope; // for FUNCTION, CLASS,
   struct Symbol *base_class;
+  struct ClassLayout *layout; // CLASS: fields and methods, inherited included
+  bool failed; // Defined by a statement with errors, uses of it report none
 } Symbol;
 
 typedef enum { ATTR_OWN_CURRENT, ATTR_OWN_BASE } AttrOwnership;
 
 typedef struct SymbolTableEntry {
   Symbol *symbol;
-  struct SymbolTableEntry *next;
+  uint32_t hash;                     // cached hash of symbol->name_id
+  struct SymbolTableEntry *next;     // previously defined entry of the scope
+  struct SymbolTableEntry *shadowed; // older entry with the same name
 } SymbolTableEntry;
 
+// Entries are kept in a list, most recent first, for ordered walks and an
+// open addressing index keyed by name for lookups. The index lives in the
+// analyzer arena; growing it abandons the previous array.
 typedef struct SymbolTable {
   SymbolTableEntry *entries;
+  SymbolTableEntry **slots;   // NULL marks an empty slot
+  uint32_t slot_count;        // power of two, 0 until the first definition
+  uint32_t count;             // distinct names in the index
+  uint32_t size;              // symbols defined, shadowed ones included
   struct SymbolTable *parent; // NULL for global scope
   size_t depth;
+  struct ClassLayout *layout; // Scope of a class: its members also go there
 } SymbolTable;
 
+// Multiplying by an odd constant is a bijection, so equal hashes mean equal
+// names and dense ids spread evenly over the low bits
+static inline uint32_t symbol_name_hash(NameId name) {
+  return name * 0x9E3779B1u;
+}
+
 /* -----------------------------
  *  SEMANTIC ANALYZER
  * ----------------------------- */
@@ -66,9 +112,15 @@ typedef struct SymbolTable {
 typedef struct SemanticAnalyzer {
   size_t next_symbol_id;
   SymbolTable *current_scope;
-  SemanticError last_error;
+  DiagnosticList diagnostics; // In program order
+  size_t statement_start; // First error of the statement being analyzed
+  bool read_failed;       // The statement used a failed symbol
   Parser parser;
   Symbol *current_class;
+  Symbol *current_function; // Top-level function whose body is analyzed
+  // Set while function bodies are checked, possibly on several threads at
+  // once: symbols of the global scope are then only read
+  bool globals_frozen;
 } SemanticAnalyzer;
 
 /* -----------------------------
@@ -96,40 +148,64 @@ bool is_self_reference(SemanticAnalyzer *sa, ASTNode *node);
  * ----------------------------- */
 
 void sa_define_symbol(SemanticAnalyzer *sa, Symbol *sym);
-Symbol *sa_lookup(SemanticAnalyzer *sa, const char *name);
-Symbol *sa_lookup_member(Symbol *class_sym, const char *name);
+// Returns the interned id of `name`, NAME_NONE if the source never uses it
+NameId sa_name(SemanticAnalyzer *sa, const char *name);
+Symbol *sa_lookup(SemanticAnalyzer *sa, NameId name);
+// Looks in the current scope only
+Symbol *sa_lookup_local(SemanticAnalyzer *sa, NameId name);
+Symbol *sa_lookup_member(Symbol *class_sym, NameId name);
 Symbol *resolve_symbol(SemanticAnalyzer *sa, ASTNode *node);
-Symbol *find_enclosing_class(SemanticAnalyzer *sa);
 
 /* Main entrypoint */
 SemanticAnalyzer analyze_program(Parser *parser);
 
+// Analyzes in two phases. A declaration pass goes through the top-level
+// statements in order and registers every function, class and global. The
+// bodies of functions with fully annotated signatures are left out and
+// checked afterwards, on up to `jobs` threads (0: all CPUs), so they see
+// every top-level name, including later ones. Errors are reported as if the
+// program had been analyzed in source order.
+SemanticAnalyzer analyze_program_parallel(Parser *parser, size_t jobs);
+
 /* Analyze a single AST node */
 bool analyze_node(SemanticAnalyzer *sa, ASTNode *node);
 
 // Error helpers
 /**
- * @brief Records a semantic error and generates a formatted error message.
- * * This function captures the error type, the specific token where the error
- * occurred, and a custom formatted message. The resulting error is stored in
- * the `SemanticAnalyzer`'s `last_error` field.
+ * @brief Records a semantic error of the statement being analyzed.
+ * * The error type, the token where the error occurred and the arguments of
+ * the format are stored as they are, the message is only formatted when the
+ * error is read. A statement reports one error: a later one replaces the
+ * earlier one, analysis goes on with the next statement.
  *
  * @param sa    Pointer to the SemanticAnalyzer instance.
  * @param type  The category of semantic error (e.g., UNDEFINED_VARIABLE).
  * @param tok   The token associated with the error location.
- * @param fmt   A printf-style format string for the error detail.
+ * @param fmt   A format string for the error detail, with %s and %zu only.
+ *              It must outlive the analyzer, usually a literal.
  * @param ...   Additional arguments for the format string.
- * * @note This function uses an internal arena allocator for the error strings.
  */
-void sa_set_error(SemanticAnalyzer *sa, SemanticErrorType type, Token *tok,
+void sa_set_error(SemanticAnalyzer *sa, SemanticErrorType type, TokenIndex tok,
                   const char *fmt, ...);
 
 bool sa_has_error(SemanticAnalyzer *sa);
 
+size_t sa_error_count(SemanticAnalyzer *sa);
+
+// Formats the error at `index`, in program order, into the analyzer arena
+SemanticError sa_error_at(SemanticAnalyzer *sa, size_t index);
+
+// First error of the program
 SemanticError sa_get_error(SemanticAnalyzer *sa);
 
+// Infers the type of a node once and caches it on the node. Results are only
+// cached when known, so failed inferences are retried.
 DataType sa_infer_type(SemanticAnalyzer *sa, ASTNode *node);
 
+// Drops the cached type of a node and of every enclosing node. Passes that
+// rewrite a subtree must call it on the rewritten node.
+void sa_invalidate_type(SemanticAnalyzer *sa, ASTNode *node);
+
 static inline bool is_primitive(DataType type) {
   return type == INT || type == FLOAT || type == STR || type == BOOL;
 }
@@ -142,4 +218,7 @@ const char *datatype_to_string(DataType t);
 
 char *dump_symbol_table(SymbolTable *st);
 
+// Streams the table to `file`. Returns false if a write failed.
+bool dump_symbol_table_to(SymbolTable *st, FILE *file, bool compact);
+
 #endif // SEMANTIC_H_
@@ -0,0 +1,23 @@
+#ifndef SOURCE_FILE_H_
+#define SOURCE_FILE_H_
+
+#pragma once
+
+#include "utils.h"
+
+// Read-only, NUL-terminated view of an input file. Regular files are mapped
+// into memory; pipes, terminals and stdin ("-") are read into a heap buffer.
+// The text must outlive every Lexer built on top of it.
+typedef struct SourceFile {
+  const char *path;
+  const char *text;
+  size_t length;
+  size_t map_size; // Bytes mapped, 0 when the text lives in a heap buffer
+} SourceFile;
+
+bool source_file_open(SourceFile *file, const char *path);
+
+// Unmaps or frees the text
+void source_file_close(SourceFile *file);
+
+#endif // SOURCE_FILE_H_
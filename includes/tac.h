@@ -18,6 +18,7 @@ typedef union ConstantValue {
 
 typedef struct ConstantEntry {
   ConstantValue value;
+  size_t length; // Bytes of a STR value, which may hold NULs
   DataType type;
   size_t id; // Unique identifier for this constant
 } ConstantEntry;
@@ -90,8 +91,13 @@ void tac_free(TACProgram *program);
 
 StringBuilder tac_generate_code(TACProgram *program);
 
+void serialize_tac_program(JsonWriter *json, TACProgram *program);
+
 char *tac_dump_program(TACProgram *program);
 
+// Streams the program to `file`. Returns false if a write failed.
+bool tac_dump_program_to(TACProgram *program, FILE *file, bool compact);
+
 const char *op_to_str(TACOp op);
 
 #endif // TAC_H
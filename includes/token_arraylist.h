@@ -4,32 +4,34 @@
 #pragma once
 
 #include "arena.h"
+#include "token_stream.h"
 #include "utils.h"
 
-typedef struct Token Token;
-
+// Growable list of token indices
 typedef struct Token_ArrayList {
-  Token **elements;
+  TokenIndex *elements;
   size_t size;
   size_t capacity;
   Allocator allocator;
-} __attribute__((aligned(64))) Token_ArrayList;
+} Token_ArrayList;
 
 Token_ArrayList Token_new(size_t capacity);
 
 Token_ArrayList Token_new_with_allocator(Allocator *allocator, size_t capacity);
 
 // Pushes an element to the end of the array list
-void Token_push(Token_ArrayList *list, Token *value);
+void Token_push(Token_ArrayList *list, TokenIndex value);
 
 // Get the last element and remove it
-Token *Token_pop(Token_ArrayList *list);
+TokenIndex Token_pop(Token_ArrayList *list);
 
-size_t Token_index_of(Token_ArrayList const *list, Token const *value);
+size_t Token_index_of(Token_ArrayList const *list, TokenIndex value);
 
-// Get the element stored at the index. Returns NULL if index is out-of-bounds
-static inline Token *Token_get(Token_ArrayList const *arrayList, size_t index) {
-  return index < arrayList->size ? arrayList->elements[index] : NULL;
+// Get the element stored at the index. Returns TOKEN_NONE if index is
+// out-of-bounds
+static inline TokenIndex Token_get(Token_ArrayList const *arrayList,
+                                   size_t index) {
+  return index < arrayList->size ? arrayList->elements[index] : TOKEN_NONE;
 }
 
 // Free linked list resources
@@ -0,0 +1,129 @@
+#ifndef TOKEN_STREAM_H_
+#define TOKEN_STREAM_H_
+
+#pragma once
+
+#include "arena.h"
+#include "intern.h"
+#include "utils.h"
+#include <stdint.h>
+
+// Tokens are addressed by their position in the stream. Index 0 is reserved
+// so that a zero index can be used as "no token".
+typedef uint32_t TokenIndex;
+
+#define TOKEN_NONE ((TokenIndex)0)
+
+// Offset of synthetic tokens that were not placed in the source
+#define OFFSET_NONE UINT32_MAX
+
+typedef enum TokenValueKind {
+  VALUE_NONE = 0,
+  VALUE_INT,
+  VALUE_FLOAT,
+  VALUE_STR,
+} TokenValueKind;
+
+// Literal decoded once by the lexer so later phases never reparse its text
+typedef struct TokenValue {
+  union {
+    int64_t int_val;
+    double float_val;
+    // Escape sequences resolved, NUL-terminated. NULL for a literal without
+    // escapes: its text is then its own lexeme, read in place from the
+    // source with token_string().
+    const char *str_val;
+  };
+  uint32_t length; // Bytes of the string, which may itself hold NULs
+  uint8_t kind;    // TokenValueKind
+  bool overflow;   // The integer does not fit in int64_t, int_val is clamped
+} TokenValue;
+
+// Struct-of-arrays token store. The parser walks `kinds`, `subkinds`,
+// `offsets` and `lengths` sequentially. Tokens only record their byte offset:
+// lines and columns are looked up in `line_starts` when a diagnostic or a
+// dump asks for them.
+typedef struct TokenStream {
+  uint8_t *kinds;       // TokenType of each token
+  uint8_t *subkinds;    // TokenSubkind of keywords, operators and delimiters
+  uint32_t *offsets;    // Byte offset of the lexeme in the source
+  uint32_t *lengths;    // Length in bytes of the lexeme
+  uint32_t *idents;     // Indentation level of the line holding the token
+  NameId *names;        // Interned text of identifiers and keywords
+  uint32_t *literals;   // Slot in `values` of NUMBER and STRING tokens
+  const char **lexemes; // NUL-terminated text, copied on first request
+  uint32_t size;
+  uint32_t capacity;
+  uint32_t *line_starts; // Byte offset of each line, line_starts[0] is 0
+  uint32_t line_count;
+  uint32_t line_capacity;
+  TokenValue *values; // Decoded literals, slot 0 is unused
+  uint32_t values_size;
+  uint32_t values_capacity;
+  uint32_t values_free; // Slot released by a splice, chained through int_val
+  InternTable interned; // Distinct names seen by the lexer
+  Allocator allocator;
+  // Decoded strings and lexeme copies. A splice drops the text of the tokens
+  // it removes, which is reclaimed by moving what is left to a fresh arena
+  // once it outweighs it.
+  Allocator strings;
+  size_t strings_live; // Bytes still used by tokens
+  size_t strings_dead; // Bytes of removed tokens
+} TokenStream;
+
+// Tokens and lines of a stream replaced after an edit of its source
+typedef struct TokenSplice {
+  TokenIndex first;   // First replaced token
+  uint32_t removed;   // Tokens dropped from `first` on
+  uint32_t inserted;  // Tokens put in their place
+  uint32_t line_from; // Lines starting in (line_from, line_to] are replaced
+  uint32_t line_to;
+  int64_t delta; // Bytes the text after the edit moved by
+} TokenSplice;
+
+TokenStream TokenStream_new(uint32_t capacity);
+
+// Appends a token and returns its index
+TokenIndex TokenStream_push(TokenStream *stream, uint8_t kind,
+                            uint8_t subkind, uint32_t offset, uint32_t length);
+
+// Appends every token of `other`, which must have been lexed from the source
+// right after `stream`'s. Its lines follow ours, names are re-interned into
+// `stream` and decoded literals are copied; cached lexemes are not carried
+// over.
+bool TokenStream_append(TokenStream *stream, const TokenStream *other);
+
+// Replaces the tokens and lines described by `splice` with the
+// `splice->inserted` tokens of `other` from `from` on and every line of
+// `other` but the first. `other` was lexed from the edited source. Tokens and
+// lines after them move by `splice->delta` bytes. The literal slots and the
+// text of the removed tokens are reused, so strings and lexemes read before
+// the splice may no longer be valid.
+bool TokenStream_splice(TokenStream *stream, const TokenSplice *splice,
+                        const TokenStream *other, TokenIndex from);
+
+// Drops the tokens from `size` on, releasing their literals and text
+void TokenStream_truncate(TokenStream *stream, uint32_t size);
+
+// Records that a new line starts at `offset`
+bool TokenStream_add_line(TokenStream *stream, uint32_t offset);
+
+// 1-based number of the line holding `offset`
+uint32_t TokenStream_line_of(const TokenStream *stream, uint32_t offset);
+
+// Attaches a decoded literal to the token. Strings are copied into the
+// stream.
+bool TokenStream_set_value(TokenStream *stream, TokenIndex token,
+                           TokenValue value);
+
+// Returns the lexeme cache slot of the token, allocating the cache if needed
+const char **TokenStream_lexeme_slot(TokenStream *stream, TokenIndex token);
+
+// Caches a NUL-terminated copy of `text` as the lexeme of the token
+const char *TokenStream_set_lexeme(TokenStream *stream, TokenIndex token,
+                                   const char *text, size_t length);
+
+// Free token stream resources
+void TokenStream_free(TokenStream *stream);
+
+#endif // TOKEN_STREAM_H_
@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include "ast.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define AST_MIN_WORDS 8192
+#define AST_MIN_CHILDREN 64
+
+static bool AST_grow(AST *ast, NodeIndex **array, uint32_t *capacity,
+                     uint32_t needed) {
+  if (needed <= *capacity)
+    return true;
+
+  uint32_t cap = *capacity ? *capacity : AST_MIN_CHILDREN;
+  while (cap < needed)
+    cap *= 2;
+
+  NodeIndex *grown =
+      allocator_realloc(&ast->allocator, *array, *capacity * sizeof(NodeIndex),
+                        cap * sizeof(NodeIndex));
+  if (grown == NULL) {
+    slog_error("Failed to resize AST child list");
+    return false;
+  }
+
+  *array = grown;
+  *capacity = cap;
+  return true;
+}
+
+// Rounds a reservation up to whole pages without letting indices overflow
+static uint32_t AST_round_words(uint64_t words) {
+  long page_bytes = sysconf(_SC_PAGESIZE);
+  uint64_t page =
+      page_bytes > AST_NODE_ALIGN ? (uint64_t)page_bytes / AST_NODE_ALIGN : 1;
+  uint64_t limit = UINT32_MAX / page * page;
+  if (words < AST_MIN_WORDS)
+    words = AST_MIN_WORDS;
+  words = (words + page - 1) / page * page;
+  return (uint32_t)(words < limit ? words : limit);
+}
+
+static uint64_t *AST_map(uint32_t words) {
+  void *nodes = mmap(NULL, (size_t)words * AST_NODE_ALIGN,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return nodes != MAP_FAILED ? nodes : NULL;
+}
+
+AST AST_new(size_t words) {
+  AST ast = {0};
+  allocator_init(&ast.allocator, "AST");
+
+  // Reserve address space only; pages are backed as nodes get used
+  ast.capacity = AST_round_words(words);
+  ast.nodes = AST_map(ast.capacity);
+  if (ast.nodes == NULL) {
+    slog_error("Could not reserve memory for AST nodes");
+    ast.capacity = 0;
+    return ast;
+  }
+
+  ast.size = 1; // NODE_NONE
+  return ast;
+}
+
+bool AST_reserve(AST *ast, size_t words) {
+  if (words <= ast->capacity - ast->size)
+    return true;
+  if (ast->nodes == NULL)
+    return false;
+
+  uint64_t needed = (uint64_t)ast->size + words;
+  uint64_t doubled = (uint64_t)ast->capacity * 2;
+  uint32_t cap = AST_round_words(needed > doubled ? needed : doubled);
+  if (cap < needed) {
+    slog_error("AST exceeds %zu bytes", (size_t)cap * AST_NODE_ALIGN);
+    return false;
+  }
+
+  size_t old_bytes = (size_t)ast->capacity * AST_NODE_ALIGN;
+  size_t new_bytes = (size_t)cap * AST_NODE_ALIGN;
+  void *moved = mremap(ast->nodes, old_bytes, new_bytes, MREMAP_MAYMOVE);
+  if (moved == MAP_FAILED) {
+    // Nodes mapped from a snapshot file span several mappings, which mremap
+    // cannot move as one
+    moved = AST_map(cap);
+    if (moved == NULL) {
+      slog_error("Could not grow AST to %zu bytes", new_bytes);
+      return false;
+    }
+    memcpy(moved, ast->nodes, (size_t)ast->size * AST_NODE_ALIGN);
+    munmap(ast->nodes, old_bytes);
+  }
+
+  ast->nodes = moved;
+  ast->capacity = cap;
+  return true;
+}
+
+ASTNode *AST_alloc(AST *ast, size_t size) {
+  uint32_t words = (uint32_t)((size + AST_NODE_ALIGN - 1) / AST_NODE_ALIGN);
+  if (words > ast->capacity - ast->size) {
+    slog_error("AST exceeds %zu bytes",
+               (size_t)ast->capacity * AST_NODE_ALIGN);
+    return NULL;
+  }
+
+  // Fresh anonymous pages are already zeroed
+  ASTNode *node = AST_node(ast, ast->size);
+  ast->size += words;
+  return node;
+}
+
+void AST_list_push(AST *ast, const ASTNode *node) {
+  if (!AST_grow(ast, &ast->scratch, &ast->scratch_capacity,
+                ast->scratch_size + 1))
+    return;
+
+  ast->scratch[ast->scratch_size++] = AST_index(ast, node);
+}
+
+NodeSpan AST_list_end(AST *ast, uint32_t mark) {
+  uint32_t count = ast->scratch_size - mark;
+  NodeSpan span = {.start = ast->children_size, .count = 0};
+  ast->scratch_size = mark;
+
+  if (count == 0 || !AST_grow(ast, &ast->children, &ast->children_capacity,
+                              ast->children_size + count))
+    return span;
+
+  memcpy(&ast->children[span.start], &ast->scratch[mark],
+         count * sizeof(NodeIndex));
+  ast->children_size += count;
+  span.count = count;
+  return span;
+}
+
+void AST_append(AST *ast, NodeSpan *span, const ASTNode *node) {
+  bool at_end = span->start + span->count == ast->children_size;
+  uint32_t moved = at_end ? 0 : span->count;
+  if (!AST_grow(ast, &ast->children, &ast->children_capacity,
+                ast->children_size + moved + 1))
+    return;
+
+  if (!at_end) {
+    memcpy(&ast->children[ast->children_size], &ast->children[span->start],
+           moved * sizeof(NodeIndex));
+    span->start = ast->children_size;
+    ast->children_size += moved;
+  }
+
+  ast->children[ast->children_size++] = AST_index(ast, node);
+  span->count++;
+}
+
+bool AST_adopt(AST *ast, AST *other, NodeIndex *shift, uint32_t *children) {
+  uint32_t words = other->size - 1;
+  if (!AST_reserve(ast, words) ||
+      !AST_grow(ast, &ast->children, &ast->children_capacity,
+                ast->children_size + other->children_size))
+    return false;
+
+  *shift = ast->size - 1;
+  *children = ast->children_size;
+  memcpy(ast->nodes + ast->size, other->nodes + 1,
+         (size_t)words * AST_NODE_ALIGN);
+  ast->size += words;
+
+  for (uint32_t i = 0; i < other->children_size; i++) {
+    ast->children[ast->children_size++] = other->children[i] + *shift;
+  }
+
+  allocator_adopt(&ast->allocator, &other->allocator);
+  return true;
+}
+
+void AST_free(AST *ast) {
+  if (ast->nodes != NULL)
+    munmap(ast->nodes, (size_t)ast->capacity * AST_NODE_ALIGN);
+  allocator_free(&ast->allocator);
+  *ast = (AST){0};
+}
@@ -0,0 +1,610 @@
+#define _DEFAULT_SOURCE
+#include "ast_snapshot.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_VERSION 2
+
+// The node section starts and ends on a page boundary so that it can be
+// mapped straight into the node pool
+#define SNAPSHOT_PAGE 4096
+
+static const char snapshot_magic[8] = {'C', 'E', 'E', 'A',
+                                       'S', 'T', '\r', '\n'};
+
+_Static_assert(sizeof(void *) == sizeof(uint64_t),
+               "snapshots keep indices in pointer fields");
+
+typedef enum SnapshotSectionId {
+  SECTION_SOURCE,    // Source text, NUL-terminated
+  SECTION_STRINGS,   // NUL-terminated strings, offset 0 being ""
+  SECTION_KINDS,     // Token columns, see TokenStream
+  SECTION_SUBKINDS,
+  SECTION_OFFSETS,
+  SECTION_LENGTHS,
+  SECTION_IDENTS,
+  SECTION_NAMES,
+  SECTION_LITERALS,
+  SECTION_LINES,     // Line starts
+  SECTION_VALUES,    // TokenValue, str_val as a string offset
+  SECTION_NAME_TEXT, // String offset of each interned name
+  SECTION_HASHES,    // InternTable hashes and slots
+  SECTION_SLOTS,
+  SECTION_CHILDREN,  // AST.children
+  SECTION_STARTS,    // First token of each top-level statement
+  SECTION_OPS,       // Comparison operators: a count, then the tokens
+  SECTION_NODES,     // Node pool, node pointers as node indices
+  SECTION_COUNT
+} SnapshotSectionId;
+
+typedef struct SnapshotSection {
+  uint64_t offset; // From the start of the file, 8 byte aligned
+  uint64_t size;   // In bytes
+} SnapshotSection;
+
+typedef struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  // Layout of the nodes, which must match this build's
+  uint32_t node_header;
+  uint32_t node_bytes;
+  uint32_t token_count;
+  uint32_t token_idx;
+  uint32_t token_end;
+  uint32_t line_count;
+  uint32_t value_count;
+  uint32_t name_count;
+  uint32_t slot_count;
+  uint32_t node_words;
+  uint32_t child_count;
+  NodeSpan program;
+  NodeSpan statements;
+  uint64_t filename; // String offset
+  SnapshotSection sections[SECTION_COUNT];
+} SnapshotHeader;
+
+typedef struct SnapshotWriter {
+  FILE *file;
+  uint64_t offset;
+  bool ok;
+  SnapshotHeader header;
+} SnapshotWriter;
+
+static void snapshot_pad(SnapshotWriter *writer, uint64_t align) {
+  static const char zeros[SNAPSHOT_PAGE];
+  size_t padding = (size_t)((align - writer->offset % align) % align);
+  if (padding > 0 && fwrite(zeros, 1, padding, writer->file) != padding)
+    writer->ok = false;
+  writer->offset += padding;
+}
+
+static void snapshot_write(SnapshotWriter *writer, SnapshotSectionId id,
+                           const void *data, size_t size) {
+  snapshot_pad(writer, 8);
+  writer->header.sections[id] =
+      (SnapshotSection){.offset = writer->offset, .size = size};
+  if (size > 0 && fwrite(data, 1, size, writer->file) != size)
+    writer->ok = false;
+  writer->offset += size;
+}
+
+typedef struct SnapshotStrings {
+  char *data;
+  uint64_t size;
+} SnapshotStrings;
+
+static uint64_t snapshot_string(SnapshotStrings *strings, const char *text,
+                                size_t length) {
+  uint64_t offset = strings->size;
+  memcpy(strings->data + offset, text, length);
+  strings->data[offset + length] = '\0';
+  strings->size += length + 1;
+  return offset;
+}
+
+// Replaces the pointers of a copied node by what the file keeps instead. Links
+// to other nodes are indices and are kept as they are.
+static void snapshot_unlink_node(ASTNode *node, uint32_t *ops,
+                                 uint32_t *ops_size) {
+  node->symbol = NULL;
+
+  switch (node->type) {
+  case ASSIGNMENT:
+    node->assign.type_comment = NULL;
+    break;
+  case ATTRIBUTE:
+    // The name is the lexeme of the node's token
+    node->attribute.attr = NULL;
+    break;
+  case COMPARE: {
+    const Token_ArrayList *list = node->compare.ops;
+    if (list == NULL)
+      break;
+
+    node->compare.ops = (Token_ArrayList *)(uintptr_t)(*ops_size + 1);
+    ops[(*ops_size)++] = (uint32_t)list->size;
+    for (size_t i = 0; i < list->size; i++) {
+      ops[(*ops_size)++] = list->elements[i];
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+bool ast_snapshot_save(Parser *parser, const char *path) {
+  const Lexer *lexer = &parser->lexer;
+  const TokenStream *tokens = &lexer->tokens;
+  const InternTable *interned = &tokens->interned;
+  const AST *ast = &parser->ast;
+
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    slog_error("[%s] Failed to open AST snapshot", path);
+    return false;
+  }
+
+  Allocator allocator = {0};
+  allocator_init(&allocator, "ast_snapshot");
+  SnapshotWriter writer = {.file = file, .ok = true};
+  SnapshotHeader *header = &writer.header;
+  memcpy(header->magic, snapshot_magic, sizeof(header->magic));
+  header->version = SNAPSHOT_VERSION;
+  header->node_header = (uint32_t)offsetof(ASTNode, child);
+  header->node_bytes = (uint32_t)sizeof(ASTNode);
+  header->token_count = tokens->size;
+  header->token_idx = lexer->token_idx;
+  header->token_end = lexer->token_end;
+  header->line_count = tokens->line_count;
+  header->value_count = tokens->values_size;
+  header->name_count = interned->size;
+  header->slot_count = interned->slot_count;
+  header->node_words = ast->size;
+  header->child_count = ast->children_size;
+  header->program = parser->program;
+  header->statements = parser->statements;
+
+  // Room for the file name, the string literals and the names
+  uint64_t strings_size = 1 + strlen(lexer->filename) + 1;
+  for (uint32_t i = 1; i < tokens->values_size; i++) {
+    if (tokens->values[i].kind == VALUE_STR)
+      strings_size += tokens->values[i].length + 1;
+  }
+  for (NameId id = NAME_NONE + 1; id < interned->size; id++) {
+    strings_size += strlen(interned->names[id]) + 1;
+  }
+
+  SnapshotStrings strings = {.data = allocator_alloc(&allocator, strings_size),
+                             .size = 1};
+  TokenValue *values = allocator_alloc(
+      &allocator, (tokens->values_size + 1) * sizeof(TokenValue));
+  uint64_t *names =
+      allocator_alloc(&allocator, interned->size * sizeof(uint64_t));
+
+  uint32_t ops_count = 0;
+  for (NodeIndex i = NODE_NONE + 1; i < ast->size;) {
+    const ASTNode *node = AST_node(ast, i);
+    if (node->type == COMPARE && node->compare.ops != NULL)
+      ops_count += 1 + (uint32_t)node->compare.ops->size;
+    i += node_words(node->type);
+  }
+  uint32_t *ops = allocator_alloc(&allocator, (ops_count + 1) * sizeof(*ops));
+  uint64_t *nodes =
+      allocator_alloc(&allocator, (size_t)ast->size * AST_NODE_ALIGN);
+
+  if (strings.data == NULL || values == NULL || names == NULL || ops == NULL ||
+      nodes == NULL) {
+    slog_error("[%s] Could not allocate memory for AST snapshot", path);
+    allocator_free(&allocator);
+    fclose(file);
+    return false;
+  }
+
+  strings.data[0] = '\0';
+  header->filename =
+      snapshot_string(&strings, lexer->filename, strlen(lexer->filename));
+  // Strings are written through their token, as those read in place from the
+  // source are only reachable that way. A slot no token uses any more is
+  // left empty.
+  for (uint32_t i = 0; i < tokens->values_size; i++) {
+    values[i] = tokens->values[i];
+    if (i > 0 && values[i].kind == VALUE_STR)
+      values[i] = (TokenValue){.kind = VALUE_STR, .str_val = NULL};
+  }
+  for (TokenIndex t = TOKEN_NONE + 1; t < lexer->token_end; t++) {
+    uint32_t slot = tokens->literals[t];
+    if (slot == 0 || tokens->values[slot].kind != VALUE_STR)
+      continue;
+
+    values[slot].length = tokens->values[slot].length;
+    uint64_t offset = snapshot_string(&strings, token_string(lexer, t),
+                                      values[slot].length);
+    values[slot].str_val = (const char *)(uintptr_t)offset;
+  }
+  names[NAME_NONE] = 0;
+  for (NameId id = NAME_NONE + 1; id < interned->size; id++) {
+    const char *name = interned->names[id];
+    names[id] = snapshot_string(&strings, name, strlen(name));
+  }
+
+  memcpy(nodes, ast->nodes, (size_t)ast->size * AST_NODE_ALIGN);
+  uint32_t ops_size = 0;
+  for (NodeIndex i = NODE_NONE + 1; i < ast->size;) {
+    ASTNode *node = (ASTNode *)(nodes + i);
+    snapshot_unlink_node(node, ops, &ops_size);
+    i += node_words(node->type);
+  }
+
+  // Written once more when the sections are known
+  writer.ok = fwrite(header, sizeof(*header), 1, file) == 1;
+  writer.offset = sizeof(*header);
+
+  uint32_t count = tokens->size;
+  snapshot_write(&writer, SECTION_SOURCE, lexer->source,
+                 lexer->source_length + 1);
+  snapshot_write(&writer, SECTION_STRINGS, strings.data, strings.size);
+  snapshot_write(&writer, SECTION_KINDS, tokens->kinds, count);
+  snapshot_write(&writer, SECTION_SUBKINDS, tokens->subkinds, count);
+  snapshot_write(&writer, SECTION_OFFSETS, tokens->offsets,
+                 count * sizeof(uint32_t));
+  snapshot_write(&writer, SECTION_LENGTHS, tokens->lengths,
+                 count * sizeof(uint32_t));
+  snapshot_write(&writer, SECTION_IDENTS, tokens->idents,
+                 count * sizeof(*tokens->idents));
+  snapshot_write(&writer, SECTION_NAMES, tokens->names,
+                 count * sizeof(NameId));
+  snapshot_write(&writer, SECTION_LITERALS, tokens->literals,
+                 count * sizeof(uint32_t));
+  snapshot_write(&writer, SECTION_LINES, tokens->line_starts,
+                 tokens->line_count * sizeof(uint32_t));
+  snapshot_write(&writer, SECTION_VALUES, values,
+                 tokens->values_size * sizeof(TokenValue));
+  snapshot_write(&writer, SECTION_NAME_TEXT, names,
+                 interned->size * sizeof(uint64_t));
+  snapshot_write(&writer, SECTION_HASHES, interned->hashes,
+                 interned->size * sizeof(uint32_t));
+  snapshot_write(&writer, SECTION_SLOTS, interned->slots,
+                 interned->slot_count * sizeof(NameId));
+  snapshot_write(&writer, SECTION_CHILDREN, ast->children,
+                 ast->children_size * sizeof(NodeIndex));
+  snapshot_write(&writer, SECTION_STARTS, parser->statement_starts,
+                 parser->statements.count * sizeof(TokenIndex));
+  snapshot_write(&writer, SECTION_OPS, ops, ops_size * sizeof(uint32_t));
+
+  snapshot_pad(&writer, SNAPSHOT_PAGE);
+  snapshot_write(&writer, SECTION_NODES, nodes,
+                 (size_t)ast->size * AST_NODE_ALIGN);
+  snapshot_pad(&writer, SNAPSHOT_PAGE);
+  header->sections[SECTION_NODES].size =
+      writer.offset - header->sections[SECTION_NODES].offset;
+
+  if (writer.ok) {
+    writer.ok = fseek(file, 0, SEEK_SET) == 0 &&
+                fwrite(header, sizeof(*header), 1, file) == 1;
+  }
+  if (fclose(file) != 0)
+    writer.ok = false;
+  allocator_free(&allocator);
+
+  if (!writer.ok) {
+    slog_error("[%s] Failed to write AST snapshot", path);
+    remove(path);
+  }
+  return writer.ok;
+}
+
+bool ast_snapshot_detect(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+
+  char magic[sizeof(snapshot_magic)];
+  bool found = fread(magic, sizeof(magic), 1, file) == 1 &&
+               memcmp(magic, snapshot_magic, sizeof(magic)) == 0;
+  fclose(file);
+  return found;
+}
+
+// Section `id` if it lies within the file and holds `size` bytes, NULL
+// otherwise
+static void *snapshot_section(const ASTSnapshot *snapshot,
+                              const SnapshotHeader *header,
+                              SnapshotSectionId id, uint64_t size) {
+  SnapshotSection section = header->sections[id];
+  if (section.offset % 8 != 0 || section.offset > snapshot->size ||
+      section.size > snapshot->size - section.offset || section.size != size)
+    return NULL;
+  return (char *)snapshot->base + section.offset;
+}
+
+// Pointer to the string at `offset`, NULL when it is out of the section
+static const char *snapshot_string_at(const char *strings, uint64_t size,
+                                      uint64_t offset) {
+  return offset < size ? strings + offset : NULL;
+}
+
+// Checks the node links and turns the offsets kept by the file back into
+// pointers
+static bool snapshot_link_node(Parser *parser, ASTNode *node,
+                               const uint32_t *ops, uint32_t ops_size) {
+  AST *ast = &parser->ast;
+  if (node->token >= parser->lexer.tokens.size)
+    return false;
+
+  NodeLinks links = node_links(node);
+  for (uint32_t i = 0; i < links.node_count; i++) {
+    if (*links.nodes[i] >= ast->size)
+      return false;
+  }
+  for (uint32_t i = 0; i < links.span_count; i++) {
+    NodeSpan span = *links.spans[i];
+    if (span.start > ast->children_size ||
+        span.count > ast->children_size - span.start)
+      return false;
+  }
+
+  switch (node->type) {
+  case ATTRIBUTE:
+    node->attribute.attr = token_lexeme(&parser->lexer, node->token);
+    break;
+  case COMPARE: {
+    uintptr_t at = (uintptr_t)node->compare.ops;
+    if (at == 0)
+      break;
+    if (at > ops_size || ops[at - 1] > ops_size - at)
+      return false;
+
+    uint32_t count = ops[at - 1];
+    Token_ArrayList *list =
+        allocator_alloc(&ast->allocator, sizeof(Token_ArrayList));
+    if (list == NULL)
+      return false;
+    *list = Token_new_with_allocator(&ast->allocator, count ? count : 1);
+    for (uint32_t i = 0; i < count; i++) {
+      Token_push(list, ops[at + i]);
+    }
+    node->compare.ops = list;
+    break;
+  }
+  default:
+    break;
+  }
+  return true;
+}
+
+// Points the token stream of `lexer` into the mapped file
+static bool snapshot_load_tokens(ASTSnapshot *snapshot,
+                                 const SnapshotHeader *header, Lexer *lexer) {
+  TokenStream *tokens = &lexer->tokens;
+  InternTable *interned = &tokens->interned;
+  uint32_t count = header->token_count;
+  uint64_t strings_size = header->sections[SECTION_STRINGS].size;
+  const char *strings = snapshot_section(snapshot, header, SECTION_STRINGS,
+                                         strings_size);
+  uint64_t source_size = header->sections[SECTION_SOURCE].size;
+  const char *source =
+      snapshot_section(snapshot, header, SECTION_SOURCE, source_size);
+  if (strings == NULL || strings_size == 0 ||
+      strings[strings_size - 1] != '\0' || source == NULL ||
+      source_size == 0 || source[source_size - 1] != '\0')
+    return false;
+
+  lexer->source = source;
+  lexer->source_length = source_size - 1;
+  lexer->position = lexer->source_length;
+  lexer->filename =
+      snapshot_string_at(strings, strings_size, header->filename);
+  lexer->token_idx = header->token_idx;
+  lexer->token_end = header->token_end;
+  lexer->scan = scan_kernels();
+
+  // Every column is mapped with no spare room, so the first token or line
+  // added copies it out of the file
+  tokens->kinds = snapshot_section(snapshot, header, SECTION_KINDS, count);
+  tokens->subkinds =
+      snapshot_section(snapshot, header, SECTION_SUBKINDS, count);
+  tokens->offsets = snapshot_section(snapshot, header, SECTION_OFFSETS,
+                                     count * sizeof(uint32_t));
+  tokens->lengths = snapshot_section(snapshot, header, SECTION_LENGTHS,
+                                     count * sizeof(uint32_t));
+  tokens->idents = snapshot_section(snapshot, header, SECTION_IDENTS,
+                                    count * sizeof(*tokens->idents));
+  tokens->names = snapshot_section(snapshot, header, SECTION_NAMES,
+                                   count * sizeof(NameId));
+  tokens->literals = snapshot_section(snapshot, header, SECTION_LITERALS,
+                                      count * sizeof(uint32_t));
+  tokens->size = tokens->capacity = count;
+  tokens->line_starts = snapshot_section(snapshot, header, SECTION_LINES,
+                                         header->line_count * sizeof(uint32_t));
+  tokens->line_count = tokens->line_capacity = header->line_count;
+  if (count == 0 || tokens->kinds == NULL || tokens->subkinds == NULL ||
+      tokens->offsets == NULL || tokens->lengths == NULL ||
+      tokens->idents == NULL || tokens->names == NULL ||
+      tokens->literals == NULL || tokens->line_starts == NULL ||
+      header->token_end > count || lexer->filename == NULL)
+    return false;
+
+  tokens->values = snapshot_section(snapshot, header, SECTION_VALUES,
+                                    header->value_count * sizeof(TokenValue));
+  tokens->values_size = tokens->values_capacity = header->value_count;
+  if (tokens->values == NULL)
+    return false;
+  for (uint32_t i = 1; i < header->value_count; i++) {
+    TokenValue *value = &tokens->values[i];
+    if (value->kind != VALUE_STR)
+      continue;
+
+    uint64_t offset = (uintptr_t)value->str_val;
+    value->str_val = snapshot_string_at(strings, strings_size, offset);
+    if (value->str_val == NULL || value->length > strings_size - offset - 1)
+      return false;
+  }
+  if (header->value_count == 0)
+    tokens->values = NULL;
+
+  uint32_t names = header->name_count;
+  interned->names = snapshot_section(snapshot, header, SECTION_NAME_TEXT,
+                                     names * sizeof(uint64_t));
+  interned->hashes = snapshot_section(snapshot, header, SECTION_HASHES,
+                                      names * sizeof(uint32_t));
+  interned->slots = snapshot_section(snapshot, header, SECTION_SLOTS,
+                                     header->slot_count * sizeof(NameId));
+  interned->size = interned->capacity = names;
+  interned->slot_count = header->slot_count;
+  if (names == 0 || interned->names == NULL || interned->hashes == NULL ||
+      interned->slots == NULL || header->slot_count < names ||
+      (header->slot_count & (header->slot_count - 1)) != 0)
+    return false;
+
+  interned->names[NAME_NONE] = NULL;
+  for (NameId id = NAME_NONE + 1; id < names; id++) {
+    uint64_t offset = (uintptr_t)interned->names[id];
+    interned->names[id] = snapshot_string_at(strings, strings_size, offset);
+    if (interned->names[id] == NULL)
+      return false;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    if (tokens->names[i] >= names)
+      return false;
+  }
+  for (uint32_t i = 0; i < header->slot_count; i++) {
+    if (interned->slots[i] >= names)
+      return false;
+  }
+  return true;
+}
+
+// Maps the node section into the reserved pool, or copies it where the file
+// cannot be mapped there
+static bool snapshot_load_nodes(ASTSnapshot *snapshot,
+                                const SnapshotHeader *header, int fd,
+                                AST *ast) {
+  size_t bytes = (size_t)header->node_words * AST_NODE_ALIGN;
+  uint64_t padded = (bytes + SNAPSHOT_PAGE - 1) / SNAPSHOT_PAGE * SNAPSHOT_PAGE;
+  const uint64_t *nodes =
+      snapshot_section(snapshot, header, SECTION_NODES, padded);
+  if (nodes == NULL || header->node_words == 0 ||
+      header->node_words > ast->capacity)
+    return false;
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  uint64_t offset = header->sections[SECTION_NODES].offset;
+  bool mapped = page <= SNAPSHOT_PAGE && offset % page == 0 &&
+                mmap(ast->nodes, padded, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_FIXED, fd,
+                     (off_t)offset) != MAP_FAILED;
+  if (!mapped)
+    memcpy(ast->nodes, nodes, bytes);
+
+  ast->size = header->node_words;
+  return true;
+}
+
+static bool snapshot_load(ASTSnapshot *snapshot, int fd, Parser *parser) {
+  const SnapshotHeader *header = snapshot->base;
+  if (memcmp(header->magic, snapshot_magic, sizeof(snapshot_magic)) != 0 ||
+      header->version != SNAPSHOT_VERSION ||
+      header->node_header != offsetof(ASTNode, child) ||
+      header->node_bytes != sizeof(ASTNode))
+    return false;
+
+  Lexer *lexer = &parser->lexer;
+  if (!snapshot_load_tokens(snapshot, header, lexer))
+    return false;
+
+  AST *ast = &parser->ast;
+  // Later passes still add nodes to the loaded tree
+  *ast = AST_new(header->node_words + AST_words_for(header->token_count));
+  if (ast->nodes == NULL ||
+      !snapshot_load_nodes(snapshot, header, fd, ast))
+    return false;
+
+  ast->children = snapshot_section(snapshot, header, SECTION_CHILDREN,
+                                   header->child_count * sizeof(NodeIndex));
+  ast->children_size = ast->children_capacity = header->child_count;
+  if (ast->children == NULL)
+    return false;
+  for (uint32_t i = 0; i < ast->children_size; i++) {
+    if (ast->children[i] == NODE_NONE || ast->children[i] >= ast->size)
+      return false;
+  }
+
+  uint64_t ops_bytes = header->sections[SECTION_OPS].size;
+  const uint32_t *ops =
+      snapshot_section(snapshot, header, SECTION_OPS, ops_bytes);
+  if (ops == NULL)
+    return false;
+
+  for (NodeIndex i = NODE_NONE + 1; i < ast->size;) {
+    ASTNode *node = AST_node(ast, i);
+    if (node->type > END_BLOCK || node_words(node->type) > ast->size - i ||
+        !snapshot_link_node(parser, node, ops,
+                            (uint32_t)(ops_bytes / sizeof(uint32_t))))
+      return false;
+    i += node_words(node->type);
+  }
+
+  NodeSpan spans[] = {header->program, header->statements};
+  for (size_t i = 0; i < ARRAYSIZE(spans); i++) {
+    if (spans[i].start > ast->children_size ||
+        spans[i].count > ast->children_size - spans[i].start)
+      return false;
+  }
+  parser->program = header->program;
+  parser->statements = header->statements;
+  parser->statement_starts =
+      snapshot_section(snapshot, header, SECTION_STARTS,
+                       header->statements.count * sizeof(TokenIndex));
+  return parser->statement_starts != NULL;
+}
+
+bool ast_snapshot_open(ASTSnapshot *snapshot, const char *path,
+                       Parser *parser) {
+  *snapshot = (ASTSnapshot){.path = path};
+  *parser = (Parser){.current = TOKEN_NONE, .next = TOKEN_NONE};
+  allocator_init(&parser->lexer.tokens.allocator, "TokenStream");
+  allocator_init(&parser->lexer.tokens.strings, "TokenStream strings");
+  allocator_init(&parser->lexer.tokens.interned.allocator, "InternTable");
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    slog_error("[%s] Could not open AST snapshot", path);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+    slog_error("[%s] Not an AST snapshot", path);
+    close(fd);
+    return false;
+  }
+
+  // Private and writable: pointers are fixed up in place, without touching
+  // the file
+  snapshot->size = (size_t)st.st_size;
+  snapshot->base = mmap(NULL, snapshot->size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE, fd, 0);
+  if (snapshot->base == MAP_FAILED) {
+    slog_error("[%s] Could not map AST snapshot", path);
+    *snapshot = (ASTSnapshot){0};
+    close(fd);
+    return false;
+  }
+
+  bool loaded = snapshot_load(snapshot, fd, parser);
+  close(fd);
+  if (!loaded) {
+    slog_error("[%s] Not an AST snapshot of this build or corrupted", path);
+    parser_free(parser);
+    ast_snapshot_close(snapshot);
+  }
+  return loaded;
+}
+
+void ast_snapshot_close(ASTSnapshot *snapshot) {
+  if (snapshot->base != NULL)
+    munmap(snapshot->base, snapshot->size);
+  *snapshot = (ASTSnapshot){0};
+}
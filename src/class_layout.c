@@ -0,0 +1,165 @@
+#include "class_layout.h"
+
+#define CLASS_LAYOUT_MIN_SLOTS 8
+#define CLASS_MEMBER_METHOD 0x80000000u
+
+static ClassMember *member_at(const ClassLayout *layout, uint32_t ref) {
+  if (ref & CLASS_MEMBER_METHOD)
+    return &layout->methods[ref & ~CLASS_MEMBER_METHOD];
+  return &layout->fields[ref];
+}
+
+// Index of the slot holding `name` or of the empty slot where it would go
+static uint32_t class_layout_probe(const ClassLayout *layout, NameId name) {
+  uint32_t mask = layout->slot_count - 1;
+  uint32_t slot = symbol_name_hash(name) & mask;
+  while (layout->slots[slot] != CLASS_MEMBER_NONE &&
+         member_at(layout, layout->slots[slot])->symbol->name_id != name)
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+static bool class_layout_grow(ClassLayout *layout) {
+  uint32_t old_count = layout->slot_count;
+  uint32_t *old_slots = layout->slots;
+  uint32_t slot_count = old_count ? old_count * 2 : CLASS_LAYOUT_MIN_SLOTS;
+  uint32_t *slots =
+      allocator_alloc(layout->allocator, slot_count * sizeof(*slots));
+  if (slots == NULL) {
+    slog_error("Failed to grow class layout index");
+    return false;
+  }
+  memset(slots, 0xff, slot_count * sizeof(*slots));
+
+  layout->slots = slots;
+  layout->slot_count = slot_count;
+  for (uint32_t i = 0; i < old_count; i++) {
+    uint32_t ref = old_slots[i];
+    if (ref != CLASS_MEMBER_NONE) {
+      NameId name = member_at(layout, ref)->symbol->name_id;
+      slots[class_layout_probe(layout, name)] = ref;
+    }
+  }
+  return true;
+}
+
+// Appends to the field or the method table
+static bool member_push(Allocator *allocator, ClassMember **table,
+                        uint32_t *count, uint32_t *capacity,
+                        ClassMember member) {
+  if (*count == *capacity) {
+    uint32_t cap = *capacity ? *capacity * 2 : 4;
+    ClassMember *grown =
+        allocator_realloc(allocator, *table, *capacity * sizeof(ClassMember),
+                          cap * sizeof(ClassMember));
+    if (grown == NULL) {
+      slog_error("Failed to resize class member table");
+      return false;
+    }
+    *table = grown;
+    *capacity = cap;
+  }
+  (*table)[(*count)++] = member;
+  return true;
+}
+
+// Points the index at `ref`, hiding whatever had the same name
+static bool class_layout_index(ClassLayout *layout, uint32_t ref) {
+  // Keep the load factor under one half
+  if ((layout->count + 1) * 2 > layout->slot_count &&
+      !class_layout_grow(layout))
+    return false;
+
+  NameId name = member_at(layout, ref)->symbol->name_id;
+  uint32_t slot = class_layout_probe(layout, name);
+  if (layout->slots[slot] == CLASS_MEMBER_NONE)
+    layout->count++;
+  layout->slots[slot] = ref;
+  return true;
+}
+
+static bool class_layout_insert(ClassLayout *layout, ClassMember member) {
+  if (member.is_method) {
+    member.offset = layout->method_count;
+    if (!member_push(layout->allocator, &layout->methods,
+                     &layout->method_count, &layout->method_capacity, member))
+      return false;
+    return class_layout_index(layout, member.offset | CLASS_MEMBER_METHOD);
+  }
+
+  member.offset = layout->field_count;
+  if (!member_push(layout->allocator, &layout->fields, &layout->field_count,
+                   &layout->field_capacity, member))
+    return false;
+  return class_layout_index(layout, member.offset);
+}
+
+ClassLayout *class_layout_new(Allocator *allocator, Symbol *class_sym,
+                              const ClassLayout *base) {
+  ClassLayout *layout = allocator_alloc(allocator, sizeof(ClassLayout));
+  if (layout == NULL) {
+    slog_error("Failed to allocate class layout");
+    return NULL;
+  }
+  *layout = (ClassLayout){.class_sym = class_sym, .allocator = allocator};
+  if (base == NULL)
+    return layout;
+
+  // Inherited members keep their offsets and names hidden in the base stay
+  // hidden, so both tables and the index are copied as they are
+  for (uint32_t i = 0; i < base->field_count; i++) {
+    member_push(allocator, &layout->fields, &layout->field_count,
+                &layout->field_capacity, base->fields[i]);
+  }
+  for (uint32_t i = 0; i < base->method_count; i++) {
+    member_push(allocator, &layout->methods, &layout->method_count,
+                &layout->method_capacity, base->methods[i]);
+  }
+  if (layout->field_count != base->field_count ||
+      layout->method_count != base->method_count)
+    return layout;
+
+  for (uint32_t i = 0; i < base->slot_count; i++) {
+    if (base->slots[i] != CLASS_MEMBER_NONE)
+      class_layout_index(layout, base->slots[i]);
+  }
+  return layout;
+}
+
+bool class_layout_add(ClassLayout *layout, const AST *ast, Symbol *member) {
+  ASSERT(layout != NULL, "Class layout cannot be NULL");
+  bool is_method = member->kind == FUNCTION;
+  ClassMember entry = {.symbol = member,
+                       .owner = layout->class_sym,
+                       .is_method = is_method};
+  if (is_method) {
+    ASTNode *def = AST_get(ast, member->decl_node->parent);
+    entry.takes_self = def && def->def.params.count > 0;
+  }
+
+  // An override takes the slot of the method it replaces
+  const ClassMember *found = class_layout_find(layout, member->name_id);
+  if (is_method && found && found->is_method) {
+    entry.offset = found->offset;
+    layout->methods[found->offset] = entry;
+    return true;
+  }
+
+  // Declaring a field again in the same class keeps its slot
+  if (!is_method && found && !found->is_method &&
+      found->owner == layout->class_sym) {
+    entry.offset = found->offset;
+    layout->fields[found->offset] = entry;
+    return true;
+  }
+
+  return class_layout_insert(layout, entry);
+}
+
+const ClassMember *class_layout_find(const ClassLayout *layout, NameId name) {
+  if (layout == NULL || layout->slot_count == 0)
+    return NULL;
+
+  uint32_t ref = layout->slots[class_layout_probe(layout, name)];
+  return ref == CLASS_MEMBER_NONE ? NULL : member_at(layout, ref);
+}
@@ -1,4 +1,7 @@
 #include "codegen.h"
+#include <inttypes.h>
+
+#define DEFAULT_CAP 10
 
 /* -----------------------------
  *  INTERNAL API
@@ -11,28 +14,56 @@ void gen_ctrl_flow(Codegen *cg, ASTNode *node);
 
 void gen_match_stmt(Codegen *cg, ASTNode *node);
 
+static void gen_function_signature(Codegen *cg, ASTNode *node,
+                                   const char *prefix, const char *self_type);
+
 /* -----------------------------
  *  CODEGEN IMPLEMENTATION
  * ----------------------------- */
 
 // NULL means no substitution
 typedef struct {
-  const char *from; // original variable name (e.g. "x")
-  const char *to;   // replacement (e.g. "_tmp0")
+  NameId from;    // original variable name (e.g. "x")
+  const char *to; // replacement (e.g. "_tmp0")
 } VarSubst;
 
 static void gen_expr(Codegen *cg, ASTNode *node, VarSubst *subst);
 
-int8_t get_node_precedence(ASTNode *node) {
+static inline const char *cg_lexeme(Codegen *cg, TokenIndex token) {
+  return token_lexeme(&cg->sa.parser.lexer, token);
+}
+
+static inline TokenSubkind cg_sub(Codegen *cg, TokenIndex token) {
+  return token_subkind(&cg->sa.parser.lexer, token);
+}
+
+static inline NameId cg_name(Codegen *cg, TokenIndex token) {
+  return token_name(&cg->sa.parser.lexer, token);
+}
+
+static inline ASTNode *cg_child(Codegen *cg, NodeSpan span, uint32_t i) {
+  return AST_child(&cg->sa.parser.ast, span, i);
+}
+
+static inline ASTNode *cg_node(Codegen *cg, NodeIndex index) {
+  return AST_get(&cg->sa.parser.ast, index);
+}
+
+// Indentation of the line the node starts on
+static inline size_t cg_ident(Codegen *cg, ASTNode *node) {
+  return token_ident(&cg->sa.parser.lexer, node->token);
+}
+
+int8_t get_node_precedence(Codegen *cg, ASTNode *node) {
   if (node == NULL)
     return 0;
 
   if (node->type == BINARY_OPERATION) {
-    return get_infix_precedence(node->token->lexeme);
+    return get_infix_precedence(cg_sub(cg, node->token));
   }
 
   if (node->type == UNARY_OPERATION) {
-    return get_prefix_precedence(node->token->lexeme);
+    return get_prefix_precedence(cg_sub(cg, node->token));
   }
 
   return 127;
@@ -54,7 +85,7 @@ const char *ctype_to_string(Codegen *cg, ASTNode *node) {
   case NONE:
     return "void";
   case OBJECT: {
-    Symbol *obj_sym = sa_lookup(&cg->sa, node->token->lexeme);
+    Symbol *obj_sym = node->symbol;
     Symbol *class_sym =
         (obj_sym && obj_sym->dtype == OBJECT) ? obj_sym->base_class : NULL;
     return class_sym ? class_sym->base_class->name : "void*";
@@ -64,18 +95,24 @@ const char *ctype_to_string(Codegen *cg, ASTNode *node) {
   }
 }
 
-static const char *py_op_to_c_op(const char *op) {
-  if (strcmp(op, "and") == 0)
+static const char *py_op_to_c_op(Codegen *cg, TokenIndex op) {
+  switch (cg_sub(cg, op)) {
+  case KW_AND:
     return "&&";
-  if (strcmp(op, "or") == 0)
+  case KW_OR:
     return "||";
-  if (strcmp(op, "not") == 0)
+  case KW_NOT:
     return "!";
-  if (strcmp(op, "//") == 0)
+  case KW_IS:
+    return "==";
+  case OP_SLASH_SLASH:
     return "/"; // integer division (assumes int operands)
-  if (strcmp(op, "**") == 0)
+  case OP_STAR_STAR:
     return NULL; // no C equivalent, handle separately
-  return op;     // +, -, *, /, %, ==, !=, <, >, <=, >= pass through unchanged
+  default:
+    // +, -, *, /, %, ==, !=, <, >, <=, >= pass through unchanged
+    return cg_lexeme(cg, op);
+  }
 }
 
 Codegen codegen_init(SemanticAnalyzer *sa) {
@@ -96,12 +133,12 @@ bool gen_code(Codegen *cg, ASTNode *node) {
   case CALL: {
     bool saved_standalone = cg->is_standalone;
     cg->is_standalone = false;
-    sb_appendf(&cg->output, "%s(", node->call.func->token->lexeme);
-    for (size_t cur = node->call.args.head; cur != SIZE_MAX;
-         cur = node->call.args.elements[cur].next) {
-      ASTNode *arg = node->call.args.elements[cur].data;
+    ASTNode *func = cg_node(cg, node->call.func);
+    sb_appendf(&cg->output, "%s(", cg_lexeme(cg, func->token));
+    for (uint32_t cur = 0; cur < node->call.args.count; cur++) {
+      ASTNode *arg = cg_child(cg, node->call.args, cur);
       gen_code(cg, arg);
-      if (cur != node->call.args.tail) {
+      if (cur + 1 < node->call.args.count) {
         sb_appendf(&cg->output, ", ");
       }
     }
@@ -114,7 +151,7 @@ bool gen_code(Codegen *cg, ASTNode *node) {
   } break;
   case RETURN: {
     sb_appendf(&cg->output, "    return ");
-    ASTNode *ret_expr = node->child;
+    ASTNode *ret_expr = cg_node(cg, node->child);
     cg->is_standalone = false;
     gen_code(cg, ret_expr);
     sb_appendf(&cg->output, ";\n");
@@ -142,59 +179,54 @@ bool gen_code(Codegen *cg, ASTNode *node) {
     }
   } break;
   case CLASS_DEF: {
-    const char *class_name = node->def.name->token->lexeme;
+    const char *class_name = cg_lexeme(cg, cg_node(cg, node->def.name)->token);
     sb_appendf(&cg->output, "typedef struct {\n");
 
     // Handle Inheritance (Composition)
-    if (node->def.params.size == 1) {
-      ASTNode *base = ASTNode_pop(&node->def.params);
-      sb_appendf(&cg->output, "  %s* base;\n", base->token->lexeme);
+    if (node->def.params.count == 1) {
+      ASTNode *base = AST_pop(&cg->sa.parser.ast, &node->def.params);
+      sb_appendf(&cg->output, "  %s* base;\n", cg_lexeme(cg, base->token));
     } else {
-      for (size_t cur = node->def.params.head; cur != SIZE_MAX;
-           cur = node->def.params.elements[cur].next) {
-        ASTNode *base = node->call.args.elements[cur].data;
-        sb_appendf(&cg->output, "  %s* base%zu;\n", base->token->lexeme, cur);
+      for (uint32_t cur = 0; cur < node->def.params.count; cur++) {
+        ASTNode *base = cg_child(cg, node->def.params, cur);
+        sb_appendf(&cg->output, "  %s* base%u;\n", cg_lexeme(cg, base->token),
+                   cur);
       }
     }
 
-    ASTNode_LinkedList methods =
-        ASTNode_new_with_allocator(&cg->sa.parser.ast.allocator, DEFAULT_CAP);
-
-    for (size_t cur = node->def.body.head; cur != SIZE_MAX;
-         cur = node->def.body.elements[cur].next) {
-      ASTNode *member = node->def.body.elements[cur].data;
+    for (uint32_t cur = 0; cur < node->def.body.count; cur++) {
+      ASTNode *member = cg_child(cg, node->def.body, cur);
       if (member->type == FUNCTION_DEF) {
-        ASTNode_add_first(&methods, member);
         cg->is_standalone = true;
         continue;
       } else {
-        sb_append_padding(&cg->output, ' ', member->token->ident);
+        sb_append_padding(&cg->output, ' ', cg_ident(cg, member));
         gen_code(cg, member);
       }
     }
 
     sb_appendf(&cg->output, "} %s;\n\n", class_name);
 
-    for (size_t cur = methods.head; cur != SIZE_MAX;
-         cur = methods.elements[cur].next) {
-      ASTNode *method = methods.elements[cur].data;
-      gen_function_def(cg, method, class_name, class_name);
+    // Methods are emitted after the struct, last defined first
+    for (uint32_t cur = node->def.body.count; cur-- > 0;) {
+      ASTNode *method = cg_child(cg, node->def.body, cur);
+      if (method->type == FUNCTION_DEF)
+        gen_function_def(cg, method, class_name, class_name);
     }
   } break;
   case ASSIGNMENT: {
-    sb_append_padding(&cg->output, ' ', node->token->ident);
-    for (size_t cur = node->assign.targets.head; cur != SIZE_MAX;
-         cur = node->assign.targets.elements[cur].next) {
-      ASTNode *target = node->assign.targets.elements[cur].data;
+    sb_append_padding(&cg->output, ' ', cg_ident(cg, node));
+    for (uint32_t cur = 0; cur < node->assign.targets.count; cur++) {
+      ASTNode *target = cg_child(cg, node->assign.targets, cur);
       cg->is_standalone = false;
       gen_code(cg, target);
       sb_appendf(&cg->output, " = ");
       cg->is_standalone = true;
-      gen_code(cg, node->assign.value);
+      gen_code(cg, cg_node(cg, node->assign.value));
     }
   } break;
   case ATTRIBUTE: {
-    gen_code(cg, node->attribute.value);
+    gen_code(cg, cg_node(cg, node->attribute.value));
     AttrOwnership owner = resolve_attribute_owner(&cg->sa, node);
 
     if (owner == ATTR_OWN_BASE) {
@@ -204,35 +236,32 @@ bool gen_code(Codegen *cg, ASTNode *node) {
     }
   } break;
   case IF: {
-    sb_append_padding(&cg->output, ' ', node->token->ident);
+    sb_append_padding(&cg->output, ' ', cg_ident(cg, node));
     sb_appendf(&cg->output, "if (");
     cg->is_standalone = false;
-    gen_code(cg, node->ctrl_stmt.test);
+    gen_code(cg, cg_node(cg, node->ctrl_stmt.test));
     cg->is_standalone = true;
     sb_appendf(&cg->output, ") {\n");
 
-    for (size_t cur = node->ctrl_stmt.body.head; cur != SIZE_MAX;
-         cur = node->ctrl_stmt.body.elements[cur].next) {
-      ASTNode *stmt = node->ctrl_stmt.body.elements[cur].data;
+    for (uint32_t cur = 0; cur < node->ctrl_stmt.body.count; cur++) {
+      ASTNode *stmt = cg_child(cg, node->ctrl_stmt.body, cur);
       gen_code(cg, stmt);
     }
 
-    sb_append_padding(&cg->output, ' ', node->token->ident);
+    sb_append_padding(&cg->output, ' ', cg_ident(cg, node));
 
-    if (node->ctrl_stmt.orelse.size > 0) {
+    if (node->ctrl_stmt.orelse.count > 0) {
       sb_appendf(&cg->output, "}");
-      ASTNode *last =
-          node->ctrl_stmt.orelse.elements[node->ctrl_stmt.orelse.head].data;
+      ASTNode *last = cg_child(cg, node->ctrl_stmt.orelse, 0);
       sb_append_padding(&cg->output, ' ',
-                        last->type == IF ? 0 : node->token->ident);
+                        last->type == IF ? 0 : cg_ident(cg, node));
       sb_appendf(&cg->output, last->type == IF ? "else " : "else {\n");
-      for (size_t cur = node->ctrl_stmt.orelse.head; cur != SIZE_MAX;
-           cur = node->ctrl_stmt.orelse.elements[cur].next) {
-        ASTNode *stmt = node->ctrl_stmt.orelse.elements[cur].data;
+      for (uint32_t cur = 0; cur < node->ctrl_stmt.orelse.count; cur++) {
+        ASTNode *stmt = cg_child(cg, node->ctrl_stmt.orelse, cur);
         gen_code(cg, stmt);
       }
 
-      sb_append_padding(&cg->output, ' ', node->token->ident);
+      sb_append_padding(&cg->output, ' ', cg_ident(cg, node));
       sb_appendf(&cg->output, "}\n");
     } else {
       sb_appendf(&cg->output, "}\n");
@@ -247,15 +276,14 @@ bool gen_code(Codegen *cg, ASTNode *node) {
 
     // Python comparison chaining: a < b < c  => (a < b && b < c)
     // We'll use parentheses to ensure C precedence doesn't break logic
-    bool chained = node->compare.comparators.size > 1;
+    bool chained = node->compare.comparators.count > 1;
     if (chained)
       sb_appendf(&cg->output, "(");
 
-    ASTNode *left_side = node->compare.left;
+    ASTNode *left_side = cg_node(cg, node->compare.left);
 
     size_t op_idx = 0;
-    for (size_t cur = node->compare.comparators.head; cur != SIZE_MAX;
-         cur = node->compare.comparators.elements[cur].next) {
+    for (uint32_t cur = 0; cur < node->compare.comparators.count; cur++) {
 
       if (op_idx > 0) {
         sb_appendf(&cg->output, " && ");
@@ -264,15 +292,13 @@ bool gen_code(Codegen *cg, ASTNode *node) {
       // Generate the sub-expression: left_side OP right_side
       gen_code(cg, left_side);
 
-      Token *op = node->compare.ops.elements[op_idx];
+      TokenIndex op = node->compare.ops->elements[op_idx];
       // Map Python '==' to C '==', 'is' to '==', etc.
-      const char *c_op = op->lexeme;
-      if (strcmp(c_op, "is") == 0)
-        c_op = "==";
+      const char *c_op = py_op_to_c_op(cg, op);
 
       sb_appendf(&cg->output, " %s ", c_op);
 
-      ASTNode *right_side = node->compare.comparators.elements[cur].data;
+      ASTNode *right_side = cg_child(cg, node->compare.comparators, cur);
       gen_code(cg, right_side);
 
       // In chained comparison, the right of the current becomes the left of the
@@ -307,13 +333,96 @@ void codegen_free(Codegen *cg) {
   parser_free(&cg->sa.parser);
 }
 
+// Symbol ids of later top-level functions that `node` calls
+typedef struct ForwardCalls {
+  size_t *ids;
+  uint32_t count;
+  uint32_t capacity;
+} ForwardCalls;
+
+static void collect_forward_calls(Codegen *cg, ForwardCalls *calls,
+                                  ASTNode *node, size_t caller_id) {
+  if (node == NULL)
+    return;
+
+  if (node->type == CALL) {
+    Symbol *callee = node->symbol;
+    if (callee && callee->kind == FUNCTION && callee->scope_level == 0 &&
+        callee->id > caller_id) {
+      if (calls->count == calls->capacity) {
+        uint32_t cap = calls->capacity ? calls->capacity * 2 : 16;
+        size_t *grown = allocator_realloc(
+            &cg->sa.parser.ast.allocator, calls->ids,
+            calls->capacity * sizeof(size_t), cap * sizeof(size_t));
+        if (grown == NULL) {
+          slog_error("Failed to resize forward call list");
+          return;
+        }
+        calls->ids = grown;
+        calls->capacity = cap;
+      }
+      calls->ids[calls->count++] = callee->id;
+    }
+  }
+
+  // The first link is the parent
+  NodeLinks links = node_links(node);
+  for (uint32_t i = 1; i < links.node_count; i++)
+    collect_forward_calls(cg, calls, cg_node(cg, *links.nodes[i]), caller_id);
+  for (uint32_t i = 0; i < links.span_count; i++) {
+    NodeSpan span = *links.spans[i];
+    for (uint32_t cur = 0; cur < span.count; cur++)
+      collect_forward_calls(cg, calls, cg_child(cg, span, cur), caller_id);
+  }
+}
+
+static int compare_ids(const void *a, const void *b) {
+  size_t x = *(const size_t *)a;
+  size_t y = *(const size_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Function bodies may call functions defined further down, which C only
+// allows once they are declared. Top-level symbols are numbered in program
+// order, so those are the callees numbered after their caller.
+static void gen_forward_declarations(Codegen *cg) {
+  NodeSpan program = cg->sa.parser.program;
+  ForwardCalls calls = {0};
+  for (uint32_t current = 0; current < program.count; current++) {
+    ASTNode *node = cg_child(cg, program, current);
+    Symbol *sym = node->type == FUNCTION_DEF
+                      ? cg_node(cg, node->def.name)->symbol
+                      : NULL;
+    if (sym)
+      collect_forward_calls(cg, &calls, node, sym->id);
+  }
+  if (calls.count == 0)
+    return;
+
+  qsort(calls.ids, calls.count, sizeof(size_t), compare_ids);
+  uint32_t next = 0;
+  for (uint32_t current = 0; current < program.count; current++) {
+    ASTNode *node = cg_child(cg, program, current);
+    if (node->type != FUNCTION_DEF)
+      continue;
+
+    Symbol *sym = cg_node(cg, node->def.name)->symbol;
+    while (sym && next < calls.count && calls.ids[next] < sym->id)
+      next++;
+    if (sym && next < calls.count && calls.ids[next] == sym->id) {
+      gen_function_signature(cg, node, NULL, NULL);
+      sb_appendf(&cg->output, ";\n");
+    }
+  }
+}
+
 bool codegen_program(Codegen *cg) {
   ASSERT(cg != NULL, "Codegen context cannot be NULL");
-  ASTNode_LinkedList *program = &cg->sa.parser.ast;
+  NodeSpan program = cg->sa.parser.program;
+  gen_forward_declarations(cg);
 
-  for (size_t current = program->head; current != SIZE_MAX;
-       current = program->elements[current].next) {
-    ASTNode *node = program->elements[current].data;
+  for (uint32_t current = 0; current < program.count; current++) {
+    ASTNode *node = cg_child(cg, program, current);
     cg->is_standalone = true;
 
     if (!gen_code(cg, node))
@@ -327,86 +436,88 @@ bool codegen_has_error(Codegen *cg) { return cg->last_error.type != CG_OK; }
 
 CodegenError codegen_get_error(Codegen *cg) { return cg->last_error; }
 
-void gen_function_def(Codegen *cg, ASTNode *node, const char *prefix,
-                      const char *self_type) {
+static void gen_function_signature(Codegen *cg, ASTNode *node,
+                                   const char *prefix, const char *self_type) {
   // 1. Return Type
-  sb_appendf(&cg->output, "%s ", ctype_to_string(cg, node->def.returns));
+  ASTNode *returns = cg_node(cg, node->def.returns);
+  sb_appendf(&cg->output, "%s ", ctype_to_string(cg, returns));
 
   // 2. Name (with optional prefix for methods)
+  const char *name = cg_lexeme(cg, cg_node(cg, node->def.name)->token);
   if (prefix) {
-    sb_appendf(&cg->output, "%s_%s(", prefix, node->def.name->token->lexeme);
+    sb_appendf(&cg->output, "%s_%s(", prefix, name);
   } else {
-    sb_appendf(&cg->output, "%s(", node->def.name->token->lexeme);
+    sb_appendf(&cg->output, "%s(", name);
   }
 
   // 3. Parameters
-  if (node->def.params.size == 0 && !self_type) {
+  if (node->def.params.count == 0 && !self_type) {
     sb_appendf(&cg->output, "void");
   }
 
-  for (size_t cur = node->def.params.head; cur != SIZE_MAX;
-       cur = node->def.params.elements[cur].next) {
-    ASTNode *param = node->def.params.elements[cur].data;
+  for (uint32_t cur = 0; cur < node->def.params.count; cur++) {
+    ASTNode *param = cg_child(cg, node->def.params, cur);
 
     // If this is the first param and we have a self_type override
-    if (cur == node->def.params.head && self_type) {
-      sb_appendf(&cg->output, "%s* %s", self_type, param->token->lexeme);
+    if (cur == 0 && self_type) {
+      sb_appendf(&cg->output, "%s* %s", self_type, cg_lexeme(cg, param->token));
     } else {
       const char *p_type = ctype_to_string(cg, param);
-      sb_appendf(&cg->output, "%s %s", p_type, param->token->lexeme);
+      sb_appendf(&cg->output, "%s %s", p_type, cg_lexeme(cg, param->token));
     }
 
-    if (cur != node->def.params.tail) {
+    if (cur + 1 < node->def.params.count) {
       sb_appendf(&cg->output, ", ");
     }
   }
-  sb_appendf(&cg->output, ") {\n");
-  Symbol *fun_sym = sa_lookup(&cg->sa, node->def.name->token->lexeme);
-  cg->sa.current_scope = fun_sym ? fun_sym->scope : cg->sa.current_scope;
+  sb_appendf(&cg->output, ")");
+}
+
+void gen_function_def(Codegen *cg, ASTNode *node, const char *prefix,
+                      const char *self_type) {
+  gen_function_signature(cg, node, prefix, self_type);
+  sb_appendf(&cg->output, " {\n");
   // 4. Body
-  for (size_t cur = node->def.body.head; cur != SIZE_MAX;
-       cur = node->def.body.elements[cur].next) {
-    ASTNode *body_node = node->def.body.elements[cur].data;
+  for (uint32_t cur = 0; cur < node->def.body.count; cur++) {
+    ASTNode *body_node = cg_child(cg, node->def.body, cur);
     cg->is_standalone = true;
     gen_code(cg, body_node);
   }
 
   sb_appendf(&cg->output, "}\n");
-  sa_exit_scope(&cg->sa);
 }
 
 void gen_ctrl_flow(Codegen *cg, ASTNode *node) {
   ASSERT(cg, "Codegen context cannot be NULL");
   ASSERT(node, "Node cannot be null");
 
-  sb_append_padding(&cg->output, ' ', node->token->ident);
+  sb_append_padding(&cg->output, ' ', cg_ident(cg, node));
 
   sb_appendf(&cg->output, "while (");
   cg->is_standalone = false;
-  gen_code(cg, node->ctrl_stmt.test);
+  gen_code(cg, cg_node(cg, node->ctrl_stmt.test));
   cg->is_standalone = true;
   sb_appendf(&cg->output, ") {\n");
 
-  for (size_t cur = node->ctrl_stmt.body.head; cur != SIZE_MAX;
-       cur = node->ctrl_stmt.body.elements[cur].next) {
-    ASTNode *stmt = node->ctrl_stmt.body.elements[cur].data;
+  for (uint32_t cur = 0; cur < node->ctrl_stmt.body.count; cur++) {
+    ASTNode *stmt = cg_child(cg, node->ctrl_stmt.body, cur);
     gen_code(cg, stmt);
   }
 
-  sb_append_padding(&cg->output, ' ', node->token->ident);
+  sb_append_padding(&cg->output, ' ', cg_ident(cg, node));
   sb_appendf(&cg->output, "}\n");
 }
 
 void gen_match_stmt(Codegen *cg, ASTNode *node) {
   ASSERT(cg, "Codegen context cannot be NULL");
   ASSERT(node, "Node cannot be null");
-  ASTNode *scrutinee = node->ctrl_stmt.test;
+  ASTNode *scrutinee = cg_node(cg, node->ctrl_stmt.test);
   bool first = true;
   static uint8_t match_depth = 0;
   int current_tmp_id = match_depth++;
 
   // 1. Generate the temporary variable for the scrutinee
-  sb_append_padding(&cg->output, ' ', node->token->ident);
+  sb_append_padding(&cg->output, ' ', cg_ident(cg, node));
   sb_appendf(&cg->output, "%s _tmp%d = ", ctype_to_string(cg, scrutinee),
              current_tmp_id);
 
@@ -416,22 +527,22 @@ void gen_match_stmt(Codegen *cg, ASTNode *node) {
   sb_appendf(&cg->output, ";\n");
 
   // 2. Iterate through cases
-  for (size_t cur = node->ctrl_stmt.body.head; cur != SIZE_MAX;
-       cur = node->ctrl_stmt.body.elements[cur].next) {
+  for (uint32_t cur = 0; cur < node->ctrl_stmt.body.count; cur++) {
 
-    ASTNode *case_node = node->ctrl_stmt.body.elements[cur].data;
-    size_t pattern_idx = case_node->ctrl_stmt.orelse.head;
-    ASTNode *pattern = case_node->ctrl_stmt.orelse.elements[pattern_idx].data;
+    ASTNode *case_node = cg_child(cg, node->ctrl_stmt.body, cur);
+    ASTNode *pattern = cg_child(cg, case_node->ctrl_stmt.orelse, 0);
 
     // Check for a guard condition on this case node
-    ASTNode *guard = case_node->ctrl_stmt.test;
+    ASTNode *guard = cg_node(cg, case_node->ctrl_stmt.test);
 
-    sb_append_padding(&cg->output, ' ', node->token->ident);
+    sb_append_padding(&cg->output, ' ', cg_ident(cg, node));
 
     bool is_wildcard =
-        (pattern->type == VARIABLE && strcmp(pattern->token->lexeme, "_") == 0);
+        (pattern->type == VARIABLE &&
+         strcmp(cg_lexeme(cg, pattern->token), "_") == 0);
     bool is_capture =
-        (pattern->type == VARIABLE && strcmp(pattern->token->lexeme, "_") != 0);
+        (pattern->type == VARIABLE &&
+         strcmp(cg_lexeme(cg, pattern->token), "_") != 0);
 
     // Header: if / else if / else
     char tmp_name[16];
@@ -442,7 +553,7 @@ void gen_match_stmt(Codegen *cg, ASTNode *node) {
       const char *branch = first ? "if" : "else if";
       sb_appendf(&cg->output, "%s (", branch);
       cg->is_standalone = false;
-      VarSubst subst = {scrutinee->token->lexeme, tmp_name};
+      VarSubst subst = {cg_name(cg, scrutinee->token), tmp_name};
       gen_expr(cg, guard, &subst);
       sb_appendf(&cg->output, ") {\n");
       first = false;
@@ -459,22 +570,21 @@ void gen_match_stmt(Codegen *cg, ASTNode *node) {
 
     // 3. Body: Handle variable capture assignment
     if (is_capture) {
-      sb_append_padding(&cg->output, ' ', node->token->ident + 4);
+      sb_append_padding(&cg->output, ' ', cg_ident(cg, node) + 4);
       sb_appendf(&cg->output, "%s %s = _tmp%d;\n",
-                 ctype_to_string(cg, scrutinee), pattern->token->lexeme,
+                 ctype_to_string(cg, scrutinee), cg_lexeme(cg, pattern->token),
                  current_tmp_id);
     }
 
     // 4. Body: Generate statements
-    for (size_t bcur = case_node->ctrl_stmt.body.head; bcur != SIZE_MAX;
-         bcur = case_node->ctrl_stmt.body.elements[bcur].next) {
-      ASTNode *stmt = case_node->ctrl_stmt.body.elements[bcur].data;
-      sb_append_padding(&cg->output, ' ', node->token->ident + 4);
+    for (uint32_t bcur = 0; bcur < case_node->ctrl_stmt.body.count; bcur++) {
+      ASTNode *stmt = cg_child(cg, case_node->ctrl_stmt.body, bcur);
+      sb_append_padding(&cg->output, ' ', cg_ident(cg, node) + 4);
       cg->is_standalone = true;
       gen_code(cg, stmt);
     }
 
-    sb_append_padding(&cg->output, ' ', node->token->ident);
+    sb_append_padding(&cg->output, ' ', cg_ident(cg, node));
     sb_appendf(&cg->output, "}\n");
   }
 
@@ -488,47 +598,56 @@ static void gen_expr(Codegen *cg, ASTNode *node, VarSubst *subst) {
 
   switch (node->type) {
   case VARIABLE: {
-    const char *name = node->token->lexeme;
+    const char *name = cg_lexeme(cg, node->token);
+    NameId name_id = cg_name(cg, node->token);
     // Apply substitution if provided and name matches
-    if (subst && strcmp(name, subst->from) == 0) {
+    if (subst && name_id == subst->from) {
       sb_appendf(&cg->output, "%s", subst->to);
       break;
     }
-    // Normal variable emit — check for definition vs usage
-    Symbol *var_sym = sa_lookup(&cg->sa, name);
-    Symbol *class_sym = var_sym ? NULL : find_enclosing_class(&cg->sa);
-    var_sym =
-        !var_sym && class_sym ? sa_lookup_member(class_sym, name) : var_sym;
-    if (var_sym && ((node->ctx == STORE && var_sym->decl_node == node) ||
-                    var_sym->base_class)) {
+    // Normal variable emit — the store that declared it names its type
+    Symbol *var_sym = node->symbol;
+    if (var_sym && node->ctx == STORE && var_sym->decl_node == node) {
       sb_appendf(&cg->output, "%s %s", ctype_to_string(cg, node), name);
     } else {
       sb_appendf(&cg->output, "%s", name);
     }
   } break;
 
-  case LITERAL:
-    if (node->token->type == STRING) {
-      sb_appendf(&cg->output, "\"%s\"", node->token->lexeme);
+  case LITERAL: {
+    const TokenValue *value = token_value(&cg->sa.parser.lexer, node->token);
+    if (token_type(&cg->sa.parser.lexer, node->token) == STRING) {
+      sb_appendf(&cg->output, "\"%s\"", cg_lexeme(cg, node->token));
+    } else if (value != NULL && value->kind == VALUE_INT) {
+      // Digit separators are not valid C
+      sb_appendf(&cg->output, "%" PRId64, value->int_val);
+    } else if (value != NULL && value->kind == VALUE_FLOAT) {
+      const char *lex = cg_lexeme(cg, node->token);
+      for (size_t len; *lex; lex += len + (lex[len] == '_')) {
+        len = strcspn(lex, "_");
+        sb_appendf(&cg->output, "%.*s", (int)len, lex);
+      }
     } else {
-      sb_appendf(&cg->output, "%s", node->token->lexeme);
+      sb_appendf(&cg->output, "%s", cg_lexeme(cg, node->token));
     }
-    break;
+  } break;
 
   case BINARY_OPERATION: {
-    int8_t current_prec = get_infix_precedence(node->token->lexeme);
-    int8_t left_prec = get_node_precedence(node->bin_op.left);
-    int8_t right_prec = get_node_precedence(node->bin_op.right);
+    ASTNode *left = cg_node(cg, node->bin_op.left);
+    ASTNode *right = cg_node(cg, node->bin_op.right);
+    int8_t current_prec = get_infix_precedence(cg_sub(cg, node->token));
+    int8_t left_prec = get_node_precedence(cg, left);
+    int8_t right_prec = get_node_precedence(cg, right);
 
     if (left_prec < current_prec) {
       sb_appendf(&cg->output, "(");
-      gen_expr(cg, node->bin_op.left, subst);
+      gen_expr(cg, left, subst);
       sb_appendf(&cg->output, ")");
     } else {
-      gen_expr(cg, node->bin_op.left, subst);
+      gen_expr(cg, left, subst);
     }
 
-    const char *c_op = py_op_to_c_op(node->token->lexeme);
+    const char *c_op = py_op_to_c_op(cg, node->token);
     if (c_op == NULL) {
       ASSERT(false, "Operator '**' not supported in codegen");
     }
@@ -536,34 +655,31 @@ static void gen_expr(Codegen *cg, ASTNode *node, VarSubst *subst) {
 
     if (right_prec <= current_prec) {
       sb_appendf(&cg->output, "(");
-      gen_expr(cg, node->bin_op.right, subst);
+      gen_expr(cg, right, subst);
       sb_appendf(&cg->output, ")");
     } else {
-      gen_expr(cg, node->bin_op.right, subst);
+      gen_expr(cg, right, subst);
     }
   } break;
 
   case COMPARE: {
-    bool chained = node->compare.comparators.size > 1;
+    bool chained = node->compare.comparators.count > 1;
     if (chained)
       sb_appendf(&cg->output, "(");
 
-    ASTNode *left_side = node->compare.left;
+    ASTNode *left_side = cg_node(cg, node->compare.left);
     size_t op_idx = 0;
-    for (size_t cur = node->compare.comparators.head; cur != SIZE_MAX;
-         cur = node->compare.comparators.elements[cur].next) {
+    for (uint32_t cur = 0; cur < node->compare.comparators.count; cur++) {
       if (op_idx > 0)
         sb_appendf(&cg->output, " && ");
 
       gen_expr(cg, left_side, subst);
 
-      Token *op = node->compare.ops.elements[op_idx];
-      const char *c_op = op->lexeme;
-      if (strcmp(c_op, "is") == 0)
-        c_op = "==";
+      TokenIndex op = node->compare.ops->elements[op_idx];
+      const char *c_op = py_op_to_c_op(cg, op);
       sb_appendf(&cg->output, " %s ", c_op);
 
-      ASTNode *right_side = node->compare.comparators.elements[cur].data;
+      ASTNode *right_side = cg_child(cg, node->compare.comparators, cur);
       gen_expr(cg, right_side, subst);
 
       left_side = right_side;
@@ -0,0 +1,188 @@
+#define _DEFAULT_SOURCE
+#include "compile_cache.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bump when the layout of entries changes
+#define COMPILE_CACHE_FORMAT 1
+
+#define CACHE_K1 0x9e3779b97f4a7c15ull
+#define CACHE_K2 0xc2b2ae3d27d4eb4full
+
+static uint64_t cache_rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t cache_fmix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// Folds `data` into two 64-bit lanes, 16 bytes per step
+static void cache_hash(uint64_t lanes[2], const void *data, size_t length) {
+  const unsigned char *bytes = data;
+  uint64_t h0 = lanes[0];
+  uint64_t h1 = lanes[1];
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    uint64_t a, b;
+    memcpy(&a, bytes + i, sizeof(a));
+    memcpy(&b, bytes + i + 8, sizeof(b));
+    h0 = cache_rotl(h0 ^ (a * CACHE_K1), 31) * CACHE_K2;
+    h1 = cache_rotl(h1 ^ (b * CACHE_K2), 33) * CACHE_K1;
+  }
+
+  uint64_t tail[2] = {0, 0};
+  memcpy(tail, bytes + i, length - i);
+  h0 = cache_rotl(h0 ^ (tail[0] * CACHE_K1), 31) * CACHE_K2;
+  h1 = cache_rotl(h1 ^ (tail[1] * CACHE_K2), 33) * CACHE_K1;
+
+  h0 ^= length;
+  h1 ^= length;
+  h0 += h1;
+  h1 += h0;
+  lanes[0] = cache_fmix(h0);
+  lanes[1] = cache_fmix(h1);
+  lanes[0] += lanes[1];
+  lanes[1] += lanes[0];
+}
+
+bool compile_cache_open(CompileCache *cache, const char *dir,
+                        const char *source, size_t length,
+                        const char *options) {
+  *cache = (CompileCache){.lock = -1};
+  if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+    slog_warn("[%s] Cannot create cache directory: %s", dir, strerror(errno));
+    return false;
+  }
+
+  char header[256];
+  int header_length =
+      snprintf(header, sizeof(header), "ceeify %s %d %s", CEEIFY_VERSION,
+               COMPILE_CACHE_FORMAT, options);
+  if (header_length < 0 || (size_t)header_length >= sizeof(header)) {
+    slog_warn("Compiler options too long to cache: %s", options);
+    return false;
+  }
+
+  uint64_t key[2] = {CACHE_K1, CACHE_K2};
+  cache_hash(key, header, (size_t)header_length);
+  cache_hash(key, source, length);
+
+  int path_length =
+      snprintf(cache->path, sizeof(cache->path), "%s/%016" PRIx64 "%016" PRIx64
+               ".c", dir, key[0], key[1]);
+  int lock_length =
+      snprintf(cache->lock_path, sizeof(cache->lock_path), "%.*s.lock",
+               path_length - 2, cache->path);
+  if (path_length < 0 || (size_t)path_length >= sizeof(cache->path) ||
+      lock_length < 0 || (size_t)lock_length >= sizeof(cache->lock_path)) {
+    slog_warn("[%s] Cache directory path is too long", dir);
+    // Fetch and store then leave the cache alone
+    cache->path[0] = '\0';
+    cache->lock_path[0] = '\0';
+    return false;
+  }
+  return true;
+}
+
+static bool cache_read(CompileCache *cache, SourceFile *entry) {
+  struct stat st;
+  if (stat(cache->path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    return false;
+  return source_file_open(entry, cache->path);
+}
+
+bool compile_cache_fetch(CompileCache *cache, SourceFile *entry) {
+  if (cache->path[0] == '\0')
+    return false;
+  if (cache_read(cache, entry))
+    return true;
+
+  for (;;) {
+    int fd = open(cache->lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) {
+      slog_warn("[%s] Cannot open cache lock: %s", cache->lock_path,
+                strerror(errno));
+      return false;
+    }
+    while (flock(fd, LOCK_EX) != 0) {
+      if (errno != EINTR) {
+        slog_warn("[%s] Cannot lock cache entry: %s", cache->lock_path,
+                  strerror(errno));
+        close(fd);
+        return false;
+      }
+    }
+
+    // The holder unlinks the lock file on release, so a job that waited on
+    // it has locked a file that is gone and must lock the current one
+    struct stat locked, current;
+    if (fstat(fd, &locked) == 0 && stat(cache->lock_path, &current) == 0 &&
+        locked.st_dev == current.st_dev && locked.st_ino == current.st_ino) {
+      cache->lock = fd;
+      break;
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+    if (cache_read(cache, entry))
+      return true;
+  }
+
+  // Another job may have stored the entry while this one waited
+  return cache_read(cache, entry);
+}
+
+bool compile_cache_store(CompileCache *cache, const char *text,
+                         size_t length) {
+  if (cache->path[0] == '\0')
+    return false;
+
+  // Written aside and renamed over the entry, so readers see all or nothing
+  char temp[COMPILE_CACHE_PATH + 32];
+  snprintf(temp, sizeof(temp), "%s.%ld.tmp", cache->path, (long)getpid());
+  int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    slog_warn("[%s] Cannot write cache entry: %s", temp, strerror(errno));
+    return false;
+  }
+
+  size_t written = 0;
+  while (written < length) {
+    ssize_t count = write(fd, text + written, length - written);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      break;
+    written += (size_t)count;
+  }
+
+  bool stored = written == length && close(fd) == 0;
+  if (written != length)
+    close(fd);
+  if (stored && rename(temp, cache->path) == 0)
+    return true;
+
+  slog_warn("[%s] Cannot write cache entry: %s", cache->path, strerror(errno));
+  unlink(temp);
+  return false;
+}
+
+void compile_cache_close(CompileCache *cache) {
+  if (cache->lock >= 0) {
+    // Dropped while still held, once the entry is in place or the job gave
+    // up on it. A job already waiting on it sees the file is gone and locks
+    // a fresh one, so only the holder ever unlinks the current lock file.
+    unlink(cache->lock_path);
+    flock(cache->lock, LOCK_UN);
+    close(cache->lock);
+  }
+  cache->lock = -1;
+}
@@ -0,0 +1,132 @@
+#include "intern.h"
+
+// FNV-1a
+static uint32_t intern_hash(const char *text, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint8_t)text[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Slot holding `text` or the empty slot where it would go
+static uint32_t intern_probe(const InternTable *table, const char *text,
+                             size_t length, uint32_t hash) {
+  uint32_t mask = table->slot_count - 1;
+  for (uint32_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    NameId id = table->slots[slot];
+    if (id == NAME_NONE)
+      return slot;
+    if (table->hashes[id] == hash &&
+        strncmp(table->names[id], text, length) == 0 &&
+        table->names[id][length] == '\0')
+      return slot;
+  }
+}
+
+static bool intern_rehash(InternTable *table, uint32_t slot_count) {
+  NameId *slots =
+      allocator_alloc(&table->allocator, slot_count * sizeof(*slots));
+  if (slots == NULL) {
+    slog_error("Failed to resize intern table");
+    return false;
+  }
+  memset(slots, 0, slot_count * sizeof(*slots));
+
+  uint32_t mask = slot_count - 1;
+  for (NameId id = NAME_NONE + 1; id < table->size; id++) {
+    uint32_t slot = table->hashes[id] & mask;
+    while (slots[slot] != NAME_NONE)
+      slot = (slot + 1) & mask;
+    slots[slot] = id;
+  }
+
+  table->slots = slots;
+  table->slot_count = slot_count;
+  return true;
+}
+
+static bool intern_reserve(InternTable *table, uint32_t capacity) {
+  table->names = allocator_realloc(&table->allocator, table->names,
+                                   table->capacity * sizeof(*table->names),
+                                   capacity * sizeof(*table->names));
+  table->hashes = allocator_realloc(&table->allocator, table->hashes,
+                                    table->capacity * sizeof(*table->hashes),
+                                    capacity * sizeof(*table->hashes));
+  if (table->names == NULL || table->hashes == NULL) {
+    slog_error("Failed to resize intern table");
+    return false;
+  }
+
+  table->capacity = capacity;
+  return true;
+}
+
+InternTable InternTable_new(uint32_t capacity) {
+  InternTable table = {0};
+  allocator_init(&table.allocator, "InternTable");
+
+  if (capacity < 8)
+    capacity = 8;
+
+  // Keep the load factor of the slots under one half
+  uint32_t slot_count = 16;
+  while (slot_count < capacity * 2)
+    slot_count *= 2;
+
+  if (!intern_reserve(&table, capacity) ||
+      !intern_rehash(&table, slot_count)) {
+    slog_error("Could not allocate memory for intern table");
+    return table;
+  }
+
+  table.names[NAME_NONE] = NULL;
+  table.hashes[NAME_NONE] = 0;
+  table.size = 1;
+  return table;
+}
+
+NameId InternTable_intern(InternTable *table, const char *text, size_t length) {
+  uint32_t hash = intern_hash(text, length);
+  uint32_t slot = intern_probe(table, text, length, hash);
+  if (table->slots[slot] != NAME_NONE)
+    return table->slots[slot];
+
+  if (table->size == table->capacity &&
+      !intern_reserve(table, table->capacity * 2)) {
+    return NAME_NONE;
+  }
+
+  char *name = allocator_alloc(&table->allocator, length + 1);
+  if (name == NULL) {
+    slog_error("Failed to allocate memory for interned name");
+    return NAME_NONE;
+  }
+  memcpy(name, text, length);
+  name[length] = '\0';
+
+  NameId id = table->size++;
+  table->names[id] = name;
+  table->hashes[id] = hash;
+  table->slots[slot] = id;
+
+  if (table->size * 2 > table->slot_count)
+    intern_rehash(table, table->slot_count * 2);
+
+  return id;
+}
+
+NameId InternTable_find(const InternTable *table, const char *text,
+                        size_t length) {
+  if (table->slots == NULL)
+    return NAME_NONE;
+
+  uint32_t slot = intern_probe(table, text, length, intern_hash(text, length));
+  return table->slots[slot];
+}
+
+void InternTable_free(InternTable *table) {
+  allocator_free(&table->allocator);
+  *table = (InternTable){0};
+}
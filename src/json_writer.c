@@ -0,0 +1,295 @@
+#include "json_writer.h"
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+
+#define JSON_FILE_BUFFER 65536
+#define JSON_STRING_BUFFER 1024
+
+static const char json_tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
+static JsonWriter json_writer_new(FILE *file, bool compact, size_t capacity) {
+  JsonWriter json = {.file = file, .compact = compact, .first = true};
+  json.buffer = malloc(capacity);
+  if (json.buffer == NULL) {
+    slog_error("Failed to allocate the JSON output buffer");
+    json.failed = true;
+    return json;
+  }
+  json.capacity = capacity;
+  return json;
+}
+
+JsonWriter json_writer_file(FILE *file, bool compact) {
+  return json_writer_new(file, compact, JSON_FILE_BUFFER);
+}
+
+JsonWriter json_writer_string(bool compact) {
+  return json_writer_new(NULL, compact, JSON_STRING_BUFFER);
+}
+
+static void json_drain(JsonWriter *json) {
+  if (json->size > 0 && !json->failed &&
+      fwrite(json->buffer, 1, json->size, json->file) != json->size) {
+    slog_error("Failed to write JSON output: %s", strerror(errno));
+    json->failed = true;
+  }
+  json->size = 0;
+}
+
+bool json_writer_flush(JsonWriter *json) {
+  if (json->file == NULL)
+    return !json->failed;
+
+  json_drain(json);
+  if (fflush(json->file) != 0 && !json->failed) {
+    slog_error("Failed to write JSON output: %s", strerror(errno));
+    json->failed = true;
+  }
+  return !json->failed;
+}
+
+bool json_writer_finish(JsonWriter *json) {
+  bool written = json_writer_flush(json);
+  json_writer_free(json);
+  return written;
+}
+
+char *json_writer_take(JsonWriter *json) {
+  ASSERT(json->file == NULL, "Only string writers hold their text");
+  if (json->failed) {
+    json_writer_free(json);
+    return NULL;
+  }
+
+  // There is always room for the terminator, see json_write()
+  char *text = json->buffer;
+  text[json->size] = '\0';
+  *json = (JsonWriter){0};
+  return text;
+}
+
+void json_writer_free(JsonWriter *json) {
+  free(json->buffer);
+  *json = (JsonWriter){0};
+}
+
+static void json_write(JsonWriter *json, const char *text, size_t length) {
+  if (json->failed)
+    return;
+
+  if (json->file != NULL) {
+    if (json->size + length > json->capacity) {
+      json_drain(json);
+      // Too long to be worth buffering
+      if (length > json->capacity) {
+        if (fwrite(text, 1, length, json->file) != length) {
+          slog_error("Failed to write JSON output: %s", strerror(errno));
+          json->failed = true;
+        }
+        return;
+      }
+    }
+  } else if (json->size + length + 1 > json->capacity) {
+    size_t capacity = json->capacity * 2;
+    while (json->size + length + 1 > capacity)
+      capacity *= 2;
+    char *grown = realloc(json->buffer, capacity);
+    if (grown == NULL) {
+      slog_error("Failed to grow the JSON output buffer");
+      json->failed = true;
+      return;
+    }
+    json->buffer = grown;
+    json->capacity = capacity;
+  }
+
+  memcpy(json->buffer + json->size, text, length);
+  json->size += length;
+}
+
+static void json_write_tabs(JsonWriter *json, uint32_t count) {
+  while (count > 0) {
+    uint32_t chunk = count < sizeof(json_tabs) - 1 ? count
+                                                   : sizeof(json_tabs) - 1;
+    json_write(json, json_tabs, chunk);
+    count -= chunk;
+  }
+}
+
+// Separates a value from the previous array element, objects separate at
+// their keys
+static void json_value_begin(JsonWriter *json) {
+  if (json->after_key) {
+    json->after_key = false;
+  } else if (!json->first) {
+    json_write(json, json->compact ? "," : ", ", json->compact ? 1 : 2);
+  }
+  json->first = false;
+}
+
+static void json_write_string(JsonWriter *json, const char *value,
+                              size_t length) {
+  json_write(json, "\"", 1);
+  const char *run = value;
+  const char *end = value + length;
+  for (const char *c = value; c < end; c++) {
+    unsigned char ch = (unsigned char)*c;
+    if (ch >= 0x20 && ch != '"' && ch != '\\')
+      continue;
+
+    json_write(json, run, (size_t)(c - run));
+    run = c + 1;
+    char escape[8];
+    switch (ch) {
+    case '"':
+      json_write(json, "\\\"", 2);
+      break;
+    case '\\':
+      json_write(json, "\\\\", 2);
+      break;
+    case '\b':
+      json_write(json, "\\b", 2);
+      break;
+    case '\f':
+      json_write(json, "\\f", 2);
+      break;
+    case '\n':
+      json_write(json, "\\n", 2);
+      break;
+    case '\r':
+      json_write(json, "\\r", 2);
+      break;
+    case '\t':
+      json_write(json, "\\t", 2);
+      break;
+    default:
+      snprintf(escape, sizeof(escape), "\\u%04x", ch);
+      json_write(json, escape, 6);
+      break;
+    }
+  }
+  json_write(json, run, (size_t)(end - run));
+  json_write(json, "\"", 1);
+}
+
+void json_begin_object(JsonWriter *json) {
+  json_value_begin(json);
+  json_write(json, json->compact ? "{" : "{\n", json->compact ? 1 : 2);
+  json->depth++;
+  json->first = true;
+}
+
+void json_end_object(JsonWriter *json) {
+  ASSERT(json->depth > 0, "Unbalanced JSON object");
+  if (!json->compact) {
+    if (!json->first)
+      json_write(json, "\n", 1);
+    json_write_tabs(json, json->depth - 1);
+  }
+  json_write(json, "}", 1);
+  json->depth--;
+  json->first = false;
+}
+
+void json_begin_array(JsonWriter *json) {
+  json_value_begin(json);
+  json_write(json, "[", 1);
+  json->depth++;
+  json->first = true;
+}
+
+void json_end_array(JsonWriter *json) {
+  ASSERT(json->depth > 0, "Unbalanced JSON array");
+  json_write(json, "]", 1);
+  json->depth--;
+  json->first = false;
+}
+
+void json_key(JsonWriter *json, const char *key) {
+  if (!json->first)
+    json_write(json, json->compact ? "," : ",\n", json->compact ? 1 : 2);
+  json_write_tabs(json, json->compact ? 0 : json->depth);
+  json_write_string(json, key, strlen(key));
+  json_write(json, json->compact ? ":" : ":\t", json->compact ? 1 : 2);
+  json->first = false;
+  json->after_key = true;
+}
+
+void json_string(JsonWriter *json, const char *value) {
+  json_string_n(json, value, value != NULL ? strlen(value) : 0);
+}
+
+void json_string_n(JsonWriter *json, const char *value, size_t length) {
+  json_value_begin(json);
+  json_write_string(json, value != NULL ? value : "", length);
+}
+
+// The int cJSON keeps next to every number
+static int json_saturate(double value) {
+  if (value >= INT_MAX)
+    return INT_MAX;
+  if (value <= INT_MIN)
+    return INT_MIN;
+  return (int)value;
+}
+
+void json_number(JsonWriter *json, double value) {
+  json_value_begin(json);
+  char number[32];
+  int length;
+  // Same digits as cJSON: integers plainly, otherwise the shortest of 15 or
+  // 17 significant digits that reads back the same
+  if (isnan(value) || isinf(value)) {
+    length = snprintf(number, sizeof(number), "null");
+  } else if (value == (double)json_saturate(value)) {
+    length = snprintf(number, sizeof(number), "%d", json_saturate(value));
+  } else {
+    length = snprintf(number, sizeof(number), "%1.15g", value);
+    double test = strtod(number, NULL);
+    double scale = fabs(test) > fabs(value) ? fabs(test) : fabs(value);
+    if (fabs(test - value) > scale * DBL_EPSILON)
+      length = snprintf(number, sizeof(number), "%1.17g", value);
+  }
+  json_write(json, number, (size_t)length);
+}
+
+void json_bool(JsonWriter *json, bool value) {
+  json_value_begin(json);
+  json_write(json, value ? "true" : "false", value ? 4 : 5);
+}
+
+void json_null(JsonWriter *json) {
+  json_value_begin(json);
+  json_write(json, "null", 4);
+}
+
+void json_field_string(JsonWriter *json, const char *key, const char *value) {
+  if (value == NULL)
+    return;
+  json_key(json, key);
+  json_string(json, value);
+}
+
+void json_field_string_n(JsonWriter *json, const char *key, const char *value,
+                         size_t length) {
+  if (value == NULL)
+    return;
+  json_key(json, key);
+  json_string_n(json, value, length);
+}
+
+void json_field_number(JsonWriter *json, const char *key, double value) {
+  json_key(json, key);
+  json_number(json, value);
+}
+
+void json_field_bool(JsonWriter *json, const char *key, bool value) {
+  json_key(json, key);
+  json_bool(json, value);
+}
+
+void json_field_null(JsonWriter *json, const char *key) {
+  json_key(json, key);
+  json_null(json);
+}
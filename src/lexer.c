@@ -1,39 +1,354 @@
 #include "lexer.h"
-#define NUM_KEYWORDS 37
-#define LEX_CAP 32
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+// Character classes driving the scanner. Every operator character gets its own
+// class so the operator state machine can be indexed by class directly.
+typedef enum CharClass {
+  CC_OTHER = 0,
+  CC_SPACE,
+  CC_NEWLINE,
+  CC_COMMENT,
+  CC_DIGIT,
+  CC_IDENT,
+  CC_QUOTE,
+  CC_LPAR,
+  CC_RPAR,
+  CC_COMMA,
+  CC_COLON,
+  CC_LSQB,
+  CC_RSQB,
+  CC_PLUS,
+  CC_MINUS,
+  CC_STAR,
+  CC_SLASH,
+  CC_PERCENT,
+  CC_GT,
+  CC_LT,
+  CC_BANG,
+  CC_EQ,
+  CC_AMP,
+  CC_PIPE,
+  CC_CARET,
+  CC_TILDE,
+  CC_DOT,
+  CC_COUNT
+} CharClass;
+
+#define CC_FIRST_OPERATOR CC_PLUS
+
+#define CHAR_CLASS_OF(c)                                                       \
+  ((c) == ' ' || (c) == '\t'                               ? CC_SPACE          \
+   : (c) == '\n'                                           ? CC_NEWLINE        \
+   : (c) == '#'                                            ? CC_COMMENT        \
+   : ((c) >= '0' && (c) <= '9')                            ? CC_DIGIT          \
+   : ((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') || (c) == '_'   \
+       ? CC_IDENT                                                              \
+   : (c) == '\'' || (c) == '"' ? CC_QUOTE                                      \
+   : (c) == '('                ? CC_LPAR                                       \
+   : (c) == ')'                ? CC_RPAR                                       \
+   : (c) == ','                ? CC_COMMA                                      \
+   : (c) == ':'                ? CC_COLON                                      \
+   : (c) == '['                ? CC_LSQB                                       \
+   : (c) == ']'                ? CC_RSQB                                       \
+   : (c) == '+'                ? CC_PLUS                                       \
+   : (c) == '-'                ? CC_MINUS                                      \
+   : (c) == '*'                ? CC_STAR                                       \
+   : (c) == '/'                ? CC_SLASH                                      \
+   : (c) == '%'                ? CC_PERCENT                                    \
+   : (c) == '>'                ? CC_GT                                         \
+   : (c) == '<'                ? CC_LT                                         \
+   : (c) == '!'                ? CC_BANG                                       \
+   : (c) == '='                ? CC_EQ                                         \
+   : (c) == '&'                ? CC_AMP                                        \
+   : (c) == '|'                ? CC_PIPE                                       \
+   : (c) == '^'                ? CC_CARET                                      \
+   : (c) == '~'                ? CC_TILDE                                      \
+   : (c) == '.'                ? CC_DOT                                        \
+                               : CC_OTHER)
+
+#define CHAR_CLASS_4(c)                                                        \
+  CHAR_CLASS_OF(c), CHAR_CLASS_OF((c) + 1), CHAR_CLASS_OF((c) + 2),            \
+      CHAR_CLASS_OF((c) + 3)
+#define CHAR_CLASS_16(c)                                                       \
+  CHAR_CLASS_4(c), CHAR_CLASS_4((c) + 4), CHAR_CLASS_4((c) + 8),               \
+      CHAR_CLASS_4((c) + 12)
+#define CHAR_CLASS_64(c)                                                       \
+  CHAR_CLASS_16(c), CHAR_CLASS_16((c) + 16), CHAR_CLASS_16((c) + 32),          \
+      CHAR_CLASS_16((c) + 48)
+
+static const uint8_t CHAR_CLASS[256] = {CHAR_CLASS_64(0), CHAR_CLASS_64(64),
+                                        CHAR_CLASS_64(128),
+                                        CHAR_CLASS_64(192)};
+
+static inline CharClass char_class(char c) {
+  return (CharClass)CHAR_CLASS[(unsigned char)c];
+}
 
-const char *PYTHON_KEYWORD[NUM_KEYWORDS] = {
-    "False",  "None",   "True",    "and",      "as",       "assert", "async",
-    "await",  "break",  "class",   "continue", "def",      "del",    "elif",
-    "else",   "except", "finally", "for",      "from",     "global", "if",
-    "import", "in",     "is",      "lambda",   "nonlocal", "not",    "or",
-    "pass",   "raise",  "return",  "try",      "while",    "with",   "yield",
-    "match",  "case"};
+// Operator recognizer. Each state is the operator read so far, named by its
+// sub-kind, and every state but SUB_NONE is accepting: scanning runs until
+// there is no transition and the state reached is the token's sub-kind.
+enum { OP_START = OP_LAST + 1, OP_STATE_COUNT };
+
+static const uint8_t OPERATOR_DFA[OP_STATE_COUNT][CC_COUNT] = {
+    [OP_START] = {[CC_PLUS] = OP_PLUS,
+                  [CC_MINUS] = OP_MINUS,
+                  [CC_STAR] = OP_STAR,
+                  [CC_SLASH] = OP_SLASH,
+                  [CC_PERCENT] = OP_PERCENT,
+                  [CC_GT] = OP_GT,
+                  [CC_LT] = OP_LT,
+                  [CC_BANG] = OP_BANG,
+                  [CC_EQ] = OP_EQ,
+                  [CC_AMP] = OP_AMP,
+                  [CC_PIPE] = OP_PIPE,
+                  [CC_CARET] = OP_CARET,
+                  [CC_TILDE] = OP_TILDE,
+                  [CC_DOT] = OP_DOT},
+    [OP_PLUS] = {[CC_EQ] = OP_PLUS_EQ},
+    [OP_MINUS] = {[CC_EQ] = OP_MINUS_EQ, [CC_GT] = OP_ARROW},
+    [OP_STAR] = {[CC_STAR] = OP_STAR_STAR, [CC_EQ] = OP_STAR_EQ},
+    [OP_STAR_STAR] = {[CC_EQ] = OP_STAR_STAR_EQ},
+    [OP_SLASH] = {[CC_SLASH] = OP_SLASH_SLASH, [CC_EQ] = OP_SLASH_EQ},
+    [OP_SLASH_SLASH] = {[CC_EQ] = OP_SLASH_SLASH_EQ},
+    [OP_PERCENT] = {[CC_EQ] = OP_PERCENT_EQ},
+    [OP_GT] = {[CC_GT] = OP_GT_GT, [CC_EQ] = OP_GT_EQ},
+    [OP_LT] = {[CC_LT] = OP_LT_LT, [CC_EQ] = OP_LT_EQ},
+    [OP_BANG] = {[CC_EQ] = OP_BANG_EQ},
+    [OP_EQ] = {[CC_EQ] = OP_EQ_EQ},
+    [OP_AMP] = {[CC_AMP] = OP_AMP_AMP},
+    [OP_PIPE] = {[CC_PIPE] = OP_PIPE_PIPE},
+};
+
+// Returns the sub-kind of the longest operator `text` starts with and stores
+// its length
+static TokenSubkind match_operator(const char *text, size_t *length) {
+  uint8_t state = OP_START;
+  uint8_t next = SUB_NONE;
+  size_t i = 0;
+  while ((next = OPERATOR_DFA[state][char_class(text[i])]) != SUB_NONE) {
+    state = next;
+    i++;
+  }
 
-const char OPERATORS[] = {'+', '-', '*', '/', '%', '>', '<',
-                          '!', '=', '&', '|', '^', '~', '.'};
+  *length = i;
+  return i > 0 ? (TokenSubkind)state : SUB_NONE;
+}
 
-const char *EXTENDED_OPERATORS[] = {
-    "//", "==", "!=", "**", ">=",  "<=",  "&&", "||", "+=",
-    "-=", "*=", "/=", "%=", "//=", "**=", "<<", ">>"};
+// Perfect hash over the Python keywords, keyed on the first and last
+// character and the length. The slots are computed by the compiler; two
+// keywords landing on the same slot fail the build (-Woverride-init).
+#define KEYWORD_SLOT(first, last, length)                                      \
+  (((unsigned)(unsigned char)(first) + 11u * (unsigned char)(last) +           \
+    (unsigned)(length)) &                                                      \
+   127u)
+
+#define KEYWORD(first, last, text, subkind)                                    \
+  [KEYWORD_SLOT(first, last, sizeof(text) - 1)] = {text, subkind}
+
+typedef struct Keyword {
+  const char *text;
+  TokenSubkind subkind;
+} Keyword;
+
+static const Keyword KEYWORD_TABLE[128] = {
+    KEYWORD('F', 'e', "False", KW_FALSE),
+    KEYWORD('N', 'e', "None", KW_NONE),
+    KEYWORD('T', 'e', "True", KW_TRUE),
+    KEYWORD('a', 'd', "and", KW_AND),
+    KEYWORD('a', 's', "as", KW_AS),
+    KEYWORD('a', 't', "assert", KW_ASSERT),
+    KEYWORD('a', 'c', "async", KW_ASYNC),
+    KEYWORD('a', 't', "await", KW_AWAIT),
+    KEYWORD('b', 'k', "break", KW_BREAK),
+    KEYWORD('c', 's', "class", KW_CLASS),
+    KEYWORD('c', 'e', "continue", KW_CONTINUE),
+    KEYWORD('d', 'f', "def", KW_DEF),
+    KEYWORD('d', 'l', "del", KW_DEL),
+    KEYWORD('e', 'f', "elif", KW_ELIF),
+    KEYWORD('e', 'e', "else", KW_ELSE),
+    KEYWORD('e', 't', "except", KW_EXCEPT),
+    KEYWORD('f', 'y', "finally", KW_FINALLY),
+    KEYWORD('f', 'r', "for", KW_FOR),
+    KEYWORD('f', 'm', "from", KW_FROM),
+    KEYWORD('g', 'l', "global", KW_GLOBAL),
+    KEYWORD('i', 'f', "if", KW_IF),
+    KEYWORD('i', 't', "import", KW_IMPORT),
+    KEYWORD('i', 'n', "in", KW_IN),
+    KEYWORD('i', 's', "is", KW_IS),
+    KEYWORD('l', 'a', "lambda", KW_LAMBDA),
+    KEYWORD('n', 'l', "nonlocal", KW_NONLOCAL),
+    KEYWORD('n', 't', "not", KW_NOT),
+    KEYWORD('o', 'r', "or", KW_OR),
+    KEYWORD('p', 's', "pass", KW_PASS),
+    KEYWORD('r', 'e', "raise", KW_RAISE),
+    KEYWORD('r', 'n', "return", KW_RETURN),
+    KEYWORD('t', 'y', "try", KW_TRY),
+    KEYWORD('w', 'e', "while", KW_WHILE),
+    KEYWORD('w', 'h', "with", KW_WITH),
+    KEYWORD('y', 'd', "yield", KW_YIELD),
+    KEYWORD('m', 'h', "match", KW_MATCH),
+    KEYWORD('c', 'e', "case", KW_CASE),
+};
+
+// Sub-kinds of the single character tokens, by token type
+static const uint8_t DELIMITER_SUBKIND[ENDMARKER + 1] = {
+    [COMMA] = OP_COMMA, [COLON] = OP_COLON, [LPAR] = OP_LPAR,
+    [RPAR] = OP_RPAR,   [LSQB] = OP_LSQB,   [RSQB] = OP_RSQB,
+};
+
+// Sub-kind of the keyword spelled by `lexeme`, SUB_NONE for other names
+static TokenSubkind keyword_subkind(const char *lexeme, size_t length) {
+  const Keyword *keyword =
+      &KEYWORD_TABLE[KEYWORD_SLOT(lexeme[0], lexeme[length - 1], length)];
+  if (keyword->text != NULL && strncmp(lexeme, keyword->text, length) == 0 &&
+      keyword->text[length] == '\0')
+    return keyword->subkind;
+  return SUB_NONE;
+}
 
-const char DELIMITERS[] = {'(', ')', '{', '}', ',', ';', '.', ':', '`'};
+static TokenIndex token_new(Lexer *lexer, TokenType type,
+                            TokenSubkind subkind, size_t start);
 
-Token *create_token_from_char(Lexer *lexer, char character, TokenType type);
+// Longest float lexeme decoded without a heap copy
+#define NUMBER_BUFFER_SIZE 64
 
-Token *create_operator_token(Lexer *lexer, const char *matchedOperator);
+// Decodes the text of a NUMBER token. `_` separators are skipped and a dot
+// makes it a float.
+static TokenValue decode_number(const char *text, size_t length) {
+  TokenValue value = {.kind = VALUE_INT};
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] == '_')
+      continue;
+    if (text[i] == '.') {
+      value.kind = VALUE_FLOAT;
+      break;
+    }
 
-Token *create_EOF_token(Lexer *lexer);
+    int64_t digit = text[i] - '0';
+    if (value.overflow || value.int_val > (INT64_MAX - digit) / 10) {
+      value.overflow = true;
+      value.int_val = INT64_MAX;
+    } else {
+      value.int_val = value.int_val * 10 + digit;
+    }
+  }
 
-Token *create_number_token(Lexer *lexer, char character);
+  if (value.kind == VALUE_INT)
+    return value;
 
-Token *create_string_token(Lexer *lexer, char character);
+  // strtod needs the digits alone and NUL-terminated
+  char buffer[NUMBER_BUFFER_SIZE];
+  char *digits = length < sizeof(buffer) ? buffer : malloc(length + 1);
+  if (digits == NULL) {
+    slog_error("Failed to allocate memory for number literal");
+    return (TokenValue){.kind = VALUE_FLOAT};
+  }
 
-Token *create_keyword_token(Lexer *lexer, char character);
+  size_t count = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] != '_')
+      digits[count++] = text[i];
+  }
+  digits[count] = '\0';
+  value = (TokenValue){.kind = VALUE_FLOAT, .float_val = strtod(digits, NULL)};
 
-Token *create_newline_token(Lexer *lexer);
+  if (digits != buffer)
+    free(digits);
+  return value;
+}
 
-Token *create_token_from_str(Lexer *lexer, char *lexeme, TokenType type);
+// Character an escape sequence stands for, -1 when `c` does not start one
+static int escape_char(char c) {
+  switch (c) {
+  case 'n':
+    return '\n';
+  case 't':
+    return '\t';
+  case 'r':
+    return '\r';
+  case '0':
+    return '\0';
+  case 'a':
+    return '\a';
+  case 'b':
+    return '\b';
+  case 'f':
+    return '\f';
+  case 'v':
+    return '\v';
+  case '\\':
+  case '\'':
+  case '"':
+    return c;
+  default:
+    return -1;
+  }
+}
+
+// Decodes the text between the quotes of a STRING token into `decoded`,
+// which must hold `length` bytes. Unknown escapes are kept verbatim, as
+// Python does.
+static TokenValue decode_string(const char *text, size_t length,
+                                char *decoded) {
+  size_t count = 0;
+  for (size_t i = 0; i < length; i++) {
+    char c = text[i];
+    if (c == '\\' && i + 1 < length && escape_char(text[i + 1]) != -1)
+      c = (char)escape_char(text[++i]);
+    decoded[count++] = c;
+  }
+
+  return (TokenValue){
+      .kind = VALUE_STR, .str_val = decoded, .length = (uint32_t)count};
+}
+
+// Decodes the literal held by `token` and attaches it. `text` is in the
+// source unless the token is synthetic.
+static void token_decode(Lexer *lexer, TokenIndex token, const char *text,
+                         size_t length, bool in_source) {
+  if (token == TOKEN_NONE)
+    return;
+
+  if (token_type(lexer, token) == NUMBER) {
+    TokenStream_set_value(&lexer->tokens, token, decode_number(text, length));
+    return;
+  }
+
+  // Escape-free strings, the common case, decode to their own text and are
+  // not copied: the value only records their length
+  if (in_source && memchr(text, '\\', length) == NULL) {
+    TokenValue value = {
+        .kind = VALUE_STR, .str_val = NULL, .length = (uint32_t)length};
+    TokenStream_set_value(&lexer->tokens, token, value);
+    return;
+  }
+
+  char *decoded = malloc(length);
+  if (decoded == NULL) {
+    slog_error("Failed to allocate memory for string literal");
+    return;
+  }
+  TokenStream_set_value(&lexer->tokens, token,
+                        decode_string(text, length, decoded));
+  free(decoded);
+}
+
+TokenIndex create_token_from_char(Lexer *lexer, char character,
+                                  TokenType type);
+
+TokenIndex create_operator_token(Lexer *lexer);
+
+TokenIndex create_EOF_token(Lexer *lexer);
+
+TokenIndex create_number_token(Lexer *lexer, char character);
+
+TokenIndex create_string_token(Lexer *lexer, char character);
+
+TokenIndex create_keyword_token(Lexer *lexer, char character);
+
+TokenIndex create_newline_token(Lexer *lexer);
 
 const char *token_type_to_string(TokenType type) {
   switch (type) {
@@ -70,431 +385,747 @@ const char *token_type_to_string(TokenType type) {
   }
 }
 
-cJSON *serialize_token(Token *token) {
-  cJSON *root = cJSON_CreateObject();
-  cJSON_AddStringToObject(root, "type", token_type_to_string(token->type));
-  cJSON_AddStringToObject(root, "lexeme", token->lexeme);
-  cJSON_AddNumberToObject(root, "line", token->line);
-  cJSON_AddNumberToObject(root, "col", token->col);
-  cJSON_AddNumberToObject(root, "ident", token->ident);
-  return root;
+void serialize_token(JsonWriter *json, Lexer *lexer, TokenIndex token) {
+  json_begin_object(json);
+  json_field_string(json, "type",
+                    token_type_to_string(token_type(lexer, token)));
+  json_field_string(json, "lexeme", token_lexeme(lexer, token));
+  json_field_number(json, "line", token_line(lexer, token));
+  json_field_number(json, "col", token_col(lexer, token));
+  json_field_number(json, "ident", token_ident(lexer, token));
+  json_end_object(json);
 }
 
 Lexer lexer_new(const char *source, const char *filename) {
   size_t len = strlen(source);
-  return (Lexer){.source = source,
+  Lexer lexer = {.source = source,
                  .filename = filename,
                  .position = 0,
-                 .token_idx = 0,
+                 .token_idx = TOKEN_NONE + 1,
+                 .token_end = TOKEN_NONE + 1,
                  .source_length = len,
-                 .tokens = Token_new(100)};
+                 .tokens = TokenStream_new(100),
+                 .scan = scan_kernels()};
+  // Looking at the "no token" slot behaves like reaching the end of input
+  lexer.tokens.kinds[TOKEN_NONE] = ENDMARKER;
+  return lexer;
 }
 
-Lexer tokenize(const char *source, const char *filename) {
-  ASSERT(source != NULL, "Source file was not provided");
-  Lexer lexer = lexer_new(source, filename);
-  size_t line = 1;
-  size_t column = 1;
+// Lets lex_source() stop at the first line starting at or past `from`. With
+// `old` tokens, only once that line also started a line there, `delta` bytes
+// earlier: from then on both lex the same.
+typedef struct LexStop {
+  size_t from;
+  const TokenStream *old;
+  int64_t delta;
+} LexStop;
+
+static bool lex_should_stop(const LexStop *stop, size_t position) {
+  if (stop == NULL || position < stop->from)
+    return false;
+  if (stop->old == NULL)
+    return true;
+
+  uint32_t offset = (uint32_t)((int64_t)position - stop->delta);
+  uint32_t line = TokenStream_line_of(stop->old, offset);
+  return stop->old->line_starts[line - 1] == offset;
+}
+
+// Lexes lexer->source from lexer->position up to lexer->source_length, or
+// until `stop` says so at a line start, which returns true
+static bool lex_source(Lexer *lexer, const LexStop *stop) {
   size_t ident = 0;
   bool at_line_start = true;
 
-  while (lexer.position < lexer.source_length) {
-    char character = lexer.source[lexer.position];
-    size_t token_start_col = column;
+  while (lexer->position < lexer->source_length) {
+    char character = lexer->source[lexer->position];
     size_t spaces = 0;
 
     if (at_line_start) {
-      while (character == ' ' || character == '\t') {
-        if (character == ' ')
-          spaces++;
-        else
-          spaces += 4;
-
-        lexer.position++;
-        character = lexer.source[lexer.position];
-      }
+      lexer->position = lexer->scan->blank_end(
+          lexer->source, lexer->position, lexer->source_length, &spaces);
+      character = lexer->source[lexer->position];
 
       ident = spaces / 2;
-      column = spaces + 1;
       at_line_start = false;
     }
 
-    if (character == ' ' || character == '\t') {
-      if (character == ' ') {
-        column++;
-      } else {
-        column += 4;
-      }
-      lexer.position++;
-      continue;
-    }
+    TokenIndex token = TOKEN_NONE;
 
-    if (character == '#') {
-      while (lexer.position + 1 < lexer.source_length &&
-             lexer.source[lexer.position + 1] != '\n') {
-        lexer.position++;
-      }
-
-      if (lexer.position + 1 < lexer.source_length) {
-        lexer.position++;
-      }
+    switch (char_class(character)) {
+    case CC_SPACE:
+      lexer->position = lexer->scan->blank_end(
+          lexer->source, lexer->position, lexer->source_length, &spaces);
+      continue;
+    case CC_COMMENT:
+      // Skip past the newline ending the comment, if any
+      lexer->position = lexer->scan->find_byte(
+          lexer->source, lexer->position + 1, lexer->source_length, '\n');
+      if (lexer->position == lexer->source_length)
+        continue;
 
-      line++;
-      column = 1;
+      lexer->position++;
+      TokenStream_add_line(&lexer->tokens, (uint32_t)lexer->position);
+      if (lex_should_stop(stop, lexer->position))
+        return true;
       at_line_start = true;
-      lexer.position++;
       continue;
+    case CC_NEWLINE:
+      token = create_newline_token(lexer);
+      lexer->tokens.idents[token] = (uint32_t)ident;
+      lexer->position++;
+      TokenStream_add_line(&lexer->tokens, (uint32_t)lexer->position);
+      if (lex_should_stop(stop, lexer->position))
+        return true;
+      at_line_start = true;
+      continue;
+    case CC_LPAR:
+      token = create_token_from_char(lexer, character, LPAR);
+      break;
+    case CC_RPAR:
+      token = create_token_from_char(lexer, character, RPAR);
+      break;
+    case CC_COMMA:
+      token = create_token_from_char(lexer, character, COMMA);
+      break;
+    case CC_COLON:
+      token = create_token_from_char(lexer, character, COLON);
+      break;
+    case CC_LSQB:
+      token = create_token_from_char(lexer, character, LSQB);
+      break;
+    case CC_RSQB:
+      token = create_token_from_char(lexer, character, RSQB);
+      break;
+    case CC_DIGIT:
+      token = create_number_token(lexer, character);
+      break;
+    case CC_QUOTE:
+      token = create_string_token(lexer, character);
+      break;
+    case CC_IDENT:
+      token = create_keyword_token(lexer, character);
+      break;
+    case CC_OTHER:
+      lexer->position++;
+      continue;
+    default:
+      ASSERT(char_class(character) >= CC_FIRST_OPERATOR,
+             "Unhandled character class");
+      token = create_operator_token(lexer);
+      break;
     }
 
-    Token *token = NULL;
+    lexer->tokens.idents[token] = (uint32_t)ident;
+  }
 
-    char next = lexer.source[lexer.position + 1];
-    if (character == '-' && next == '>') {
-      token = create_token_from_str(&lexer, "->", RARROW);
-    }
+  return false;
+}
 
-    const char *matched_operator = NULL;
-    for (size_t i = 0; i < ARRAYSIZE(OPERATORS); i++) {
-      if (character == OPERATORS[i]) {
-        matched_operator = &character;
-        break;
-      }
-    }
+static void lex_finish(Lexer *lexer) {
+  TokenIndex eof = create_EOF_token(lexer);
+  lexer->token_end = eof + 1;
+}
 
-    switch (character) {
-    case '(':
-      token = create_token_from_char(&lexer, character, LPAR);
-      break;
-    case ')':
-      token = create_token_from_char(&lexer, character, RPAR);
-      break;
-    case ',':
-      token = create_token_from_char(&lexer, character, COMMA);
-      break;
-    case ':':
-      token = create_token_from_char(&lexer, character, COLON);
+Lexer tokenize(const char *source, const char *filename) {
+  ASSERT(source != NULL, "Source file was not provided");
+  Lexer lexer = lexer_new(source, filename);
+  lex_source(&lexer, NULL);
+  lex_finish(&lexer);
+  return lexer;
+}
+
+// Chunks smaller than this are not worth a thread
+#define LEX_MIN_CHUNK_SIZE ((size_t)256 * 1024)
+#define LEX_MAX_JOBS 64
+
+// Picks up to `count` chunk starts, `splits[0]` being 0. A chunk may only start
+// right after a newline the lexer reads as a line break, never inside a string
+// or a comment, so each chunk can be lexed from a fresh line start.
+static size_t lex_split_source(const Lexer *lexer, size_t *splits,
+                               size_t count) {
+  const char *src = lexer->source;
+  size_t length = lexer->source_length;
+  size_t stride = length / count;
+  size_t chunks = 0;
+  splits[chunks++] = 0;
+
+  size_t pos = 0;
+  while (pos < length && chunks < count) {
+    switch (src[pos]) {
+    case '\'':
+    case '"':
+      pos = lexer->scan->find_byte(src, pos + 1, length, src[pos]) + 1;
       break;
-    case '[':
-      token = create_token_from_char(&lexer, character, LSQB);
+    case '#':
+      // The newline ending the comment is a safe split as well
+      pos = lexer->scan->find_byte(src, pos + 1, length, '\n');
       break;
-    case ']':
-      token = create_token_from_char(&lexer, character, RSQB);
+    case '\n':
+      pos++;
+      if (pos >= stride * chunks && pos < length)
+        splits[chunks++] = pos;
       break;
     default:
+      pos++;
       break;
     }
+  }
 
-    if (token != NULL) {
-      token->col = token_start_col;
-      token->line = line;
-      token->ident = ident;
-      column += 1;
-      Token_push(&lexer.tokens, token);
-      continue;
-    }
+  return chunks;
+}
 
-    if (matched_operator != NULL) {
-      // Build the operator lexeme
-      token = create_operator_token(&lexer, matched_operator);
-      token->col = token_start_col;
-      token->line = line;
-      token->ident = ident;
-      column += strlen(token->lexeme);
-      Token_push(&lexer.tokens, token);
-      continue;
-    }
+static void *lex_chunk(void *arg) {
+  lex_source(arg, NULL);
+  return NULL;
+}
 
-    if (isdigit(character)) {
-      token = create_number_token(&lexer, character);
-      token->col = token_start_col;
-      token->line = line;
-      token->ident = ident;
-      column += strlen(token->lexeme);
-      Token_push(&lexer.tokens, token);
-      continue;
-    }
+Lexer tokenize_parallel(const char *source, const char *filename, size_t jobs) {
+  ASSERT(source != NULL, "Source file was not provided");
+  Lexer lexer = lexer_new(source, filename);
 
-    if (character == '\'' || character == '\"') {
-      token = create_string_token(&lexer, character);
-      token->col = token_start_col;
-      token->line = line;
-      token->ident = ident;
-      column += strlen(token->lexeme) + 2; // account for quotes
-      Token_push(&lexer.tokens, token);
-      continue;
+  if (jobs == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = cpus > 0 ? (size_t)cpus : 1;
+  }
+  if (jobs > LEX_MAX_JOBS)
+    jobs = LEX_MAX_JOBS;
+  if (jobs > lexer.source_length / LEX_MIN_CHUNK_SIZE)
+    jobs = lexer.source_length / LEX_MIN_CHUNK_SIZE;
+
+  size_t splits[LEX_MAX_JOBS + 1];
+  size_t count = jobs > 1 ? lex_split_source(&lexer, splits, jobs) : 1;
+  if (count <= 1) {
+    lex_source(&lexer, NULL);
+    lex_finish(&lexer);
+    return lexer;
+  }
+  splits[count] = lexer.source_length;
+
+  Lexer chunks[LEX_MAX_JOBS];
+  pthread_t threads[LEX_MAX_JOBS];
+  bool started[LEX_MAX_JOBS] = {0};
+  for (size_t i = 0; i < count; i++) {
+    size_t size = splits[i + 1] - splits[i];
+    chunks[i] = (Lexer){.source = source,
+                        .filename = filename,
+                        .position = splits[i],
+                        .source_length = splits[i + 1],
+                        // Roughly one token every four bytes
+                        .tokens = TokenStream_new((uint32_t)(size / 4)),
+                        .scan = lexer.scan};
+  }
+
+  // The calling thread takes the first chunk
+  for (size_t i = 1; i < count; i++) {
+    started[i] = pthread_create(&threads[i], NULL, lex_chunk, &chunks[i]) == 0;
+    if (!started[i]) {
+      slog_warn("Could not start lexer thread, lexing chunk %zu inline", i);
+      lex_chunk(&chunks[i]);
     }
+  }
+  lex_chunk(&chunks[0]);
 
-    if (isalpha(character) || character == '_') {
-      token = create_keyword_token(&lexer, character);
-      token->col = token_start_col;
-      token->line = line;
-      token->ident = ident;
-      column += strlen(token->lexeme);
-      Token_push(&lexer.tokens, token);
-      continue;
+  // Stitch the chunks together, their lines following the previous ones
+  for (size_t i = 0; i < count; i++) {
+    if (started[i])
+      pthread_join(threads[i], NULL);
+
+    if (!TokenStream_append(&lexer.tokens, &chunks[i].tokens)) {
+      slog_error("Could not merge lexer chunk %zu", i);
     }
+    TokenStream_free(&chunks[i].tokens);
+  }
 
-    if (character == '\n') {
-      token = create_newline_token(&lexer);
-      token->ident = ident;
-      token->col = token_start_col;
-      token->line = line;
-      column = 1;
-      line++;
-      at_line_start = true;
-      Token_push(&lexer.tokens, token);
+  lexer.position = chunks[count - 1].position;
+  lex_finish(&lexer);
+  return lexer;
+}
+
+// First token in [low, high) whose offset is at least `offset`, or `high`
+static TokenIndex first_token_at(const TokenStream *tokens, TokenIndex low,
+                                 TokenIndex high, uint32_t offset) {
+  while (low < high) {
+    TokenIndex mid = low + (high - low) / 2;
+    if (tokens->offsets[mid] < offset)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+// Blocks are cut at the first line start past this many bytes
+#define LEX_STREAM_BLOCK ((size_t)64 * 1024)
+#define LEX_STREAM_SLOTS 4
+
+// Single producer, single consumer ring of lexed blocks. The lexer thread
+// fills the slot at `head` and the consumer empties the one at `tail`. Both
+// only sleep on `wake` when the ring is full or empty.
+typedef struct LexStream {
+  Lexer blocks[LEX_STREAM_SLOTS];
+  atomic_size_t head; // Blocks lexed, only advanced by the lexer thread
+  atomic_size_t tail; // Blocks taken, only advanced by the consumer
+  atomic_bool done;   // The last block has been lexed
+  atomic_uint waiting;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_t thread;
+  const char *source;
+  size_t source_length;
+  const ScanKernels *scan;
+} LexStream;
+
+static void lex_stream_signal(LexStream *stream) {
+  if (atomic_load(&stream->waiting) == 0)
+    return;
+
+  pthread_mutex_lock(&stream->lock);
+  pthread_cond_broadcast(&stream->wake);
+  pthread_mutex_unlock(&stream->lock);
+}
+
+static void *lex_stream_run(void *arg) {
+  LexStream *stream = arg;
+  size_t position = 0;
+  size_t head = 0;
+
+  while (position < stream->source_length) {
+    if (head - atomic_load(&stream->tail) == LEX_STREAM_SLOTS) {
+      pthread_mutex_lock(&stream->lock);
+      atomic_fetch_add(&stream->waiting, 1);
+      while (head - atomic_load(&stream->tail) == LEX_STREAM_SLOTS)
+        pthread_cond_wait(&stream->wake, &stream->lock);
+      atomic_fetch_sub(&stream->waiting, 1);
+      pthread_mutex_unlock(&stream->lock);
     }
 
-    lexer.position++;
+    // The consumer is done with whatever this slot held
+    Lexer *block = &stream->blocks[head % LEX_STREAM_SLOTS];
+    TokenStream_free(&block->tokens);
+    *block = (Lexer){.source = stream->source,
+                     .position = position,
+                     .source_length = stream->source_length,
+                     .tokens = TokenStream_new(LEX_STREAM_BLOCK / 4),
+                     .scan = stream->scan};
+    LexStop stop = {.from = position + LEX_STREAM_BLOCK};
+    lex_source(block, &stop);
+    position = block->position;
+
+    atomic_store(&stream->head, ++head);
+    lex_stream_signal(stream);
   }
 
-  Token *eof = create_EOF_token(&lexer);
-  eof->col = column;
-  eof->line = line;
-  eof->ident = 0;
-  Token_push(&lexer.tokens, eof);
-  return lexer;
+  atomic_store(&stream->done, true);
+  lex_stream_signal(stream);
+  return NULL;
 }
 
-Token *create_token_from_char(Lexer *lexer, char character, TokenType type) {
-  Token *token = allocator_alloc(&lexer->tokens.allocator, sizeof(Token));
-  if (token == NULL) {
-    slog_error("Could not allocate memory for token");
-    return NULL;
+static void lex_stream_free(Lexer *lexer) {
+  LexStream *stream = lexer->stream;
+  for (size_t i = 0; i < LEX_STREAM_SLOTS; i++) {
+    TokenStream_free(&stream->blocks[i].tokens);
   }
+  pthread_cond_destroy(&stream->wake);
+  pthread_mutex_destroy(&stream->lock);
+  free(stream);
+  lexer->stream = NULL;
+}
 
-  char *lexeme = allocator_alloc(&lexer->tokens.allocator, sizeof(char) * 2);
-  if (lexeme == NULL) {
-    slog_error("Failed to allocate memory for lexeme");
-    return NULL;
+Lexer tokenize_streaming(const char *source, const char *filename) {
+  ASSERT(source != NULL, "Source file was not provided");
+  Lexer lexer = lexer_new(source, filename);
+
+  LexStream *stream = calloc(1, sizeof(*stream));
+  if (stream == NULL) {
+    slog_warn("Could not allocate the lexer stream, lexing up front");
+    lex_source(&lexer, NULL);
+    lex_finish(&lexer);
+    return lexer;
   }
 
-  lexeme[0] = character;
-  lexeme[1] = '\0';
-  token->lexeme = lexeme;
-  token->type = type;
-  lexer->position++;
-  return token;
+  stream->source = source;
+  stream->source_length = lexer.source_length;
+  stream->scan = lexer.scan;
+  pthread_mutex_init(&stream->lock, NULL);
+  pthread_cond_init(&stream->wake, NULL);
+  lexer.stream = stream;
+
+  if (pthread_create(&stream->thread, NULL, lex_stream_run, stream) != 0) {
+    slog_warn("Could not start the lexer thread, lexing up front");
+    lex_stream_free(&lexer);
+    lex_source(&lexer, NULL);
+    lex_finish(&lexer);
+  }
+  return lexer;
 }
 
-Token *create_operator_token(Lexer *lexer, const char *matched_operator) {
-  size_t max_lexeme_length = 1;
-  for (size_t i = 0; i < ARRAYSIZE(EXTENDED_OPERATORS); i++) {
-    const char *operatorStr = EXTENDED_OPERATORS[i];
-    size_t operatorLength = strlen(operatorStr);
+void lexer_stream_pull(Lexer *lexer, TokenIndex token) {
+  LexStream *stream = lexer->stream;
+  while (stream != NULL && lexer->tokens.size <= token) {
+    size_t tail = atomic_load(&stream->tail);
+    if (atomic_load(&stream->head) == tail) {
+      if (atomic_load(&stream->done) && atomic_load(&stream->head) == tail) {
+        pthread_join(stream->thread, NULL);
+        lex_stream_free(lexer);
+        lex_finish(lexer);
+        return;
+      }
 
-    if (strncmp(&lexer->source[lexer->position], operatorStr, operatorLength) ==
-            0 &&
-        operatorLength > max_lexeme_length) {
-      max_lexeme_length = operatorLength;
-      matched_operator = operatorStr;
+      pthread_mutex_lock(&stream->lock);
+      atomic_fetch_add(&stream->waiting, 1);
+      while (atomic_load(&stream->head) == tail && !atomic_load(&stream->done))
+        pthread_cond_wait(&stream->wake, &stream->lock);
+      atomic_fetch_sub(&stream->waiting, 1);
+      pthread_mutex_unlock(&stream->lock);
+      continue;
     }
+
+    Lexer *block = &stream->blocks[tail % LEX_STREAM_SLOTS];
+    if (!TokenStream_append(&lexer->tokens, &block->tokens)) {
+      slog_error("Could not take lexed block %zu", tail);
+    }
+    lexer->position = block->position;
+    lexer->token_end = lexer->tokens.size;
+
+    atomic_store(&stream->tail, tail + 1);
+    lex_stream_signal(stream);
   }
+}
 
-  size_t lexeme_size = max_lexeme_length * sizeof(char) + 1;
-  char *lexeme = allocator_alloc(&lexer->tokens.allocator, lexeme_size);
-  if (lexeme == NULL) {
-    slog_error("Failed to allocate memory for lexeme");
-    return NULL;
+// Bytes holding the token in the source, quotes of strings included
+static size_t token_text_start(const TokenStream *tokens, TokenIndex token) {
+  return tokens->offsets[token] - (tokens->kinds[token] == STRING);
+}
+
+static size_t token_text_end(const TokenStream *tokens, TokenIndex token) {
+  return (size_t)tokens->offsets[token] + tokens->lengths[token] +
+         (tokens->kinds[token] == STRING);
+}
+
+// Whether token `b` of `other` is token `a` of `tokens` moved by `delta`
+static bool same_token(const TokenStream *tokens, TokenIndex a,
+                       const TokenStream *other, TokenIndex b, int64_t delta) {
+  return tokens->kinds[a] == other->kinds[b] &&
+         tokens->subkinds[a] == other->subkinds[b] &&
+         tokens->lengths[a] == other->lengths[b] &&
+         tokens->idents[a] == other->idents[b] &&
+         (int64_t)tokens->offsets[a] + delta == other->offsets[b];
+}
+
+TokenSplice retokenize(Lexer *lexer, const char *source, SourceEdit edit) {
+  TokenStream *tokens = &lexer->tokens;
+  int64_t delta = (int64_t)edit.new_length - (int64_t)edit.old_length;
+  TokenStream_truncate(tokens, lexer->token_end);
+
+  // Everything before the line holding the edit lexes the same
+  uint32_t line = TokenStream_line_of(tokens, (uint32_t)edit.start);
+  TokenSplice splice = {.line_from = tokens->line_starts[line - 1],
+                        .delta = delta};
+  splice.first = first_token_at(tokens, TOKEN_NONE + 1, lexer->token_end,
+                                splice.line_from);
+
+  Lexer scratch = {.source = source,
+                   .filename = lexer->filename,
+                   .position = splice.line_from,
+                   .source_length = (size_t)((int64_t)lexer->source_length +
+                                             delta),
+                   .tokens = TokenStream_new(64),
+                   .scan = lexer->scan};
+  LexStop resync = {.from = edit.start + edit.new_length,
+                    .old = tokens,
+                    .delta = delta};
+  if (lex_source(&scratch, &resync)) {
+    splice.line_to = (uint32_t)((int64_t)scratch.position - delta);
+  } else {
+    create_EOF_token(&scratch);
+    splice.line_to = UINT32_MAX;
   }
 
-  safe_memcpy(lexeme, max_lexeme_length * sizeof(char) + 1, matched_operator,
-              max_lexeme_length);
-  lexeme[max_lexeme_length] = '\0';
-  lexer->position += max_lexeme_length;
+  TokenIndex tail = first_token_at(tokens, splice.first, lexer->token_end,
+                                   splice.line_to);
+
+  // Tokens lexed again the same way as before the edit are kept
+  const TokenStream *fresh = &scratch.tokens;
+  TokenIndex from = TOKEN_NONE + 1;
+  TokenIndex to = fresh->size;
+  while (from < to && splice.first < tail &&
+         same_token(tokens, splice.first, fresh, from, 0) &&
+         token_text_end(tokens, splice.first) <= edit.start) {
+    from++;
+    splice.first++;
+  }
+  while (to > from && tail > splice.first &&
+         same_token(tokens, tail - 1, fresh, to - 1, delta) &&
+         token_text_start(tokens, tail - 1) >=
+             edit.start + edit.old_length) {
+    to--;
+    tail--;
+  }
 
-  Token *token = allocator_alloc(&lexer->tokens.allocator, sizeof(Token));
-  if (token == NULL) {
-    slog_error("Failed to allocate memory for token");
-    return NULL;
+  splice.removed = tail - splice.first;
+  splice.inserted = to - from;
+  if (!TokenStream_splice(tokens, &splice, fresh, from)) {
+    slog_error("Could not splice re-lexed tokens");
   }
+  TokenStream_free(&scratch.tokens);
+
+  lexer->source = source;
+  lexer->source_length = scratch.source_length;
+  lexer->position = scratch.source_length;
+  lexer->token_idx = TOKEN_NONE + 1;
+  lexer->token_end = tokens->size;
+  return splice;
+}
 
-  token->type = OPERATOR;
-  token->lexeme = lexeme;
+static TokenIndex token_new(Lexer *lexer, TokenType type,
+                            TokenSubkind subkind, size_t start) {
+  TokenIndex token = TokenStream_push(&lexer->tokens, (uint8_t)type,
+                                      (uint8_t)subkind, (uint32_t)start,
+                                      (uint32_t)(lexer->position - start));
+  if (token == TOKEN_NONE) {
+    slog_error("Could not allocate memory for token");
+  }
   return token;
 }
 
-Token *create_EOF_token(Lexer *lexer) {
-  Token *token = allocator_alloc(&lexer->tokens.allocator, sizeof(Token));
-  if (token == NULL) {
-    slog_error("Failed to allocate memory for EOF token");
-    return NULL;
-  }
+void token_locate(Lexer *lexer, TokenIndex token, size_t offset,
+                  size_t ident) {
+  lexer->tokens.offsets[token] = (uint32_t)offset;
+  lexer->tokens.idents[token] = (uint32_t)ident;
+}
 
-  token->type = ENDMARKER;
-  token->lexeme = arena_strdup(&lexer->tokens.allocator.base, "EOF");
-  return token;
+size_t token_line(const Lexer *lexer, TokenIndex token) {
+  uint32_t offset = lexer->tokens.offsets[token];
+  if (offset == OFFSET_NONE)
+    return 0;
+  return TokenStream_line_of(&lexer->tokens, offset);
 }
 
-Token *create_number_token(Lexer *lexer, char character) {
-  char *lexeme =
-      allocator_alloc(&lexer->tokens.allocator, LEX_CAP * sizeof(char));
-  if (lexeme == NULL) {
-    slog_error("Failed to allocate memory for lexeme");
-    return NULL;
+size_t token_col(const Lexer *lexer, TokenIndex token) {
+  const TokenStream *tokens = &lexer->tokens;
+  uint32_t offset = tokens->offsets[token];
+  if (offset == OFFSET_NONE)
+    return 0;
+
+  uint32_t line = TokenStream_line_of(tokens, offset);
+  // String lexemes start past the opening quote
+  if (tokens->kinds[token] == STRING)
+    offset--;
+  return offset - tokens->line_starts[line - 1] + 1;
+}
+
+const char *source_line(const Lexer *lexer, size_t line, size_t *length) {
+  const TokenStream *tokens = &lexer->tokens;
+  if (line == 0 || line > tokens->line_count) {
+    *length = 0;
+    return "";
   }
-  size_t lexeme_length = 0;
-  lexeme[lexeme_length++] = character;
-  lexer->position++;
+
+  uint32_t offset = tokens->line_starts[line - 1];
+  const char *start = &lexer->source[offset];
+  const char *end = memchr(start, '\n', lexer->source_length - offset);
+  *length = end ? (size_t)(end - start) : strlen(start);
+  return start;
+}
+
+TokenIndex create_token_from_char(Lexer *lexer, char character,
+                                  TokenType type) {
+  UNUSED(character);
+  size_t start = lexer->position++;
+  return token_new(lexer, type, (TokenSubkind)DELIMITER_SUBKIND[type], start);
+}
+
+TokenIndex create_operator_token(Lexer *lexer) {
+  size_t start = lexer->position;
+  size_t length = 0;
+  TokenSubkind subkind = match_operator(&lexer->source[start], &length);
+  lexer->position += length;
+
+  return token_new(lexer, subkind == OP_ARROW ? RARROW : OPERATOR, subkind,
+                   start);
+}
+
+TokenIndex create_EOF_token(Lexer *lexer) {
+  return token_new(lexer, ENDMARKER, SUB_NONE, lexer->position);
+}
+
+TokenIndex create_number_token(Lexer *lexer, char character) {
+  size_t start = lexer->position++;
 
 #ifdef __GNUC__
 #pragma GCC unroll 100
 #endif
   while (lexer->position < lexer->source_length) {
     character = lexer->source[lexer->position];
-    if (isdigit(character) || character == '_') {
-      lexeme[lexeme_length++] = character;
-      lexer->position++;
-    } else if (character == '.') {
-      lexeme[lexeme_length++] = character;
+    if (char_class(character) == CC_DIGIT || character == '_' ||
+        character == '.') {
       lexer->position++;
     } else {
       break;
     }
   }
-  lexeme[lexeme_length] = '\0';
-  Token *token = allocator_alloc(&lexer->tokens.allocator, sizeof(Token));
-  if (token == NULL) {
-    slog_error("Failed to allocate memory for token");
-    return NULL;
-  }
 
-  token->type = NUMBER;
-  token->lexeme = lexeme;
+  TokenIndex token = token_new(lexer, NUMBER, SUB_NONE, start);
+  token_decode(lexer, token, &lexer->source[start], lexer->position - start,
+               true);
   return token;
 }
 
-Token *create_string_token(Lexer *lexer, char character) {
-  size_t start = lexer->position + 1;
-  lexer->position++;
-
-#ifdef __GNUC__
-#pragma GCC unroll 100
-#endif
-  while (lexer->source[lexer->position] != character) {
-    lexer->position++;
-  }
-
-  char *lexeme =
-      slice(&lexer->tokens.allocator, lexer->source, start, lexer->position);
-  Token *token = allocator_alloc(&lexer->tokens.allocator, sizeof(Token));
-
-  if (token == NULL) {
-    slog_error("Failed to allocate memory for token");
-    return NULL;
-  }
+TokenIndex create_string_token(Lexer *lexer, char character) {
+  size_t start = ++lexer->position;
+  lexer->position = lexer->scan->find_byte(lexer->source, lexer->position,
+                                           lexer->source_length, character);
 
+  TokenIndex token = token_new(lexer, STRING, SUB_NONE, start);
+  token_decode(lexer, token, &lexer->source[start], lexer->position - start,
+               true);
   lexer->position++;
-  token->type = STRING;
-  token->lexeme = lexeme;
   return token;
 }
 
-Token *create_keyword_token(Lexer *lexer, char character) {
-  char *lexeme =
-      allocator_alloc(&lexer->tokens.allocator, LEX_CAP * sizeof(char));
+TokenIndex create_keyword_token(Lexer *lexer, char character) {
+  UNUSED(character);
+  size_t start = lexer->position++;
+  lexer->position = lexer->scan->ident_end(lexer->source, lexer->position,
+                                           lexer->source_length);
+
+  size_t length = lexer->position - start;
+  TokenSubkind subkind = keyword_subkind(&lexer->source[start], length);
+  TokenIndex token = token_new(lexer, subkind ? KEYWORD : IDENTIFIER, subkind,
+                               start);
+  if (token != TOKEN_NONE)
+    lexer->tokens.names[token] = InternTable_intern(
+        &lexer->tokens.interned, &lexer->source[start], length);
+  return token;
+}
 
-  if (lexeme == NULL) {
-    slog_error("Failed to allocate memory for lexeme");
-    return NULL;
+TokenIndex create_newline_token(Lexer *lexer) {
+  TokenIndex token = token_new(lexer, NEWLINE, SUB_NONE, lexer->position);
+  lexer->tokens.lengths[token] = 1;
+  return token;
+}
+
+// Returns the token text (not NUL-terminated) and its length
+static const char *token_text(const Lexer *lexer, TokenIndex token,
+                              size_t *length) {
+  const TokenStream *tokens = &lexer->tokens;
+  switch ((TokenType)tokens->kinds[token]) {
+  case NEWLINE:
+    *length = 2;
+    return "\\n";
+  case ENDMARKER:
+    *length = 3;
+    return "EOF";
+  default:
+    break;
   }
 
-  size_t lexeme_length = 0;
-  lexeme[lexeme_length++] = character;
-  lexer->position++;
+  *length = tokens->lengths[token];
+  if (tokens->lexemes != NULL && tokens->lexemes[token] != NULL)
+    return tokens->lexemes[token];
 
-// Build the lexeme until a non-alphanumeric character is encountered
-#ifdef __GNUC__
-#pragma GCC unroll 100
-#endif
-  while (lexer->position < lexer->source_length) {
-    character = lexer->source[lexer->position];
-    if (isalnum(character) || character == '_') {
-      lexeme[lexeme_length++] = character;
-      lexer->position++;
-      continue;
-    }
+  return &lexer->source[tokens->offsets[token]];
+}
 
-    break;
-  }
+const char *token_lexeme(Lexer *lexer, TokenIndex token) {
+  size_t length = 0;
+  const char *text = token_text(lexer, token, &length);
+  TokenType type = token_type(lexer, token);
+  if (type == NEWLINE || type == ENDMARKER)
+    return text;
 
-  lexeme[lexeme_length] = '\0';
-  Token *token = allocator_alloc(&lexer->tokens.allocator, sizeof(Token));
+  // Names already have a NUL-terminated copy in the intern table
+  if (lexer->tokens.names[token] != NAME_NONE)
+    return InternTable_name(&lexer->tokens.interned,
+                            lexer->tokens.names[token]);
 
-  if (token == NULL) {
-    slog_error("Failed to allocate memory for token");
+  const char **slot = TokenStream_lexeme_slot(&lexer->tokens, token);
+  if (slot == NULL)
     return NULL;
-  }
 
-  token->lexeme = lexeme;
+  if (*slot != NULL)
+    return *slot;
 
-  for (size_t i = 0; i < NUM_KEYWORDS; i++) {
-    const char *substring = PYTHON_KEYWORD[i];
-    if (strcmp(lexeme, substring) == 0) {
-      token->type = KEYWORD;
-      return token;
-    }
-  }
-
-  token->type = IDENTIFIER;
-  return token;
+  return TokenStream_set_lexeme(&lexer->tokens, token, text, length);
 }
 
-Token *create_newline_token(Lexer *lexer) {
-  Token *token = allocator_alloc(&lexer->tokens.allocator, sizeof(Token));
-  if (token == NULL) {
-    slog_error("Failed to allocate memory for NEWLINE token");
-    return NULL;
-  }
+bool token_is(const Lexer *lexer, TokenIndex token, const char *text) {
+  size_t length = 0;
+  const char *lexeme = token_text(lexer, token, &length);
+  return strncmp(lexeme, text, length) == 0 && text[length] == '\0';
+}
 
-  token->type = NEWLINE;
-  token->lexeme = arena_strdup(&lexer->tokens.allocator.base, "\\n");
-  return token;
+char *dump_tokens(Lexer *lexer) {
+  JsonWriter json = json_writer_string(false);
+  serialize_tokens(&json, lexer);
+  return json_writer_take(&json);
 }
 
-char *dump_tokens(Token_ArrayList *tokens) {
-  cJSON *json = serialize_tokens(tokens);
-  char *dump = cJSON_Print(json);
-  cJSON_Delete(json);
-  return dump;
+bool dump_tokens_to(Lexer *lexer, FILE *file, bool compact) {
+  JsonWriter json = json_writer_file(file, compact);
+  serialize_tokens(&json, lexer);
+  return json_writer_finish(&json);
 }
 
-Token *peek_token(Lexer *lexer) {
-  if (!lexer || lexer->token_idx >= lexer->tokens.size) {
-    return NULL;
+TokenIndex peek_token(Lexer *lexer) {
+  if (!lexer || lexer->token_idx >= lexer->token_end) {
+    return TOKEN_NONE;
   }
-  return lexer->tokens.elements[lexer->token_idx];
+  return lexer->token_idx;
 }
 
-cJSON *serialize_tokens(Token_ArrayList *tokens) {
-  cJSON *root = cJSON_CreateArray();
-
-  for (size_t i = 0; i < tokens->size; i++) {
-    cJSON_AddItemToArray(root, serialize_token(tokens->elements[i]));
+void serialize_tokens(JsonWriter *json, Lexer *lexer) {
+  json_begin_array(json);
+  for (TokenIndex i = TOKEN_NONE + 1; i < lexer->token_end; i++) {
+    serialize_token(json, lexer, i);
   }
-  return root;
+  json_end_array(json);
 }
 
-cJSON *serialize_lexer(Lexer *lexer) {
-  cJSON *root = cJSON_CreateObject();
-  cJSON_AddStringToObject(root, "filename", lexer->filename);
-  cJSON_AddNumberToObject(root, "position", lexer->position);
-  cJSON_AddNumberToObject(root, "token_idx", lexer->token_idx);
-  cJSON_AddNumberToObject(root, "source_length", lexer->source_length);
-  cJSON *tokens_json = serialize_tokens(&lexer->tokens);
-  cJSON_AddItemToObject(root, "tokens", tokens_json);
-  return root;
+void serialize_lexer(JsonWriter *json, Lexer *lexer) {
+  json_begin_object(json);
+  json_field_string(json, "filename", lexer->filename);
+  json_field_number(json, "position", lexer->position);
+  json_field_number(json, "token_idx", lexer->token_idx);
+  json_field_number(json, "source_length", lexer->source_length);
+  json_key(json, "tokens");
+  serialize_tokens(json, lexer);
+  json_end_object(json);
 }
 
-Token *create_token_from_str(Lexer *lexer, char *lexeme, TokenType type) {
-  Token *token = allocator_alloc(&lexer->tokens.allocator, sizeof(Token));
-  if (token == NULL) {
-    slog_error("Could not allocate memory for token");
-    return NULL;
+TokenIndex create_token_from_str(Lexer *lexer, const char *lexeme,
+                                 TokenType type) {
+  size_t start = lexer->position;
+  size_t length = strlen(lexeme);
+  lexer->position += length;
+
+  size_t matched = 0;
+  TokenSubkind subkind =
+      type == KEYWORD    ? keyword_subkind(lexeme, length)
+      : type == OPERATOR ? match_operator(lexeme, &matched)
+                         : SUB_NONE;
+  TokenIndex token = token_new(lexer, type, subkind, start);
+  if (token == TOKEN_NONE)
+    return TOKEN_NONE;
+
+  if (type == NUMBER || type == STRING)
+    token_decode(lexer, token, lexeme, length, false);
+  // Not in the source until token_locate() places it
+  lexer->tokens.offsets[token] = OFFSET_NONE;
+
+  // Synthetic tokens do not necessarily exist in the source, keep their text
+  const char **slot = TokenStream_lexeme_slot(&lexer->tokens, token);
+  if (slot == NULL)
+    return token;
+
+  if (type == IDENTIFIER || type == KEYWORD) {
+    NameId name =
+        InternTable_intern(&lexer->tokens.interned, lexeme, strlen(lexeme));
+    lexer->tokens.names[token] = name;
+    *slot = InternTable_name(&lexer->tokens.interned, name);
+  } else {
+    TokenStream_set_lexeme(&lexer->tokens, token, lexeme, strlen(lexeme));
   }
-
-  token->lexeme = arena_strdup(&lexer->tokens.allocator.base, lexeme);
-  token->type = type;
-  lexer->position += strlen(lexeme);
   return token;
 }
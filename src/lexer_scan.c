@@ -0,0 +1,218 @@
+#include "lexer_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#else
+#define SCAN_X86 0
+#endif
+
+static inline bool is_ident_byte(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+static size_t scalar_find_byte(const char *src, size_t pos, size_t end,
+                               char target) {
+  while (pos < end && src[pos] != target)
+    pos++;
+  return pos;
+}
+
+static size_t scalar_ident_end(const char *src, size_t pos, size_t end) {
+  while (pos < end && is_ident_byte(src[pos]))
+    pos++;
+  return pos;
+}
+
+static size_t scalar_blank_end(const char *src, size_t pos, size_t end,
+                               size_t *width) {
+  size_t cols = 0;
+  for (; pos < end; pos++) {
+    if (src[pos] == ' ')
+      cols++;
+    else if (src[pos] == '\t')
+      cols += 4;
+    else
+      break;
+  }
+
+  *width = cols;
+  return pos;
+}
+
+static const ScanKernels SCALAR_KERNELS = {
+    .name = "scalar",
+    .find_byte = scalar_find_byte,
+    .ident_end = scalar_ident_end,
+    .blank_end = scalar_blank_end,
+};
+
+#if SCAN_X86
+
+// Identifier bytes are classified with signed compares: bytes >= 0x80 are
+// negative and fall outside every range. Or-ing 0x20 folds upper case letters
+// onto lower case ones.
+__attribute__((target("sse2"))) static inline __m128i
+sse2_ident_mask(__m128i v) {
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+  __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  return _mm_or_si128(_mm_or_si128(alpha, digit), underscore);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+avx2_ident_mask(__m256i v) {
+  __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i alpha =
+      _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+  __m256i digit =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+  __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+  return _mm256_or_si256(_mm256_or_si256(alpha, digit), underscore);
+}
+
+__attribute__((target("sse2"))) static size_t
+sse2_find_byte(const char *src, size_t pos, size_t end, char target) {
+  const __m128i needle = _mm_set1_epi8(target);
+  for (; pos + 16 <= end; pos += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + pos));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+    if (mask != 0)
+      return pos + (size_t)__builtin_ctz(mask);
+  }
+  return scalar_find_byte(src, pos, end, target);
+}
+
+__attribute__((target("sse2"))) static size_t
+sse2_ident_end(const char *src, size_t pos, size_t end) {
+  for (; pos + 16 <= end; pos += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + pos));
+    unsigned stop = ~(unsigned)_mm_movemask_epi8(sse2_ident_mask(v)) & 0xFFFFu;
+    if (stop != 0)
+      return pos + (size_t)__builtin_ctz(stop);
+  }
+  return scalar_ident_end(src, pos, end);
+}
+
+__attribute__((target("sse2"))) static size_t
+sse2_blank_end(const char *src, size_t pos, size_t end, size_t *width) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  size_t cols = 0;
+  for (; pos + 16 <= end; pos += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + pos));
+    unsigned spaces = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, space));
+    unsigned tabs = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, tab));
+    unsigned stop = ~(spaces | tabs) & 0xFFFFu;
+    if (stop != 0) {
+      unsigned keep = (1u << __builtin_ctz(stop)) - 1;
+      cols += (size_t)__builtin_popcount(spaces & keep) +
+              4 * (size_t)__builtin_popcount(tabs & keep);
+      *width = cols;
+      return pos + (size_t)__builtin_ctz(stop);
+    }
+    cols += (size_t)__builtin_popcount(spaces) +
+            4 * (size_t)__builtin_popcount(tabs);
+  }
+
+  size_t tail = 0;
+  pos = scalar_blank_end(src, pos, end, &tail);
+  *width = cols + tail;
+  return pos;
+}
+
+__attribute__((target("avx2"))) static size_t
+avx2_find_byte(const char *src, size_t pos, size_t end, char target) {
+  const __m256i needle = _mm256_set1_epi8(target);
+  for (; pos + 32 <= end; pos += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + pos));
+    unsigned mask =
+        (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+    if (mask != 0)
+      return pos + (size_t)__builtin_ctz(mask);
+  }
+  return sse2_find_byte(src, pos, end, target);
+}
+
+__attribute__((target("avx2"))) static size_t
+avx2_ident_end(const char *src, size_t pos, size_t end) {
+  for (; pos + 32 <= end; pos += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + pos));
+    unsigned stop = ~(unsigned)_mm256_movemask_epi8(avx2_ident_mask(v));
+    if (stop != 0)
+      return pos + (size_t)__builtin_ctz(stop);
+  }
+  return sse2_ident_end(src, pos, end);
+}
+
+__attribute__((target("avx2"))) static size_t
+avx2_blank_end(const char *src, size_t pos, size_t end, size_t *width) {
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  size_t cols = 0;
+  for (; pos + 32 <= end; pos += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + pos));
+    unsigned spaces =
+        (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, space));
+    unsigned tabs = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, tab));
+    unsigned stop = ~(spaces | tabs);
+    if (stop != 0) {
+      unsigned keep = (1u << __builtin_ctz(stop)) - 1;
+      cols += (size_t)__builtin_popcount(spaces & keep) +
+              4 * (size_t)__builtin_popcount(tabs & keep);
+      *width = cols;
+      return pos + (size_t)__builtin_ctz(stop);
+    }
+    cols += (size_t)__builtin_popcount(spaces) +
+            4 * (size_t)__builtin_popcount(tabs);
+  }
+
+  size_t tail = 0;
+  pos = sse2_blank_end(src, pos, end, &tail);
+  *width = cols + tail;
+  return pos;
+}
+
+static const ScanKernels SSE2_KERNELS = {
+    .name = "sse2",
+    .find_byte = sse2_find_byte,
+    .ident_end = sse2_ident_end,
+    .blank_end = sse2_blank_end,
+};
+
+static const ScanKernels AVX2_KERNELS = {
+    .name = "avx2",
+    .find_byte = avx2_find_byte,
+    .ident_end = avx2_ident_end,
+    .blank_end = avx2_blank_end,
+};
+
+#endif // SCAN_X86
+
+size_t scan_kernels_available(const ScanKernels **out, size_t capacity) {
+  size_t count = 0;
+  if (count < capacity)
+    out[count++] = &SCALAR_KERNELS;
+
+#if SCAN_X86
+  __builtin_cpu_init();
+  if (count < capacity && __builtin_cpu_supports("sse2"))
+    out[count++] = &SSE2_KERNELS;
+  if (count < capacity && __builtin_cpu_supports("avx2"))
+    out[count++] = &AVX2_KERNELS;
+#endif
+
+  return count;
+}
+
+const ScanKernels *scan_kernels(void) {
+  const ScanKernels *kernels[3];
+  size_t count = scan_kernels_available(kernels, ARRAYSIZE(kernels));
+  return kernels[count - 1];
+}
@@ -1,5 +1,9 @@
+#include "ast_snapshot.h"
 #include "codegen.h"
+#include "compile_cache.h"
 #include "profiler.h"
+#include "source_file.h"
+#include "tac.h"
 #ifndef FLAG_IMPLEMENTATION
 #define FLAG_IMPLEMENTATION
 #include "flag.h"
@@ -17,61 +21,197 @@ static Allocator allocator_global;
 // TODO: Add support for multiple files
 // TODO: Perhaps move argument parsing to its own module (for testing purposes)
 
-int dump_ast(const char *source_path, const char *out_file) {
+// Lexes up front on `jobs` threads, or hands the tokens to the parser from a
+// second thread as they are lexed
+static Lexer lex_input(const char *source, const char *source_path,
+                       size_t jobs, bool stream) {
+  if (stream)
+    return tokenize_streaming(source, source_path);
+  return tokenize_parallel(source, source_path, jobs);
+}
+
+// What a -dump-* flag writes out of the parsed input
+typedef enum DumpStage {
+  DUMP_TOKENS,
+  DUMP_AST,
+  DUMP_SYMBOLS,
+  DUMP_TAC,
+} DumpStage;
+
+static void report_semantic_errors(SemanticAnalyzer *sa) {
+  size_t errors = sa_error_count(sa);
+  for (size_t i = 0; i < errors; i++)
+    slog_error("%s", sa_error_at(sa, i).message);
+  if (errors > 1)
+    slog_error("%zu semantic errors", errors);
+}
+
+// Streams the JSON of `stage` to `file` and frees the parser
+static bool dump_parsed(Parser *parser, DumpStage stage, size_t jobs,
+                        FILE *file, bool compact) {
+  if (stage == DUMP_TOKENS || stage == DUMP_AST) {
+    bool written =
+        stage == DUMP_TOKENS
+            ? dump_tokens_to(&parser->lexer, file, compact)
+            : dump_program_to(parser, parser->program, file, compact);
+    parser_free(parser);
+    return written;
+  }
+
+  SemanticAnalyzer sa = analyze_program_parallel(parser, jobs);
+  bool written = false;
+  if (sa_has_error(&sa)) {
+    report_semantic_errors(&sa);
+  } else if (stage == DUMP_SYMBOLS) {
+    written = dump_symbol_table_to(sa.current_scope, file, compact);
+  } else {
+    TACProgram tac = tac_generate(&sa);
+    written = tac_dump_program_to(&tac, file, compact);
+  }
+  parser_free(&sa.parser);
+  return written;
+}
+
+int dump_input(const char *source_path, const char *out_file, DumpStage stage,
+               size_t jobs, bool stream, bool compact) {
+  SourceFile source = {0};
+  ASTSnapshot snapshot = {0};
+  bool cached = ast_snapshot_detect(source_path);
+  if (!cached && !source_file_open(&source, source_path))
+    return EXIT_FAILURE;
+
   Allocator allocator = {0};
-  allocator_init(&allocator, "dump_ast");
+  allocator_init(&allocator, "dump_input");
   allocator_alloc(&allocator, MIN_CAP);
-  char *source = load_file_text(&allocator, source_path);
   TraceBuffer trace = trace_buffer_create(&allocator, 100);
-  trace_event_begin(&trace, "lex");
-  Lexer lexer = tokenize(source, source_path);
-  trace_event_end(&trace, "lex");
-  trace_event_begin(&trace, "parse");
-  Parser parser = parse(&lexer);
-  trace_event_end(&trace, "parse");
-  trace_event_begin(&trace, "serialize");
-  cJSON *root = serialize_program(&parser.ast);
-  trace_event_end(&trace, "serialize");
-  trace_event_begin(&trace, "json_print");
-  char *result = cJSON_Print(root);
-  trace_event_end(&trace, "json_print");
-
-  trace_event_begin(&trace, "json_export");
-  if (out_file != NULL && strlen(out_file) > 0) {
-    if (!save_file_text(out_file, result))
-      return EXIT_FAILURE;
+  Parser parser = {0};
+  bool parsed = true;
+  if (cached) {
+    trace_event_begin(&trace, "load");
+    parsed = ast_snapshot_open(&snapshot, source_path, &parser);
+    trace_event_end(&trace, "load");
   } else {
-    slog_info("%s", result);
+    trace_event_begin(&trace, "lex");
+    Lexer lexer = lex_input(source.text, source_path, jobs, stream);
+    trace_event_end(&trace, "lex");
+    trace_event_begin(&trace, "parse");
+    parser = parse_parallel(&lexer, jobs);
+    trace_event_end(&trace, "parse");
   }
-  trace_event_end(&trace, "json_export");
 
-  cJSON_Delete(root);
-  parser_free(&parser);
-  free(result);
-  char *json = trace_buffer_to_json(&trace);
-  save_file_text("trace.json", json);
-  free(json);
+  // Every outcome from here on goes through the same cleanup
+  int status = EXIT_FAILURE;
+  if (parsed) {
+    trace_event_begin(&trace, "serialize");
+    bool to_file = out_file != NULL && strlen(out_file) > 0;
+    FILE *file = to_file ? fopen(out_file, "wt") : stdout;
+    if (file == NULL) {
+      slog_error("FILE: [%s] Failed to open text file", out_file);
+      parser_free(&parser);
+    } else {
+      bool written = dump_parsed(&parser, stage, jobs, file, compact);
+      if (to_file && fclose(file) != 0)
+        written = false;
+      if (written)
+        status = EXIT_SUCCESS;
+    }
+    trace_event_end(&trace, "serialize");
+  }
+
+  ast_snapshot_close(&snapshot);
+  source_file_close(&source);
+  if (status == EXIT_SUCCESS) {
+    char *trace_json = trace_buffer_to_json(&trace);
+    save_file_text("trace.json", trace_json);
+    free(trace_json);
+  }
   trace_buffer_destroy(&trace);
-  return EXIT_SUCCESS;
+  return status;
 }
 
-Codegen compile_to_c(const char *source, const char *source_path) {
-  Lexer lexer = tokenize(source, source_path);
-  Parser parser = parse(&lexer);
+// Writes the parse of the input to `out_file` for later runs to load
+static int emit_ast(const char *source_path, const char *out_file,
+                    size_t jobs, bool stream) {
+  if (out_file == NULL || strlen(out_file) == 0) {
+    slog_error("the ast target needs an output file (-o)");
+    return EXIT_FAILURE;
+  }
+
+  SourceFile source = {0};
+  if (!source_file_open(&source, source_path))
+    return EXIT_FAILURE;
+
+  Lexer lexer = lex_input(source.text, source_path, jobs, stream);
+  Parser parser = parse_parallel(&lexer, jobs);
+  bool saved = ast_snapshot_save(&parser, out_file);
+  parser_free(&parser);
+  source_file_close(&source);
+  return saved ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-  SemanticAnalyzer sa = analyze_program(&parser);
+// Analyzes and generates C for `parser`, which `cg` owns on success. On
+// errors, reports them and frees the parser.
+static bool compile_parsed(Parser *parser, size_t jobs, Codegen *cg) {
+  SemanticAnalyzer sa = analyze_program_parallel(parser, jobs);
   if (sa_has_error(&sa)) {
-    slog_error(sa_get_error(&sa).message);
-    exit(EXIT_FAILURE);
+    report_semantic_errors(&sa);
+    parser_free(&sa.parser);
+    return false;
   }
 
-  Codegen cg = codegen_init(&sa);
-  if (!codegen_program(&cg)) {
-    slog_error("Code generation failed: %s", codegen_get_error(&cg).message);
-    exit(EXIT_FAILURE);
+  *cg = codegen_init(&sa);
+  if (!codegen_program(cg)) {
+    slog_error("Code generation failed: %s", codegen_get_error(cg).message);
+    codegen_free(cg);
+    return false;
+  }
+
+  return true;
+}
+
+bool compile_to_c(const char *source, const char *source_path, size_t jobs,
+                  bool stream, Codegen *cg) {
+  Lexer lexer = lex_input(source, source_path, jobs, stream);
+  Parser parser = parse_parallel(&lexer, jobs);
+  return compile_parsed(&parser, jobs, cg);
+}
+
+static bool write_output(const char *out_file, const char *text) {
+  if (out_file != NULL && strlen(out_file) > 0)
+    return save_file_text(out_file, (char *)text);
+  slog_info("%s", text);
+  return true;
+}
+
+// Compiles through the cache in `cache_dir`: an unchanged source, compiled
+// by the same ceeify with the same options, gets the C stored by an earlier
+// run without lexing, parsing or analyzing it again
+static int compile_cached(const char *source_path, const char *out_file,
+                          const char *cache_dir, size_t jobs, bool stream) {
+  SourceFile source = {0};
+  if (!source_file_open(&source, source_path))
+    return EXIT_FAILURE;
+
+  CompileCache cache;
+  SourceFile entry = {0};
+  bool hit = compile_cache_open(&cache, cache_dir, source.text, source.length,
+                                "emit=c") &&
+             compile_cache_fetch(&cache, &entry);
+  bool written = false;
+  Codegen cg;
+  if (hit) {
+    written = write_output(out_file, entry.text);
+  } else if (compile_to_c(source.text, source_path, jobs, stream, &cg)) {
+    compile_cache_store(&cache, cg.output.items, cg.output.count);
+    written = write_output(out_file, cg.output.items);
+    codegen_free(&cg);
   }
 
-  return cg;
+  // Also on errors, so jobs waiting on the entry go on to compile it
+  compile_cache_close(&cache);
+  source_file_close(&entry);
+  source_file_close(&source);
+  return written ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 void usage(FILE *stream) {
@@ -143,8 +283,22 @@ int main(int argc, char **argv) {
       flag_bool("help", false, "Print this help to stdout and exit with 0");
   bool *dump_flag = flag_bool("dump-ast", false,
                               "Dump the parse tree after parsing and stop");
+  bool *dump_tokens_flag =
+      flag_bool("dump-tokens", false, "Dump the tokens after lexing and stop");
+  bool *dump_symbols_flag = flag_bool(
+      "dump-symbols", false, "Dump the global symbols after analysis and stop");
+  bool *dump_tac_flag =
+      flag_bool("dump-tac", false, "Dump the three-address code and stop");
   char **out_file = flag_str("o", NULL, "Output file (default: stdout)");
-  char **emit = flag_str("emit", "c", "Output kind: c | tac | llvm");
+  char **emit = flag_str("emit", "c", "Output kind: c | ast | tac | llvm");
+  size_t *jobs =
+      flag_size("j", 1, "Threads compiling large inputs (0: all CPUs)");
+  bool *stream =
+      flag_bool("stream", false, "Lex on a second thread while parsing");
+  bool *compact =
+      flag_bool("compact", false, "Dump JSON without indentation");
+  char **cache_dir =
+      flag_str("cache", NULL, "Directory caching generated C across runs");
 
   /* reorder so flags can appear anywhere */
   reorder_args(&argc, argv);
@@ -172,22 +326,45 @@ int main(int argc, char **argv) {
 
   const char *in_filepath = argv[0];
 
-  if (*dump_flag) {
-    int rc = dump_ast(in_filepath, *out_file);
-    return rc;
+  if (*dump_flag || *dump_tokens_flag || *dump_symbols_flag ||
+      *dump_tac_flag) {
+    DumpStage stage = *dump_tac_flag       ? DUMP_TAC
+                      : *dump_symbols_flag ? DUMP_SYMBOLS
+                      : *dump_flag         ? DUMP_AST
+                                           : DUMP_TOKENS;
+    return dump_input(in_filepath, *out_file, stage, *jobs, *stream, *compact);
   }
 
-  if (strcmp(*emit, "c") == 0) {
-    // Python → C
-    Codegen cg = compile_to_c(load_file_text(&allocator_global, in_filepath),
-                              in_filepath);
-    if (*out_file != NULL && strlen(*out_file) > 0) {
-      if (!save_file_text(*out_file, cg.output.items))
+  if (strcmp(*emit, "c") == 0 && *cache_dir != NULL &&
+      !ast_snapshot_detect(in_filepath)) {
+    // Python → C, reusing earlier output for unchanged sources
+    return compile_cached(in_filepath, *out_file, *cache_dir, *jobs, *stream);
+  } else if (strcmp(*emit, "c") == 0) {
+    // Python → C, or AST snapshot → C
+    SourceFile source = {0};
+    ASTSnapshot snapshot = {0};
+    Codegen cg;
+    bool compiled;
+    if (ast_snapshot_detect(in_filepath)) {
+      Parser parser;
+      if (!ast_snapshot_open(&snapshot, in_filepath, &parser))
         return EXIT_FAILURE;
+      compiled = compile_parsed(&parser, *jobs, &cg);
     } else {
-      slog_info("%s", cg.output.items);
+      if (!source_file_open(&source, in_filepath))
+        return EXIT_FAILURE;
+      compiled = compile_to_c(source.text, in_filepath, *jobs, *stream, &cg);
     }
-    codegen_free(&cg);
+    bool written = compiled && write_output(*out_file, cg.output.items);
+    if (compiled)
+      codegen_free(&cg);
+    ast_snapshot_close(&snapshot);
+    source_file_close(&source);
+    if (!written)
+      return EXIT_FAILURE;
+  } else if (strcmp(*emit, "ast") == 0) {
+    // Python → AST snapshot
+    return emit_ast(in_filepath, *out_file, *jobs, *stream);
   } else if (strcmp(*emit, "tac") == 0) {
     // Python → TAC
   } else if (strcmp(*emit, "llvm") == 0) {
@@ -1,29 +1,23 @@
 #include "parser.h"
-
-// TODO: Replace strcmp with proper token type checks where possible (e.g., for
-// keywords)
-
-const char *COMPARISON_OPERATORS[] = {"==", "!=", ">", "<", ">=", "<="};
-
-const char *AUG_ASSIGN_OPS[] = {"+=", "-=", "*=",  "@=",  "/=",  "%=", "&=",
-                                "|=", "^=", "<<=", ">>=", "**=", "//="};
-
-Token *advance(Parser *parser) {
-  if (parser->lexer.token_idx >= parser->lexer.tokens.size) {
-    parser->current = NULL;
-    parser->next = NULL;
-    return NULL;
-  }
-
-  parser->current = Token_get(&parser->lexer.tokens, parser->lexer.token_idx);
-  parser->lexer.token_idx++;
-
-  if (parser->lexer.token_idx < parser->lexer.tokens.size) {
-    parser->next = Token_get(&parser->lexer.tokens, parser->lexer.token_idx);
-  } else {
-    parser->next = NULL;
+#include <pthread.h>
+#include <unistd.h>
+
+TokenIndex advance(Parser *parser) {
+  // A streaming lexer may not have produced the lookahead token yet
+  if (parser->lexer.stream != NULL)
+    lexer_stream_pull(&parser->lexer, parser->lexer.token_idx + 1);
+
+  if (parser->lexer.token_idx >= parser->lexer.token_end) {
+    parser->current = TOKEN_NONE;
+    parser->next = TOKEN_NONE;
+    return TOKEN_NONE;
   }
 
+  // Tokens are consumed in order, so the stream is walked sequentially
+  parser->current = parser->lexer.token_idx++;
+  parser->next = parser->lexer.token_idx < parser->lexer.token_end
+                     ? parser->lexer.token_idx
+                     : TOKEN_NONE;
   return parser->current;
 }
 
@@ -33,37 +27,71 @@ ASTNode *parse_if_statement(Parser *parser, ASTNode *if_node);
 
 ASTNode *parse_expression(Parser *parser, int8_t min_precedence);
 
-ASTNode *parse_call(Parser *parser, ASTNode *callee);
-
 ASTNode *parse_class_def(Parser *parser, ASTNode *class_node);
 
 ASTNode *parse_match_stmt(Parser *parser);
 
-static ASTNode *parse_subscript(Parser *parser, ASTNode *value);
-
-static ASTNode *parse_comprehension_body(Parser *parser, Token *origin_token,
+static ASTNode *parse_comprehension_body(Parser *parser,
+                                         TokenIndex origin_token,
                                          NodeType type, ASTNode *expr);
 
 bool blacklist_tokens(TokenType type, const TokenType blacklist[], size_t size);
 
-ASTNode *bin_op_new(Parser *parser, Token *operation, ASTNode *left,
+ASTNode *bin_op_new(Parser *parser, TokenIndex operation, ASTNode *left,
                     ASTNode *right);
 
-bool is_python_main_check(ASTNode *node);
+bool is_python_main_check(Parser *parser, ASTNode *node);
 
-static inline Parser parser_new(Lexer *lexer) {
+// The tree is reserved for `tokens` tokens up front, so that node pointers
+// stay valid while it is being built
+static inline Parser parser_new(Lexer *lexer, size_t tokens) {
   return (Parser){.lexer = *lexer,
-                  .current = NULL,
+                  .current = TOKEN_NONE,
                   .next = peek_token(lexer),
-                  .ast = ASTNode_new(DEFAULT_CAP)};
+                  .ast = AST_new(AST_words_for(tokens))};
 }
 
-static bool is_augassign_op(const char *lexeme) {
-  for (uint8_t i = 0; i < ARRAYSIZE(AUG_ASSIGN_OPS); i++) {
-    if (strcmp(lexeme, AUG_ASSIGN_OPS[i]) == 0)
-      return true;
+static inline NodeIndex node_ref(Parser *parser, const ASTNode *node) {
+  return AST_ref(&parser->ast, node);
+}
+
+static inline ASTNode *node_at(Parser *parser, NodeIndex index) {
+  return AST_get(&parser->ast, index);
+}
+
+static inline const char *tok_lexeme(Parser *parser, TokenIndex token) {
+  return token_lexeme(&parser->lexer, token);
+}
+
+static inline bool tok_is(Parser *parser, TokenIndex token, const char *text) {
+  return token_is(&parser->lexer, token, text);
+}
+
+static inline TokenType tok_type(Parser *parser, TokenIndex token) {
+  return token_type(&parser->lexer, token);
+}
+
+static inline TokenSubkind tok_sub(Parser *parser, TokenIndex token) {
+  return token_subkind(&parser->lexer, token);
+}
+
+static inline size_t tok_ident(Parser *parser, TokenIndex token) {
+  return token_ident(&parser->lexer, token);
+}
+
+static bool is_augassign_op(TokenSubkind op) {
+  switch (op) {
+  case OP_PLUS_EQ:
+  case OP_MINUS_EQ:
+  case OP_STAR_EQ:
+  case OP_STAR_STAR_EQ:
+  case OP_SLASH_EQ:
+  case OP_SLASH_SLASH_EQ:
+  case OP_PERCENT_EQ:
+    return true;
+  default:
+    return false;
   }
-  return false;
 }
 
 const char *ctx_to_str(Context ctx) {
@@ -135,16 +163,135 @@ const char *node_type_to_string(NodeType type) {
   }
 }
 
-void syntax_error(const char *message, const char *filename, Token *token) {
-  size_t line = token ? token->line : 1;
-  size_t col = token ? token->col : 1;
-  slog_error("%s:%d:%d SyntaxError: %s near '%s'.\n", filename, line, col,
-             message, token ? token->lexeme : "EOF");
+void syntax_error(const char *message, Lexer *lexer, TokenIndex token) {
+  size_t line = token ? token_line(lexer, token) : 1;
+  size_t col = token ? token_col(lexer, token) : 1;
+  slog_error("%s:%d:%d SyntaxError: %s near '%s'.\n", lexer->filename, line,
+             col, message, token ? token_lexeme(lexer, token) : "EOF");
   exit(EXIT_FAILURE);
 }
 
-ASTNode *node_new(Parser *parser, Token *token, NodeType type) {
-  ASTNode *node = allocator_alloc(&parser->ast.allocator, sizeof(ASTNode));
+size_t node_size(NodeType type) {
+  size_t header = offsetof(ASTNode, child);
+  switch (type) {
+  case ASSIGNMENT:
+    return header + sizeof(Assign);
+  case AUG_ASSIGNMENT:
+    return header + sizeof(AugAssign);
+  case BINARY_OPERATION:
+  case UNARY_OPERATION:
+    return header + sizeof(BinOp);
+  case COMPARE:
+    return header + sizeof(Compare);
+  case IF:
+  case IF_EXPR:
+  case WHILE:
+  case FOR:
+  case MATCH:
+  case CASE:
+    return header + sizeof(ControlFlowStatement);
+  case FUNCTION_DEF:
+  case CLASS_DEF:
+    return header + sizeof(FunctionDef);
+  case CALL:
+    return header + sizeof(CallExpr);
+  case ATTRIBUTE:
+    return header + sizeof(Attribute);
+  case SUBSCRIPT:
+    return header + sizeof(Subscript);
+  case LIST_COMPREHENSION:
+    return header + sizeof(Comprehension);
+  case IMPORT:
+  case IMPORT_FROM:
+  case TUPLE:
+  case LIST_EXPR:
+    return header + sizeof(NodeSpan);
+  default:
+    // Names, literals, returns and block markers only use `child`
+    return header + sizeof(NodeIndex);
+  }
+}
+
+NodeLinks node_links(ASTNode *node) {
+  NodeLinks links = {.nodes = {&node->parent}, .node_count = 1};
+#define LINK(field) (links.nodes[links.node_count++] = &(field))
+#define LINK_SPAN(span) (links.spans[links.span_count++] = &(span))
+
+  switch (node->type) {
+  case ASSIGNMENT:
+    LINK_SPAN(node->assign.targets);
+    LINK(node->assign.value);
+    break;
+  case AUG_ASSIGNMENT:
+    LINK(node->aug_assign.target);
+    LINK(node->aug_assign.value);
+    break;
+  case BINARY_OPERATION:
+  case UNARY_OPERATION:
+    LINK(node->bin_op.left);
+    LINK(node->bin_op.right);
+    break;
+  case COMPARE:
+    LINK(node->compare.left);
+    LINK_SPAN(node->compare.comparators);
+    break;
+  case IF:
+  case IF_EXPR:
+  case WHILE:
+  case FOR:
+  case MATCH:
+  case CASE:
+    LINK(node->ctrl_stmt.test);
+    LINK_SPAN(node->ctrl_stmt.body);
+    LINK_SPAN(node->ctrl_stmt.orelse);
+    break;
+  case FUNCTION_DEF:
+  case CLASS_DEF:
+    LINK(node->def.name);
+    LINK(node->def.returns);
+    LINK_SPAN(node->def.params);
+    LINK_SPAN(node->def.body);
+    break;
+  case CALL:
+    LINK(node->call.func);
+    LINK_SPAN(node->call.args);
+    break;
+  case ATTRIBUTE:
+    LINK(node->attribute.value);
+    break;
+  case SUBSCRIPT:
+    LINK(node->subscript.value);
+    LINK(node->subscript.slice);
+    break;
+  case LIST_COMPREHENSION:
+    LINK(node->list_comp.key);
+    LINK(node->list_comp.expr);
+    LINK(node->list_comp.target);
+    LINK(node->list_comp.iter);
+    LINK_SPAN(node->list_comp.ifs);
+    break;
+  case IMPORT:
+  case IMPORT_FROM:
+  case TUPLE:
+  case LIST_EXPR:
+    LINK_SPAN(node->collection);
+    break;
+  default:
+    LINK(node->child);
+    break;
+  }
+
+#undef LINK
+#undef LINK_SPAN
+  return links;
+}
+
+uint32_t node_words(NodeType type) {
+  return (uint32_t)((node_size(type) + AST_NODE_ALIGN - 1) / AST_NODE_ALIGN);
+}
+
+ASTNode *node_new(Parser *parser, TokenIndex token, NodeType type) {
+  ASTNode *node = AST_alloc(&parser->ast, node_size(type));
   if (node == NULL) {
     slog_error("Could not allocate memory for AST node");
     return NULL;
@@ -153,380 +300,462 @@ ASTNode *node_new(Parser *parser, Token *token, NodeType type) {
   node->type = type;
   node->token = token;
   node->depth = 1;
-  node->child = NULL;
-  node->parent = NULL;
+  node->child = NODE_NONE;
+  node->parent = NODE_NONE;
   node->ctx = LOAD;
+  node->dtype = UNKNOWN;
+  node->symbol = NULL;
   return node;
 }
 
-cJSON *serialize_program(ASTNode_LinkedList *program) {
-  cJSON *root = cJSON_CreateArray();
-
-  for (size_t current = program->head; current != SIZE_MAX;
-       current = program->elements[current].next) {
-    cJSON_AddItemToArray(root, serialize_node(program->elements[current].data));
+void serialize_program(JsonWriter *json, Parser *parser, NodeSpan program) {
+  json_begin_array(json);
+  for (uint32_t i = 0; i < program.count; i++) {
+    serialize_node(json, parser, AST_child(&parser->ast, program, i));
   }
-  return root;
+  json_end_array(json);
 }
 
-cJSON *serialize_node(ASTNode *node) {
+// Missing children leave their key out
+static void serialize_node_field(JsonWriter *json, Parser *parser,
+                                 const char *key, NodeIndex node) {
+  if (node == NODE_NONE)
+    return;
+  json_key(json, key);
+  serialize_node(json, parser, AST_node(&parser->ast, node));
+}
+
+void serialize_node(JsonWriter *json, Parser *parser, ASTNode *node) {
+  Lexer *lexer = &parser->lexer;
   if (node == NULL)
-    return NULL;
-  cJSON *root = cJSON_CreateObject();
-  cJSON_AddStringToObject(root, "type", node_type_to_string(node->type));
-  cJSON_AddNumberToObject(root, "depth", node->depth);
-  cJSON_AddStringToObject(root, "ctx", ctx_to_str(node->ctx));
+    return;
+  json_begin_object(json);
+  json_field_string(json, "type", node_type_to_string(node->type));
+  json_field_number(json, "depth", node->depth);
+  json_field_string(json, "ctx", ctx_to_str(node->ctx));
 
   switch (node->type) {
   case ASSIGNMENT:
-    cJSON_AddItemToObject(root, "targets",
-                          serialize_program(&node->assign.targets));
-    cJSON_AddItemToObject(root, "value", serialize_node(node->assign.value));
+    json_key(json, "targets");
+    serialize_program(json, parser, node->assign.targets);
+    serialize_node_field(json, parser, "value", node->assign.value);
     break;
   case AUG_ASSIGNMENT:
-    cJSON_AddItemToObject(root, "target",
-                          serialize_node(node->aug_assign.target));
-    cJSON_AddItemToObject(root, "op", serialize_token(node->aug_assign.op));
-    cJSON_AddItemToObject(root, "value",
-                          serialize_node(node->aug_assign.value));
+    serialize_node_field(json, parser, "target", node->aug_assign.target);
+    json_key(json, "op");
+    serialize_token(json, lexer, node->aug_assign.op);
+    serialize_node_field(json, parser, "value", node->aug_assign.value);
     break;
   case ATTRIBUTE:
-    cJSON_AddItemToObject(root, "value", serialize_node(node->attribute.value));
-    cJSON_AddStringToObject(root, "attr", node->attribute.attr);
+    serialize_node_field(json, parser, "value", node->attribute.value);
+    json_field_string(json, "attr", node->attribute.attr);
     break;
   case VARIABLE:
   case LITERAL:
-    cJSON_AddItemToObject(root, "token", serialize_token(node->token));
-    // cJSON_AddStringToObject(root, "ctx", ctx_to_str(node->ctx));
-    if (node->child) {
-      cJSON_AddItemToObject(root, "annotation", serialize_node(node->child));
-    }
+    json_key(json, "token");
+    serialize_token(json, lexer, node->token);
+    serialize_node_field(json, parser, "annotation", node->child);
     break;
   case BINARY_OPERATION:
-    cJSON_AddItemToObject(root, "token", serialize_token(node->token));
-    cJSON_AddItemToObject(root, "left", serialize_node(node->bin_op.left));
-    cJSON_AddItemToObject(root, "right", serialize_node(node->bin_op.right));
+    json_key(json, "token");
+    serialize_token(json, lexer, node->token);
+    serialize_node_field(json, parser, "left", node->bin_op.left);
+    serialize_node_field(json, parser, "right", node->bin_op.right);
     break;
   case IMPORT:
-    cJSON_AddItemToObject(root, "token", serialize_token(node->token));
-    cJSON_AddItemToObject(root, "names", serialize_program(&node->collection));
+    json_key(json, "token");
+    serialize_token(json, lexer, node->token);
+    json_key(json, "names");
+    serialize_program(json, parser, node->collection);
     break;
   case IMPORT_FROM:
-    cJSON_AddItemToObject(root, "token", serialize_token(node->token));
-    cJSON_AddItemToObject(root, "module", serialize_node(node->parent));
-    cJSON_AddItemToObject(root, "names", serialize_program(&node->collection));
+    json_key(json, "token");
+    serialize_token(json, lexer, node->token);
+    serialize_node_field(json, parser, "module", node->parent);
+    json_key(json, "names");
+    serialize_program(json, parser, node->collection);
     break;
   case COMPARE:
-    cJSON_AddItemToObject(root, "left", serialize_node(node->compare.left));
-    cJSON *ops = cJSON_CreateArray();
-    cJSON_AddItemToObject(root, "ops", ops);
-    cJSON_AddItemToObject(root, "comparators",
-                          serialize_program(&node->compare.comparators));
-    for (size_t i = 0; i < node->compare.ops.size; ++i) {
-      Token *token = Token_get(&node->compare.ops, i);
-      cJSON_AddItemToArray(ops, serialize_token(token));
+    serialize_node_field(json, parser, "left", node->compare.left);
+    json_key(json, "ops");
+    json_begin_array(json);
+    for (size_t i = 0; i < node->compare.ops->size; ++i) {
+      serialize_token(json, lexer, Token_get(node->compare.ops, i));
     }
+    json_end_array(json);
+    json_key(json, "comparators");
+    serialize_program(json, parser, node->compare.comparators);
     break;
   case IF:
   case WHILE:
   case CASE:
-    cJSON_AddItemToObject(root, "token", serialize_token(node->token));
-    cJSON_AddItemToObject(root, "test", serialize_node(node->ctrl_stmt.test));
-    cJSON_AddItemToObject(root, "body",
-                          serialize_program(&node->ctrl_stmt.body));
-    cJSON_AddItemToObject(root, "orelse",
-                          serialize_program(&node->ctrl_stmt.orelse));
+    json_key(json, "token");
+    serialize_token(json, lexer, node->token);
+    serialize_node_field(json, parser, "test", node->ctrl_stmt.test);
+    json_key(json, "body");
+    serialize_program(json, parser, node->ctrl_stmt.body);
+    json_key(json, "orelse");
+    serialize_program(json, parser, node->ctrl_stmt.orelse);
     break;
   case FUNCTION_DEF:
   case CLASS_DEF:
-    cJSON_AddItemToObject(root, "name", serialize_node(node->def.name));
-    cJSON_AddItemToObject(root, "params", serialize_program(&node->def.params));
-    cJSON_AddItemToObject(root, "body", serialize_program(&node->def.body));
+    serialize_node_field(json, parser, "name", node->def.name);
+    json_key(json, "params");
+    serialize_program(json, parser, node->def.params);
+    json_key(json, "body");
+    serialize_program(json, parser, node->def.body);
     break;
   case RETURN:
-    cJSON_AddItemToObject(root, "token", serialize_token(node->token));
-    cJSON_AddItemToObject(root, "ret", serialize_node(node->child));
+    json_key(json, "token");
+    serialize_token(json, lexer, node->token);
+    serialize_node_field(json, parser, "ret", node->child);
     break;
   case CALL:
-    cJSON_AddItemToObject(root, "token", serialize_token(node->token));
-    cJSON_AddItemToObject(root, "args", serialize_program(&node->call.args));
+    json_key(json, "token");
+    serialize_token(json, lexer, node->token);
+    json_key(json, "args");
+    serialize_program(json, parser, node->call.args);
     break;
   case MATCH:
-    cJSON_AddItemToObject(root, "token", serialize_token(node->token));
-    cJSON_AddItemToObject(root, "test", serialize_node(node->ctrl_stmt.test));
-    cJSON_AddItemToObject(root, "body",
-                          serialize_program(&node->ctrl_stmt.body));
+    json_key(json, "token");
+    serialize_token(json, lexer, node->token);
+    serialize_node_field(json, parser, "test", node->ctrl_stmt.test);
+    json_key(json, "body");
+    serialize_program(json, parser, node->ctrl_stmt.body);
     break;
   case TUPLE:
   case LIST_EXPR:
-    cJSON_AddItemToObject(root, "token", serialize_token(node->token));
-    cJSON_AddItemToObject(root, "elements",
-                          serialize_program(&node->collection));
+    json_key(json, "token");
+    serialize_token(json, lexer, node->token);
+    json_key(json, "elements");
+    serialize_program(json, parser, node->collection);
     break;
   case SUBSCRIPT:
-    cJSON_AddItemToObject(root, "value", serialize_node(node->subscript.value));
-    cJSON_AddItemToObject(root, "slice", serialize_node(node->subscript.slice));
+    serialize_node_field(json, parser, "value", node->subscript.value);
+    serialize_node_field(json, parser, "slice", node->subscript.slice);
     break;
   case LIST_COMPREHENSION:
-    cJSON_AddItemToObject(root, "expr", serialize_node(node->list_comp.expr));
-    cJSON_AddItemToObject(root, "target",
-                          serialize_node(node->list_comp.target));
-    cJSON_AddItemToObject(root, "iter", serialize_node(node->list_comp.iter));
-    cJSON_AddItemToObject(root, "ifs", serialize_program(&node->list_comp.ifs));
+    serialize_node_field(json, parser, "expr", node->list_comp.expr);
+    serialize_node_field(json, parser, "target", node->list_comp.target);
+    serialize_node_field(json, parser, "iter", node->list_comp.iter);
+    json_key(json, "ifs");
+    serialize_program(json, parser, node->list_comp.ifs);
     break;
   default:
     break;
   }
-  return root;
+  json_end_object(json);
+}
+
+char *dump_program(Parser *parser, NodeSpan program) {
+  JsonWriter json = json_writer_string(false);
+  serialize_program(&json, parser, program);
+  return json_writer_take(&json);
 }
 
-char *dump_program(ASTNode_LinkedList *program) {
-  cJSON *json = serialize_program(program);
-  char *dump = cJSON_Print(json);
-  cJSON_Delete(json);
-  return dump;
+bool dump_program_to(Parser *parser, NodeSpan program, FILE *file,
+                     bool compact) {
+  JsonWriter json = json_writer_file(file, compact);
+  serialize_program(&json, parser, program);
+  return json_writer_finish(&json);
 }
 
-char *dump_node(ASTNode *node) {
-  cJSON *json = serialize_node(node);
-  char *dump = cJSON_Print(json);
-  cJSON_Delete(json);
-  return dump;
+char *dump_node(Parser *parser, ASTNode *node) {
+  JsonWriter json = json_writer_string(false);
+  serialize_node(&json, parser, node);
+  return json_writer_take(&json);
 }
 
-int8_t get_infix_precedence(const char *op) {
-  if (strcmp(op, "and") == 0)
+int8_t get_infix_precedence(TokenSubkind op) {
+  switch (op) {
+  case KW_AND:
     return 10;
-  if (strcmp(op, "or") == 0)
+  case KW_OR:
     return 5;
 
   // Comparisons
-  if (strcmp(op, "<") == 0 || strcmp(op, ">") == 0 || strcmp(op, "<=") == 0 ||
-      strcmp(op, ">=") == 0 || strcmp(op, "==") == 0 || strcmp(op, "!=") == 0)
+  case OP_LT:
+  case OP_GT:
+  case OP_LT_EQ:
+  case OP_GT_EQ:
+  case OP_EQ_EQ:
+  case OP_BANG_EQ:
     return 20;
 
   // Bitwise OR
-  if (strcmp(op, "|") == 0)
+  case OP_PIPE:
     return 21;
 
   // Bitwise XOR
-  if (strcmp(op, "^") == 0)
+  case OP_CARET:
     return 22;
 
   // Bitwise AND
-  if (strcmp(op, "&") == 0)
+  case OP_AMP:
     return 23;
 
   // Shift Operators
-  if (strcmp(op, "<<") == 0 || strcmp(op, ">>") == 0)
+  case OP_LT_LT:
+  case OP_GT_GT:
     return 24;
 
   // Additive
-  if (strcmp(op, "+") == 0 || strcmp(op, "-") == 0)
+  case OP_PLUS:
+  case OP_MINUS:
     return 30;
 
   // Multiplicative
-  if (strcmp(op, "*") == 0 || strcmp(op, "/") == 0)
+  case OP_STAR:
+  case OP_SLASH:
     return 40;
 
   // Exponentiation (Right-associative)
-  if (strcmp(op, "**") == 0)
+  case OP_STAR_STAR:
     return 50;
 
-  if (strcmp(op, "(") == 0)
-    return 70;
-
-  if (strcmp(op, "[") == 0)
+  case OP_LPAR:
+  case OP_LSQB:
     return 70;
 
-  if (strcmp(op, ".") == 0)
+  case OP_DOT:
     return 80;
 
-  return 0;
+  default:
+    return 0;
+  }
 }
 
-int8_t get_prefix_precedence(const char *op) {
-  if (strcmp(op, "not") == 0)
-    return 60;
-  if (strcmp(op, "+") == 0 || strcmp(op, "-") == 0)
+int8_t get_prefix_precedence(TokenSubkind op) {
+  switch (op) {
+  case KW_NOT:
+  case OP_PLUS:
+  case OP_MINUS:
     return 60;
 
   // Bitwise NOT
-  if (strcmp(op, "~") == 0)
+  case OP_TILDE:
     return 65;
 
-  return 0;
+  default:
+    return 0;
+  }
 }
 
-static inline bool is_prefix_operator(Token *t) {
-  if (t->type == OPERATOR) {
-    if (strcmp(t->lexeme, "+") == 0 || strcmp(t->lexeme, "-") == 0 ||
-        strcmp(t->lexeme, "~") == 0) {
-      return true;
-    }
+static inline bool is_prefix_operator(Parser *parser, TokenIndex t) {
+  switch (tok_sub(parser, t)) {
+  case OP_PLUS:
+  case OP_MINUS:
+  case OP_TILDE:
+  case KW_NOT:
+    return true;
+  default:
+    return false;
   }
-  return t->type == KEYWORD && strcmp(t->lexeme, "not") == 0;
 }
 
-static inline bool is_comparison_operator(Token *t) {
-  for (size_t j = 0; j < ARRAYSIZE(COMPARISON_OPERATORS); j++) {
-    if (strcmp(COMPARISON_OPERATORS[j], t->lexeme) == 0) {
-      return true;
-    }
+static inline bool is_comparison_operator(Parser *parser, TokenIndex t) {
+  switch (tok_sub(parser, t)) {
+  case OP_EQ_EQ:
+  case OP_BANG_EQ:
+  case OP_GT:
+  case OP_LT:
+  case OP_GT_EQ:
+  case OP_LT_EQ:
+    return true;
+  default:
+    return false;
   }
-
-  return false;
 }
 
-ASTNode_LinkedList parse_argument_list(Parser *parser);
-
 ASTNode *parse_assign(Parser *parser, ASTNode *target) {
   advance(parser); // Move to '='
-  Token *assign_token = parser->current;
+  TokenIndex assign_token = parser->current;
   advance(parser); // Move to value
   ASTNode *value = parse_expression(parser, 0);
   ASTNode *assign_node = node_new(parser, assign_token, ASSIGNMENT);
   assign_node->ctx = STORE;
-  assign_node->assign.targets =
-      ASTNode_new_with_allocator(&parser->ast.allocator, 1);
   target->ctx = STORE;
-  target->parent = assign_node;
-  ASTNode_add_last(&assign_node->assign.targets, target);
-  assign_node->assign.value = value;
+  target->parent = node_ref(parser, assign_node);
+  uint32_t targets = AST_list_begin(&parser->ast);
+  AST_list_push(&parser->ast, target);
+  assign_node->assign.targets = AST_list_end(&parser->ast, targets);
+  assign_node->assign.value = node_ref(parser, value);
   return assign_node;
 }
 
 ASTNode *parse_attribute(Parser *parser, ASTNode *left) {
   advance(parser);
   ASTNode *node = node_new(parser, parser->current, ATTRIBUTE);
-  node->attribute.value = left;
-  node->attribute.attr =
-      arena_strdup(&parser->ast.allocator.base, parser->current->lexeme);
-  if (strcmp(parser->next->lexeme, "=") == 0) {
+  node->attribute.value = node_ref(parser, left);
+  // Shares the interned text of the name
+  node->attribute.attr = tok_lexeme(parser, parser->current);
+  if (tok_sub(parser, parser->next) == OP_EQ) {
     ASTNode *assign = parse_assign(parser, node);
-    node->parent = assign;
+    node->parent = node_ref(parser, assign);
     return assign;
   }
   node->ctx = LOAD;
   return node;
 }
 
-static inline bool is_boolean_infix(Token *t) {
-  return t->type == KEYWORD &&
-         (strcmp(t->lexeme, "and") == 0 || strcmp(t->lexeme, "or") == 0);
+static inline bool is_boolean_infix(Parser *parser, TokenIndex t) {
+  TokenSubkind op = tok_sub(parser, t);
+  return op == KW_AND || op == KW_OR;
+}
+
+// Depth of the parsing routines that still recurse before the input is
+// rejected
+#define PARSE_MAX_NESTING 1000
+
+// Parsing state of an expression that is still waiting for an operand.
+// parse_expression() keeps these on an explicit stack instead of recursing,
+// so long operator chains and deeply nested brackets cannot exhaust the C
+// stack.
+typedef enum ExprFrameKind {
+  FRAME_PREFIX,    // Unary operator `node` waits for its operand
+  FRAME_INFIX,     // `node` is the left operand of the operator `token`
+  FRAME_COMPARE,   // Comparison `node` waits for the operand after `token`
+  FRAME_GROUP,     // '(' at `token` waits for its first expression
+  FRAME_TUPLE,     // Tuple `node` collects its elements from `mark`
+  FRAME_LIST,      // '[' at `token` waits for its first expression
+  FRAME_LIST_ITEM, // List `node` collects its elements from `mark`
+  FRAME_ARGUMENT,  // Call `node` collects its arguments from `mark`
+  FRAME_SUBSCRIPT, // Subscript `node` waits for its slice
+} ExprFrameKind;
+
+typedef struct ExprFrame {
+  ExprFrameKind kind;
+  int8_t rbp; // Binding power the pending operand is parsed with
+  TokenIndex token;
+  ASTNode *node;
+  uint32_t mark;
+} ExprFrame;
+
+static void frame_push(Parser *parser, ExprFrame frame) {
+  if (parser->frame_count == parser->frame_capacity) {
+    uint32_t cap = parser->frame_capacity ? parser->frame_capacity * 2 : 64;
+    ExprFrame *grown = allocator_realloc(
+        &parser->ast.allocator, parser->frames,
+        parser->frame_capacity * sizeof(ExprFrame), cap * sizeof(ExprFrame));
+    ASSERT(grown != NULL, "Failed to grow the expression stack");
+    parser->frames = grown;
+    parser->frame_capacity = cap;
+  }
+
+  parser->frames[parser->frame_count++] = frame;
+}
+
+// Guards the parsing routines that still recurse: blocks, comprehensions and
+// expressions nested inside them
+static void nesting_enter(Parser *parser) {
+  if (++parser->nesting > PARSE_MAX_NESTING) {
+    syntax_error("too many nested blocks or expressions", &parser->lexer,
+                 parser->current);
+  }
+}
+
+// Moves past the comma to the next element of a bracketed list. Returns
+// false at the end of the list, a trailing comma included.
+static bool element_follows(Parser *parser, TokenType closer) {
+  if (!parser->next || tok_type(parser, parser->next) != COMMA)
+    return false;
+
+  advance(parser); // consume comma
+  advance(parser); // move to next expression
+  return tok_type(parser, parser->current) != closer;
+}
+
+// Moves past an argument to the next one. Returns false at the end of the
+// argument list.
+static bool argument_follows(Parser *parser) {
+  advance(parser);
+  if (parser->current == TOKEN_NONE)
+    return false;
+
+  switch (tok_type(parser, parser->current)) {
+  case COMMA:
+    advance(parser); // Consume COMMA
+    return parser->current != TOKEN_NONE &&
+           tok_type(parser, parser->current) != RPAR;
+  case RPAR:
+  case ENDMARKER:
+    return false;
+  default:
+    return true;
+  }
 }
 
-// NUD (Null Denotation) - Parses a token that starts an expression
-ASTNode *nud(Parser *parser) {
-  Token *token = parser->current;
-  switch (token->type) {
+// Starts an operand at the current token. Returns it if it is complete, or
+// NULL after pushing a frame for a prefix operator or an opening bracket.
+static ASTNode *expr_operand(Parser *parser) {
+  TokenIndex token = parser->current;
+  switch (tok_type(parser, token)) {
   case NUMBER:
   case STRING:
     return node_new(parser, token, LITERAL);
 
-  case IDENTIFIER:
-    if (parser->next->type == LPAR) {
-      ASTNode *callee = node_new(parser, token, VARIABLE);
-      return parse_call(parser, callee);
-    }
-    return node_new(parser, token, VARIABLE);
-  case LPAR: {
+  case IDENTIFIER: {
+    if (tok_type(parser, parser->next) != LPAR)
+      return node_new(parser, token, VARIABLE);
+
+    ASTNode *callee = node_new(parser, token, VARIABLE);
+    ASTNode *call = node_new(parser, callee->token, CALL);
+    call->call.func = node_ref(parser, callee);
     advance(parser);
 
-    // Check for empty tuple: ()
-    if (parser->current && parser->current->type == RPAR) {
-      ASTNode *tuple_node = node_new(parser, token, TUPLE);
-      tuple_node->collection =
-          ASTNode_new_with_allocator(&parser->ast.allocator, 0);
-      return tuple_node;
+    // Check for empty argument list: f()
+    if (parser->next && tok_type(parser, parser->next) == RPAR) {
+      call->call.args = (NodeSpan){0};
+      return call;
     }
 
-    ASTNode *first_expr = parse_expression(parser, 0);
-
-    // Check if there's a comma after the first expression (indicates tuple)
-    if (parser->next && parser->next->type == COMMA) {
-      ASTNode *tuple_node = node_new(parser, token, TUPLE);
-      tuple_node->collection =
-          ASTNode_new_with_allocator(&parser->ast.allocator, 4);
-      ASTNode_add_last(&tuple_node->collection, first_expr);
-
-      // Parse remaining tuple elements
-      while (parser->next && parser->next->type == COMMA) {
-        advance(parser); // consume comma
-        advance(parser); // move to next expression
-
-        // Check for trailing comma: (1, 2,)
-        if (parser->current->type == RPAR) {
-          break;
-        }
+    uint32_t args = AST_list_begin(&parser->ast);
+    advance(parser);
+    frame_push(parser, (ExprFrame){
+                           .kind = FRAME_ARGUMENT, .node = call, .mark = args});
+    return NULL;
+  }
 
-        ASTNode *elem = parse_expression(parser, 0);
-        ASTNode_add_last(&tuple_node->collection, elem);
-      }
+  case LPAR:
+    advance(parser);
 
-      advance(parser); // consume RPAR
+    // Check for empty tuple: ()
+    if (parser->current && tok_type(parser, parser->current) == RPAR) {
+      ASTNode *tuple_node = node_new(parser, token, TUPLE);
+      tuple_node->collection = (NodeSpan){0};
       return tuple_node;
     }
 
-    // Not a tuple, just a parenthesized expression
-    advance(parser);
-    return first_expr;
-  }
-  case LSQB: {
-    Token *bracket_token = token;
+    frame_push(parser, (ExprFrame){.kind = FRAME_GROUP, .token = token});
+    return NULL;
+
+  case LSQB:
     advance(parser); // Consume '['
 
-    // 1. Handle empty list: []
-    if (parser->current && parser->current->type == RSQB) {
-      ASTNode *list_node = node_new(parser, bracket_token, LIST_EXPR);
-      list_node->collection =
-          ASTNode_new_with_allocator(&parser->ast.allocator, 1);
+    // Handle empty list: []
+    if (parser->current && tok_type(parser, parser->current) == RSQB) {
+      ASTNode *list_node = node_new(parser, token, LIST_EXPR);
+      list_node->collection = (NodeSpan){0};
       return list_node;
     }
 
-    // 2. Parse the first expression
-    ASTNode *first_expr = parse_expression(parser, 0);
-
-    // 3. Peek for 'for' keyword to identify a List Comprehension
-    if (parser->next && parser->next->type == KEYWORD &&
-        strcmp(parser->next->lexeme, "for") == 0) {
-      ASTNode *comp = parse_comprehension_body(parser, bracket_token,
-                                               LIST_COMPREHENSION, first_expr);
-      consume(parser, RSQB);
-      return comp;
-    }
-
-    // 4. Fallback: Regular List Expression [1, 2, 3]
-    ASTNode *list_node = node_new(parser, bracket_token, LIST_EXPR);
-    list_node->collection =
-        ASTNode_new_with_allocator(&parser->ast.allocator, 4);
-    ASTNode_add_last(&list_node->collection, first_expr);
-
-    while (parser->next && parser->next->type == COMMA) {
-      advance(parser); // consume comma
-      advance(parser); // move to next expression
-
-      if (parser->current->type == RSQB)
-        break;
-
-      ASTNode *elem = parse_expression(parser, 0);
-      ASTNode_add_last(&list_node->collection, elem);
-    }
+    frame_push(parser, (ExprFrame){.kind = FRAME_LIST, .token = token});
+    return NULL;
 
-    consume(parser, RSQB);
-    return list_node;
-  }
   case KEYWORD:
   case OPERATOR:
-    if (is_prefix_operator(token)) {
+    if (is_prefix_operator(parser, token)) {
       advance(parser);
       ASTNode *node = node_new(parser, token, UNARY_OPERATION);
-      int8_t rbp = get_prefix_precedence(token->lexeme);
-      node->bin_op.right = parse_expression(parser, rbp);
-      return node;
+      int8_t rbp = get_prefix_precedence(tok_sub(parser, token));
+      frame_push(parser, (ExprFrame){.kind = FRAME_PREFIX,
+                                     .rbp = rbp,
+                                     .token = token,
+                                     .node = node});
+      return NULL;
     }
 
-    if (strcmp(token->lexeme, "None") == 0) {
+    if (tok_sub(parser, token) == KW_NONE) {
       return node_new(parser, token, LITERAL);
     }
     break;
@@ -537,122 +766,213 @@ ASTNode *nud(Parser *parser) {
 
   syntax_error(
       "expected start of expression (literal, variable, or prefix operator)",
-      parser->lexer.filename, token);
+      &parser->lexer, token);
   return NULL;
 }
 
-ASTNode *led(Parser *parser, ASTNode *left) {
-  Token *op_token = parser->current;
-  if (op_token->type == LPAR) {
-    return parse_call(parser, left);
-  }
+// Whether the next token is an operator that takes `left` as its left
+// operand inside an operand parsed with binding power `rbp`
+static bool expr_binds(Parser *parser, ASTNode *left, int8_t rbp) {
+  TokenIndex next = parser->next;
+  if (!next)
+    return false;
+
+  TokenType type = tok_type(parser, next);
+  if (type != OPERATOR && type != KEYWORD && type != LSQB)
+    return false;
+  if (rbp >= get_infix_precedence(tok_sub(parser, next)))
+    return false;
 
-  if (op_token->type == LSQB) {
-    return parse_subscript(parser, left);
+  return left->type != COMPARE || is_comparison_operator(parser, next) ||
+         is_boolean_infix(parser, next);
+}
+
+// Applies the infix operator at the current token to `left`. Returns the
+// result, or NULL after pushing a frame for the right operand.
+static ASTNode *expr_infix(Parser *parser, ASTNode *left) {
+  TokenIndex op_token = parser->current;
+  if (tok_type(parser, op_token) == LSQB) {
+    advance(parser); // move past '['
+    ASTNode *node = node_new(parser, op_token, SUBSCRIPT);
+    node->subscript.value = node_ref(parser, left);
+    frame_push(parser, (ExprFrame){.kind = FRAME_SUBSCRIPT,
+                                   .token = op_token,
+                                   .node = node});
+    return NULL;
   }
 
-  if (strcmp(op_token->lexeme, ".") == 0) {
+  if (tok_sub(parser, op_token) == OP_DOT) {
     return parse_attribute(parser, left);
   }
 
-  int8_t lbp = get_infix_precedence(op_token->lexeme);
-  ASTNode *right = NULL;
-  // Right-associativity for Exponentiation (e.g., a ** b ** c -> a ** (b ** c))
-  int8_t rbp = (strcmp(op_token->lexeme, "**") == 0) ? lbp - 1 : lbp;
-
-  if (is_comparison_operator(op_token)) {
+  int8_t lbp = get_infix_precedence(tok_sub(parser, op_token));
+  if (is_comparison_operator(parser, op_token)) {
     ASTNode *comp = NULL;
 
     if (left->type == COMPARE) {
       comp = left;
     } else {
-      comp = node_new(parser, NULL, COMPARE);
-      comp->compare.left = left;
-      comp->compare.comparators =
-          ASTNode_new_with_allocator(&parser->ast.allocator, 3);
-      comp->compare.ops = Token_new_with_allocator(&parser->ast.allocator, 3);
+      comp = node_new(parser, TOKEN_NONE, COMPARE);
+      comp->compare.left = node_ref(parser, left);
+      comp->compare.comparators = (NodeSpan){0};
+      comp->compare.ops =
+          allocator_alloc(&parser->ast.allocator, sizeof(Token_ArrayList));
+      *comp->compare.ops = Token_new_with_allocator(&parser->ast.allocator, 3);
     }
 
     advance(parser);
-    right = parse_expression(parser, lbp + 1);
-    ASTNode_add_last(&comp->compare.comparators, right);
-    Token_push(&comp->compare.ops, op_token);
-    return comp;
+    frame_push(parser, (ExprFrame){.kind = FRAME_COMPARE,
+                                   .rbp = (int8_t)(lbp + 1),
+                                   .token = op_token,
+                                   .node = comp});
+    return NULL;
   }
-  // Regular binary operation
+
+  // Right-associativity for Exponentiation (e.g., a ** b ** c -> a ** (b ** c))
+  int8_t rbp = tok_sub(parser, op_token) == OP_STAR_STAR ? lbp - 1 : lbp;
   advance(parser);
-  right = parse_expression(parser, rbp);
-  ASTNode *node = bin_op_new(parser, op_token, left, right);
-  return node;
+  frame_push(parser, (ExprFrame){.kind = FRAME_INFIX,
+                                 .rbp = rbp,
+                                 .token = op_token,
+                                 .node = left});
+  return NULL;
 }
 
-ASTNode *parse_expression(Parser *parser, int8_t rbp) {
-  ASTNode *left = nud(parser);
-
-  while (parser->next &&
-         (parser->next->type == OPERATOR || parser->next->type == KEYWORD ||
-          parser->next->type == LSQB) &&
-         rbp < get_infix_precedence(parser->next->lexeme)) {
-    if (left->type == COMPARE && !is_comparison_operator(parser->next) &&
-        !is_boolean_infix(parser->next)) {
-      break;
+// Hands the finished operand `left` to the frame on top of the stack and
+// pops it. Returns what the frame completes, or NULL when the frame was
+// pushed back to wait for the next element of a list.
+static ASTNode *expr_reduce(Parser *parser, ASTNode *left) {
+  ExprFrame frame = parser->frames[--parser->frame_count];
+  ASTNode *node = frame.node;
+  switch (frame.kind) {
+  case FRAME_PREFIX:
+    node->bin_op.right = node_ref(parser, left);
+    if (left)
+      left->parent = node_ref(parser, node);
+    return node;
+
+  case FRAME_INFIX:
+    return bin_op_new(parser, frame.token, node, left);
+
+  case FRAME_COMPARE:
+    // Chained comparisons grow the list one operand at a time
+    AST_append(&parser->ast, &node->compare.comparators, left);
+    Token_push(node->compare.ops, frame.token);
+    return node;
+
+  case FRAME_GROUP:
+    // Check if there's a comma after the first expression (indicates tuple)
+    if (!parser->next || tok_type(parser, parser->next) != COMMA) {
+      // Not a tuple, just a parenthesized expression
+      advance(parser);
+      return left;
     }
 
-    advance(parser);
-    left = led(parser, left);
-  }
-
-  return left;
-}
+    node = node_new(parser, frame.token, TUPLE);
+    frame = (ExprFrame){.kind = FRAME_TUPLE,
+                        .node = node,
+                        .mark = AST_list_begin(&parser->ast)};
+    // fallthrough
+  case FRAME_TUPLE:
+    AST_list_push(&parser->ast, left);
+    if (element_follows(parser, RPAR)) {
+      frame_push(parser, frame);
+      return NULL;
+    }
 
-ASTNode_LinkedList parse_argument_list(Parser *parser) {
-  ASTNode_LinkedList args =
-      ASTNode_new_with_allocator(&parser->ast.allocator, 4);
+    node->collection = AST_list_end(&parser->ast, frame.mark);
+    advance(parser); // consume RPAR
+    return node;
 
-  // Check for empty argument list: f()
-  if (parser->next && parser->next->type == RPAR) {
-    return args;
-  }
+  case FRAME_LIST:
+    // Peek for 'for' keyword to identify a List Comprehension
+    if (parser->next && tok_sub(parser, parser->next) == KW_FOR) {
+      ASTNode *comp = parse_comprehension_body(parser, frame.token,
+                                               LIST_COMPREHENSION, left);
+      consume(parser, RSQB);
+      return comp;
+    }
 
-  advance(parser);
+    // Fallback: Regular List Expression [1, 2, 3]
+    node = node_new(parser, frame.token, LIST_EXPR);
+    frame = (ExprFrame){.kind = FRAME_LIST_ITEM,
+                        .node = node,
+                        .mark = AST_list_begin(&parser->ast)};
+    // fallthrough
+  case FRAME_LIST_ITEM:
+    AST_list_push(&parser->ast, left);
+    if (element_follows(parser, RSQB)) {
+      frame_push(parser, frame);
+      return NULL;
+    }
 
-  do {
-    ASTNode *arg = parse_expression(parser, 0);
+    node->collection = AST_list_end(&parser->ast, frame.mark);
+    consume(parser, RSQB);
+    return node;
 
+  case FRAME_ARGUMENT:
     // Detect generator expression
-    if (parser->next && parser->next->type == KEYWORD &&
-        strcmp(parser->next->lexeme, "for") == 0) {
-      ASTNode *genexp =
-          parse_comprehension_body(parser, arg->token, LIST_COMPREHENSION, arg);
-      ASTNode_add_last(&args, genexp);
+    if (parser->next && tok_sub(parser, parser->next) == KW_FOR) {
+      ASTNode *genexp = parse_comprehension_body(parser, left->token,
+                                                 LIST_COMPREHENSION, left);
+      AST_list_push(&parser->ast, genexp);
       advance(parser); // consume RPAR
-      return args;
+    } else {
+      AST_list_push(&parser->ast, left);
+      if (argument_follows(parser)) {
+        frame_push(parser, frame);
+        return NULL;
+      }
     }
 
-    ASTNode_add_last(&args, arg);
-    advance(parser);
+    node->call.args = AST_list_end(&parser->ast, frame.mark);
+    return node;
 
-    // Check the token immediately after the expression
-    if (parser->current == NULL)
-      break;
+  case FRAME_SUBSCRIPT:
+    node->subscript.slice = node_ref(parser, left);
+    consume(parser, RSQB); // expects and consumes ']'
+    return node;
+  }
 
-    if (parser->current->type == COMMA) {
-      advance(parser); // Consume COMMA
-    } else if (parser->current->type == RPAR ||
-               parser->current->type == ENDMARKER) {
-      break; // Done with arguments
-    } else {
-      continue;
-    }
-  } while (parser->current && parser->current->type != RPAR);
+  UNREACHABLE("unknown expression frame");
+}
 
-  return args;
+// Pratt parser driven by an explicit stack: operands are started by
+// expr_operand(), operators binding tighter than the innermost pending
+// operand are applied by expr_infix(), and expr_reduce() completes the
+// innermost frame once nothing binds anymore
+ASTNode *parse_expression(Parser *parser, int8_t rbp) {
+  nesting_enter(parser);
+  uint32_t base = parser->frame_count;
+  for (;;) {
+    ASTNode *left = expr_operand(parser);
+    while (left != NULL) {
+      int8_t bp = parser->frame_count > base
+                      ? parser->frames[parser->frame_count - 1].rbp
+                      : rbp;
+      if (expr_binds(parser, left, bp)) {
+        advance(parser);
+        left = expr_infix(parser, left);
+      } else if (parser->frame_count > base) {
+        left = expr_reduce(parser, left);
+      } else {
+        parser->nesting--;
+        return left;
+      }
+    }
+  }
 }
 
-ASTNode *bin_op_new(Parser *parser, Token *operation, ASTNode *left,
+ASTNode *bin_op_new(Parser *parser, TokenIndex operation, ASTNode *left,
                     ASTNode *right) {
   ASTNode *node = node_new(parser, operation, BINARY_OPERATION);
-  node->bin_op = (BinOp){.left = left, .right = right};
+  node->bin_op = (BinOp){.left = node_ref(parser, left),
+                         .right = node_ref(parser, right)};
+  // Lets sa_invalidate_type reach the operation from its operands
+  if (left)
+    left->parent = node_ref(parser, node);
+  if (right)
+    right->parent = node_ref(parser, node);
   return node;
 }
 
@@ -666,100 +986,93 @@ bool blacklist_tokens(TokenType type, const TokenType blacklist[],
   return false;
 }
 
-void parse_identifiers_into_list(Parser *parser, ASTNode_LinkedList *list,
-                                 Token *token, Context ctx) {
+void parse_identifiers_into_list(Parser *parser, TokenIndex token,
+                                 Context ctx) {
   ASTNode *var = node_new(parser, token, VARIABLE);
   var->ctx = ctx;
-  ASTNode_add_last(list, var);
-  Token *next = advance(parser);
+  AST_list_push(&parser->ast, var);
+  TokenIndex next = advance(parser);
 
-  for (; next != NULL && next->type == COMMA; next = advance(parser)) {
-    if (token == NULL || token->type != IDENTIFIER) {
-      syntax_error("expected identifier after comma", parser->lexer.filename,
-                   token);
+  for (; next != TOKEN_NONE && tok_type(parser, next) == COMMA;
+       next = advance(parser)) {
+    if (token == TOKEN_NONE || tok_type(parser, token) != IDENTIFIER) {
+      syntax_error("expected identifier after comma", &parser->lexer, token);
     }
 
     token = advance(parser);
     var = node_new(parser, token, VARIABLE);
     var->ctx = ctx;
-    ASTNode_add_last(list, var);
+    AST_list_push(&parser->ast, var);
   }
 }
 
-ASTNode_LinkedList parse_identifier_list(Parser *parser, Token *token,
-                                         Context ctx) {
-  ASTNode_LinkedList targets =
-      ASTNode_new_with_allocator(&parser->ast.allocator, 1);
-  parse_identifiers_into_list(parser, &targets, token, ctx);
-  return targets;
+NodeSpan parse_identifier_list(Parser *parser, TokenIndex token,
+                               Context ctx) {
+  uint32_t targets = AST_list_begin(&parser->ast);
+  parse_identifiers_into_list(parser, token, ctx);
+  return AST_list_end(&parser->ast, targets);
 }
 
-Token *consume(Parser *parser, TokenType expected) {
-  Token *token = advance(parser);
-  if (!token || token->type != expected) {
-    syntax_error("unexpected token", parser->lexer.filename, token);
+TokenIndex consume(Parser *parser, TokenType expected) {
+  TokenIndex token = advance(parser);
+  if (!token || tok_type(parser, token) != expected) {
+    syntax_error("unexpected token", &parser->lexer, token);
   }
   return token;
 }
 
-ASTNode *parse_call(Parser *parser, ASTNode *callee) {
-  ASTNode *node = node_new(parser, callee->token, CALL);
-  node->call.func = callee;
-  advance(parser);
-  node->call.args = parse_argument_list(parser);
-  return node;
-}
-
 ASTNode *parse_while_statement(Parser *parser, ASTNode *while_node) {
   ASTNode *condition = parse_expression(parser, 0);
-  while_node->ctrl_stmt.test = condition;
-  while_node->ctrl_stmt.body =
-      ASTNode_new_with_allocator(&parser->ast.allocator, 4);
-  while_node->ctrl_stmt.orelse =
-      ASTNode_new_with_allocator(&parser->ast.allocator, 4);
+  while_node->ctrl_stmt.test = node_ref(parser, condition);
+  while_node->ctrl_stmt.orelse = (NodeSpan){0};
   advance(parser);
 
-  if (parser->next == NULL || parser->next->type != NEWLINE) {
+  if (parser->next == TOKEN_NONE || tok_type(parser, parser->next) != NEWLINE) {
     syntax_error("expected newline after ':' in 'while' statement",
-                 parser->lexer.filename, parser->next);
+                 &parser->lexer, parser->next);
     return NULL;
   }
 
   advance(parser);
-  while (advance(parser) != NULL) {
+  uint32_t body = AST_list_begin(&parser->ast);
+  while (advance(parser) != TOKEN_NONE) {
     ASTNode *stmt = parse_statement(parser);
 
     if (stmt == NULL || stmt->type == END_BLOCK) {
       break;
     }
 
-    ASTNode_add_last(&while_node->ctrl_stmt.body, stmt);
+    AST_list_push(&parser->ast, stmt);
   }
+  while_node->ctrl_stmt.body = AST_list_end(&parser->ast, body);
 
   advance(parser);
-  if (parser->current && parser->current->type == KEYWORD &&
-      strcmp(parser->current->lexeme, "else") == 0) {
+  if (parser->current && tok_sub(parser, parser->current) == KW_ELSE) {
     advance(parser);
-    if (parser->current == NULL || parser->current->type != COLON) {
-      syntax_error("expected ':' after 'else'", parser->lexer.filename,
+    if (parser->current == TOKEN_NONE ||
+        tok_type(parser, parser->current) != COLON) {
+      syntax_error("expected ':' after 'else'", &parser->lexer,
                    parser->current);
       return NULL;
     }
 
-    if (parser->next == NULL || parser->next->type != NEWLINE) {
+    if (parser->next == TOKEN_NONE ||
+        tok_type(parser, parser->next) != NEWLINE) {
       syntax_error("expected newline after ':' in 'else' statement",
-                   parser->lexer.filename, parser->next);
+                   &parser->lexer, parser->next);
       return NULL;
     }
 
     // Parse the 'else' block
     advance(parser);
-    while (advance(parser) != NULL) {
+    uint32_t orelse = AST_list_begin(&parser->ast);
+    while (advance(parser) != TOKEN_NONE) {
       ASTNode *stmt = parse_statement(parser);
       if (stmt == NULL || stmt->type == END_BLOCK)
         break;
-      ASTNode_add_last(&while_node->ctrl_stmt.orelse, stmt);
+      AST_list_push(&parser->ast, stmt);
     }
+    while_node->ctrl_stmt.orelse = AST_list_end(&parser->ast, orelse);
   }
 
   return while_node;
@@ -767,44 +1080,45 @@ ASTNode *parse_while_statement(Parser *parser, ASTNode *while_node) {
 
 ASTNode *parse_if_statement(Parser *parser, ASTNode *if_node) {
   ASTNode *condition = parse_expression(parser, 0);
-  if_node->ctrl_stmt.test = condition;
-  if_node->ctrl_stmt.body =
-      ASTNode_new_with_allocator(&parser->ast.allocator, 4);
-  if_node->ctrl_stmt.orelse =
-      ASTNode_new_with_allocator(&parser->ast.allocator, 4);
+  if_node->ctrl_stmt.test = node_ref(parser, condition);
+  if_node->ctrl_stmt.orelse = (NodeSpan){0};
   advance(parser);
 
-  if (!parser->current || !parser->next || parser->current->type != COLON ||
-      parser->next->type != NEWLINE) {
+  if (!parser->current || !parser->next ||
+      tok_type(parser, parser->current) != COLON ||
+      tok_type(parser, parser->next) != NEWLINE) {
     syntax_error("expected newline after ':' in 'if' statement",
-                 parser->lexer.filename, parser->next);
+                 &parser->lexer, parser->next);
     return NULL;
   }
 
   advance(parser);
-  while (advance(parser) != NULL) {
+  uint32_t body = AST_list_begin(&parser->ast);
+  while (advance(parser) != TOKEN_NONE) {
     ASTNode *stmt = parse_statement(parser);
 
     if (stmt == NULL || stmt->type == END_BLOCK) {
       break;
     }
 
-    ASTNode_add_last(&if_node->ctrl_stmt.body, stmt);
+    AST_list_push(&parser->ast, stmt);
   }
+  if_node->ctrl_stmt.body = AST_list_end(&parser->ast, body);
 
   advance(parser);
-  if (parser->current && parser->current->type == KEYWORD &&
-      strcmp(parser->current->lexeme, "elif") == 0) {
+  if (parser->current && tok_sub(parser, parser->current) == KW_ELIF) {
     advance(parser);
     ASTNode *elif_node = node_new(parser, parser->current, IF);
     ASTNode *parsed_elif = parse_if_statement(parser, elif_node);
-    ASTNode_add_last(&if_node->ctrl_stmt.orelse, parsed_elif);
-  } else if (parser->current && parser->current->type == KEYWORD &&
-             strcmp(parser->current->lexeme, "else") == 0) {
+    uint32_t orelse = AST_list_begin(&parser->ast);
+    AST_list_push(&parser->ast, parsed_elif);
+    if_node->ctrl_stmt.orelse = AST_list_end(&parser->ast, orelse);
+  } else if (parser->current && tok_sub(parser, parser->current) == KW_ELSE) {
     advance(parser);
 
-    if (parser->current == NULL || parser->current->type != COLON) {
-      syntax_error("expected ':' after 'else'", parser->lexer.filename,
+    if (parser->current == TOKEN_NONE ||
+        tok_type(parser, parser->current) != COLON) {
+      syntax_error("expected ':' after 'else'", &parser->lexer,
                    parser->current);
       return NULL;
     }
@@ -812,220 +1126,211 @@ ASTNode *parse_if_statement(Parser *parser, ASTNode *if_node) {
     // Expect NEWLINE
     advance(parser);
 
-    if (parser->current == NULL || parser->current->type != NEWLINE) {
+    if (parser->current == TOKEN_NONE ||
+        tok_type(parser, parser->current) != NEWLINE) {
       syntax_error("expected newline after ':' in 'else' statement",
-                   parser->lexer.filename, parser->current);
+                   &parser->lexer, parser->current);
       return NULL;
     }
 
     // Parse the 'else' block
-    while (advance(parser) != NULL) {
+    uint32_t orelse = AST_list_begin(&parser->ast);
+    while (advance(parser) != TOKEN_NONE) {
       ASTNode *stmt = parse_statement(parser);
       if (stmt == NULL || stmt->type == END_BLOCK)
         break;
-      ASTNode_add_last(&if_node->ctrl_stmt.orelse, stmt);
+      AST_list_push(&parser->ast, stmt);
     }
+    if_node->ctrl_stmt.orelse = AST_list_end(&parser->ast, orelse);
   }
   return if_node;
 }
 
 ASTNode *parse_function_def(Parser *parser, ASTNode *func_node) {
-  Token *token = advance(parser);
-  if (token == NULL || token->type != IDENTIFIER) {
-    syntax_error("expected function name after 'def'", parser->lexer.filename,
-                 token);
+  TokenIndex token = advance(parser);
+  if (token == TOKEN_NONE || tok_type(parser, token) != IDENTIFIER) {
+    syntax_error("expected function name after 'def'", &parser->lexer, token);
     return NULL;
   }
 
   ASTNode *name_node = node_new(parser, token, VARIABLE);
-  func_node->def.name = name_node;
-  func_node->def.returns = NULL;
+  func_node->def.name = node_ref(parser, name_node);
+  func_node->def.returns = NODE_NONE;
 
   token = advance(parser);
-  if (token == NULL || token->type != LPAR) {
-    syntax_error("expected '(' after function name", parser->lexer.filename,
-                 token);
+  if (token == TOKEN_NONE || tok_type(parser, token) != LPAR) {
+    syntax_error("expected '(' after function name", &parser->lexer, token);
     return NULL;
   }
 
-  func_node->def.params = ASTNode_new_with_allocator(&parser->ast.allocator, 4);
-
   // Parse parameters
+  uint32_t params = AST_list_begin(&parser->ast);
   token = advance(parser);
-  while (token != NULL && token->type != RPAR) {
-    if (token->type == IDENTIFIER) {
+  while (token != TOKEN_NONE && tok_type(parser, token) != RPAR) {
+    if (tok_type(parser, token) == IDENTIFIER) {
       ASTNode *param_node = node_new(parser, token, VARIABLE);
 
-      if (parser->next && parser->next->type == COLON) {
+      if (parser->next && tok_type(parser, parser->next) == COLON) {
         advance(parser); // Consume identifier
         advance(parser); // Consume COLON
-        param_node->child = parse_expression(parser, 0);
+        param_node->child = node_ref(parser, parse_expression(parser, 0));
       }
-      param_node->parent = func_node;
-      ASTNode_add_last(&func_node->def.params, param_node);
-    } else if (token->type != COMMA) {
-      syntax_error("expected parameter name or ','", parser->lexer.filename,
-                   token);
+      param_node->parent = node_ref(parser, func_node);
+      AST_list_push(&parser->ast, param_node);
+    } else if (tok_type(parser, token) != COMMA) {
+      syntax_error("expected parameter name or ','", &parser->lexer, token);
       return NULL;
     }
     token = advance(parser);
   }
+  func_node->def.params = AST_list_end(&parser->ast, params);
 
   token = advance(parser);
-  if (token && token->type == RARROW) {
+  if (token && tok_type(parser, token) == RARROW) {
     advance(parser);
-    func_node->def.returns = parse_expression(parser, 0);
-    func_node->def.returns->parent = func_node;
+    ASTNode *returns = parse_expression(parser, 0);
+    func_node->def.returns = node_ref(parser, returns);
+    returns->parent = node_ref(parser, func_node);
     token = advance(parser);
   }
 
-  if (!token || token->type != COLON) {
+  if (!token || tok_type(parser, token) != COLON) {
     syntax_error("expected ':' after function parameters",
-                 parser->lexer.filename, token);
+                 &parser->lexer, token);
     return NULL;
   }
 
   token = advance(parser);
-  func_node->def.body = ASTNode_new_with_allocator(&parser->ast.allocator, 4);
 
   // Parse function body
-  while ((token = advance(parser)) != NULL) {
+  uint32_t body = AST_list_begin(&parser->ast);
+  while ((token = advance(parser)) != TOKEN_NONE) {
     ASTNode *stmt = parse_statement(parser);
     if (stmt == NULL || stmt->type == END_BLOCK)
       break;
 
-    stmt->parent = func_node;
-    ASTNode_add_last(&func_node->def.body, stmt);
+    stmt->parent = node_ref(parser, func_node);
+    AST_list_push(&parser->ast, stmt);
   }
+  func_node->def.body = AST_list_end(&parser->ast, body);
 
   return func_node;
 }
 
-ASTNode *parse_statement(Parser *parser) {
-  Token *token = parser->current;
-  if (token == NULL)
-    return NULL;
-
-  switch (token->type) {
+static ASTNode *parse_statement_at_token(Parser *parser, TokenIndex token) {
+  switch (tok_type(parser, token)) {
   case NUMBER: {
     return parse_expression(parser, 0);
   }
   case IDENTIFIER: {
-    if (parser->next && parser->next->type == COLON) {
+    if (parser->next && tok_type(parser, parser->next) == COLON) {
       ASTNode *var = node_new(parser, token, VARIABLE);
       advance(parser);
       advance(parser);
 
       // Parse the type (e.g., "int", "List", etc.)
-      var->child = parse_expression(parser, 0);
+      var->child = node_ref(parser, parse_expression(parser, 0));
 
-      if (parser->next && strcmp(parser->next->lexeme, "=") == 0) {
+      if (parser->next && tok_sub(parser, parser->next) == OP_EQ) {
         return parse_assign(parser, var);
       }
 
       return var;
     }
 
-    if (parser->next && is_augassign_op(parser->next->lexeme)) {
-      ASTNode_LinkedList targets = parse_identifier_list(parser, token, STORE);
+    if (parser->next && is_augassign_op(tok_sub(parser, parser->next))) {
+      NodeSpan targets = parse_identifier_list(parser, token, STORE);
       ASTNode *node = node_new(parser, parser->current, AUG_ASSIGNMENT);
       advance(parser);
       ASTNode *expr = parse_expression(parser, 0);
-      ASTNode *target = ASTNode_pop(&targets);
-      node->aug_assign =
-          (AugAssign){.target = target, .op = parser->current, .value = expr};
+      ASTNode *target = AST_pop(&parser->ast, &targets);
+      node->aug_assign = (AugAssign){.target = node_ref(parser, target),
+                                     .op = parser->current,
+                                     .value = node_ref(parser, expr)};
       return node;
     }
 
-    if (parser->next && (strcmp(parser->next->lexeme, "=") == 0 ||
-                         strcmp(parser->next->lexeme, ",") == 0)) {
-      ASTNode_LinkedList targets = parse_identifier_list(parser, token, STORE);
+    if (parser->next && (tok_sub(parser, parser->next) == OP_EQ ||
+                         tok_sub(parser, parser->next) == OP_COMMA)) {
+      NodeSpan targets = parse_identifier_list(parser, token, STORE);
       ASTNode *node = node_new(parser, parser->current, ASSIGNMENT);
       advance(parser);
       ASTNode *expr = parse_expression(parser, 0);
-      node->assign = (Assign){.targets = targets, .value = expr};
+      node->assign =
+          (Assign){.targets = targets, .value = node_ref(parser, expr)};
       node->ctx = STORE;
       return node;
     }
 
     return parse_expression(parser, 0);
   } break;
-  case KEYWORD: {
-    if (strcmp(token->lexeme, "import") == 0) {
+  case KEYWORD:
+    switch (tok_sub(parser, token)) {
+    case KW_IMPORT: {
       ASTNode *node = node_new(parser, token, IMPORT);
       token = advance(parser);
       node->collection = parse_identifier_list(parser, token, LOAD);
       return node;
     }
 
-    if (strcmp(token->lexeme, "from") == 0) {
+    case KW_FROM: {
       ASTNode *node = node_new(parser, token, IMPORT_FROM);
       token = advance(parser);
       ASTNode *module = node_new(parser, token, VARIABLE);
-      node->parent = module;
+      node->parent = node_ref(parser, module);
       advance(parser);
       token = advance(parser); // Skip "import"
       node->collection = parse_identifier_list(parser, token, LOAD);
       return node;
     }
 
-    if (strcmp(token->lexeme, "if") == 0) {
+    case KW_IF: {
       ASTNode *node = node_new(parser, token, IF);
       token = advance(parser);
       return parse_if_statement(parser, node);
     }
 
-    if (strcmp(token->lexeme, "elif") == 0 ||
-        strcmp(token->lexeme, "else") == 0) {
+    case KW_ELIF:
+    case KW_ELSE:
       // Signal end of current block - elif/else should be handled by parent if
       return node_new(parser, token, END_BLOCK);
-    }
 
-    if (strcmp(token->lexeme, "while") == 0) {
+    case KW_WHILE: {
       ASTNode *node = node_new(parser, token, WHILE);
       token = advance(parser);
       return parse_while_statement(parser, node);
     }
 
-    if (strcmp(token->lexeme, "def") == 0) {
+    case KW_DEF: {
       ASTNode *node = node_new(parser, token, FUNCTION_DEF);
       return parse_function_def(parser, node);
     }
 
-    if (strcmp(token->lexeme, "class") == 0) {
+    case KW_CLASS: {
       ASTNode *node = node_new(parser, token, CLASS_DEF);
-      node->parent = NULL;
+      node->parent = NODE_NONE;
       return parse_class_def(parser, node);
     }
 
-    if (strcmp(token->lexeme, "return") == 0) {
+    case KW_RETURN: {
       ASTNode *node = node_new(parser, token, RETURN);
       advance(parser);
 
-      if (parser->next != NULL) {
-        node->child = parse_expression(parser, 0);
+      if (parser->next != TOKEN_NONE) {
+        node->child = node_ref(parser, parse_expression(parser, 0));
       } else {
-        node->child = NULL;
+        node->child = NODE_NONE;
       }
       return node;
     }
 
-    if (strcmp(token->lexeme, "match") == 0) {
+    case KW_MATCH:
       return parse_match_stmt(parser);
-    }
-  } break;
-  case NEWLINE: {
-    while (parser->next && parser->next->type == NEWLINE) {
-      advance(parser);
-    }
 
-    if (parser->next->ident != token->ident) {
-      return node_new(parser, token, END_BLOCK);
+    default:
+      break;
     }
-
-    advance(parser);
-    return parse_statement(parser);
-  } break;
+    break;
   case LSQB:
   case LPAR:
     return parse_expression(parser, 0);
@@ -1036,6 +1341,30 @@ ASTNode *parse_statement(Parser *parser) {
   return NULL;
 }
 
+ASTNode *parse_statement(Parser *parser) {
+  TokenIndex token = parser->current;
+  // Blank lines are skipped in one go
+  while (token != TOKEN_NONE && tok_type(parser, token) == NEWLINE) {
+    while (parser->next && tok_type(parser, parser->next) == NEWLINE) {
+      advance(parser);
+    }
+
+    if (tok_ident(parser, parser->next) != tok_ident(parser, token)) {
+      return node_new(parser, token, END_BLOCK);
+    }
+
+    token = advance(parser);
+  }
+
+  if (token == TOKEN_NONE)
+    return NULL;
+
+  nesting_enter(parser);
+  ASTNode *stmt = parse_statement_at_token(parser, token);
+  parser->nesting--;
+  return stmt;
+}
+
 bool is_definition_node(NodeType type) {
   static const NodeType definitions[] = {FUNCTION_DEF, CLASS_DEF, IMPORT,
                                          IMPORT_FROM};
@@ -1049,86 +1378,481 @@ bool is_definition_node(NodeType type) {
   return false;
 }
 
-Parser parse(Lexer *lexer) {
-  Parser parser = parser_new(lexer);
-  // Create a synthetic main node to collect unbound logic
-  Token *main_tok = create_token_from_str(&parser.lexer, "main", IDENTIFIER);
-  Token *def_tok = create_token_from_str(&parser.lexer, "def", KEYWORD);
-  ASTNode *name = node_new(&parser, main_tok, VARIABLE);
-  ASTNode *synthetic_main = node_new(&parser, def_tok, FUNCTION_DEF);
-  synthetic_main->def.name = name;
-  synthetic_main->def.returns = NULL;
-  synthetic_main->def.body =
-      ASTNode_new_with_allocator(&parser.ast.allocator, 4);
-  synthetic_main->def.params =
-      ASTNode_new_with_allocator(&parser.ast.allocator, 2);
+// Module level statements stay in the program, the rest run from main
+static bool is_module_statement(Parser *parser, ASTNode *stmt) {
+  return is_definition_node(stmt->type) ||
+         (stmt->type == ASSIGNMENT && !stmt->parent) ||
+         is_python_main_check(parser, stmt);
+}
+
+// Splits the top-level statements into the program and a synthetic main
+// collecting the unbound logic
+static void build_program(Parser *parser) {
+  AST *ast = &parser->ast;
+  TokenIndex main_tok =
+      create_token_from_str(&parser->lexer, "main", IDENTIFIER);
+  TokenIndex def_tok = create_token_from_str(&parser->lexer, "def", KEYWORD);
+  ASTNode *name = node_new(parser, main_tok, VARIABLE);
+  ASTNode *synthetic_main = node_new(parser, def_tok, FUNCTION_DEF);
+  synthetic_main->def.name = node_ref(parser, name);
+  synthetic_main->def.returns = NODE_NONE;
+  synthetic_main->def.params = (NodeSpan){0};
   bool explicit_main_found = false;
-  // ---
 
-  while (advance(&parser) != NULL) {
-    ASTNode *stmt = parse_statement(&parser);
+  NodeSpan statements = parser->statements;
+  uint32_t main_body = AST_list_begin(ast);
+  for (uint32_t i = 0; i < statements.count; i++) {
+    ASTNode *stmt = AST_child(ast, statements, i);
+    // Unbound executable statements (calls, etc) move to synthetic main
+    if (!is_module_statement(parser, stmt))
+      AST_list_push(ast, stmt);
+  }
+  synthetic_main->def.body = AST_list_end(ast, main_body);
 
-    if (!stmt)
-      break;
+  uint32_t program = AST_list_begin(ast);
+  for (uint32_t i = 0; i < statements.count; i++) {
+    ASTNode *stmt = AST_child(ast, statements, i);
+    if (!is_module_statement(parser, stmt))
+      continue;
 
-    if (is_definition_node(stmt->type)) {
-      ASTNode_add_last(&parser.ast, stmt);
-    } else if (stmt->type == ASSIGNMENT && !stmt->parent) {
-      ASTNode_add_last(&parser.ast, stmt);
-    } else if (is_python_main_check(stmt)) {
-      // Found 'if __name__ == "__main__":'
+    // Found 'if __name__ == "__main__":'
+    if (is_python_main_check(parser, stmt))
       explicit_main_found = true;
-      ASTNode_add_last(&parser.ast, stmt);
-    } else {
-      // Unbound executable statements (calls, etc) move to synthetic main
-      ASTNode_add_last(&synthetic_main->def.body, stmt);
-    }
+    AST_list_push(ast, stmt);
   }
 
   // Finalization: If we have unbound code and no explicit main, add our
   // synthetic one
-  if (!explicit_main_found && synthetic_main->def.body.size > 0) {
-    ASTNode_add_last(&parser.ast, synthetic_main);
+  if (!explicit_main_found && synthetic_main->def.body.count > 0) {
+    AST_list_push(ast, synthetic_main);
+  }
+
+  parser->program = AST_list_end(ast, program);
+}
+
+// Top-level statements being collected: the nodes sit on the scratch stack
+// from `mark` and the token each one starts at is kept in `starts`
+typedef struct StatementList {
+  uint32_t mark;
+  TokenIndex *starts;
+  uint32_t capacity;
+} StatementList;
+
+static void statement_push(Parser *parser, StatementList *list,
+                           ASTNode *stmt, TokenIndex start) {
+  AST *ast = &parser->ast;
+  uint32_t count = ast->scratch_size - list->mark;
+  if (count == list->capacity) {
+    uint32_t cap = list->capacity ? list->capacity * 2 : 64;
+    TokenIndex *grown = allocator_realloc(
+        &ast->allocator, list->starts, list->capacity * sizeof(TokenIndex),
+        cap * sizeof(TokenIndex));
+    if (grown == NULL) {
+      slog_error("Failed to resize top-level statement list");
+      return;
+    }
+    list->starts = grown;
+    list->capacity = cap;
   }
 
-  return parser;
+  list->starts[count] = start;
+  AST_list_push(ast, stmt);
+}
+
+// Takes the top-level statements and builds the program out of them
+static void parser_finish(Parser *parser, NodeSpan statements,
+                          TokenIndex *starts) {
+  // Parsing may stop early, later phases still see every token
+  lexer_stream_finish(&parser->lexer);
+  parser->statements = statements;
+  parser->statement_starts = starts;
+  build_program(parser);
+}
+
+static void statement_list_end(Parser *parser, StatementList *list) {
+  NodeSpan statements = AST_list_end(&parser->ast, list->mark);
+  parser_finish(parser, statements, list->starts);
+}
+
+// Top-level statements parsed from `start` on, until one begins at or past
+// `limit`
+typedef struct ParseChunk {
+  Parser parser;
+  TokenIndex start;
+  TokenIndex limit;
+  TokenIndex end;      // Start of the first statement left out
+  bool halted;         // The statement at `end` did not parse
+  NodeSpan statements; // Children of parser.ast
+  TokenIndex *starts;  // First token of each statement
+} ParseChunk;
+
+static void parse_chunk(ParseChunk *chunk) {
+  Parser *parser = &chunk->parser;
+  StatementList list = {.mark = AST_list_begin(&parser->ast)};
+  parser->lexer.token_idx = chunk->start;
+  while (advance(parser) != TOKEN_NONE) {
+    TokenIndex start = parser->current;
+    chunk->end = start;
+    if (start >= chunk->limit)
+      break;
+
+    ASTNode *stmt = parse_statement(parser);
+    if (!stmt) {
+      chunk->halted = true;
+      break;
+    }
+
+    statement_push(parser, &list, stmt, start);
+  }
+
+  if (parser->current == TOKEN_NONE)
+    chunk->end = parser->lexer.token_end;
+  chunk->statements = AST_list_end(&parser->ast, list.mark);
+  chunk->starts = list.starts;
+}
+
+Parser parse(Lexer *lexer) {
+  // A streaming lexer has not counted its tokens yet, but it makes at most
+  // one per byte besides the end marker
+  size_t tokens = lexer->stream != NULL ? lexer->source_length + 2
+                                        : lexer->tokens.size;
+  ParseChunk chunk = {.parser = parser_new(lexer, tokens),
+                      .start = lexer->token_idx,
+                      .limit = UINT32_MAX};
+  parse_chunk(&chunk);
+  parser_finish(&chunk.parser, chunk.statements, chunk.starts);
+  return chunk.parser;
+}
+
+static void shift_token(TokenIndex *token, TokenIndex from, TokenIndex to,
+                        int64_t shift) {
+  if (*token >= from && *token < to)
+    *token = (TokenIndex)(*token + shift);
+}
+
+// Moves the tokens in [from, to) referenced by the nodes below word `end` of
+// the pool by `shift` places
+static void shift_node_tokens(AST *ast, NodeIndex end, TokenIndex from,
+                              TokenIndex to, int64_t shift) {
+  for (NodeIndex i = NODE_NONE + 1; i < end;) {
+    ASTNode *node = AST_node(ast, i);
+    shift_token(&node->token, from, to, shift);
+
+    if (node->type == AUG_ASSIGNMENT) {
+      shift_token(&node->aug_assign.op, from, to, shift);
+    } else if (node->type == COMPARE && node->compare.ops) {
+      Token_ArrayList *ops = node->compare.ops;
+      for (size_t op = 0; op < ops->size; op++) {
+        shift_token(&ops->elements[op], from, to, shift);
+      }
+    }
+
+    i += node_words(node->type);
+  }
+}
+
+// Index of the statement starting at `token`, or `high` if there is none
+static uint32_t find_statement(const TokenIndex *starts, uint32_t low,
+                               uint32_t high, int64_t token) {
+  uint32_t end = high;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (starts[mid] < token)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low < end && starts[low] == token ? low : end;
+}
+
+void reparse(Parser *parser, const char *source, SourceEdit edit) {
+  AST *ast = &parser->ast;
+  NodeSpan old = parser->statements;
+  const TokenIndex *old_starts = parser->statement_starts;
+  TokenIndex old_end = parser->lexer.token_end;
+  NodeIndex old_words = ast->size;
+
+  TokenSplice splice = retokenize(&parser->lexer, source, edit);
+  int64_t shift = (int64_t)splice.inserted - splice.removed;
+  if (!AST_reserve(ast, AST_words_for(parser->lexer.tokens.size)))
+    slog_error("Could not grow the AST for the edit");
+
+  // Statements also look at the token following them, so only those ending
+  // before the first changed token are known to parse the same
+  uint32_t kept = 0;
+  while (kept < old.count) {
+    TokenIndex next = kept + 1 < old.count ? old_starts[kept + 1] : old_end;
+    if (next >= splice.first)
+      break;
+    kept++;
+  }
+
+  StatementList list = {.mark = AST_list_begin(ast)};
+  for (uint32_t i = 0; i < kept; i++) {
+    statement_push(parser, &list, AST_child(ast, old, i), old_starts[i]);
+  }
+
+  // Past the new tokens, once a statement starts where an old one did the
+  // rest of the old statements are still valid
+  parser->lexer.token_idx =
+      kept < old.count ? old_starts[kept] : TOKEN_NONE + 1;
+  TokenIndex tail = splice.first + splice.inserted;
+  uint32_t resumed = old.count;
+  while (advance(parser) != TOKEN_NONE) {
+    TokenIndex start = parser->current;
+    if (start >= tail) {
+      resumed = find_statement(old_starts, kept, old.count,
+                               (int64_t)start - shift);
+      if (resumed < old.count)
+        break;
+    }
+
+    ASTNode *stmt = parse_statement(parser);
+    if (!stmt)
+      break;
+
+    statement_push(parser, &list, stmt, start);
+  }
+
+  if (resumed < old.count && shift != 0) {
+    shift_node_tokens(ast, old_words, splice.first + splice.removed, old_end,
+                      shift);
+  }
+  for (uint32_t i = resumed; i < old.count; i++) {
+    statement_push(parser, &list, AST_child(ast, old, i),
+                   (TokenIndex)(old_starts[i] + shift));
+  }
+
+  statement_list_end(parser, &list);
+}
+
+// Top-level chunks smaller than this many tokens are not worth a thread
+#define PARSE_MIN_CHUNK_TOKENS ((TokenIndex)16 * 1024)
+#define PARSE_MAX_JOBS 64
+
+// Picks up to `count` chunk starts, `splits[0]` being the first token. Later
+// chunks start at a `def` or `class` opening an unindented line outside of
+// any bracket, where the serial parser starts a new top-level statement.
+static size_t parse_split_tokens(Lexer *lexer, TokenIndex *splits,
+                                 size_t count) {
+  TokenIndex first = lexer->token_idx;
+  TokenIndex stride = (TokenIndex)((lexer->token_end - first) / count);
+  size_t chunks = 0;
+  splits[chunks++] = first;
+
+  uint32_t depth = 0;
+  for (TokenIndex i = first; i < lexer->token_end; i++) {
+    switch (token_type(lexer, i)) {
+    case LPAR:
+    case LSQB:
+      depth++;
+      break;
+    case RPAR:
+    case RSQB:
+      if (depth > 0)
+        depth--;
+      break;
+    case OPERATOR:
+      // Attribute names are the only lexemes the parser asks for, copy the
+      // ones that are not interned before the workers race to do it
+      if (token_subkind(lexer, i) == OP_DOT && i + 1 < lexer->token_end)
+        token_lexeme(lexer, i + 1);
+      break;
+    case KEYWORD: {
+      TokenSubkind kw = token_subkind(lexer, i);
+      if (chunks < count && depth == 0 && i > first &&
+          (kw == KW_DEF || kw == KW_CLASS) && token_ident(lexer, i) == 0 &&
+          token_type(lexer, i - 1) == NEWLINE && i >= stride * chunks)
+        splits[chunks++] = i;
+      break;
+    }
+    default:
+      break;
+    }
+  }
+
+  return chunks;
+}
+
+static void *parse_worker(void *arg) {
+  parse_chunk(arg);
+  return NULL;
+}
+
+// Points a node copied by AST_adopt() at the copies of its children
+static void relocate_node(ASTNode *node, NodeIndex shift, uint32_t children) {
+  NodeLinks links = node_links(node);
+  for (uint32_t i = 0; i < links.node_count; i++) {
+    NodeIndex *link = links.nodes[i];
+    if (*link != NODE_NONE)
+      *link += shift;
+  }
+  for (uint32_t i = 0; i < links.span_count; i++) {
+    links.spans[i]->start += children;
+  }
+}
+
+// Moves the tree of a worker into `parser`, along with its statements
+static bool adopt_chunk(Parser *parser, ParseChunk *chunk) {
+  AST *ast = &parser->ast;
+  AST *from = &chunk->parser.ast;
+  NodeIndex shift = 0;
+  uint32_t children = 0;
+  NodeIndex end = ast->size + from->size - 1;
+  bool adopted = AST_adopt(ast, from, &shift, &children);
+  if (adopted) {
+    for (NodeIndex i = shift + 1; i < end;) {
+      ASTNode *node = AST_node(ast, i);
+      relocate_node(node, shift, children);
+      i += node_words(node->type);
+    }
+    chunk->statements.start += children;
+  }
+
+  AST_free(from);
+  return adopted;
+}
+
+// Parses the top-level statement at `*next` into the list and moves `*next`
+// past it. Returns false where the serial parser stops.
+static bool parse_statement_at(Parser *parser, StatementList *list,
+                               TokenIndex *next) {
+  parser->lexer.token_idx = *next;
+  if (advance(parser) == TOKEN_NONE)
+    return false;
+
+  ASTNode *stmt = parse_statement(parser);
+  if (!stmt)
+    return false;
+
+  statement_push(parser, list, stmt, *next);
+  *next = parser->lexer.token_idx;
+  return true;
+}
+
+Parser parse_parallel(Lexer *lexer, size_t jobs) {
+  // A streaming lexer already keeps the parser busy as tokens come in
+  if (lexer->stream != NULL)
+    return parse(lexer);
+
+  if (jobs == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = cpus > 0 ? (size_t)cpus : 1;
+  }
+  if (jobs > PARSE_MAX_JOBS)
+    jobs = PARSE_MAX_JOBS;
+  if (jobs > lexer->token_end / PARSE_MIN_CHUNK_TOKENS)
+    jobs = lexer->token_end / PARSE_MIN_CHUNK_TOKENS;
+
+  TokenIndex splits[PARSE_MAX_JOBS + 1];
+  size_t count = jobs > 1 ? parse_split_tokens(lexer, splits, jobs) : 1;
+  if (count <= 1)
+    return parse(lexer);
+  splits[count] = UINT32_MAX;
+
+  ParseChunk chunks[PARSE_MAX_JOBS];
+  pthread_t threads[PARSE_MAX_JOBS];
+  bool started[PARSE_MAX_JOBS] = {0};
+  for (size_t i = 0; i < count; i++) {
+    TokenIndex end = i + 1 < count ? splits[i + 1] : lexer->token_end;
+    chunks[i] = (ParseChunk){.parser = parser_new(lexer, end - splits[i]),
+                             .start = splits[i],
+                             .limit = splits[i + 1]};
+  }
+
+  // The calling thread takes the first chunk, whose tree the others join
+  for (size_t i = 1; i < count; i++) {
+    started[i] =
+        pthread_create(&threads[i], NULL, parse_worker, &chunks[i]) == 0;
+    if (!started[i]) {
+      slog_warn("Could not start parser thread, parsing chunk %zu inline", i);
+      parse_worker(&chunks[i]);
+    }
+  }
+  parse_worker(&chunks[0]);
+
+  Parser *parser = &chunks[0].parser;
+  for (size_t i = 1; i < count; i++) {
+    if (started[i])
+      pthread_join(threads[i], NULL);
+
+    if (!adopt_chunk(parser, &chunks[i])) {
+      slog_error("Could not merge parser chunk %zu", i);
+      // Its statements get parsed again below
+      chunks[i].statements.count = 0;
+    }
+  }
+
+  // Room for the statements parsed again below and the nodes later passes add
+  if (!AST_reserve(&parser->ast, AST_words_for(lexer->tokens.size)))
+    slog_error("Could not grow the merged AST");
+
+  // Take the statements of each chunk from the first one the serial parser
+  // would also start at. A chunk that did not begin on a statement boundary
+  // is caught up with one statement at a time until it does.
+  StatementList list = {.mark = AST_list_begin(&parser->ast)};
+  TokenIndex next = splits[0];
+  bool stopped = false;
+  for (size_t i = 0; i < count && !stopped; i++) {
+    ParseChunk *chunk = &chunks[i];
+    while (next < chunk->end) {
+      uint32_t first =
+          find_statement(chunk->starts, 0, chunk->statements.count, next);
+      if (first < chunk->statements.count) {
+        for (uint32_t j = first; j < chunk->statements.count; j++) {
+          statement_push(parser, &list,
+                         AST_child(&parser->ast, chunk->statements, j),
+                         chunk->starts[j]);
+        }
+        next = chunk->end;
+        break;
+      }
+
+      if (!parse_statement_at(parser, &list, &next)) {
+        stopped = true;
+        break;
+      }
+    }
+
+    if (chunk->halted && next == chunk->end)
+      stopped = true;
+  }
+
+  statement_list_end(parser, &list);
+  return *parser;
 }
 
 void parser_free(Parser *parser) {
   if (!parser)
     return;
 
-  ASTNode_free(&parser->ast);
-  Token_free(&parser->lexer.tokens);
+  AST_free(&parser->ast);
+  TokenStream_free(&parser->lexer.tokens);
 }
 
 ASTNode *parse_class_def(Parser *parser, ASTNode *class_node) {
   // 1. Consume Class Name
-  Token *token = advance(parser);
-  if (token == NULL || token->type != IDENTIFIER) {
-    syntax_error("expected class name after 'class'", parser->lexer.filename,
-                 token);
+  TokenIndex token = advance(parser);
+  if (token == TOKEN_NONE || tok_type(parser, token) != IDENTIFIER) {
+    syntax_error("expected class name after 'class'", &parser->lexer, token);
     return NULL;
   }
 
-  class_node->def.name = node_new(parser, token, VARIABLE);
-  // Initialize lists
-  class_node->def.params =
-      ASTNode_new_with_allocator(&parser->ast.allocator, 2);
-  class_node->def.body = ASTNode_new_with_allocator(&parser->ast.allocator, 4);
-  class_node->def.returns = NULL;
+  class_node->def.name = node_ref(parser, node_new(parser, token, VARIABLE));
+  class_node->def.returns = NODE_NONE;
 
   // 2. Handle Inheritance: class Dog(Animal):
-  if (parser->next && parser->next->type == LPAR) {
+  uint32_t params = AST_list_begin(&parser->ast);
+  if (parser->next && tok_type(parser, parser->next) == LPAR) {
     advance(parser); // Consume '('
 
-    while (parser->next && parser->next->type != RPAR) {
+    while (parser->next && tok_type(parser, parser->next) != RPAR) {
       advance(parser);
       ASTNode *base = parse_expression(parser, 0);
-      base->parent = class_node;
-      ASTNode_add_last(&class_node->def.params, base);
+      base->parent = node_ref(parser, class_node);
+      AST_list_push(&parser->ast, base);
 
-      if (parser->next && parser->next->type == COMMA) {
+      if (parser->next && tok_type(parser, parser->next) == COMMA) {
         advance(parser); // Consume ','
       } else {
         break;
@@ -1136,19 +1860,20 @@ ASTNode *parse_class_def(Parser *parser, ASTNode *class_node) {
     }
     consume(parser, RPAR);
   }
+  class_node->def.params = AST_list_end(&parser->ast, params);
 
   // 3. Consume Colon
   token = advance(parser);
-  if (!token || token->type != COLON) {
-    syntax_error("expected ':' after class definition", parser->lexer.filename,
-                 token);
+  if (!token || tok_type(parser, token) != COLON) {
+    syntax_error("expected ':' after class definition", &parser->lexer, token);
     return NULL;
   }
 
   // 4. Parse Class Body
   // Expect a NEWLINE then increased indentation
   advance(parser);
-  while ((token = advance(parser)) != NULL) {
+  uint32_t body = AST_list_begin(&parser->ast);
+  while ((token = advance(parser)) != TOKEN_NONE) {
     ASTNode *stmt = parse_statement(parser);
     // If parse_statement hits a NEWLINE with less indentation, it returns
     // END_BLOCK
@@ -1157,25 +1882,28 @@ ASTNode *parse_class_def(Parser *parser, ASTNode *class_node) {
 
     if (stmt->type == VARIABLE)
       stmt->ctx = STORE;
-    stmt->parent = class_node;
-    ASTNode_add_last(&class_node->def.body, stmt);
+    stmt->parent = node_ref(parser, class_node);
+    AST_list_push(&parser->ast, stmt);
   }
+  class_node->def.body = AST_list_end(&parser->ast, body);
 
   return class_node;
 }
 
-bool is_python_main_check(ASTNode *node) {
+bool is_python_main_check(Parser *parser, ASTNode *node) {
   if (node->type != IF || !node->ctrl_stmt.test)
     return false;
-  ASTNode *test = node->ctrl_stmt.test;
+  ASTNode *test = node_at(parser, node->ctrl_stmt.test);
   // Look for: VARIABLE(__name__) == LITERAL("__main__")
-  if (test->type == COMPARE && test->compare.left->type == VARIABLE) {
-    if (strcmp(test->compare.left->token->lexeme, "__name__") == 0) {
+  if (test->type != COMPARE)
+    return false;
+  ASTNode *left = node_at(parser, test->compare.left);
+  if (left->type == VARIABLE) {
+    if (tok_is(parser, left->token, "__name__")) {
       ASTNode *first_comp =
-          test->compare.comparators.elements[test->compare.comparators.head]
-              .data;
+          AST_child(&parser->ast, test->compare.comparators, 0);
       if (first_comp->type == LITERAL &&
-          strcmp(first_comp->token->lexeme, "\"__main__\"") == 0) {
+          tok_is(parser, first_comp->token, "\"__main__\"")) {
         return true;
       }
     }
@@ -1190,115 +1918,101 @@ ASTNode *parse_match_stmt(Parser *parser) {
   // match <expr>
   advance(parser);
   ASTNode *subject = parse_expression(parser, 0);
-  match_node->ctrl_stmt.test = subject;
-
-  match_node->ctrl_stmt.body =
-      ASTNode_new_with_allocator(&parser->ast.allocator, 4);
+  match_node->ctrl_stmt.test = node_ref(parser, subject);
 
   // expect ':'
   advance(parser);
-  if (!parser->current || parser->current->type != COLON) {
-    syntax_error("expected ':' after match subject", parser->lexer.filename,
+  if (!parser->current || tok_type(parser, parser->current) != COLON) {
+    syntax_error("expected ':' after match subject", &parser->lexer,
                  parser->current);
   }
 
   // expect NEWLINE
   advance(parser);
-  if (!parser->current || parser->current->type != NEWLINE) {
-    syntax_error("expected newline after match ':'", parser->lexer.filename,
+  if (!parser->current || tok_type(parser, parser->current) != NEWLINE) {
+    syntax_error("expected newline after match ':'", &parser->lexer,
                  parser->current);
   }
 
   // parse cases
+  uint32_t cases = AST_list_begin(&parser->ast);
   while (advance(parser)) {
-    if (parser->current->type == ENDMARKER)
+    if (tok_type(parser, parser->current) == ENDMARKER)
       break;
 
-    if (parser->current->type != KEYWORD ||
-        strcmp(parser->current->lexeme, "case") != 0) {
-      syntax_error("expected 'case' in match block", parser->lexer.filename,
+    if (tok_sub(parser, parser->current) != KW_CASE) {
+      syntax_error("expected 'case' in match block", &parser->lexer,
                    parser->current);
     }
 
     ASTNode *case_node = node_new(parser, parser->current, CASE);
-    case_node->ctrl_stmt.body =
-        ASTNode_new_with_allocator(&parser->ast.allocator, 4);
-    case_node->ctrl_stmt.orelse =
-        ASTNode_new_with_allocator(&parser->ast.allocator, 1);
-    case_node->ctrl_stmt.test = NULL;
+    case_node->ctrl_stmt.test = NODE_NONE;
 
     // case <pattern>
     advance(parser);
     ASTNode *pattern = parse_expression(parser, 0);
-    ASTNode_add_last(&case_node->ctrl_stmt.orelse, pattern);
+    uint32_t patterns = AST_list_begin(&parser->ast);
+    AST_list_push(&parser->ast, pattern);
+    case_node->ctrl_stmt.orelse = AST_list_end(&parser->ast, patterns);
 
     // optional guard: if <expr>
-    if (parser->next && parser->next->type == KEYWORD &&
-        strcmp(parser->next->lexeme, "if") == 0) {
+    if (parser->next && tok_sub(parser, parser->next) == KW_IF) {
       advance(parser); // move to 'if'
       advance(parser); // move to guard expr
-      case_node->ctrl_stmt.test = parse_expression(parser, 0);
+      case_node->ctrl_stmt.test =
+          node_ref(parser, parse_expression(parser, 0));
     }
 
     // expect ':'
     advance(parser);
-    if (!parser->current || parser->current->type != COLON) {
-      syntax_error("expected ':' after case", parser->lexer.filename,
-                   parser->current);
+    if (!parser->current || tok_type(parser, parser->current) != COLON) {
+      syntax_error("expected ':' after case", &parser->lexer, parser->current);
     }
 
     // expect NEWLINE
     advance(parser);
-    if (!parser->current || parser->current->type != NEWLINE) {
-      syntax_error("expected newline after case ':'", parser->lexer.filename,
+    if (!parser->current || tok_type(parser, parser->current) != NEWLINE) {
+      syntax_error("expected newline after case ':'", &parser->lexer,
                    parser->current);
     }
 
     // parse case body
+    uint32_t body = AST_list_begin(&parser->ast);
     while (advance(parser)) {
       ASTNode *stmt = parse_statement(parser);
       if (!stmt || stmt->type == END_BLOCK)
         break;
 
-      ASTNode_add_last(&case_node->ctrl_stmt.body, stmt);
+      AST_list_push(&parser->ast, stmt);
     }
+    case_node->ctrl_stmt.body = AST_list_end(&parser->ast, body);
 
-    ASTNode_add_last(&match_node->ctrl_stmt.body, case_node);
+    AST_list_push(&parser->ast, case_node);
   }
+  match_node->ctrl_stmt.body = AST_list_end(&parser->ast, cases);
 
   return match_node;
 }
 
-static ASTNode *parse_subscript(Parser *parser, ASTNode *value) {
-  // parser->current is '[' when this is called from led()
-  Token *bracket_token = parser->current;
-  advance(parser); // move past '['
-  ASTNode *node = node_new(parser, bracket_token, SUBSCRIPT);
-  node->subscript.value = value;
-  node->subscript.slice = parse_expression(parser, 0);
-  consume(parser, RSQB); // expects and consumes ']'
-  return node;
-}
-
-static ASTNode *parse_comprehension_body(Parser *parser, Token *origin_token,
+static ASTNode *parse_comprehension_body(Parser *parser,
+                                         TokenIndex origin_token,
                                          NodeType type, ASTNode *expr) {
   ASTNode *node = node_new(parser, origin_token, type);
-  node->list_comp.expr = expr;
+  node->list_comp.expr = node_ref(parser, expr);
   advance(parser); // move to 'for'
   advance(parser); // consume 'for', move to target
-  node->list_comp.target = parse_expression(parser, 0);
+  node->list_comp.target = node_ref(parser, parse_expression(parser, 0));
   consume(parser, KEYWORD); // consumes 'in'
   advance(parser);          // move to iterable
-  node->list_comp.iter = parse_expression(parser, 0);
-  node->list_comp.ifs = ASTNode_new_with_allocator(&parser->ast.allocator, 2);
-
-  while (parser->next && parser->next->type == KEYWORD &&
-         strcmp(parser->next->lexeme, "if") == 0) {
+  node->list_comp.iter = node_ref(parser, parse_expression(parser, 0));
+  uint32_t ifs = AST_list_begin(&parser->ast);
+  while (parser->next && tok_sub(parser, parser->next) == KW_IF) {
     advance(parser); // move to 'if'
     advance(parser); // consume 'if', move to guard
     ASTNode *guard = parse_expression(parser, 0);
-    ASTNode_add_last(&node->list_comp.ifs, guard);
+    AST_list_push(&parser->ast, guard);
   }
+  node->list_comp.ifs = AST_list_end(&parser->ast, ifs);
 
   return node;
 }
\ No newline at end of file
@@ -1,33 +1,125 @@
 #include "semantic.h"
+#include "class_layout.h"
 #include "pattern_binding.h"
+#include "string_builder.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
 // TODO: Create main scope (it is different from global scope)
 
-const char *ARITHMETIC_OPS[] = {
-    "+", "-", "*", "/", "%", // arithmetic
-};
-
-const char *COMPARISON_OPS[] = {
-    "==", "!=", "<", ">", "<=", ">=", // comparison
-};
-
 Symbol *sa_create_symbol(SemanticAnalyzer *sa, ASTNode *node, DataType type,
                          SymbolType kind);
 DataType sa_infer_type(SemanticAnalyzer *sa, ASTNode *node);
-cJSON *serialize_symbol(Symbol *sym);
-cJSON *serialize_symbol_table(SymbolTable *st);
-cJSON *serialize_symbol(Symbol *sym);
+static DataType infer_node_type(SemanticAnalyzer *sa, ASTNode *node);
+void serialize_symbol(JsonWriter *json, Symbol *sym);
+void serialize_symbol_table(JsonWriter *json, SymbolTable *st);
 bool analyze_match_stmt(SemanticAnalyzer *sa, ASTNode *node);
+static bool sa_push_diagnostic(SemanticAnalyzer *sa, Diagnostic diagnostic);
+
+static inline const char *sa_lexeme(SemanticAnalyzer *sa, TokenIndex token) {
+  return token_lexeme(&sa->parser.lexer, token);
+}
+
+static inline NameId sa_name_of(SemanticAnalyzer *sa, TokenIndex token) {
+  return token_name(&sa->parser.lexer, token);
+}
+
+static inline ASTNode *sa_child(SemanticAnalyzer *sa, NodeSpan span,
+                                uint32_t i) {
+  return AST_child(&sa->parser.ast, span, i);
+}
+
+static inline ASTNode *sa_node(SemanticAnalyzer *sa, NodeIndex index) {
+  return AST_get(&sa->parser.ast, index);
+}
 
 static SymbolTable *symbol_table_new(Allocator *allocator, SymbolTable *parent,
                                      size_t depth) {
   ASSERT(allocator != NULL, "Allocator cannot be NULL in symbol_table_new");
   SymbolTable *st = allocator_alloc(allocator, sizeof(SymbolTable));
   st->entries = NULL;
+  st->slots = NULL;
+  st->slot_count = 0;
+  st->count = 0;
+  st->size = 0;
   st->parent = parent;
+  st->layout = NULL;
   st->depth = depth;
   return st;
 }
 
+#define SYMBOL_TABLE_MIN_SLOTS 8
+
+// Index of the slot holding `hash` or of the empty slot where it would go
+static uint32_t symbol_table_probe(SymbolTableEntry *const *slots,
+                                   uint32_t slot_count, uint32_t hash) {
+  uint32_t mask = slot_count - 1;
+  uint32_t slot = hash & mask;
+  while (slots[slot] != NULL && slots[slot]->hash != hash)
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+static bool symbol_table_grow(Allocator *allocator, SymbolTable *st) {
+  uint32_t slot_count =
+      st->slot_count ? st->slot_count * 2 : SYMBOL_TABLE_MIN_SLOTS;
+  SymbolTableEntry **slots =
+      allocator_alloc(allocator, slot_count * sizeof(*slots));
+  if (slots == NULL) {
+    slog_error("Failed to grow symbol table");
+    return false;
+  }
+  memset(slots, 0, slot_count * sizeof(*slots));
+
+  for (uint32_t i = 0; i < st->slot_count; i++) {
+    SymbolTableEntry *entry = st->slots[i];
+    if (entry != NULL)
+      slots[symbol_table_probe(slots, slot_count, entry->hash)] = entry;
+  }
+
+  st->slots = slots;
+  st->slot_count = slot_count;
+  return true;
+}
+
+// Most recent entry named `name` in this scope only
+static SymbolTableEntry *symbol_table_find(const SymbolTable *st,
+                                           NameId name) {
+  if (st == NULL || st->slot_count == 0 || name == NAME_NONE)
+    return NULL;
+
+  uint32_t slot =
+      symbol_table_probe(st->slots, st->slot_count, symbol_name_hash(name));
+  return st->slots[slot];
+}
+
+static void symbol_table_insert(AST *ast, SymbolTable *st, Symbol *sym) {
+  Allocator *allocator = &ast->allocator;
+  // Keep the load factor under one half
+  if ((st->count + 1) * 2 > st->slot_count &&
+      !symbol_table_grow(allocator, st)) {
+    return;
+  }
+
+  sym->scope_level = st->depth;
+  sym->index = st->size++;
+  SymbolTableEntry *entry =
+      allocator_alloc(allocator, sizeof(SymbolTableEntry));
+  entry->symbol = sym;
+  entry->hash = symbol_name_hash(sym->name_id);
+  entry->next = st->entries;
+  st->entries = entry;
+
+  uint32_t slot = symbol_table_probe(st->slots, st->slot_count, entry->hash);
+  entry->shadowed = st->slots[slot];
+  if (entry->shadowed == NULL)
+    st->count++;
+  st->slots[slot] = entry;
+
+  if (st->layout)
+    class_layout_add(st->layout, ast, sym);
+}
+
 DataType string_to_datatype(const char *name) {
   if (strcmp(name, "int") == 0)
     return INT;
@@ -85,30 +177,39 @@ const char *datatype_to_string(DataType t) {
   }
 }
 
-bool is_arithmetic_op(char *op) {
-  for (size_t i = 0; i < ARRAYSIZE(ARITHMETIC_OPS); i++) {
-    if (strcmp(ARITHMETIC_OPS[i], op) == 0)
-      return true;
+bool is_arithmetic_op(TokenSubkind op) {
+  switch (op) {
+  case OP_PLUS:
+  case OP_MINUS:
+  case OP_STAR:
+  case OP_SLASH:
+  case OP_PERCENT:
+    return true;
+  default:
+    return false;
   }
-
-  return false;
 }
 
-bool is_comparison_op(char *op) {
-  for (size_t i = 0; i < ARRAYSIZE(COMPARISON_OPS); i++) {
-    if (strcmp(COMPARISON_OPS[i], op) == 0)
-      return true;
+bool is_comparison_op(TokenSubkind op) {
+  switch (op) {
+  case OP_EQ_EQ:
+  case OP_BANG_EQ:
+  case OP_LT:
+  case OP_GT:
+  case OP_LT_EQ:
+  case OP_GT_EQ:
+    return true;
+  default:
+    return false;
   }
-
-  return false;
 }
 
 static DataType infer_binary_op(SemanticAnalyzer *sa, ASTNode *node) {
   if (!node || node->type != BINARY_OPERATION)
     return UNKNOWN;
 
-  ASTNode *L = node->bin_op.left;
-  ASTNode *R = node->bin_op.right;
+  ASTNode *L = sa_node(sa, node->bin_op.left);
+  ASTNode *R = sa_node(sa, node->bin_op.right);
   DataType lt = sa_infer_type(sa, L);
   DataType rt = sa_infer_type(sa, R);
 
@@ -116,9 +217,10 @@ static DataType infer_binary_op(SemanticAnalyzer *sa, ASTNode *node) {
     return UNKNOWN;
 
   /* Arithmetic operators: allow INT/FLOAT mixing */
-  if (is_arithmetic_op(node->token->lexeme)) {
+  TokenSubkind op = token_subkind(&sa->parser.lexer, node->token);
+  if (is_arithmetic_op(op)) {
     /* string concatenation special case for + */
-    if (strcmp(node->token->lexeme, "+") == 0 && lt == STR && rt == STR)
+    if (op == OP_PLUS && lt == STR && rt == STR)
       return STR;
 
     if ((lt == INT || lt == FLOAT) && (rt == INT || rt == FLOAT)) {
@@ -127,13 +229,13 @@ static DataType infer_binary_op(SemanticAnalyzer *sa, ASTNode *node) {
 
     sa_set_error(sa, SEM_TYPE_MISMATCH, node->token,
                  "unsupported operand type(s) for %s: '%s' and '%s'",
-                 node->token->lexeme, datatype_to_string(lt),
+                 sa_lexeme(sa, node->token), datatype_to_string(lt),
                  datatype_to_string(rt));
     return UNKNOWN;
   }
 
   /* Comparison operators -> bool (we allow comparing same-typed values) */
-  if (is_comparison_op(node->token->lexeme)) {
+  if (is_comparison_op(op)) {
     /* allow comparing same basic types (int/float interchangeable) */
     if ((lt == INT || lt == FLOAT) && (rt == INT || rt == FLOAT))
       return BOOL;
@@ -147,7 +249,7 @@ static DataType infer_binary_op(SemanticAnalyzer *sa, ASTNode *node) {
   }
 
   // /* Logical operators (and/or) -> bool */
-  if (is_boolean_operator(node->token)) {
+  if (is_boolean_operator(&sa->parser.lexer, node->token)) {
     if (lt == BOOL && rt == BOOL)
       return BOOL;
     sa_set_error(sa, SEM_TYPE_MISMATCH, node->token,
@@ -161,58 +263,145 @@ static DataType infer_binary_op(SemanticAnalyzer *sa, ASTNode *node) {
   return UNKNOWN;
 }
 
+// Marks what a failed statement defines as failed, declaring the names it did
+// not get to
+static void sa_mark_failed(SemanticAnalyzer *sa, ASTNode *node) {
+  switch (node->type) {
+  case FUNCTION_DEF:
+  case CLASS_DEF: {
+    ASTNode *name = sa_node(sa, node->def.name);
+    if (name->symbol)
+      name->symbol->failed = true;
+  } break;
+  case ASSIGNMENT:
+    for (uint32_t cur = 0; cur < node->assign.targets.count; cur++) {
+      ASTNode *target = sa_child(sa, node->assign.targets, cur);
+      if (target->type != VARIABLE)
+        continue;
+
+      Symbol *sym = sa_lookup_local(sa, sa_name_of(sa, target->token));
+      if (sym == NULL) {
+        sym = sa_create_symbol(sa, target, UNKNOWN, VAR);
+        sa_define_symbol(sa, sym);
+      }
+      // A name assigned before keeps its type
+      if (sym->decl_node == target) {
+        sym->failed = true;
+        target->symbol = sym;
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+// Starts a recovery point: the errors raised from here on belong to one
+// statement. Returns whether the enclosing one had read a failed symbol.
+static bool sa_begin_statement(SemanticAnalyzer *sa) {
+  bool read_failed = sa->read_failed;
+  sa->read_failed = false;
+  sa->statement_start = sa->diagnostics.count;
+  return read_failed;
+}
+
+// Ends the recovery point, dropping its errors when they follow from an
+// earlier one
+static void sa_end_statement(SemanticAnalyzer *sa, bool read_failed) {
+  // Statements nested in this one moved the start past their own errors
+  if (sa->read_failed)
+    sa->diagnostics.count = sa->statement_start;
+  sa->read_failed = read_failed;
+  sa->statement_start = sa->diagnostics.count;
+}
+
+// Analyzes a statement of the program or of a body. Its error is kept and
+// analysis can go on with the next statement, errors that follow from an
+// earlier one are dropped.
+static bool analyze_statement(SemanticAnalyzer *sa, ASTNode *node) {
+  SymbolTable *scope = sa->current_scope;
+  Symbol *current_class = sa->current_class;
+  Symbol *current_function = sa->current_function;
+  bool read_failed = sa_begin_statement(sa);
+
+  bool ok = analyze_node(sa, node);
+  if (!ok) {
+    sa->current_scope = scope;
+    sa->current_class = current_class;
+    sa->current_function = current_function;
+    sa_mark_failed(sa, node);
+  }
+
+  sa_end_statement(sa, read_failed);
+  return ok;
+}
+
 bool analyze_class_def(SemanticAnalyzer *sa, ASTNode *node) {
-  node->def.name->parent = node;
-  Symbol *class_sym = sa_create_symbol(sa, node->def.name, OBJECT, CLASS);
+  ASTNode *name = sa_node(sa, node->def.name);
+  name->parent = AST_index(&sa->parser.ast, node);
+  Symbol *class_sym = sa_create_symbol(sa, name, OBJECT, CLASS);
+  name->symbol = class_sym;
   sa_define_symbol(sa, class_sym);
   sa_enter_scope(sa);
   class_sym->scope = sa->current_scope;
   Symbol *previous_class = sa->current_class;
   sa->current_class = class_sym;
 
-  for (size_t cur = node->def.params.head; cur != SIZE_MAX;
-       cur = node->def.params.elements[cur].next) {
-    ASTNode *param = node->def.params.elements[cur].data;
-    Symbol *base = sa_lookup(sa, param->token->lexeme);
+  for (uint32_t cur = 0; cur < node->def.params.count; cur++) {
+    ASTNode *param = sa_child(sa, node->def.params, cur);
+    Symbol *base = sa_lookup(sa, sa_name_of(sa, param->token));
+    param->symbol = base;
 
     if (base && base->kind == CLASS) {
       class_sym->base_class = base;
     } else {
-      sa_set_error(sa, SEM_TYPE_MISMATCH, node->child->token,
+      sa_set_error(sa, SEM_TYPE_MISMATCH, name->token,
                    "base class '%s' is undefined or not a class",
-                   node->child->token->lexeme);
+                   sa_lexeme(sa, name->token));
       return false;
     }
   }
 
+  ClassLayout *base_layout =
+      class_sym->base_class ? class_sym->base_class->layout : NULL;
+  class_sym->layout =
+      class_layout_new(&sa->parser.ast.allocator, class_sym, base_layout);
+  class_sym->scope->layout = class_sym->layout;
+
   // TODO: fix code duplication for body
-  for (size_t cur = node->def.body.head; cur != SIZE_MAX;
-       cur = node->def.body.elements[cur].next) {
-    ASTNode *body_node = node->def.body.elements[cur].data;
-    if (!analyze_node(sa, body_node)) {
-      return false;
-    }
+  bool ok = true;
+  for (uint32_t cur = 0; cur < node->def.body.count; cur++) {
+    ASTNode *body_node = sa_child(sa, node->def.body, cur);
+    ok = analyze_statement(sa, body_node) && ok;
   }
 
   sa_exit_scope(sa);
   sa->current_class = previous_class;
-  return true;
+  return ok;
+}
+
+// Latest function defined along the scope chain. At global scope, that is the
+// top-level function whose body is being analyzed, which a body checked after
+// the declaration pass has to be told about.
+static Symbol *sa_enclosing_function(SemanticAnalyzer *sa) {
+  for (SymbolTable *st = sa->current_scope; st; st = st->parent) {
+    if (st->parent == NULL && sa->current_function)
+      return sa->current_function;
+
+    for (SymbolTableEntry *e = st->entries; e; e = e->next) {
+      if (e->symbol->kind == FUNCTION)
+        return e->symbol;
+    }
+  }
+  return NULL;
 }
 
 /**
  * @brief Checks if the current analysis context is inside an __init__ method.
  */
 bool is_inside_constructor(SemanticAnalyzer *sa) {
-  SymbolTable *st = sa->current_scope;
-  while (st) {
-    for (SymbolTableEntry *e = st->entries; e; e = e->next) {
-      if (e->symbol->kind == FUNCTION) {
-        return strcmp(e->symbol->name, "__init__") == 0;
-      }
-    }
-    st = st->parent;
-  }
-  return false;
+  Symbol *function = sa_enclosing_function(sa);
+  return function && strcmp(function->name, "__init__") == 0;
 }
 
 /**
@@ -223,54 +412,11 @@ bool is_self_reference(SemanticAnalyzer *sa, ASTNode *node) {
   if (!node || node->type != VARIABLE)
     return false;
 
-  SymbolTable *st = sa->current_scope;
-
-  while (st) {
-    for (SymbolTableEntry *e = st->entries; e; e = e->next) {
-      Symbol *sym = e->symbol;
-
-      // Case 1: class → traverse its inner scope
-      if (sym->kind == CLASS && sym->scope) {
-        SymbolTable *class_scope = sym->scope;
-
-        for (SymbolTableEntry *ce = class_scope->entries; ce; ce = ce->next) {
-          Symbol *cs = ce->symbol;
-
-          // Case 2: function inside class → check first param
-          if (cs->kind == FUNCTION) {
-            ASTNode_LinkedList *params = &cs->decl_node->parent->def.params;
-
-            if (params->size > 0) {
-              ASTNode *first_param = params->elements[params->head].data;
-
-              if (strcmp(node->token->lexeme, first_param->token->lexeme) ==
-                  0) {
-                return true;
-              }
-            }
-          }
-        }
-      }
-
-      // Case 3: function in current scope (already inside class scope)
-      if (sym->kind == FUNCTION && sym->base_class) {
-        ASTNode_LinkedList *params = &sym->decl_node->parent->def.params;
-
-        if (params->size > 0) {
-          ASTNode *first_param = params->elements[params->head].data;
-
-          return strcmp(node->token->lexeme, first_param->token->lexeme) == 0;
-        }
-
-        return false;
-      }
-    }
-
-    // Otherwise go up one scope
-    st = st->parent;
-  }
-
-  return false;
+  // Only the first parameter of a method taking the instance is bound as an
+  // object of its class
+  Symbol *sym = node->symbol ? node->symbol
+                             : sa_lookup(sa, sa_name_of(sa, node->token));
+  return sym && sym->kind == VAR && sym->base_class != NULL;
 }
 
 /**
@@ -281,55 +427,88 @@ void sa_define_member(SemanticAnalyzer *sa, Symbol *class_sym,
   if (!class_sym || !class_sym->scope || !member_sym)
     return;
 
-  SymbolTableEntry *entry =
-      allocator_alloc(&sa->parser.ast.allocator, sizeof(SymbolTableEntry));
-  entry->symbol = member_sym;
-  entry->next = class_sym->scope->entries;
-  class_sym->scope->entries = entry;
+  symbol_table_insert(&sa->parser.ast, class_sym->scope, member_sym);
 }
 
-bool analyze_func_def(SemanticAnalyzer *sa, ASTNode *node) {
-  ASSERT(sa, "Semantic Analyzer context not provided");
-  ASSERT(node, "Node not provided");
-  node->def.name->parent = node;
-  Symbol *sym = sa_create_symbol(sa, node->def.name, UNKNOWN, FUNCTION);
+// Defines the function and its parameters, leaving its scope entered
+static Symbol *declare_function(SemanticAnalyzer *sa, ASTNode *node) {
+  ASTNode *name = sa_node(sa, node->def.name);
+  name->parent = AST_index(&sa->parser.ast, node);
+  Symbol *sym = sa_create_symbol(sa, name, UNKNOWN, FUNCTION);
+  name->symbol = sym;
   sa_define_symbol(sa, sym);
+  const ClassMember *method =
+      class_layout_find(sa->current_scope->layout, sym->name_id);
+  bool takes_self = method && method->symbol == sym && method->takes_self;
   sa_enter_scope(sa);
   sym->scope = sa->current_scope;
 
-  for (size_t cur = node->def.params.head; cur != SIZE_MAX;
-       cur = node->def.params.elements[cur].next) {
+  for (uint32_t cur = 0; cur < node->def.params.count; cur++) {
     // TODO: it will need to check for static also to not set it to object
     // automatically
-    ASTNode *param = node->def.params.elements[cur].data;
+    ASTNode *param = sa_child(sa, node->def.params, cur);
     Symbol *param_sym =
         allocator_alloc(&sa->parser.ast.allocator, sizeof(Symbol));
-    param_sym->name =
-        arena_strdup(&sa->parser.ast.allocator.base, param->token->lexeme);
+    *param_sym = (Symbol){0};
+    param_sym->name_id = sa_name_of(sa, param->token);
+    param_sym->name = sa_lexeme(sa, param->token);
     param_sym->kind = VAR;
     param_sym->dtype = UNKNOWN;
     param_sym->decl_node = param;
     param_sym->scope_level = sa->current_scope->depth;
 
-    if (sa->current_class && cur == 0) {
+    if (takes_self && cur == 0) {
       param_sym->dtype = OBJECT;
       param_sym->base_class = sa->current_class;
-    } else {
+    } else if (param->child) {
+      bool read_failed = sa_begin_statement(sa);
       param_sym->dtype = sa_infer_type(sa, param);
+      sa_end_statement(sa, read_failed);
+    } else {
+      sa_set_error(sa, SEM_TYPE_MISMATCH, param->token,
+                   "cannot infer type of parameter '%s'; add a type "
+                   "annotation",
+                   param_sym->name);
+      // Its error is reported here, not again by each use
+      param_sym->failed = true;
+      // Kept apart from the next parameter's error
+      sa->statement_start = sa->diagnostics.count;
     }
 
+    param->symbol = param_sym;
     sa_define_symbol(sa, param_sym);
   }
 
-  for (size_t cur = node->def.body.head; cur != SIZE_MAX;
-       cur = node->def.body.elements[cur].next) {
-    ASTNode *body_node = node->def.body.elements[cur].data;
-    if (!analyze_node(sa, body_node)) {
-      return false;
-    }
+  return sym;
+}
+
+// Analyzes the body in the scope of the function and infers what it returns
+static bool check_function_body(SemanticAnalyzer *sa, ASTNode *node,
+                                Symbol *sym, DataType *dtype) {
+  Symbol *previous_function = sa->current_function;
+  sa->current_function = sym;
+  bool ok = true;
+  for (uint32_t cur = 0; cur < node->def.body.count; cur++)
+    ok = analyze_statement(sa, sa_child(sa, node->def.body, cur)) && ok;
+
+  if (ok) {
+    bool read_failed = sa_begin_statement(sa);
+    *dtype = sa_infer_type(sa, node);
+    sa_end_statement(sa, read_failed);
   }
+  sa->current_function = previous_function;
+  return ok;
+}
+
+bool analyze_func_def(SemanticAnalyzer *sa, ASTNode *node) {
+  ASSERT(sa, "Semantic Analyzer context not provided");
+  ASSERT(node, "Node not provided");
+  Symbol *sym = declare_function(sa, node);
+  DataType dtype = UNKNOWN;
+  if (!check_function_body(sa, node, sym, &dtype))
+    return false;
 
-  sym->dtype = sa_infer_type(sa, node);
+  sym->dtype = dtype;
   sa_exit_scope(sa);
   return true;
 }
@@ -339,48 +518,54 @@ DataType sa_infer_type(SemanticAnalyzer *sa, ASTNode *node) {
   if (!node)
     return NONE;
 
+  if (node->dtype != UNKNOWN)
+    return node->dtype;
+
+  DataType dtype = infer_node_type(sa, node);
+  if (dtype != UNKNOWN)
+    node->dtype = dtype;
+  return dtype;
+}
+
+void sa_invalidate_type(SemanticAnalyzer *sa, ASTNode *node) {
+  for (; node; node = sa_node(sa, node->parent)) {
+    node->dtype = UNKNOWN;
+  }
+}
+
+static DataType infer_node_type(SemanticAnalyzer *sa, ASTNode *node) {
   switch (node->type) {
   case LITERAL: {
-    Token *tok = node->token;
-    const char *lex = tok->lexeme;
-
-    if (!lex) {
-      sa_set_error(sa, SEM_UNKNOWN, tok, "Invalid literal with no lexeme");
+    TokenIndex tok = node->token;
+    const TokenValue *value = token_value(&sa->parser.lexer, tok);
+    switch (value ? value->kind : VALUE_NONE) {
+    case VALUE_INT:
+      if (!value->overflow)
+        return INT;
+      sa_set_error(sa, SEM_UNSUPPORTED_FEATURE, tok,
+                   "integer literal '%s' does not fit in 64 bits",
+                   sa_lexeme(sa, tok));
       return UNKNOWN;
+    case VALUE_FLOAT:
+      return FLOAT;
+    case VALUE_STR:
+      return STR;
+    default:
+      break;
     }
 
-    if (strcmp(lex, "true") == 0 || strcmp(lex, "false") == 0) {
-      return BOOL;
-    }
-
-    if (strcmp(lex, "None") == 0) {
+    if (token_subkind(&sa->parser.lexer, tok) == KW_NONE) {
       return NONE;
     }
 
-    if (tok->type == STRING) {
-      return STR;
+    const char *lex = sa_lexeme(sa, tok);
+    if (!lex) {
+      sa_set_error(sa, SEM_UNKNOWN, tok, "Invalid literal with no lexeme");
+      return UNKNOWN;
     }
 
-    if (tok->type == NUMBER) {
-      bool is_int = true;
-      bool is_float = false;
-
-      for (size_t i = 0; lex[i]; i++) {
-        if (lex[i] == '.') {
-          is_float = true;
-          is_int = false;
-        } else if (!isdigit((unsigned char)lex[i]) &&
-                   !(i == 0 && (lex[i] == '-' || lex[i] == '+'))) {
-          is_int = false;
-          is_float = false;
-          break;
-        }
-      }
-
-      if (is_int)
-        return INT;
-      if (is_float)
-        return FLOAT;
+    if (strcmp(lex, "true") == 0 || strcmp(lex, "false") == 0) {
+      return BOOL;
     }
 
     size_t n = strlen(lex);
@@ -393,18 +578,19 @@ DataType sa_infer_type(SemanticAnalyzer *sa, ASTNode *node) {
     return UNKNOWN;
   } break;
   case ASSIGNMENT: {
-    return sa_infer_type(sa, node->assign.value);
+    return sa_infer_type(sa, sa_node(sa, node->assign.value));
   } break;
   case BINARY_OPERATION:
     return infer_binary_op(sa, node);
   case UNARY_OPERATION:
-    return sa_infer_type(sa, node->bin_op.right);
+    return sa_infer_type(sa, sa_node(sa, node->bin_op.right));
   case VARIABLE: {
     if (node->child) {
-      return string_to_datatype(node->child->token->lexeme);
+      ASTNode *annotation = sa_node(sa, node->child);
+      return string_to_datatype(sa_lexeme(sa, annotation->token));
     }
 
-    DataType dtype = string_to_datatype(node->token->lexeme);
+    DataType dtype = string_to_datatype(sa_lexeme(sa, node->token));
 
     if (is_self_reference(sa, node)) {
       return OBJECT;
@@ -414,28 +600,43 @@ DataType sa_infer_type(SemanticAnalyzer *sa, ASTNode *node) {
       return dtype;
     }
 
-    Symbol *sym = resolve_symbol(sa, node);
+    Symbol *sym = node->symbol ? node->symbol : resolve_symbol(sa, node);
+    node->symbol = sym;
     if (sym) {
+      // A bound use skips the lookup that notes a failed symbol
+      sa->read_failed |= sym->failed;
       return sym->dtype;
     } else {
       sa_set_error(sa, SEM_UNDEFINED_VARIABLE, node->token,
-                   "name '%s' is not defined", node->token->lexeme);
+                   "name '%s' is not defined", sa_lexeme(sa, node->token));
       return UNKNOWN;
     }
   } break;
   case FUNCTION_DEF: {
     DataType ret_type = NONE;
 
-    for (size_t cur = node->def.body.head; cur != SIZE_MAX;
-         cur = node->def.body.elements[cur].next) {
-      ASTNode *body_node = node->def.body.elements[cur].data;
-      ret_type = sa_infer_type(sa, body_node->child);
+    for (uint32_t cur = 0; cur < node->def.body.count; cur++) {
+      ASTNode *body_node = sa_child(sa, node->def.body, cur);
+      switch (body_node->type) {
+      case ASSIGNMENT:
+      case IMPORT:
+      case IMPORT_FROM:
+      case TUPLE:
+      case LIST_EXPR:
+        // `child` overlaps a child list for these, not a node
+        ret_type = NONE;
+        break;
+      default:
+        ret_type = sa_infer_type(sa, sa_node(sa, body_node->child));
+        break;
+      }
     }
 
     if (node->def.returns) {
-      DataType annotation_type = sa_infer_type(sa, node->def.returns);
+      ASTNode *returns = sa_node(sa, node->def.returns);
+      DataType annotation_type = sa_infer_type(sa, returns);
       if (ret_type != annotation_type) {
-        sa_set_error(sa, SEM_TYPE_MISMATCH, node->def.returns->token,
+        sa_set_error(sa, SEM_TYPE_MISMATCH, returns->token,
                      "function return type annotation '%s' does not match "
                      "inferred return type '%s'",
                      datatype_to_string(annotation_type),
@@ -447,20 +648,24 @@ DataType sa_infer_type(SemanticAnalyzer *sa, ASTNode *node) {
     return ret_type;
   } break;
   case CALL: {
-    Symbol *sym = sa_lookup(sa, node->call.func->token->lexeme);
+    ASTNode *func = sa_node(sa, node->call.func);
+    Symbol *sym = sa_lookup(sa, sa_name_of(sa, func->token));
+    node->symbol = sym;
     if (sym) {
       return sym->dtype;
     } else {
-      sa_set_error(sa, SEM_UNDEFINED_VARIABLE, node->call.func->token,
-                   "name '%s' is not defined", node->call.func->token->lexeme);
+      sa_set_error(sa, SEM_UNDEFINED_VARIABLE, func->token,
+                   "name '%s' is not defined",
+                   sa_lexeme(sa, func->token));
       return UNKNOWN;
     }
   } break;
 
   case ATTRIBUTE: {
-    Symbol *obj_sym = sa_lookup(sa, node->attribute.value->token->lexeme);
+    ASTNode *object = sa_node(sa, node->attribute.value);
+    Symbol *obj_sym = sa_lookup(sa, sa_name_of(sa, object->token));
     Symbol *class_sym = (obj_sym) ? obj_sym->base_class : NULL;
-    Symbol *member = sa_lookup_member(class_sym, node->attribute.attr);
+    Symbol *member = sa_lookup_member(class_sym, sa_name_of(sa, node->token));
     return member ? member->dtype : UNKNOWN;
   } break;
   default:
@@ -468,56 +673,278 @@ DataType sa_infer_type(SemanticAnalyzer *sa, ASTNode *node) {
   }
 }
 
-SemanticAnalyzer analyze_program(Parser *parser) {
+// Errors of a top-level statement in the declaration pass, [first, end)
+typedef struct StatementErrors {
+  size_t first;
+  size_t end;
+} StatementErrors;
+
+// Body of a top-level function checked after the declaration pass
+typedef struct BodyCheck {
+  ASTNode *def;
+  Symbol *sym;
+  TokenIndex first_token; // Tokens of the definition, [first, end)
+  TokenIndex end_token;
+  DataType dtype;
+  DiagnosticList diagnostics;
+  bool ok;
+} BodyCheck;
+
+// Bodies of fewer tokens in total are checked on the calling thread
+#define SA_MIN_JOB_TOKENS ((TokenIndex)4 * 1024)
+#define SA_MAX_JOBS 64
+#define SA_SYMBOL_ID_BLOCK (SIZE_MAX / (SA_MAX_JOBS + 1))
+
+typedef struct BodyWorker {
+  SemanticAnalyzer sa;
+  BodyCheck *checks;
+  size_t count;
+  atomic_size_t *next; // Next unclaimed check, shared by the workers
+} BodyWorker;
+
+// Classes get their members while their bodies are analyzed, and a
+// constructor adds attributes to its class, so bodies that hold either stay
+// in the declaration pass
+static bool defines_class_members(SemanticAnalyzer *sa, ASTNode *node,
+                                  NameId init) {
+  if (node->type == CLASS_DEF)
+    return true;
+  if (node->type == FUNCTION_DEF && init != NAME_NONE &&
+      sa_name_of(sa, sa_node(sa, node->def.name)->token) == init)
+    return true;
+
+  NodeLinks links = node_links(node);
+  for (uint32_t i = 0; i < links.span_count; i++) {
+    NodeSpan span = *links.spans[i];
+    for (uint32_t cur = 0; cur < span.count; cur++) {
+      if (defines_class_members(sa, sa_child(sa, span, cur), init))
+        return true;
+    }
+  }
+  return false;
+}
+
+// Only functions whose signature alone gives their type can be used before
+// their body is checked
+static bool can_defer_body(SemanticAnalyzer *sa, ASTNode *node, NameId init) {
+  if (node->type != FUNCTION_DEF || node->def.returns == NODE_NONE)
+    return false;
+
+  for (uint32_t cur = 0; cur < node->def.params.count; cur++) {
+    if (sa_child(sa, node->def.params, cur)->child == NODE_NONE)
+      return false;
+  }
+  return !defines_class_members(sa, node, init);
+}
+
+// Each body collects its errors apart, to be merged in program order
+static void check_body(SemanticAnalyzer *sa, BodyCheck *check) {
+  sa->current_scope = check->sym->scope;
+  sa->diagnostics = (DiagnosticList){0};
+  sa->statement_start = 0;
+  check->ok = check_function_body(sa, check->def, check->sym, &check->dtype);
+  check->diagnostics = sa->diagnostics;
+}
+
+static void *body_worker(void *arg) {
+  BodyWorker *worker = arg;
+  for (;;) {
+    size_t i = atomic_fetch_add(worker->next, 1);
+    if (i >= worker->count)
+      return NULL;
+    check_body(&worker->sa, &worker->checks[i]);
+  }
+}
+
+// Checks the deferred bodies, on up to `jobs` threads when there is enough
+// of them
+static void check_bodies(SemanticAnalyzer *sa, BodyCheck *checks,
+                         size_t count, size_t jobs) {
+  TokenIndex tokens = 0;
+  for (size_t i = 0; i < count; i++)
+    tokens += checks[i].end_token - checks[i].first_token;
+
+  if (jobs == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = cpus > 0 ? (size_t)cpus : 1;
+  }
+  if (jobs > SA_MAX_JOBS)
+    jobs = SA_MAX_JOBS;
+  if (jobs > count)
+    jobs = count;
+  if (jobs > tokens / SA_MIN_JOB_TOKENS)
+    jobs = tokens / SA_MIN_JOB_TOKENS;
+
+  SymbolTable *global_scope = sa->current_scope;
+  if (jobs <= 1) {
+    DiagnosticList diagnostics = sa->diagnostics;
+    for (size_t i = 0; i < count; i++)
+      check_body(sa, &checks[i]);
+    sa->diagnostics = diagnostics;
+    sa->current_scope = global_scope;
+    return;
+  }
+
+  // Lexemes other than names are copied out of the source on first use,
+  // do it before the workers race to
+  for (size_t i = 0; i < count; i++) {
+    for (TokenIndex t = checks[i].first_token; t < checks[i].end_token; t++)
+      sa_lexeme(sa, t);
+  }
+
+  atomic_size_t next = 0;
+  BodyWorker workers[SA_MAX_JOBS];
+  pthread_t threads[SA_MAX_JOBS];
+  bool started[SA_MAX_JOBS] = {0};
+  for (size_t i = 0; i < jobs; i++) {
+    workers[i] = (BodyWorker){.sa = *sa,
+                              .checks = checks,
+                              .count = count,
+                              .next = &next};
+    // Symbols and error messages of each worker go to its own arena, and
+    // its symbol ids are drawn from its own block
+    allocator_init(&workers[i].sa.parser.ast.allocator, "semantic worker");
+    if (i > 0)
+      workers[i].sa.next_symbol_id = i * SA_SYMBOL_ID_BLOCK;
+  }
+
+  // The calling thread works through the checks along with the others
+  for (size_t i = 1; i < jobs; i++) {
+    started[i] =
+        pthread_create(&threads[i], NULL, body_worker, &workers[i]) == 0;
+    if (!started[i])
+      slog_warn("Could not start semantic thread %zu", i);
+  }
+  body_worker(&workers[0]);
+
+  for (size_t i = 0; i < jobs; i++) {
+    if (i > 0 && started[i])
+      pthread_join(threads[i], NULL);
+    allocator_adopt(&sa->parser.ast.allocator,
+                    &workers[i].sa.parser.ast.allocator);
+  }
+  sa->next_symbol_id = workers[0].sa.next_symbol_id;
+  sa->current_scope = global_scope;
+}
+
+// Tokens of the top-level statement `stmt`, searching the statements from
+// `*cursor` on
+static void statement_tokens(Parser *parser, ASTNode *stmt, uint32_t *cursor,
+                             TokenIndex *first, TokenIndex *end) {
+  NodeSpan statements = parser->statements;
+  while (*cursor < statements.count &&
+         AST_child(&parser->ast, statements, *cursor) != stmt)
+    (*cursor)++;
+
+  *first = *end = parser->lexer.token_end;
+  if (*cursor < statements.count)
+    *first = parser->statement_starts[*cursor];
+  if (*cursor + 1 < statements.count)
+    *end = parser->statement_starts[*cursor + 1];
+}
+
+SemanticAnalyzer analyze_program_parallel(Parser *parser, size_t jobs) {
   SemanticAnalyzer sa = {0};
   SymbolTable *global_scope = symbol_table_new(&parser->ast.allocator, NULL, 0);
   sa.current_scope = global_scope;
   sa.parser = *parser;
-  sa.last_error.type = SEM_OK;
 
-  if (parser != NULL && parser->ast.size == 0) {
+  if (parser != NULL && parser->program.count == 0) {
     slog_warn("No AST to analyze in analyze_program");
     return sa;
   }
 
-  // Iterate over all top-level AST Nodes
-  ASTNode_LinkedList *program = &parser->ast;
-  for (size_t current = program->head; current != SIZE_MAX;
-       current = program->elements[current].next) {
-    ASTNode *node = program->elements[current].data;
+  NodeSpan program = parser->program;
+  Allocator *allocator = &sa.parser.ast.allocator;
+  StatementErrors *declared =
+      allocator_alloc(allocator, program.count * sizeof(*declared));
+  BodyCheck *checks =
+      allocator_alloc(allocator, program.count * sizeof(*checks));
+  uint32_t *check_at =
+      allocator_alloc(allocator, program.count * sizeof(*check_at));
+  if (!declared || !checks || !check_at) {
+    slog_error("Failed to allocate the semantic analysis passes");
+    sa_set_error(&sa, SEM_UNKNOWN, TOKEN_NONE, "out of memory");
+    return sa;
+  }
 
-    if (!analyze_node(&sa, node)) {
-      // Stop immediately on first semantic error
-      return sa;
+  // Phase 1: top-level statements in order. Deferred functions only get
+  // their signature, everything else is analyzed as it comes.
+  NameId init = sa_name(&sa, "__init__");
+  uint32_t cursor = 0;
+  uint32_t count = 0;
+  for (uint32_t current = 0; current < program.count; current++) {
+    ASTNode *node = sa_child(&sa, program, current);
+    check_at[current] = UINT32_MAX;
+    declared[current].first = sa.diagnostics.count;
+
+    if (can_defer_body(&sa, node, init)) {
+      bool read_failed = sa_begin_statement(&sa);
+      BodyCheck *check = &checks[count];
+      *check = (BodyCheck){.def = node};
+      check->sym = declare_function(&sa, node);
+      sa_exit_scope(&sa);
+      check->sym->dtype = sa_infer_type(&sa, sa_node(&sa, node->def.returns));
+      sa_end_statement(&sa, read_failed);
+      statement_tokens(parser, node, &cursor, &check->first_token,
+                       &check->end_token);
+      check_at[current] = count++;
+    } else {
+      analyze_statement(&sa, node);
     }
+    declared[current].end = sa.diagnostics.count;
+  }
+
+  // Phase 2: every top-level name is known, the bodies only read them
+  sa.globals_frozen = true;
+  check_bodies(&sa, checks, count, jobs);
+  sa.globals_frozen = false;
+
+  // Errors of the bodies go after those of their declaration, as if the
+  // program had been analyzed in sequence
+  DiagnosticList first_pass = sa.diagnostics;
+  sa.diagnostics = (DiagnosticList){0};
+  for (uint32_t current = 0; current < program.count; current++) {
+    for (size_t i = declared[current].first; i < declared[current].end; i++)
+      sa_push_diagnostic(&sa, first_pass.items[i]);
+    if (check_at[current] == UINT32_MAX)
+      continue;
+
+    BodyCheck *check = &checks[check_at[current]];
+    check->sym->dtype = check->ok ? check->dtype : UNKNOWN;
+    for (size_t i = 0; i < check->diagnostics.count; i++)
+      sa_push_diagnostic(&sa, check->diagnostics.items[i]);
   }
+  sa.statement_start = sa.diagnostics.count;
 
   return sa;
 }
 
-Symbol *sa_lookup(SemanticAnalyzer *sa, const char *name) {
-  SymbolTable *scope = sa->current_scope;
-  while (scope) {
-    for (SymbolTableEntry *e = scope->entries; e; e = e->next) {
-      if (strcmp(e->symbol->name, name) == 0)
-        return e->symbol;
-    }
-    scope = scope->parent;
-  }
-  return NULL;
+SemanticAnalyzer analyze_program(Parser *parser) {
+  return analyze_program_parallel(parser, 1);
 }
 
-Symbol *sa_lookup_local(SemanticAnalyzer *sa, const char *name) {
-  SymbolTable *scope = sa->current_scope;
+NameId sa_name(SemanticAnalyzer *sa, const char *name) {
+  return InternTable_find(&sa->parser.lexer.tokens.interned, name,
+                          strlen(name));
+}
 
-  for (SymbolTableEntry *e = scope->entries; e; e = e->next) {
-    if (strcmp(e->symbol->name, name) == 0)
-      return e->symbol;
+Symbol *sa_lookup(SemanticAnalyzer *sa, NameId name) {
+  for (SymbolTable *scope = sa->current_scope; scope; scope = scope->parent) {
+    SymbolTableEntry *entry = symbol_table_find(scope, name);
+    if (entry) {
+      sa->read_failed |= entry->symbol->failed;
+      return entry->symbol;
+    }
   }
-
   return NULL;
 }
 
+Symbol *sa_lookup_local(SemanticAnalyzer *sa, NameId name) {
+  SymbolTableEntry *entry = symbol_table_find(sa->current_scope, name);
+  return entry ? entry->symbol : NULL;
+}
+
 bool analyze_node(SemanticAnalyzer *sa, ASTNode *node) {
   if (!sa || !node)
     return true;
@@ -526,45 +953,51 @@ bool analyze_node(SemanticAnalyzer *sa, ASTNode *node) {
   case VARIABLE: {
     Symbol *sym;
 
-    if (node->ctx == STORE && node->parent && node->parent->type == CLASS_DEF) {
+    ASTNode *parent = sa_node(sa, node->parent);
+    if (node->ctx == STORE && parent && parent->type == CLASS_DEF) {
       sym = sa_create_symbol(sa, node, sa_infer_type(sa, node), VAR);
+      node->symbol = sym;
       sa_define_symbol(sa, sym);
       return true;
     }
 
-    sym = sa_lookup(sa, node->token->lexeme);
+    sym = sa_lookup(sa, sa_name_of(sa, node->token));
+    node->symbol = sym;
 
     if (!sym) {
       sa_set_error(sa, SEM_UNDEFINED_VARIABLE, node->token,
-                   "name '%s' is not defined", node->token->lexeme);
+                   "name '%s' is not defined", sa_lexeme(sa, node->token));
       return false;
     }
 
-    sym->dtype = sa_infer_type(sa, node);
+    DataType dtype = sa_infer_type(sa, node);
+    // Parameters are read by calls checked on other threads, a type that
+    // does not change is not written again
+    if ((!sa->globals_frozen || sym->scope_level > 0) && sym->dtype != dtype)
+      sym->dtype = dtype;
 
-    if (sym->dtype == UNKNOWN && !is_self_reference(sa, node)) {
+    if (dtype == UNKNOWN && !is_self_reference(sa, node)) {
       sa_set_error(sa, SEM_TYPE_MISMATCH, node->token,
                    "cannot infer type of variable '%s'; add a type annotation "
                    "or initialize it",
-                   node->token->lexeme);
+                   sa_lexeme(sa, node->token));
       return false;
     }
   } break;
   case BINARY_OPERATION: {
-    if (!analyze_node(sa, node->bin_op.left))
+    if (!analyze_node(sa, sa_node(sa, node->bin_op.left)))
       return false;
-    if (!analyze_node(sa, node->bin_op.right))
+    if (!analyze_node(sa, sa_node(sa, node->bin_op.right)))
       return false;
     break;
   }
   case ASSIGNMENT: {
     // Define all targets
-    for (size_t cur = node->assign.targets.head; cur != SIZE_MAX;
-         cur = node->assign.targets.elements[cur].next) {
-      ASTNode *target = node->assign.targets.elements[cur].data;
-      Symbol *sym = sa_lookup(sa, target->token->lexeme);
-      Symbol *local_sym = sa_lookup_local(sa, target->token->lexeme);
-      DataType rhs_type = sa_infer_type(sa, node->assign.value);
+    for (uint32_t cur = 0; cur < node->assign.targets.count; cur++) {
+      ASTNode *target = sa_child(sa, node->assign.targets, cur);
+      Symbol *sym = sa_lookup(sa, sa_name_of(sa, target->token));
+      Symbol *local_sym = sa_lookup_local(sa, sa_name_of(sa, target->token));
+      DataType rhs_type = sa_infer_type(sa, sa_node(sa, node->assign.value));
 
       if (rhs_type == UNKNOWN) {
         return false;
@@ -581,7 +1014,7 @@ bool analyze_node(SemanticAnalyzer *sa, ASTNode *node) {
         if (local_sym) {
           sa_set_error(sa, SEM_REDECLARATION, target->token,
                        "variable '%s' already declared in this scope",
-                       target->token->lexeme);
+                       sa_lexeme(sa, target->token));
           return false;
         }
 
@@ -596,7 +1029,7 @@ bool analyze_node(SemanticAnalyzer *sa, ASTNode *node) {
         }
       } else if (!sym) {
         goto define_sym;
-      } else if (sym && !types_compatible(sym->dtype, rhs_type)) {
+      } else if (!types_compatible(sym->dtype, rhs_type)) {
         // Type compatibility check
         sa_set_error(
             sa, SEM_TYPE_MISMATCH, sym->decl_node->token,
@@ -604,10 +1037,12 @@ bool analyze_node(SemanticAnalyzer *sa, ASTNode *node) {
             datatype_to_string(rhs_type), sym->name,
             datatype_to_string(sym->dtype));
         return false;
+      } else {
+        target->symbol = sym;
       }
     }
     // Analyze value
-    return analyze_node(sa, node->assign.value);
+    return analyze_node(sa, sa_node(sa, node->assign.value));
   }
   case CLASS_DEF: {
     if (!analyze_class_def(sa, node))
@@ -619,27 +1054,33 @@ bool analyze_node(SemanticAnalyzer *sa, ASTNode *node) {
   } break;
   case RETURN: {
     if (node->child) {
-      return analyze_node(sa, node->child);
+      return analyze_node(sa, sa_node(sa, node->child));
     }
   } break;
   case CALL: {
-    Symbol *sym = sa_lookup(sa, node->call.func->token->lexeme);
+    ASTNode *func = sa_node(sa, node->call.func);
+    Symbol *sym = sa_lookup(sa, sa_name_of(sa, func->token));
     if (!sym) {
-      sa_set_error(sa, SEM_UNDEFINED_VARIABLE, node->call.func->token,
-                   "name '%s' is not defined", node->call.func->token->lexeme);
+      sa_set_error(sa, SEM_UNDEFINED_VARIABLE, func->token,
+                   "name '%s' is not defined",
+                   sa_lexeme(sa, func->token));
       return false;
     }
     if (sym->kind != FUNCTION) {
-      sa_set_error(sa, SEM_INVALID_OPERATION, node->call.func->token,
+      sa_set_error(sa, SEM_INVALID_OPERATION, func->token,
                    "'%s' is not a function", sym->name);
       return false;
     }
+    node->symbol = sym;
+    func->symbol = sym;
 
-    size_t num_args = node->call.args.size;
-    size_t num_params = sym->decl_node->parent->def.params.size;
+    NodeSpan args = node->call.args;
+    NodeSpan params = sa_node(sa, sym->decl_node->parent)->def.params;
+    size_t num_args = args.count;
+    size_t num_params = params.count;
 
     if (num_args != num_params) {
-      sa_set_error(sa, SEM_ARITY_MISMATCH, node->call.func->token,
+      sa_set_error(sa, SEM_ARITY_MISMATCH, func->token,
                    "function '%s' expects %zu arguments but got %zu", sym->name,
                    num_params, num_args);
       return false;
@@ -647,18 +1088,19 @@ bool analyze_node(SemanticAnalyzer *sa, ASTNode *node) {
 
     // Validate argument types match parameter types
     for (size_t i = 0; i < num_args; i++) {
-      ASTNode *arg_node =
-          node->call.args.elements[node->call.args.head + i].data;
-      ASTNode *param_node =
-          sym->decl_node->parent->def.params
-              .elements[sym->decl_node->parent->def.params.head + i]
-              .data;
+      ASTNode *arg_node = sa_child(sa, args, i);
+      ASTNode *param_node = sa_child(sa, params, i);
       DataType arg_type = sa_infer_type(sa, arg_node);
-      DataType param_type = sa_infer_type(sa, param_node);
+      // The parameter nodes are the callee's, shared by every body checked
+      // in parallel, so only its declared symbols are read
+      Symbol *param_sym = param_node->symbol;
+      DataType param_type = param_sym ? param_sym->dtype : UNKNOWN;
+      if (param_sym)
+        sa->read_failed |= param_sym->failed;
 
       if (!types_compatible(param_type, arg_type)) {
         sa_set_error(
-            sa, SEM_TYPE_MISMATCH, node->call.func->token,
+            sa, SEM_TYPE_MISMATCH, func->token,
             "argument %zu to '%s' has type '%s' but parameter expects '%s'",
             i + 1, sym->name, datatype_to_string(arg_type),
             datatype_to_string(param_type));
@@ -666,9 +1108,8 @@ bool analyze_node(SemanticAnalyzer *sa, ASTNode *node) {
       }
     }
 
-    for (size_t cur = node->call.args.head; cur != SIZE_MAX;
-         cur = node->call.args.elements[cur].next) {
-      ASTNode *arg_node = node->call.args.elements[cur].data;
+    for (uint32_t cur = 0; cur < node->call.args.count; cur++) {
+      ASTNode *arg_node = sa_child(sa, node->call.args, cur);
       if (!analyze_node(sa, arg_node)) {
         return false;
       }
@@ -677,32 +1118,32 @@ bool analyze_node(SemanticAnalyzer *sa, ASTNode *node) {
 
   case WHILE:
   case IF: {
-    if (!analyze_node(sa, node->ctrl_stmt.test))
+    if (!analyze_node(sa, sa_node(sa, node->ctrl_stmt.test)))
       return false;
 
-    for (size_t cur = node->ctrl_stmt.body.head; cur != SIZE_MAX;
-         cur = node->ctrl_stmt.body.elements[cur].next) {
-      ASTNode *body_node = node->ctrl_stmt.body.elements[cur].data;
+    for (uint32_t cur = 0; cur < node->ctrl_stmt.body.count; cur++) {
+      ASTNode *body_node = sa_child(sa, node->ctrl_stmt.body, cur);
       if (!analyze_node(sa, body_node))
         return false;
     }
 
-    for (size_t cur = node->ctrl_stmt.orelse.head; cur != SIZE_MAX;
-         cur = node->ctrl_stmt.orelse.elements[cur].next) {
-      ASTNode *else_node = node->ctrl_stmt.orelse.elements[cur].data;
+    for (uint32_t cur = 0; cur < node->ctrl_stmt.orelse.count; cur++) {
+      ASTNode *else_node = sa_child(sa, node->ctrl_stmt.orelse, cur);
       if (!analyze_node(sa, else_node))
         return false;
     }
   } break;
   case ATTRIBUTE: {
-    if (!analyze_node(sa, node->attribute.value))
+    ASTNode *object = sa_node(sa, node->attribute.value);
+    if (!analyze_node(sa, object))
       return false;
 
-    DataType base_dtype = sa_infer_type(sa, node->attribute.value);
-    Symbol *obj_sym = sa_lookup(sa, node->attribute.value->token->lexeme);
+    DataType base_dtype = sa_infer_type(sa, object);
+    Symbol *obj_sym = sa_lookup(sa, sa_name_of(sa, object->token));
     Symbol *class_sym =
         (obj_sym && obj_sym->dtype == OBJECT) ? obj_sym->base_class : NULL;
-    Symbol *member = sa_lookup_member(class_sym, node->attribute.attr);
+    Symbol *member = sa_lookup_member(class_sym, sa_name_of(sa, node->token));
+    node->symbol = member;
 
     if (node->ctx == LOAD) {
       if (!member) {
@@ -714,24 +1155,30 @@ bool analyze_node(SemanticAnalyzer *sa, ASTNode *node) {
     } else if (node->ctx == STORE) {
       if (!member) {
         if (is_inside_constructor(sa) &&
-            is_self_reference(sa, node->attribute.value)) {
-          DataType inferred = sa_infer_type(sa, node->parent->assign.value);
+            is_self_reference(sa, object)) {
+          ASTNode *assign = sa_node(sa, node->parent);
+          DataType inferred =
+              sa_infer_type(sa, sa_node(sa, assign->assign.value));
           char *inferred_str = (char *)datatype_to_string(inferred);
-          Token *tok_var = create_token_from_str(
-              &sa->parser.lexer, node->token->lexeme, IDENTIFIER);
-          tok_var->ident = node->parent->parent->token->ident;
-          tok_var->line = node->token->line;
-          tok_var->col = node->token->col;
+          Lexer *lexer = &sa->parser.lexer;
+          size_t ident =
+              token_ident(lexer, sa_node(sa, assign->parent)->token);
+          size_t offset = token_offset(lexer, node->token);
+          TokenIndex tok_var = create_token_from_str(
+              lexer, sa_lexeme(sa, node->token), IDENTIFIER);
+          token_locate(lexer, tok_var, offset, ident);
           ASTNode *var = node_new(&sa->parser, tok_var, VARIABLE);
           var->ctx = STORE;
-          Token *t = create_token_from_str(&sa->parser.lexer, inferred_str,
-                                           IDENTIFIER);
-          t->ident = node->parent->parent->token->ident;
-          t->line = node->token->line;
-          t->col = node->token->col + 1;
-          var->child = node_new(&sa->parser, t, VARIABLE);
+          TokenIndex t = create_token_from_str(lexer, inferred_str, IDENTIFIER);
+          token_locate(lexer, t, offset + 1, ident);
+          var->child = AST_index(&sa->parser.ast,
+                                 node_new(&sa->parser, t, VARIABLE));
           Symbol *new_attr = sa_create_symbol(sa, var, inferred, VAR);
-          ASTNode_add_last(&class_sym->decl_node->parent->def.body, var);
+          var->symbol = new_attr;
+          node->symbol = new_attr;
+          ASTNode *class_def = sa_node(sa, class_sym->decl_node->parent);
+          AST_append(&sa->parser.ast, &class_def->def.body, var);
+          sa_invalidate_type(sa, class_def);
           sa_define_member(sa, class_sym, new_attr);
         } else {
           sa_set_error(sa, SEM_INVALID_OPERATION, node->token,
@@ -758,11 +1205,7 @@ void sa_define_symbol(SemanticAnalyzer *sa, Symbol *sym) {
     return;
   }
 
-  SymbolTableEntry *entry =
-      allocator_alloc(&sa->parser.ast.allocator, sizeof(SymbolTableEntry));
-  entry->symbol = sym;
-  entry->next = sa->current_scope->entries;
-  sa->current_scope->entries = entry;
+  symbol_table_insert(&sa->parser.ast, sa->current_scope, sym);
 }
 
 void sa_exit_scope(SemanticAnalyzer *sa) {
@@ -774,7 +1217,11 @@ void sa_exit_scope(SemanticAnalyzer *sa) {
 }
 
 bool sa_has_error(SemanticAnalyzer *sa) {
-  return sa && sa->last_error.type != SEM_OK;
+  return sa && sa->diagnostics.count > 0;
+}
+
+size_t sa_error_count(SemanticAnalyzer *sa) {
+  return sa ? sa->diagnostics.count : 0;
 }
 
 char *error_to_string(SemanticErrorType type) {
@@ -794,82 +1241,65 @@ char *error_to_string(SemanticErrorType type) {
   }
 }
 
-char *sa_format_error(SemanticAnalyzer *sa) {
-  if (!sa || sa->last_error.type == SEM_OK || !sa->last_error.token) {
-    slog_error("No error to format in sa_format_error");
-    return NULL;
+// Writes the format of `diagnostic` with its arguments
+static void sa_append_detail(StringBuilder *sb, const Diagnostic *diagnostic) {
+  const char *text = diagnostic->format;
+  uint8_t arg = 0;
+  for (const char *c; (c = strchr(text, '%')) != NULL; text = c + 1) {
+    sb_appendf(sb, "%.*s", (int)(c - text), text);
+    c++;
+    if (*c == '%') {
+      sb_appendf(sb, "%%");
+    } else if (*c == 's') {
+      sb_appendf(sb, "%s", diagnostic->args[arg++].text);
+    } else {
+      sb_appendf(sb, "%zu", diagnostic->args[arg++].number);
+      c++;
+    }
   }
+  sb_appendf(sb, "%s", text);
+}
 
-  Token *tok = sa->last_error.token;
-  SemanticErrorType type = sa->last_error.type;
-  const char *error_name = error_to_string(type);
+static char *sa_format_error(SemanticAnalyzer *sa, const Diagnostic *diagnostic,
+                             const char *detail) {
+  Allocator *allocator = &sa->parser.ast.allocator;
+  const char *error_name = error_to_string(diagnostic->type);
+  StringBuilder sb = sb_init(allocator, 256);
+  TokenIndex tok = diagnostic->token;
+  if (tok == TOKEN_NONE) {
+    sb_appendf(&sb, "%s: %s", error_name, detail);
+    return sb.items;
+  }
 
   /* -----------------------------------------------------------
      Determine frame name (Python-style)
      <module> for global code
      function_name for inside functions
+     The synthetic main holds the module's own statements
      ----------------------------------------------------------- */
+  const Symbol *function = diagnostic->function;
   const char *frame = "<module>";
-  SymbolTable *st = sa->current_scope;
-
-  while (st) {
-    SymbolTableEntry *e = st->entries;
-    while (e) {
-      if (e->symbol->kind == FUNCTION) {
-        frame = e->symbol->name;
-        goto frame_done; // break both loops
-      }
-      e = e->next;
-    }
-    st = st->parent;
-  }
-frame_done:;
+  if (function &&
+      function->decl_node->token < sa->parser.lexer.token_end)
+    frame = function->name;
 
   /* -----------------------------------------------------------
-     Extract the line of source code where the error occurred
+     Line of source code where the error occurred, with a '^' under the
+     token column
      ----------------------------------------------------------- */
-  const char *source = sa->parser.lexer.source;
-  size_t line_number = tok->line;
-  const char *line_start = source;
-  size_t curr_line = 1;
-
-  while (*line_start && curr_line < line_number) {
-    if (*line_start == '\n')
-      curr_line++;
-    line_start++;
-  }
-
-  const char *line_end = line_start;
-  while (*line_end && *line_end != '\n')
-    line_end++;
-
-  size_t line_len = line_end - line_start;
-  char *line_content = (char *)malloc(line_len + 1);
-  safe_memcpy(line_content, line_len + 1, line_start, line_len);
-  line_content[line_len] = 0;
-
-  /* -----------------------------------------------------------
-     Build caret underline: place '^' under the token column
-     ----------------------------------------------------------- */
-  size_t col = tok->col;
-  char *highlight = malloc(col + 1);
-  memset(highlight, ' ', col - 1);
-  highlight[col - 1] = '^';
-  highlight[col] = 0;
-  const char *filename = sa->parser.lexer.filename;
-  size_t buf_size =
-      strlen(filename) + strlen(line_content) + strlen(highlight) + 256;
-  char *msg = allocator_alloc(&sa->parser.ast.allocator, buf_size);
-  snprintf(msg, buf_size,
-           "  File \"%s\", line %zu, in %s\n"
-           "    %s\n"
-           "    %s\n"
-           "%s: %s",
-           filename, line_number, frame, line_content, highlight, error_name,
-           sa->last_error.detail);
-  free(line_content);
-  free(highlight);
-  return msg;
+  size_t line_number = token_line(&sa->parser.lexer, tok);
+  size_t line_len = 0;
+  const char *line_start =
+      source_line(&sa->parser.lexer, line_number, &line_len);
+  size_t col = token_col(&sa->parser.lexer, tok);
+  sb_appendf(&sb,
+             "  File \"%s\", line %zu, in %s\n"
+             "    %.*s\n"
+             "    %*s^\n"
+             "%s: %s",
+             sa->parser.lexer.filename, line_number, frame, (int)line_len,
+             line_start, (int)(col - 1), "", error_name, detail);
+  return sb.items;
 }
 
 void sa_enter_scope(SemanticAnalyzer *sa) {
@@ -878,76 +1308,123 @@ void sa_enter_scope(SemanticAnalyzer *sa) {
       symbol_table_new(&sa->parser.ast.allocator, sa->current_scope,
                        sa->current_scope ? sa->current_scope->depth + 1 : 0);
   ASSERT(new_scope != NULL, "Failed to allocate memory for new scope");
-  new_scope->entries = NULL;
   new_scope->parent = sa->current_scope;
   sa->current_scope = new_scope;
 }
 
+static bool sa_push_diagnostic(SemanticAnalyzer *sa, Diagnostic diagnostic) {
+  DiagnosticList *list = &sa->diagnostics;
+  if (list->count == list->capacity) {
+    size_t capacity = list->capacity ? list->capacity * 2 : 8;
+    Diagnostic *items = allocator_realloc(
+        &sa->parser.ast.allocator, list->items,
+        list->capacity * sizeof(Diagnostic), capacity * sizeof(Diagnostic));
+    if (items == NULL) {
+      slog_error("Failed to grow the semantic error list");
+      return false;
+    }
+    list->items = items;
+    list->capacity = capacity;
+  }
+  list->items[list->count++] = diagnostic;
+  return true;
+}
+
 PRINTF_FORMAT(4, 5)
-void sa_set_error(SemanticAnalyzer *sa, SemanticErrorType type, Token *tok,
+void sa_set_error(SemanticAnalyzer *sa, SemanticErrorType type, TokenIndex tok,
                   const char *fmt, ...) {
   if (!sa) {
     slog_error("SemanticAnalyzer pointer is NULL in sa_set_error");
     return;
   }
 
-  char buf[256];
+  Diagnostic diagnostic = {.type = type,
+                           .token = tok,
+                           .format = fmt,
+                           .function = sa_enclosing_function(sa)};
   va_list args;
   va_start(args, fmt);
-  vsnprintf(buf, sizeof(buf), fmt, args);
+  for (const char *c = fmt; (c = strchr(c, '%')) != NULL; c++) {
+    c++;
+    if (*c == '%')
+      continue;
+
+    ASSERT(diagnostic.arg_count < SA_MAX_DIAGNOSTIC_ARGS,
+           "Too many arguments for a semantic error");
+    DiagnosticArg *arg = &diagnostic.args[diagnostic.arg_count++];
+    if (*c == 's') {
+      arg->text = va_arg(args, const char *);
+    } else {
+      ASSERT(c[0] == 'z' && c[1] == 'u',
+             "Semantic errors only format %s and %zu");
+      arg->number = va_arg(args, size_t);
+      c++;
+    }
+  }
   va_end(args);
-  sa->last_error.type = type;
-  sa->last_error.token = tok;
-  sa->last_error.detail = arena_strdup(&sa->parser.ast.allocator.base, buf);
-  sa->last_error.message = sa_format_error(sa);
+
+  // The statement reports the error its analysis ended on
+  if (sa->diagnostics.count > sa->statement_start) {
+    sa->diagnostics.items[sa->diagnostics.count - 1] = diagnostic;
+    return;
+  }
+  sa_push_diagnostic(sa, diagnostic);
+}
+
+SemanticError sa_error_at(SemanticAnalyzer *sa, size_t index) {
+  if (!sa || index >= sa->diagnostics.count)
+    return (SemanticError){.type = SEM_OK, .token = TOKEN_NONE};
+
+  const Diagnostic *diagnostic = &sa->diagnostics.items[index];
+  StringBuilder detail = sb_init(&sa->parser.ast.allocator, 64);
+  sa_append_detail(&detail, diagnostic);
+  SemanticError err = {.type = diagnostic->type,
+                       .token = diagnostic->token,
+                       .detail = detail.items};
+  err.message = sa_format_error(sa, diagnostic, err.detail);
+  return err;
 }
 
 SemanticError sa_get_error(SemanticAnalyzer *sa) {
   if (!sa) {
     SemanticError err = {0};
     err.type = SEM_UNKNOWN;
-    err.token = NULL;
+    err.token = TOKEN_NONE;
     err.message = "SemanticAnalyzer pointer is NULL";
     return err;
   }
 
-  return sa->last_error;
+  return sa_error_at(sa, 0);
 }
 
 Symbol *sa_create_symbol(SemanticAnalyzer *sa, ASTNode *node, DataType type,
                          SymbolType kind) {
   Symbol *sym = allocator_alloc(&sa->parser.ast.allocator, sizeof(Symbol));
   sym->id = sa->next_symbol_id++;
-  sym->name = arena_strdup(&sa->parser.ast.allocator.base, node->token->lexeme);
+  sym->name_id = sa_name_of(sa, node->token);
+  // Identifiers share the intern table copy of their text
+  sym->name = sa_lexeme(sa, node->token);
   sym->kind = kind;
   sym->dtype = type;
   sym->decl_node = node;
   sym->scope_level = sa->current_scope ? sa->current_scope->depth : 0;
+  sym->index = 0;
   sym->scope = NULL;
   sym->base_class = NULL;
+  sym->layout = NULL;
+  sym->failed = false;
   return sym;
 }
 
 /**
- * @brief Recursively searches for an attribute in a class and its base classes.
+ * @brief Finds an attribute of a class, inherited ones included.
  */
-Symbol *sa_lookup_member(Symbol *class_sym, const char *name) {
+Symbol *sa_lookup_member(Symbol *class_sym, NameId name) {
   if (!class_sym || class_sym->kind != CLASS)
     return NULL;
 
-  // 1. Check current class scope
-  SymbolTable *st = class_sym->scope;
-  for (SymbolTableEntry *e = st->entries; e; e = e->next) {
-    if (strcmp(e->symbol->name, name) == 0)
-      return e->symbol;
-  }
-
-  // 2. Recursive check in base class
-  if (class_sym->base_class) {
-    return sa_lookup_member(class_sym->base_class, name);
-  }
-
-  return NULL;
+  const ClassMember *member = class_layout_find(class_sym->layout, name);
+  return member ? member->symbol : NULL;
 }
 
 const char *symbol_kind_to_string(SymbolType kind) {
@@ -967,105 +1444,73 @@ const char *symbol_kind_to_string(SymbolType kind) {
   }
 }
 
-cJSON *serialize_symbol(Symbol *sym) {
+void serialize_symbol(JsonWriter *json, Symbol *sym) {
   if (sym == NULL)
-    return NULL;
+    return;
 
-  cJSON *root = cJSON_CreateObject();
-  cJSON_AddStringToObject(root, "name", sym->name);
-  cJSON_AddStringToObject(root, "kind", symbol_kind_to_string(sym->kind));
-  cJSON_AddStringToObject(root, "dtype", datatype_to_string(sym->dtype));
-  cJSON_AddNumberToObject(root, "scope_level", sym->scope_level);
+  json_begin_object(json);
+  json_field_string(json, "name", sym->name);
+  json_field_string(json, "kind", symbol_kind_to_string(sym->kind));
+  json_field_string(json, "dtype", datatype_to_string(sym->dtype));
+  json_field_number(json, "scope_level", sym->scope_level);
+  json_field_number(json, "index", sym->index);
 
   // If it's a class with a base class, record the name to avoid circular
   // recursion
   if (sym->base_class) {
-    cJSON_AddStringToObject(root, "base_class", sym->base_class->name);
+    json_field_string(json, "base_class", sym->base_class->name);
   }
 
   // Recursively serialize nested scopes (for functions and classes)
   if (sym->scope) {
-    cJSON_AddItemToObject(root, "scope", serialize_symbol_table(sym->scope));
+    json_key(json, "scope");
+    serialize_symbol_table(json, sym->scope);
   }
 
-  return root;
+  json_end_object(json);
 }
 
-cJSON *serialize_symbol_table(SymbolTable *st) {
+void serialize_symbol_table(JsonWriter *json, SymbolTable *st) {
   if (st == NULL)
-    return NULL;
+    return;
 
-  cJSON *root = cJSON_CreateObject();
-  cJSON_AddNumberToObject(root, "depth", st->depth);
+  json_begin_object(json);
+  json_field_number(json, "depth", st->depth);
 
-  cJSON *entries = cJSON_CreateArray();
+  json_key(json, "entries");
+  json_begin_array(json);
   SymbolTableEntry *curr = st->entries;
   while (curr) {
-    cJSON_AddItemToArray(entries, serialize_symbol(curr->symbol));
+    serialize_symbol(json, curr->symbol);
     curr = curr->next;
   }
-  cJSON_AddItemToObject(root, "entries", entries);
+  json_end_array(json);
 
-  return root;
+  json_end_object(json);
 }
 
 char *dump_symbol_table(SymbolTable *st) {
-  cJSON *json = serialize_symbol_table(st);
-  char *dump = cJSON_Print(json);
-  cJSON_Delete(json);
-  return dump;
+  JsonWriter json = json_writer_string(false);
+  serialize_symbol_table(&json, st);
+  return json_writer_take(&json);
 }
 
-Symbol *resolve_symbol(SemanticAnalyzer *sa, ASTNode *node) {
-  if (node->parent && node->parent->type == CLASS_DEF) {
-    Symbol *class_sym = sa_lookup(sa, node->parent->def.name->token->lexeme);
-    Symbol *sym = sa_lookup_member(class_sym, node->token->lexeme);
-    return sym;
-  }
-
-  return sa_lookup(sa, node->token->lexeme);
+bool dump_symbol_table_to(SymbolTable *st, FILE *file, bool compact) {
+  JsonWriter json = json_writer_file(file, compact);
+  serialize_symbol_table(&json, st);
+  return json_writer_finish(&json);
 }
 
-Symbol *find_enclosing_class(SemanticAnalyzer *sa) {
-  SymbolTable *st = sa->current_scope;
-
-  while (st) {
-    for (SymbolTableEntry *e = st->entries; e; e = e->next) {
-      if (e->symbol->kind == CLASS)
-        return e->symbol;
-    }
-    st = st->parent;
-  }
-  return NULL;
-}
-
-static bool class_has_field(Symbol *cls, const char *name) {
-  if (!cls || !cls->scope)
-    return false;
-
-  for (SymbolTableEntry *e = cls->scope->entries; e; e = e->next) {
-    if (e->symbol->kind == VAR && strcmp(e->symbol->name, name) == 0) {
-      return true;
-    }
+Symbol *resolve_symbol(SemanticAnalyzer *sa, ASTNode *node) {
+  ASTNode *parent = sa_node(sa, node->parent);
+  if (parent && parent->type == CLASS_DEF) {
+    ASTNode *name = sa_node(sa, parent->def.name);
+    Symbol *class_sym = sa_lookup(sa, sa_name_of(sa, name->token));
+    Symbol *sym = sa_lookup_member(class_sym, sa_name_of(sa, node->token));
+    return sym;
   }
-  return false;
-}
-
-static Symbol *resolve_base_class(SemanticAnalyzer *sa, Symbol *cls) {
-  if (!cls || !cls->base_class)
-    return NULL;
 
-  SymbolTable *st = sa->current_scope;
-  while (st) {
-    for (SymbolTableEntry *e = st->entries; e; e = e->next) {
-      if (e->symbol->kind == CLASS &&
-          strcmp(e->symbol->name, cls->base_class->name) == 0) {
-        return e->symbol;
-      }
-    }
-    st = st->parent;
-  }
-  return NULL;
+  return sa_lookup(sa, sa_name_of(sa, node->token));
 }
 
 AttrOwnership resolve_attribute_owner(SemanticAnalyzer *sa,
@@ -1073,25 +1518,24 @@ AttrOwnership resolve_attribute_owner(SemanticAnalyzer *sa,
   if (!sa || !attr_node || attr_node->type != ATTRIBUTE)
     return ATTR_OWN_CURRENT;
 
-  const char *attr = attr_node->attribute.attr;
+  NameId attr = sa_name_of(sa, attr_node->token);
 
   // Rule 1: assignment ALWAYS creates / writes on current class
   if (attr_node->type == ASSIGNMENT) {
     return ATTR_OWN_CURRENT;
   }
 
-  // Rule 2: resolve by class layout
-  Symbol *cls = find_enclosing_class(sa);
+  // Rule 2: resolve by the layout of the class of the object, as bound by
+  // semantic analysis
+  Symbol *obj = sa_node(sa, attr_node->attribute.value)->symbol;
+  Symbol *cls = obj && obj->dtype == OBJECT ? obj->base_class : NULL;
   if (!cls)
     return ATTR_OWN_CURRENT;
 
-  // Field defined on current class?
-  if (class_has_field(cls, attr))
-    return ATTR_OWN_CURRENT;
-
-  // Field inherited from base?
-  Symbol *base = resolve_base_class(sa, cls);
-  if (class_has_field(base, attr))
+  // Field inherited from the direct base?
+  const ClassMember *member = class_layout_find(cls->layout, attr);
+  if (member && !member->is_method && cls->base_class &&
+      member->owner == cls->base_class)
     return ATTR_OWN_BASE;
 
   return ATTR_OWN_CURRENT;
@@ -1105,14 +1549,14 @@ static bool analyze_pattern(SemanticAnalyzer *sa, ASTNode *pat,
   switch (pat->type) {
 
   case VARIABLE: {
-    const char *name = pat->token->lexeme;
-
-    if (strcmp(name, "_") == 0)
+    if (token_is(&sa->parser.lexer, pat->token, "_"))
       return true; // wildcard never binds
 
+    NameId name = sa_name_of(sa, pat->token);
     if (pb_contains(pb, name)) {
       sa_set_error(sa, SEM_DUPLICATE_BINDING, pat->token,
-                   "multiple assignments to name '%s' in pattern", name);
+                   "multiple assignments to name '%s' in pattern",
+                   sa_lexeme(sa, pat->token));
       return false;
     }
 
@@ -1121,8 +1565,8 @@ static bool analyze_pattern(SemanticAnalyzer *sa, ASTNode *pat,
   }
 
   case TUPLE:
-    for (size_t i = 0; i < pat->collection.size; i++) {
-      if (!analyze_pattern(sa, pat->collection.elements[i].data, pb))
+    for (uint32_t i = 0; i < pat->collection.count; i++) {
+      if (!analyze_pattern(sa, sa_child(sa, pat->collection, i), pb))
         return false;
     }
     return true;
@@ -1138,23 +1582,21 @@ bool analyze_match_stmt(SemanticAnalyzer *sa, ASTNode *node) {
   ASSERT(sa, "Semantic Analyzer context not provided");
   ASSERT(node, "Node not provided");
   // 1. Analyze the 'subject' of the match (e.g., the 'x' in 'match x:')
-  if (!analyze_node(sa, node->ctrl_stmt.test))
+  if (!analyze_node(sa, sa_node(sa, node->ctrl_stmt.test)))
     return false;
 
   bool is_wildcard = false;
 
   // 2. Iterate through the cases in the body
-  for (size_t cur = node->ctrl_stmt.body.head; cur != SIZE_MAX;
-       cur = node->ctrl_stmt.body.elements[cur].next) {
-    ASTNode *case_node = node->ctrl_stmt.body.elements[cur].data;
+  for (uint32_t cur = 0; cur < node->ctrl_stmt.body.count; cur++) {
+    ASTNode *case_node = sa_child(sa, node->ctrl_stmt.body, cur);
 
-    if (case_node->ctrl_stmt.orelse.size == 0) {
+    if (case_node->ctrl_stmt.orelse.count == 0) {
       return false;
     }
 
     // Get the actual pattern node from the 'orelse' list
-    size_t pattern_idx = case_node->ctrl_stmt.orelse.head;
-    ASTNode *pat = case_node->ctrl_stmt.orelse.elements[pattern_idx].data;
+    ASTNode *pat = sa_child(sa, case_node->ctrl_stmt.orelse, 0);
 
     // Check if we've already seen a wildcard in a previous iteration
     if (is_wildcard) {
@@ -1164,7 +1606,7 @@ bool analyze_match_stmt(SemanticAnalyzer *sa, ASTNode *node) {
     }
 
     // Check if current pattern is a wildcard
-    if (pat->type == VARIABLE && strcmp(pat->token->lexeme, "_") == 0) {
+    if (pat->type == VARIABLE && token_is(&sa->parser.lexer, pat->token, "_")) {
       is_wildcard = true;
     }
 
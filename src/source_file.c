@@ -0,0 +1,126 @@
+#define _DEFAULT_SOURCE
+#include "source_file.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SOURCE_READ_CHUNK 65536
+
+static bool source_file_map(SourceFile *file, int fd, size_t size) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  // Reserve one byte past the contents so the text stays NUL-terminated even
+  // when the file fills its last page: that byte lands in a zeroed page.
+  size_t map_size = (size + 1 + page - 1) / page * page;
+  char *base = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                    -1, 0);
+  if (base == MAP_FAILED)
+    return false;
+
+  if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+      MAP_FAILED) {
+    munmap(base, map_size);
+    return false;
+  }
+
+  // The lexer walks the file front to back exactly once
+  madvise(base, size, MADV_SEQUENTIAL);
+
+  file->text = base;
+  file->length = size;
+  file->map_size = map_size;
+  return true;
+}
+
+static bool source_file_read(SourceFile *file, FILE *stream) {
+  size_t capacity = SOURCE_READ_CHUNK;
+  size_t length = 0;
+  char *buffer = malloc(capacity);
+  if (buffer == NULL) {
+    slog_error("[%s] Failed to allocate memory for file reading", file->path);
+    return false;
+  }
+
+  for (;;) {
+    // Keep room for the terminating NUL
+    if (length + 1 == capacity) {
+      char *grown = realloc(buffer, capacity * 2);
+      if (grown == NULL) {
+        slog_error("[%s] Failed to allocate memory for file reading",
+                   file->path);
+        free(buffer);
+        return false;
+      }
+      buffer = grown;
+      capacity *= 2;
+    }
+
+    size_t count = fread(buffer + length, 1, capacity - length - 1, stream);
+    if (count == 0)
+      break;
+    length += count;
+  }
+
+  buffer[length] = '\0';
+  file->text = buffer;
+  file->length = length;
+  file->map_size = 0;
+  return true;
+}
+
+bool source_file_open(SourceFile *file, const char *path) {
+  *file = (SourceFile){.path = path};
+  if (path == NULL) {
+    slog_error("File name provided is not valid");
+    return false;
+  }
+
+  bool loaded = false;
+  if (strcmp(path, "-") == 0) {
+    loaded = source_file_read(file, stdin);
+  } else {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      slog_error("[%s] Failed to open text file", path);
+      return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+      loaded = source_file_map(file, fd, (size_t)st.st_size);
+
+    if (loaded) {
+      close(fd);
+    } else {
+      // Not mappable (pipe, device, procfs...), read it instead
+      FILE *stream = fdopen(fd, "r");
+      if (stream == NULL) {
+        slog_error("[%s] Failed to open text file", path);
+        close(fd);
+        return false;
+      }
+      loaded = source_file_read(file, stream);
+      fclose(stream);
+    }
+  }
+
+  if (loaded && file->length == 0) {
+    slog_error("[%s] Failed to read text file", path);
+    source_file_close(file);
+    return false;
+  }
+
+  return loaded;
+}
+
+void source_file_close(SourceFile *file) {
+  if (file->text == NULL)
+    return;
+
+  if (file->map_size > 0)
+    munmap((void *)file->text, file->map_size);
+  else
+    free((void *)file->text);
+
+  *file = (SourceFile){0};
+}
@@ -17,7 +17,7 @@ static void gen_function_def(Tac *tac, ASTNode *node);
 TACValue gen_const_value(Tac *tac, ASTNode *node);
 
 size_t tac_add_constant(TACProgram *program, ConstantValue value,
-                        DataType type);
+                        size_t length, DataType type);
 
 ConstantEntry *tac_get_constant(TACProgram *program, size_t id);
 
@@ -28,6 +28,18 @@ static TACValue new_tac_value(size_t id, DataType type) {
   return val;
 }
 
+static inline const char *tac_lexeme(Tac *tac, TokenIndex token) {
+  return token_lexeme(&tac->sa->parser.lexer, token);
+}
+
+static inline ASTNode *tac_child(Tac *tac, NodeSpan span, uint32_t i) {
+  return AST_child(&tac->sa->parser.ast, span, i);
+}
+
+static inline ASTNode *tac_node(Tac *tac, NodeIndex index) {
+  return AST_get(&tac->sa->parser.ast, index);
+}
+
 static TACInstruction create_instruction(TACOp op, TACValue lhs, TACValue rhs,
                                          TACValue result, const char *label) {
   TACInstruction instr;
@@ -125,20 +137,20 @@ static TACValue new_reg(Tac *tac, DataType type) {
 TACProgram tac_generate(SemanticAnalyzer *sa) {
   ASSERT(sa != NULL, "SemanticAnalyzer cannot be NULL");
   // Initialize TAC generator state
-  Tac tac;
+  Tac tac = {0};
   tac.sa = sa;
   tac.reg_counter = 0;
+  // Roughly one instruction per node
   tac.program.instructions =
       allocator_alloc(&sa->parser.ast.allocator,
-                      sizeof(TACInstruction) * sa->parser.ast.capacity);
+                      sizeof(TACInstruction) * sa->parser.ast.size);
   tac.program.count = 0;
-  tac.program.capacity = sa->parser.ast.capacity;
+  tac.program.capacity = sa->parser.ast.size;
   tac.program.allocator = &sa->parser.ast.allocator;
   // Generate TAC for all AST nodes in the program
-  ASTNode_LinkedList *program = &sa->parser.ast;
-  for (size_t current = program->head; current != SIZE_MAX;
-       current = program->elements[current].next) {
-    ASTNode *node = program->elements[current].data;
+  NodeSpan program = sa->parser.program;
+  for (uint32_t current = 0; current < program.count; current++) {
+    ASTNode *node = tac_child(&tac, program, current);
     gen_stmt(&tac, node);
   }
 
@@ -173,14 +185,13 @@ static void gen_assign(Tac *tac, ASTNode *node) {
   ASSERT(node != NULL, "ASTNode cannot be NULL in gen_assign");
   ASSERT(node->type == ASSIGNMENT, "Node must be of type ASSIGNMENT");
 
-  ASTNode *value_node = node->assign.value;
+  ASTNode *value_node = tac_node(tac, node->assign.value);
   TACValue value = gen_expr(tac, value_node);
 
-  for (size_t current = node->assign.targets.head; current != SIZE_MAX;
-       current = node->assign.targets.elements[current].next) {
-    ASTNode *target = node->assign.targets.elements[current].data;
+  for (uint32_t current = 0; current < node->assign.targets.count; current++) {
+    ASTNode *target = tac_child(tac, node->assign.targets, current);
     if (target->type == VARIABLE) {
-      Symbol *sym = sa_lookup(tac->sa, target->token->lexeme);
+      Symbol *sym = target->symbol;
       if (sym) {
         TACValue var_addr = new_tac_value(sym->id, sym->dtype);
         TACInstruction instr = create_instruction(
@@ -200,7 +211,7 @@ static TACValue gen_expr(Tac *tac, ASTNode *node) {
     return gen_const_value(tac, node);
   }
   case VARIABLE: {
-    Symbol *sym = sa_lookup(tac->sa, node->token->lexeme);
+    Symbol *sym = node->symbol;
     if (!sym)
       return new_tac_value(0, UNKNOWN);
 
@@ -237,24 +248,34 @@ TACValue gen_const_value(Tac *tac, ASTNode *node) {
   ASSERT(node->type == LITERAL, "Node must be of type LITERAL");
 
   ConstantValue const_val;
+  size_t length = 0;
   DataType dtype = sa_infer_type(tac->sa, node);
+  const TokenValue *value = token_value(&tac->sa->parser.lexer, node->token);
+  if (value == NULL)
+    UNREACHABLE("Unsupported literal type in gen_const_value");
 
   switch (dtype) {
   case INT:
-    const_val.int_val = strtoll(node->token->lexeme, NULL, 10);
+    const_val.int_val = value->int_val;
     break;
   case FLOAT:
-    const_val.float_val = strtod(node->token->lexeme, NULL);
-    break;
-  case STR:
-    const_val.str_val =
-        arena_strdup(&tac->sa->parser.ast.allocator.base, node->token->lexeme);
+    const_val.float_val = value->float_val;
     break;
+  case STR: {
+    Arena *arena = &tac->sa->parser.ast.allocator.base;
+    char *text = arena_alloc(arena, value->length + 1);
+    memcpy(text, token_string(&tac->sa->parser.lexer, node->token),
+           value->length);
+    text[value->length] = '\0';
+    const_val.str_val = text;
+    length = value->length;
+  } break;
   default:
     UNREACHABLE("Unsupported literal type in gen_const_value");
   }
 
-  size_t const_id = tac_add_constant(&tac->program, const_val, dtype);
+  size_t const_id =
+      tac_add_constant(&tac->program, const_val, length, dtype);
   TACValue result = new_reg(tac, dtype);
   TACValue const_value = new_tac_value(const_id, dtype);
 
@@ -268,28 +289,31 @@ static TACValue gen_binary_op(Tac *tac, ASTNode *node) {
   ASSERT(tac != NULL, "Tac cannot be NULL in gen_binary_op");
   ASSERT(node != NULL, "ASTNode cannot be NULL in gen_binary_op");
   ASSERT(node->type == BINARY_OPERATION, "Node must be BINARY_OPERATION");
-  ASSERT(node->token != NULL, "Binary operation node must have a token");
+  ASSERT(node->token != TOKEN_NONE, "Binary operation node must have a token");
 
   // Generate operands
-  TACValue lhs = gen_expr(tac, node->bin_op.left);
-  TACValue rhs = gen_expr(tac, node->bin_op.right);
+  TACValue lhs = gen_expr(tac, tac_node(tac, node->bin_op.left));
+  TACValue rhs = gen_expr(tac, tac_node(tac, node->bin_op.right));
 
   // Infer result type from semantic analysis
   DataType result_type = sa_infer_type(tac->sa, node);
   TACValue result = new_reg(tac, result_type);
 
-  const char *op_lexeme = node->token->lexeme;
   TACOp op;
-
-  if (strcmp(op_lexeme, "+") == 0) {
+  switch (token_subkind(&tac->sa->parser.lexer, node->token)) {
+  case OP_PLUS:
     op = TAC_ADD;
-  } else if (strcmp(op_lexeme, "-") == 0) {
+    break;
+  case OP_MINUS:
     op = TAC_SUB;
-  } else if (strcmp(op_lexeme, "*") == 0) {
+    break;
+  case OP_STAR:
     op = TAC_MUL;
-  } else if (strcmp(op_lexeme, "/") == 0) {
+    break;
+  case OP_SLASH:
     op = TAC_DIV;
-  } else {
+    break;
+  default:
     UNREACHABLE("Invalid binary operator in gen_binary_op");
   }
 
@@ -302,26 +326,21 @@ static TACValue gen_unary_op(Tac *tac, ASTNode *node) {
   ASSERT(tac != NULL, "Tac cannot be NULL in gen_unary_op");
   ASSERT(node != NULL, "ASTNode cannot be NULL in gen_unary_op");
   ASSERT(node->type == UNARY_OPERATION, "Node must be UNARY_OPERATION");
-  ASSERT(node->token != NULL, "Unary operation node must have a token");
+  ASSERT(node->token != TOKEN_NONE, "Unary operation node must have a token");
 
   // Generate operand
-  TACValue operand = gen_expr(tac, node->bin_op.right);
+  TACValue operand = gen_expr(tac, tac_node(tac, node->bin_op.right));
 
   // Infer result type
   DataType result_type = sa_infer_type(tac->sa, node);
 
-  const char *op = node->token->lexeme;
+  TokenSubkind op = token_subkind(&tac->sa->parser.lexer, node->token);
 
   /* Unary minus: -x ==> 0 - x */
-  if (strcmp(op, "-") == 0) {
-    Token zero_token = {
-        .type = NUMBER,
-        .lexeme = "0",
-        .line = 0,
-        .col = 0,
-        .ident = 0,
-    };
-    ASTNode *zero_node = node_new(&tac->sa->parser, &zero_token, LITERAL);
+  if (op == OP_MINUS) {
+    TokenIndex zero_token =
+        create_token_from_str(&tac->sa->parser.lexer, "0", NUMBER);
+    ASTNode *zero_node = node_new(&tac->sa->parser, zero_token, LITERAL);
     TACValue zero_val = gen_const_value(tac, zero_node);
     TACValue result = new_reg(tac, result_type);
     TACInstruction instr =
@@ -331,7 +350,7 @@ static TACValue gen_unary_op(Tac *tac, ASTNode *node) {
   }
 
   /* Unary plus: +x ==> x (no-op) */
-  if (strcmp(op, "+") == 0) {
+  if (op == OP_PLUS) {
     return operand;
   }
 
@@ -575,7 +594,7 @@ void tac_append_instruction(StringBuilder *sb, TACInstruction *instr,
 }
 
 size_t tac_add_constant(TACProgram *program, ConstantValue value,
-                        DataType type) {
+                        size_t length, DataType type) {
   if (!program)
     return 0;
 
@@ -593,7 +612,8 @@ size_t tac_add_constant(TACProgram *program, ConstantValue value,
           return entry->id;
         break;
       case STR:
-        if (strcmp(entry->value.str_val, value.str_val) == 0)
+        if (entry->length == length &&
+            memcmp(entry->value.str_val, value.str_val, length) == 0)
           return entry->id;
         break;
       case BOOL:
@@ -624,6 +644,7 @@ size_t tac_add_constant(TACProgram *program, ConstantValue value,
   ConstantEntry *entry = &program->constants.entries[program->constants.count];
   entry->id = program->constants.next_id++;
   entry->type = type;
+  entry->length = length;
 
   // Copy value (handle strings specially)
   if (type == STR) {
@@ -656,8 +677,8 @@ static const char *new_label(Tac *tac) {
 
 static void gen_if(Tac *tac, ASTNode *node) {
   ASSERT(node->type == IF, "Expected IF");
-  TACValue cond = gen_expr(tac, node->ctrl_stmt.test);
-  bool has_else = node->ctrl_stmt.orelse.head != SIZE_MAX;
+  TACValue cond = gen_expr(tac, tac_node(tac, node->ctrl_stmt.test));
+  bool has_else = node->ctrl_stmt.orelse.count > 0;
   const char *else_label = has_else ? new_label(tac) : NULL;
   const char *end_label = new_label(tac);
 
@@ -668,9 +689,8 @@ static void gen_if(Tac *tac, ASTNode *node) {
                                         has_else ? else_label : end_label));
 
   /* then-body */
-  for (size_t cur = node->ctrl_stmt.body.head; cur != SIZE_MAX;
-       cur = node->ctrl_stmt.body.elements[cur].next) {
-    gen_stmt(tac, node->ctrl_stmt.body.elements[cur].data);
+  for (uint32_t cur = 0; cur < node->ctrl_stmt.body.count; cur++) {
+    gen_stmt(tac, tac_child(tac, node->ctrl_stmt.body, cur));
   }
 
   /* jump over else */
@@ -684,9 +704,8 @@ static void gen_if(Tac *tac, ASTNode *node) {
                                           new_tac_value(0, NONE),
                                           new_tac_value(0, NONE), else_label));
 
-    for (size_t cur = node->ctrl_stmt.orelse.head; cur != SIZE_MAX;
-         cur = node->ctrl_stmt.orelse.elements[cur].next) {
-      gen_stmt(tac, node->ctrl_stmt.orelse.elements[cur].data);
+    for (uint32_t cur = 0; cur < node->ctrl_stmt.orelse.count; cur++) {
+      gen_stmt(tac, tac_child(tac, node->ctrl_stmt.orelse, cur));
     }
   }
 
@@ -705,7 +724,8 @@ static void gen_function_def(Tac *tac, ASTNode *node) {
 
   // 1. Function Label
   // We use the function name as the label so CALL instructions can find it.
-  const char *func_name = node->def.name->token->lexeme;
+  ASTNode *name = tac_node(tac, node->def.name);
+  const char *func_name = tac_lexeme(tac, name->token);
   append_instruction(tac,
                      create_instruction(TAC_LABEL, new_tac_value(0, NONE),
                                         new_tac_value(0, NONE),
@@ -714,10 +734,9 @@ static void gen_function_def(Tac *tac, ASTNode *node) {
   // 2. Handle Parameters
   // This maps the calling convention's arguments into the function's local
   // virtual registers.
-  for (size_t cur = node->def.params.head; cur != SIZE_MAX;
-       cur = node->def.params.elements[cur].next) {
-    ASTNode *param_node = node->def.params.elements[cur].data;
-    Symbol *sym = sa_lookup(tac->sa, param_node->token->lexeme);
+  for (uint32_t cur = 0; cur < node->def.params.count; cur++) {
+    ASTNode *param_node = tac_child(tac, node->def.params, cur);
+    Symbol *sym = param_node->symbol;
     size_t arg_index = 0;
 
     if (sym) {
@@ -733,9 +752,8 @@ static void gen_function_def(Tac *tac, ASTNode *node) {
   }
 
   // 3. Generate Body
-  for (size_t cur = node->def.body.head; cur != SIZE_MAX;
-       cur = node->def.body.elements[cur].next) {
-    gen_stmt(tac, node->def.body.elements[cur].data);
+  for (uint32_t cur = 0; cur < node->def.body.count; cur++) {
+    gen_stmt(tac, tac_child(tac, node->def.body, cur));
   }
 
   // 4. Implicit Return
@@ -744,82 +762,90 @@ static void gen_function_def(Tac *tac, ASTNode *node) {
                                              new_tac_value(0, NONE), NULL));
 }
 
-static cJSON *serialize_tac_value(TACValue val) {
-  cJSON *root = cJSON_CreateObject();
-  cJSON_AddNumberToObject(root, "id", (double)val.id);
-  cJSON_AddStringToObject(root, "type", type_to_str(val.type));
-  return root;
+static void serialize_tac_value(JsonWriter *json, TACValue val) {
+  json_begin_object(json);
+  json_field_number(json, "id", (double)val.id);
+  json_field_string(json, "type", type_to_str(val.type));
+  json_end_object(json);
 }
 
-static cJSON *serialize_constant(ConstantEntry *entry) {
-  cJSON *root = cJSON_CreateObject();
-  cJSON_AddNumberToObject(root, "id", (double)entry->id);
-  cJSON_AddStringToObject(root, "type", type_to_str(entry->type));
+static void serialize_constant(JsonWriter *json, ConstantEntry *entry) {
+  json_begin_object(json);
+  json_field_number(json, "id", (double)entry->id);
+  json_field_string(json, "type", type_to_str(entry->type));
 
   switch (entry->type) {
   case INT:
-    cJSON_AddNumberToObject(root, "value", (double)entry->value.int_val);
+    json_field_number(json, "value", (double)entry->value.int_val);
     break;
   case FLOAT:
-    cJSON_AddNumberToObject(root, "value", entry->value.float_val);
+    json_field_number(json, "value", entry->value.float_val);
     break;
   case STR:
-    cJSON_AddStringToObject(root, "value", entry->value.str_val);
+    json_field_string_n(json, "value", entry->value.str_val, entry->length);
     break;
   case BOOL:
-    cJSON_AddBoolToObject(root, "value", entry->value.int_val != 0);
+    json_field_bool(json, "value", entry->value.int_val != 0);
     break;
   default:
-    cJSON_AddNullToObject(root, "value");
+    json_field_null(json, "value");
     break;
   }
-  return root;
+  json_end_object(json);
 }
 
-cJSON *serialize_tac_program(TACProgram *program) {
+void serialize_tac_program(JsonWriter *json, TACProgram *program) {
   if (!program)
-    return NULL;
+    return;
 
-  cJSON *root = cJSON_CreateObject();
+  json_begin_object(json);
 
   // 1. Serialize Constants Table
-  cJSON *constants = cJSON_CreateArray();
-  cJSON_AddItemToObject(root, "constants", constants);
+  json_key(json, "constants");
+  json_begin_array(json);
   for (size_t i = 0; i < program->constants.count; i++) {
-    cJSON_AddItemToArray(constants,
-                         serialize_constant(&program->constants.entries[i]));
+    serialize_constant(json, &program->constants.entries[i]);
   }
+  json_end_array(json);
 
   // 2. Serialize Instructions
-  cJSON *instructions = cJSON_CreateArray();
-  cJSON_AddItemToObject(root, "instructions", instructions);
+  json_key(json, "instructions");
+  json_begin_array(json);
   for (size_t i = 0; i < program->count; i++) {
     TACInstruction *instr = &program->instructions[i];
-    cJSON *j_instr = cJSON_CreateObject();
+    json_begin_object(json);
 
-    cJSON_AddNumberToObject(j_instr, "index", (double)i);
-    cJSON_AddStringToObject(j_instr, "op", op_to_str(instr->op));
+    json_field_number(json, "index", (double)i);
+    json_field_string(json, "op", op_to_str(instr->op));
 
     // Add operands
-    cJSON_AddItemToObject(j_instr, "lhs", serialize_tac_value(instr->lhs));
-    cJSON_AddItemToObject(j_instr, "rhs", serialize_tac_value(instr->rhs));
-    cJSON_AddItemToObject(j_instr, "result",
-                          serialize_tac_value(instr->result));
+    json_key(json, "lhs");
+    serialize_tac_value(json, instr->lhs);
+    json_key(json, "rhs");
+    serialize_tac_value(json, instr->rhs);
+    json_key(json, "result");
+    serialize_tac_value(json, instr->result);
 
     // Add label if it exists
     if (instr->label) {
-      cJSON_AddStringToObject(j_instr, "label", instr->label);
+      json_field_string(json, "label", instr->label);
     }
 
-    cJSON_AddItemToArray(instructions, j_instr);
+    json_end_object(json);
   }
+  json_end_array(json);
 
-  return root;
+  json_end_object(json);
 }
 
 char *tac_dump_program(TACProgram *program) {
-  cJSON *json = serialize_tac_program(program);
-  char *dump = cJSON_Print(json);
-  cJSON_Delete(json);
-  return dump;
+  JsonWriter json = json_writer_string(false);
+  serialize_tac_program(&json, program);
+  return json_writer_take(&json);
+}
+
+bool tac_dump_program_to(TACProgram *program, FILE *file, bool compact) {
+  JsonWriter json = json_writer_file(file, compact);
+  serialize_tac_program(&json, program);
+  return json_writer_finish(&json);
 }
\ No newline at end of file
@@ -5,10 +5,12 @@ Token_ArrayList Token_new(size_t capacity) {
   Token_ArrayList list = {
       .size = 0, .capacity = capacity, .allocator = allocator};
   allocator_init(&list.allocator, "Token_ArrayList");
-  list.elements = allocator_alloc(&list.allocator, capacity * sizeof(Token *));
+  list.elements =
+      allocator_alloc(&list.allocator, capacity * sizeof(TokenIndex));
 
   if (list.elements == NULL) {
-    slog_error("Could not allocate memory for \"Token*\" array list elements");
+    slog_error(
+        "Could not allocate memory for \"TokenIndex\" array list elements");
   }
 
   return list;
@@ -17,22 +19,23 @@ Token_ArrayList Token_new(size_t capacity) {
 Token_ArrayList Token_new_with_allocator(Allocator *allocator,
                                          size_t capacity) {
   Token_ArrayList list;
-  list.elements = allocator_alloc(allocator, sizeof(Token *) * capacity);
+  list.elements = allocator_alloc(allocator, sizeof(TokenIndex) * capacity);
   list.size = 0;
   list.capacity = capacity;
   list.allocator = *allocator;
   return list;
 }
 
-void Token_push(Token_ArrayList *list, Token *value) {
+void Token_push(Token_ArrayList *list, TokenIndex value) {
   if (list->size == list->capacity) {
     size_t cap = list->capacity * 2;
-    Token **elements =
+    TokenIndex *elements =
         allocator_realloc(&list->allocator, list->elements,
-                          list->size * sizeof(Token *), cap * sizeof(Token *));
+                          list->size * sizeof(TokenIndex),
+                          cap * sizeof(TokenIndex));
 
     if (elements == NULL) {
-      slog_error("Failed to resize \"Token*\" array list");
+      slog_error("Failed to resize \"TokenIndex\" array list");
       return;
     }
 
@@ -43,12 +46,12 @@ void Token_push(Token_ArrayList *list, Token *value) {
   list->elements[list->size++] = value;
 }
 
-Token *Token_pop(Token_ArrayList *list) {
+TokenIndex Token_pop(Token_ArrayList *list) {
   if (list->size == 0) {
-    return NULL; // ArrayList is empty, return NULL
+    return TOKEN_NONE; // ArrayList is empty, return TOKEN_NONE
   }
 
-  Token *element = list->elements[list->size - 1]; // Get the last element
+  TokenIndex element = list->elements[list->size - 1]; // Get the last element
   list->size--;                                    // Decrement the size
   return element;                                  // Return the last element
 }
@@ -59,8 +62,8 @@ void Token_free(Token_ArrayList *list) {
   list->size = 0;
 }
 
-size_t Token_index_of(Token_ArrayList const *list, Token const *value) {
-  if (!list || !value) {
+size_t Token_index_of(Token_ArrayList const *list, TokenIndex value) {
+  if (!list || value == TOKEN_NONE) {
     return SIZE_MAX;
   }
 
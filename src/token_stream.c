@@ -0,0 +1,425 @@
+#include "token_stream.h"
+
+// Dead text below this is not worth moving the live text for
+#define TOKEN_STRINGS_MIN_DEAD ((size_t)64 * 1024)
+
+#define GROW_ARRAY(stream, field, cap)                                         \
+  (stream)->field = allocator_realloc(                                         \
+      &(stream)->allocator, (stream)->field,                                   \
+      (stream)->capacity * sizeof(*(stream)->field),                           \
+      (cap) * sizeof(*(stream)->field))
+
+static bool TokenStream_reserve(TokenStream *stream, uint32_t cap) {
+  GROW_ARRAY(stream, kinds, cap);
+  GROW_ARRAY(stream, subkinds, cap);
+  GROW_ARRAY(stream, offsets, cap);
+  GROW_ARRAY(stream, lengths, cap);
+  GROW_ARRAY(stream, idents, cap);
+  GROW_ARRAY(stream, names, cap);
+  GROW_ARRAY(stream, literals, cap);
+
+  if (stream->kinds == NULL || stream->subkinds == NULL ||
+      stream->offsets == NULL || stream->lengths == NULL ||
+      stream->idents == NULL || stream->names == NULL ||
+      stream->literals == NULL) {
+    slog_error("Failed to resize token stream");
+    return false;
+  }
+
+  if (stream->lexemes != NULL) {
+    GROW_ARRAY(stream, lexemes, cap);
+    memset(&stream->lexemes[stream->capacity], 0,
+           (cap - stream->capacity) * sizeof(*stream->lexemes));
+  }
+
+  stream->capacity = cap;
+  return true;
+}
+
+// Makes room for `needed` tokens, at least doubling the capacity so that
+// repeated appends stay linear
+static bool TokenStream_grow(TokenStream *stream, uint32_t needed) {
+  if (needed <= stream->capacity)
+    return true;
+
+  uint32_t cap = stream->capacity * 2;
+  return TokenStream_reserve(stream, cap > needed ? cap : needed);
+}
+
+TokenStream TokenStream_new(uint32_t capacity) {
+  TokenStream stream = {0};
+  allocator_init(&stream.allocator, "TokenStream");
+
+  if (capacity < 2)
+    capacity = 2;
+
+  if (!TokenStream_reserve(&stream, capacity)) {
+    slog_error("Could not allocate memory for token stream");
+    return stream;
+  }
+
+  // Slot 0 is the "no token" sentinel
+  stream.kinds[TOKEN_NONE] = 0;
+  stream.subkinds[TOKEN_NONE] = 0;
+  stream.offsets[TOKEN_NONE] = 0;
+  stream.lengths[TOKEN_NONE] = 0;
+  stream.idents[TOKEN_NONE] = 0;
+  stream.names[TOKEN_NONE] = NAME_NONE;
+  stream.literals[TOKEN_NONE] = 0;
+  stream.size = 1;
+  allocator_init(&stream.strings, "TokenStream strings");
+  stream.interned = InternTable_new(capacity / 8);
+  TokenStream_add_line(&stream, 0);
+  return stream;
+}
+
+TokenIndex TokenStream_push(TokenStream *stream, uint8_t kind,
+                            uint8_t subkind, uint32_t offset, uint32_t length) {
+  if (!TokenStream_grow(stream, stream->size + 1)) {
+    return TOKEN_NONE;
+  }
+
+  TokenIndex token = stream->size++;
+  stream->kinds[token] = kind;
+  stream->subkinds[token] = subkind;
+  stream->offsets[token] = offset;
+  stream->lengths[token] = length;
+  stream->idents[token] = 0;
+  stream->names[token] = NAME_NONE;
+  stream->literals[token] = 0;
+  return token;
+}
+
+// Copies `count` tokens of `other` from `from` on into the slots from `at`
+// on, which must have been reserved already
+static bool TokenStream_copy(TokenStream *stream, uint32_t at,
+                             const TokenStream *other, TokenIndex from,
+                             uint32_t count) {
+  memcpy(&stream->kinds[at], &other->kinds[from],
+         count * sizeof(*other->kinds));
+  memcpy(&stream->subkinds[at], &other->subkinds[from],
+         count * sizeof(*other->subkinds));
+  memcpy(&stream->offsets[at], &other->offsets[from],
+         count * sizeof(*other->offsets));
+  memcpy(&stream->lengths[at], &other->lengths[from],
+         count * sizeof(*other->lengths));
+  memcpy(&stream->idents[at], &other->idents[from],
+         count * sizeof(*other->idents));
+
+  // Ids are local to each table, map those the copied tokens use onto ours.
+  // NAME_NONE marks an id not mapped yet.
+  NameId *remap = calloc(other->interned.size, sizeof(*remap));
+  if (remap == NULL) {
+    slog_error("Failed to allocate memory for name remapping");
+    return false;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    NameId id = other->names[from + i];
+    if (id != NAME_NONE && remap[id] == NAME_NONE) {
+      const char *name = InternTable_name(&other->interned, id);
+      remap[id] = InternTable_intern(&stream->interned, name, strlen(name));
+    }
+    stream->names[at + i] = remap[id];
+  }
+  free(remap);
+
+  // Literal slots are local as well, copy the values over
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t slot = other->literals[from + i];
+    stream->literals[at + i] = 0;
+    if (slot != 0 &&
+        !TokenStream_set_value(stream, at + i, other->values[slot]))
+      return false;
+  }
+
+  return true;
+}
+
+static bool TokenStream_reserve_lines(TokenStream *stream, uint32_t needed) {
+  if (needed <= stream->line_capacity)
+    return true;
+
+  uint32_t cap = stream->line_capacity ? stream->line_capacity : 64;
+  while (cap < needed)
+    cap *= 2;
+
+  uint32_t *grown = allocator_realloc(
+      &stream->allocator, stream->line_starts,
+      stream->line_capacity * sizeof(*stream->line_starts),
+      cap * sizeof(*stream->line_starts));
+  if (grown == NULL) {
+    slog_error("Failed to resize line table");
+    return false;
+  }
+  stream->line_starts = grown;
+  stream->line_capacity = cap;
+  return true;
+}
+
+bool TokenStream_append(TokenStream *stream, const TokenStream *other) {
+  uint32_t count = other->size - 1; // skip the sentinel slot
+  if (!TokenStream_grow(stream, stream->size + count))
+    return false;
+
+  if (!TokenStream_copy(stream, stream->size, other, 1, count))
+    return false;
+
+  // The first line of `other` was started by our last newline
+  for (uint32_t i = 1; i < other->line_count; i++) {
+    if (!TokenStream_add_line(stream, other->line_starts[i]))
+      return false;
+  }
+
+  stream->size += count;
+  return true;
+}
+
+static void TokenStream_drop_text(TokenStream *stream, size_t size) {
+  stream->strings_live -= size;
+  stream->strings_dead += size;
+}
+
+// Puts the literal slots of tokens [first, end) on the free list and counts
+// their text as dead
+static void TokenStream_release(TokenStream *stream, TokenIndex first,
+                                TokenIndex end) {
+  for (TokenIndex token = first; token < end; token++) {
+    uint32_t slot = stream->literals[token];
+    if (slot != 0) {
+      TokenValue *value = &stream->values[slot];
+      if (value->kind == VALUE_STR && value->str_val != NULL)
+        TokenStream_drop_text(stream, value->length + 1);
+      *value = (TokenValue){.int_val = stream->values_free};
+      stream->values_free = slot;
+      stream->literals[token] = 0;
+    }
+
+    // Lexemes of names are those of the intern table
+    if (stream->lexemes != NULL && stream->lexemes[token] != NULL) {
+      if (stream->names[token] == NAME_NONE)
+        TokenStream_drop_text(stream, strlen(stream->lexemes[token]) + 1);
+      stream->lexemes[token] = NULL;
+    }
+  }
+}
+
+static const char *TokenStream_copy_text(TokenStream *stream, Allocator *to,
+                                         const char *text, size_t length) {
+  char *copy = allocator_alloc(to, length + 1);
+  if (copy == NULL)
+    return NULL;
+  memcpy(copy, text, length);
+  copy[length] = '\0';
+  stream->strings_live += length + 1;
+  return copy;
+}
+
+// Moves the text still in use to a fresh arena once the dead text outweighs
+// it, so a stream edited over and over keeps a bounded footprint
+static bool TokenStream_compact_strings(TokenStream *stream) {
+  if (stream->strings_dead < TOKEN_STRINGS_MIN_DEAD ||
+      stream->strings_dead < stream->strings_live)
+    return true;
+
+  Allocator strings;
+  allocator_init(&strings, stream->strings.tag);
+  stream->strings_live = 0;
+  bool ok = true;
+  for (uint32_t slot = 1; ok && slot < stream->values_size; slot++) {
+    TokenValue *value = &stream->values[slot];
+    if (value->kind != VALUE_STR || value->str_val == NULL)
+      continue;
+    const char *text =
+        TokenStream_copy_text(stream, &strings, value->str_val, value->length);
+    ok = text != NULL;
+    if (ok)
+      value->str_val = text;
+  }
+  for (TokenIndex token = 0; ok && stream->lexemes && token < stream->size;
+       token++) {
+    const char *lexeme = stream->lexemes[token];
+    if (lexeme == NULL || stream->names[token] != NAME_NONE)
+      continue;
+    const char *text =
+        TokenStream_copy_text(stream, &strings, lexeme, strlen(lexeme));
+    ok = text != NULL;
+    if (ok)
+      stream->lexemes[token] = text;
+  }
+
+  if (!ok) {
+    // Text already moved is kept along with the rest
+    slog_error("Failed to compact token strings");
+    allocator_adopt(&stream->strings, &strings);
+    return false;
+  }
+
+  allocator_free(&stream->strings);
+  stream->strings = strings;
+  stream->strings_dead = 0;
+  return true;
+}
+
+// Moves the tokens from `from` to the end of the stream so they start at `to`
+#define MOVE_TAIL(stream, field, from, to)                                     \
+  memmove(&(stream)->field[to], &(stream)->field[from],                        \
+          ((stream)->size - (from)) * sizeof(*(stream)->field))
+
+bool TokenStream_splice(TokenStream *stream, const TokenSplice *splice,
+                        const TokenStream *other, TokenIndex from) {
+  uint32_t inserted = splice->inserted;
+  uint32_t size = stream->size - splice->removed + inserted;
+  if (!TokenStream_grow(stream, size))
+    return false;
+
+  uint32_t tail = splice->first + splice->removed;
+  uint32_t moved = splice->first + inserted;
+  TokenStream_release(stream, splice->first, tail);
+  MOVE_TAIL(stream, kinds, tail, moved);
+  MOVE_TAIL(stream, subkinds, tail, moved);
+  MOVE_TAIL(stream, offsets, tail, moved);
+  MOVE_TAIL(stream, lengths, tail, moved);
+  MOVE_TAIL(stream, idents, tail, moved);
+  MOVE_TAIL(stream, names, tail, moved);
+  MOVE_TAIL(stream, literals, tail, moved);
+  if (stream->lexemes != NULL) {
+    MOVE_TAIL(stream, lexemes, tail, moved);
+    memset(&stream->lexemes[splice->first], 0,
+           inserted * sizeof(*stream->lexemes));
+  }
+  stream->size = size;
+
+  if (!TokenStream_copy(stream, splice->first, other, from, inserted) ||
+      !TokenStream_compact_strings(stream))
+    return false;
+
+  for (uint32_t i = moved; i < size; i++) {
+    if (stream->offsets[i] != OFFSET_NONE)
+      stream->offsets[i] = (uint32_t)(stream->offsets[i] + splice->delta);
+  }
+
+  // Indices of the first line starting past line_from and past line_to
+  uint32_t low = TokenStream_line_of(stream, splice->line_from);
+  uint32_t high = TokenStream_line_of(stream, splice->line_to);
+  uint32_t added = other->line_count - 1;
+  uint32_t lines = stream->line_count - (high - low) + added;
+  if (!TokenStream_reserve_lines(stream, lines))
+    return false;
+
+  memmove(&stream->line_starts[low + added], &stream->line_starts[high],
+          (stream->line_count - high) * sizeof(*stream->line_starts));
+  memcpy(&stream->line_starts[low], &other->line_starts[1],
+         added * sizeof(*stream->line_starts));
+  for (uint32_t i = low + added; i < lines; i++) {
+    stream->line_starts[i] = (uint32_t)(stream->line_starts[i] + splice->delta);
+  }
+  stream->line_count = lines;
+  return true;
+}
+
+void TokenStream_truncate(TokenStream *stream, uint32_t size) {
+  if (size >= stream->size)
+    return;
+  TokenStream_release(stream, size, stream->size);
+  stream->size = size;
+}
+
+bool TokenStream_add_line(TokenStream *stream, uint32_t offset) {
+  if (!TokenStream_reserve_lines(stream, stream->line_count + 1))
+    return false;
+
+  stream->line_starts[stream->line_count++] = offset;
+  return true;
+}
+
+uint32_t TokenStream_line_of(const TokenStream *stream, uint32_t offset) {
+  // Last line starting at or before `offset`
+  uint32_t low = 0;
+  uint32_t high = stream->line_count;
+  while (high - low > 1) {
+    uint32_t mid = low + (high - low) / 2;
+    if (stream->line_starts[mid] <= offset)
+      low = mid;
+    else
+      high = mid;
+  }
+  return low + 1;
+}
+
+bool TokenStream_set_value(TokenStream *stream, TokenIndex token,
+                           TokenValue value) {
+  // Decoded text is owned by the stream, views of the source are kept as is
+  if (value.kind == VALUE_STR && value.str_val != NULL) {
+    value.str_val = TokenStream_copy_text(stream, &stream->strings,
+                                          value.str_val, value.length);
+    if (value.str_val == NULL) {
+      slog_error("Failed to allocate memory for string literal");
+      return false;
+    }
+  }
+
+  // Slots of removed tokens first
+  uint32_t slot = stream->values_free;
+  if (slot != 0) {
+    stream->values_free = (uint32_t)stream->values[slot].int_val;
+    stream->values[slot] = value;
+    stream->literals[token] = slot;
+    return true;
+  }
+
+  // Slot 0 stands for "no value"
+  if (stream->values_size == 0)
+    stream->values_size = 1;
+
+  if (stream->values_size == stream->values_capacity ||
+      stream->values == NULL) {
+    uint32_t cap = stream->values_capacity ? stream->values_capacity * 2 : 16;
+    TokenValue *grown = allocator_realloc(
+        &stream->allocator, stream->values,
+        stream->values_capacity * sizeof(*stream->values),
+        cap * sizeof(*stream->values));
+    if (grown == NULL) {
+      slog_error("Failed to resize token values");
+      return false;
+    }
+    stream->values = grown;
+    stream->values_capacity = cap;
+  }
+
+  stream->values[stream->values_size] = value;
+  stream->literals[token] = stream->values_size++;
+  return true;
+}
+
+const char **TokenStream_lexeme_slot(TokenStream *stream, TokenIndex token) {
+  if (stream->lexemes == NULL) {
+    size_t size = stream->capacity * sizeof(*stream->lexemes);
+    stream->lexemes = allocator_alloc(&stream->allocator, size);
+    if (stream->lexemes == NULL) {
+      slog_error("Could not allocate memory for token lexemes");
+      return NULL;
+    }
+    memset(stream->lexemes, 0, size);
+  }
+
+  return &stream->lexemes[token];
+}
+
+const char *TokenStream_set_lexeme(TokenStream *stream, TokenIndex token,
+                                   const char *text, size_t length) {
+  const char **slot = TokenStream_lexeme_slot(stream, token);
+  if (slot == NULL)
+    return NULL;
+
+  *slot = TokenStream_copy_text(stream, &stream->strings, text, length);
+  if (*slot == NULL)
+    slog_error("Failed to allocate memory for lexeme");
+  return *slot;
+}
+
+void TokenStream_free(TokenStream *stream) {
+  InternTable_free(&stream->interned);
+  allocator_free(&stream->strings);
+  allocator_free(&stream->allocator);
+  *stream = (TokenStream){0};
+}
@@ -43,6 +43,21 @@ int main(void) {
   RUN_TEST(test_lexer_endmarker);
   RUN_TEST(test_lexer_augassign);
   RUN_TEST(test_lexer_rarrow);
+  RUN_TEST(test_lexer_lexeme_view);
+  RUN_TEST(test_lexer_token_stream);
+  RUN_TEST(test_lexer_keyword_table);
+  RUN_TEST(test_lexer_operator_longest_match);
+  RUN_TEST(test_lexer_subkinds);
+  RUN_TEST(test_lexer_literal_values);
+  RUN_TEST(test_lexer_scan_kernels);
+  RUN_TEST(test_lexer_parallel_matches_serial);
+  RUN_TEST(test_lexer_streaming_matches_serial);
+  RUN_TEST(test_lexer_line_table);
+  RUN_TEST(test_lexer_deep_indentation);
+  RUN_TEST(test_lexer_retokenize_matches_tokenize);
+  RUN_TEST(test_lexer_retokenize_reuses_literal_storage);
+  RUN_TEST(test_lexer_interned_names);
+  RUN_TEST(test_lexer_mapped_source);
   // Parser
   RUN_TEST(test_parser_single_number);
   RUN_TEST(test_parse_arithmetic_expression);
@@ -72,6 +87,15 @@ int main(void) {
   RUN_TEST(test_parse_list_comprehension);
   RUN_TEST(test_parse_subscript);
   RUN_TEST(test_parse_generator_expression);
+  RUN_TEST(test_parse_child_spans);
+  RUN_TEST(test_parse_compact_nodes);
+  RUN_TEST(test_reparse_matches_parse);
+  RUN_TEST(test_reparse_grows_node_reservation);
+  RUN_TEST(test_parse_streaming_matches_parse);
+  RUN_TEST(test_parse_parallel_matches_parse);
+  RUN_TEST(test_parse_deeply_nested_expression);
+  RUN_TEST(test_ast_snapshot_round_trip);
+  RUN_TEST(test_serialize_program_streams_json);
   // Semantic
   RUN_TEST(test_semantic_empty_program);
   RUN_TEST(test_semantic_simple_assignment);
@@ -90,6 +114,16 @@ int main(void) {
   RUN_TEST(test_variable_redeclaration_error);
   RUN_TEST(test_semantic_match_unreachable_after_wildcard);
   RUN_TEST(test_semantic_match_duplicate_binding);
+  RUN_TEST(test_semantic_many_globals);
+  RUN_TEST(test_semantic_cached_types);
+  RUN_TEST(test_semantic_parallel_bodies_match_serial);
+  RUN_TEST(test_semantic_parallel_calls_share_helper);
+  RUN_TEST(test_semantic_resolved_bindings);
+  RUN_TEST(test_semantic_class_layout);
+  RUN_TEST(test_semantic_self_reference_by_name);
+  RUN_TEST(test_semantic_reports_every_error);
+  RUN_TEST(test_semantic_reports_unannotated_parameters);
+  RUN_TEST(test_semantic_module_statement_frame);
   // Three-address code (TAC)
   RUN_TEST(test_tac_simple_assignment);
   RUN_TEST(test_tac_binary_expression);
@@ -102,16 +136,23 @@ int main(void) {
   RUN_TEST(test_tac_operator_precedence);
   RUN_TEST(test_tac_parenthesized_expression);
   RUN_TEST(test_tac_if_else_statement);
+  RUN_TEST(test_tac_dump_keeps_embedded_nul);
   // Codegen (Python -> C)
   RUN_TEST(test_codegen_function_return_literal);
   RUN_TEST(test_codegen_function_call);
+  RUN_TEST(test_codegen_forward_call);
   RUN_TEST(test_codegen_class_inheritance_and_init);
+  RUN_TEST(test_codegen_method_local_declaration);
   RUN_TEST(test_codegen_if_else_statement);
   RUN_TEST(test_codegen_while_loop);
   RUN_TEST(test_codegen_variable_shadowing);
   RUN_TEST(test_codegen_match_literal);
   RUN_TEST(test_codegen_match_capture);
   RUN_TEST(test_codegen_match_guard);
+  RUN_TEST(test_compile_cache_hit_after_store);
+  RUN_TEST(test_compile_cache_leaves_only_entries);
+  RUN_TEST(test_compile_cache_waiter_relocks_current_file);
+  RUN_TEST(test_compile_cache_open_rejects_long_path);
   return UNITY_END();
 }
 
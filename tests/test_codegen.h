@@ -2,6 +2,11 @@
 #define TEST_CODEGEN_H_
 
 #include "codegen.h"
+#include "compile_cache.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <threads.h>
+#include <unistd.h>
 #include <unity.h>
 
 Codegen compile_to_c(const char *source) {
@@ -52,6 +57,28 @@ void test_codegen_function_call(void) {
   codegen_free(&cg);
 }
 
+void test_codegen_forward_call(void) {
+  // Arrange: g is called before it is defined, so it is declared first
+  const char *expected = "int g(int x);\n"
+                         "int f(int a) {\n"
+                         "    return g(a);\n"
+                         "}\n"
+                         "int g(int x) {\n"
+                         "    return x;\n"
+                         "}\n";
+  // Act
+  Codegen cg = compile_to_c("def f(a: int) -> int:\n"
+                            "    return g(a)\n"
+                            "\n"
+                            "def g(x: int) -> int:\n"
+                            "    return x\n");
+
+  // Assert
+  TEST_ASSERT_EQUAL_STRING(expected, cg.output.items);
+  // Cleanup
+  codegen_free(&cg);
+}
+
 void test_codegen_class_to_struct(void) {
   // Arrange
   const char *expected = "typedef struct {\n"
@@ -106,6 +133,31 @@ void test_codegen_class_inheritance_and_init(void) {
   codegen_free(&cg);
 }
 
+void test_codegen_method_local_declaration(void) {
+  // Arrange: locals of a method are declared like those of any function
+  char expected[] = "typedef struct {\n"
+                    "  int v;\n"
+                    "} A;\n"
+                    "\n"
+                    "void A___init__(A* self, int v) {\n"
+                    "    self->v = v;\n"
+                    "    int w = v;\n"
+                    "}\n";
+  // Act
+  Codegen cg = compile_to_c("class A:\n"
+                            "    v: int\n"
+                            "\n"
+                            "    def __init__(self, v: int):\n"
+                            "        self.v = v\n"
+                            "        w: int = v\n");
+  normalize_whitespace(expected);
+  normalize_whitespace(cg.output.items);
+  // Assert
+  TEST_ASSERT_EQUAL_STRING(expected, cg.output.items);
+  // Cleanup
+  codegen_free(&cg);
+}
+
 void test_codegen_if_else_statement(void) {
   // Arrange
   char expected[] = "int f(int x) {\n"
@@ -249,4 +301,147 @@ void test_codegen_match_guard(void) {
   codegen_free(&cg);
 }
 
+void test_compile_cache_hit_after_store(void) {
+  // Arrange
+  const char *dir = "ceeify_cache_test";
+  const char *source = "def f(x: int) -> int:\n    return x\n";
+  Codegen cg = compile_to_c(source);
+  CompileCache cache;
+  SourceFile entry = {0};
+
+  // Act: the first run misses, holds the entry lock and stores its output
+  TEST_ASSERT_TRUE(
+      compile_cache_open(&cache, dir, source, strlen(source), "emit=c"));
+  TEST_ASSERT_FALSE(compile_cache_fetch(&cache, &entry));
+  TEST_ASSERT_TRUE(cache.lock >= 0);
+  TEST_ASSERT_TRUE(
+      compile_cache_store(&cache, cg.output.items, cg.output.count));
+  compile_cache_close(&cache);
+
+  // Assert: the same source and options hit, anything else misses
+  CompileCache again;
+  TEST_ASSERT_TRUE(
+      compile_cache_open(&again, dir, source, strlen(source), "emit=c"));
+  TEST_ASSERT_EQUAL_STRING(cache.path, again.path);
+  TEST_ASSERT_TRUE(compile_cache_fetch(&again, &entry));
+  TEST_ASSERT_EQUAL_STRING(cg.output.items, entry.text);
+  TEST_ASSERT_TRUE(again.lock < 0);
+  compile_cache_close(&again);
+
+  CompileCache other;
+  TEST_ASSERT_TRUE(
+      compile_cache_open(&other, dir, source, strlen(source), "emit=tac"));
+  TEST_ASSERT_NOT_EQUAL(0, strcmp(cache.path, other.path));
+  TEST_ASSERT_TRUE(compile_cache_open(&other, dir, source,
+                                      strlen(source) - 1, "emit=c"));
+  TEST_ASSERT_NOT_EQUAL(0, strcmp(cache.path, other.path));
+
+  // Clean
+  source_file_close(&entry);
+  codegen_free(&cg);
+  remove(cache.path);
+  remove(dir);
+}
+
+void test_compile_cache_leaves_only_entries(void) {
+  // Arrange
+  const char *dir = "ceeify_cache_files_test";
+  const char *source = "x = 1\n";
+  CompileCache cache;
+  SourceFile entry = {0};
+  TEST_ASSERT_TRUE(
+      compile_cache_open(&cache, dir, source, strlen(source), "emit=c"));
+
+  // Act
+  TEST_ASSERT_FALSE(compile_cache_fetch(&cache, &entry));
+  TEST_ASSERT_TRUE(compile_cache_store(&cache, "int x;\n", 7));
+  compile_cache_close(&cache);
+
+  // Assert: no lock or temporary file is left next to the entry
+  const char *name = strrchr(cache.path, '/') + 1;
+  size_t files = 0;
+  DIR *listing = opendir(dir);
+  TEST_ASSERT_NOT_NULL(listing);
+  for (struct dirent *file; (file = readdir(listing)) != NULL;) {
+    if (strcmp(file->d_name, ".") == 0 || strcmp(file->d_name, "..") == 0)
+      continue;
+    TEST_ASSERT_EQUAL_STRING(name, file->d_name);
+    files++;
+  }
+  closedir(listing);
+  TEST_ASSERT_EQUAL(1, files);
+
+  // Clean
+  remove(cache.path);
+  remove(dir);
+}
+
+typedef struct CacheWaiter {
+  CompileCache cache;
+  SourceFile entry;
+  bool hit;
+} CacheWaiter;
+
+static void *cache_waiter_fetch(void *arg) {
+  CacheWaiter *waiter = arg;
+  waiter->hit = compile_cache_fetch(&waiter->cache, &waiter->entry);
+  return NULL;
+}
+
+void test_compile_cache_waiter_relocks_current_file(void) {
+  // Arrange: a job holds the entry lock while another waits on it
+  const char *dir = "ceeify_cache_wait_test";
+  const char *source = "y = 2\n";
+  CompileCache cache;
+  SourceFile entry = {0};
+  TEST_ASSERT_TRUE(
+      compile_cache_open(&cache, dir, source, strlen(source), "emit=c"));
+  TEST_ASSERT_FALSE(compile_cache_fetch(&cache, &entry));
+  CacheWaiter waiter = {0};
+  TEST_ASSERT_TRUE(compile_cache_open(&waiter.cache, dir, source,
+                                      strlen(source), "emit=c"));
+  pthread_t thread;
+  TEST_ASSERT_EQUAL(0,
+                    pthread_create(&thread, NULL, cache_waiter_fetch, &waiter));
+  thrd_sleep(&(struct timespec){.tv_nsec = 50 * 1000 * 1000}, NULL);
+
+  // Act: the holder stores and releases, unlinking the file waited on
+  TEST_ASSERT_TRUE(compile_cache_store(&cache, "int y;\n", 7));
+  compile_cache_close(&cache);
+  pthread_join(thread, NULL);
+
+  // Assert: the waiter gets the entry without keeping the stale lock
+  TEST_ASSERT_TRUE(waiter.hit);
+  TEST_ASSERT_EQUAL_STRING("int y;\n", waiter.entry.text);
+  TEST_ASSERT_TRUE(waiter.cache.lock < 0);
+  compile_cache_close(&waiter.cache);
+  TEST_ASSERT_NOT_EQUAL(0, access(cache.lock_path, F_OK));
+
+  // Clean
+  source_file_close(&waiter.entry);
+  remove(cache.path);
+  remove(dir);
+}
+
+void test_compile_cache_open_rejects_long_path(void) {
+  // Arrange: an existing directory, "./././...", whose path leaves no room
+  // for the entry name
+  char dir[COMPILE_CACHE_PATH - 24];
+  for (size_t i = 0; i < sizeof(dir) - 1; i++)
+    dir[i] = i % 2 ? '/' : '.';
+  dir[sizeof(dir) - 2] = '.';
+  dir[sizeof(dir) - 1] = '\0';
+  CompileCache cache;
+  SourceFile entry = {0};
+
+  // Act
+  bool opened = compile_cache_open(&cache, dir, "x = 1\n", 6, "emit=c");
+
+  // Assert: nothing is read or written at a truncated path
+  TEST_ASSERT_FALSE(opened);
+  TEST_ASSERT_EQUAL_STRING("", cache.path);
+  TEST_ASSERT_FALSE(compile_cache_fetch(&cache, &entry));
+  TEST_ASSERT_FALSE(compile_cache_store(&cache, "int x;\n", 7));
+}
+
 #endif // TEST_CODEGEN_H_
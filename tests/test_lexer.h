@@ -3,99 +3,558 @@
 #define TEST_LEXER_H_
 
 #include "lexer.h"
+#include "source_file.h"
 #include "utils.h"
+#include <unistd.h>
 #include <unity.h>
 
 void test_lexer_identifier(void) {
   Lexer lexer = tokenize("my_variable = 10", "test_file.py");
-  Token *token = Token_get(&lexer.tokens, lexer.token_idx);
-  TEST_ASSERT_EQUAL(IDENTIFIER, token->type);
-  TEST_ASSERT_EQUAL_STRING("my_variable", token->lexeme);
-  TEST_ASSERT_EQUAL(1, token->line);
-  TEST_ASSERT_EQUAL(1, token->col);
-  Token_free(&lexer.tokens);
+  TokenIndex token = lexer.token_idx;
+  TEST_ASSERT_EQUAL(IDENTIFIER, token_type(&lexer, token));
+  TEST_ASSERT_EQUAL_STRING("my_variable", token_lexeme(&lexer, token));
+  TEST_ASSERT_EQUAL(1, token_line(&lexer, token));
+  TEST_ASSERT_EQUAL(1, token_col(&lexer, token));
+  TokenStream_free(&lexer.tokens);
 }
 
 void test_lexer_numeric(void) {
   Lexer lexer = tokenize("123", "test_file.py");
-  Token *token = Token_get(&lexer.tokens, lexer.token_idx);
+  TokenIndex token = lexer.token_idx;
   // Assertions
-  TEST_ASSERT_EQUAL_INT(NUMBER, token->type);
-  TEST_ASSERT_EQUAL_STRING("123", token->lexeme);
-  Token_free(&lexer.tokens);
+  TEST_ASSERT_EQUAL_INT(NUMBER, token_type(&lexer, token));
+  TEST_ASSERT_EQUAL_STRING("123", token_lexeme(&lexer, token));
+  TokenStream_free(&lexer.tokens);
 }
 
 void test_lexer_operator(void) {
   Lexer lexer = tokenize("+", "test_file.py");
-  Token *token = Token_get(&lexer.tokens, lexer.token_idx);
+  TokenIndex token = lexer.token_idx;
   // Assertions
-  TEST_ASSERT_EQUAL_INT(OPERATOR, token->type);
-  TEST_ASSERT_EQUAL_STRING("+", token->lexeme);
-  Token_free(&lexer.tokens);
+  TEST_ASSERT_EQUAL_INT(OPERATOR, token_type(&lexer, token));
+  TEST_ASSERT_EQUAL_STRING("+", token_lexeme(&lexer, token));
+  TokenStream_free(&lexer.tokens);
 }
 
 void test_lexer_keyword(void) {
   Lexer lexer = tokenize("class", "test_file.py");
-  Token *token = Token_get(&lexer.tokens, lexer.token_idx);
+  TokenIndex token = lexer.token_idx;
   // Assertions
-  TEST_ASSERT_EQUAL_INT(KEYWORD, token->type);
-  TEST_ASSERT_EQUAL_STRING("class", token->lexeme);
-  Token_free(&lexer.tokens);
+  TEST_ASSERT_EQUAL_INT(KEYWORD, token_type(&lexer, token));
+  TEST_ASSERT_EQUAL_STRING("class", token_lexeme(&lexer, token));
+  TokenStream_free(&lexer.tokens);
 }
 
 void test_lexer_delimiter(void) {
   Lexer lexer = tokenize("()", "test_file.py");
-  Token *token = Token_get(&lexer.tokens, lexer.token_idx);
+  TokenIndex token = lexer.token_idx;
   // Assertions
-  TEST_ASSERT_EQUAL_INT(LPAR, token->type);
-  TEST_ASSERT_EQUAL_STRING("(", token->lexeme);
-  Token_free(&lexer.tokens);
+  TEST_ASSERT_EQUAL_INT(LPAR, token_type(&lexer, token));
+  TEST_ASSERT_EQUAL_STRING("(", token_lexeme(&lexer, token));
+  TokenStream_free(&lexer.tokens);
 }
 
 void test_lexer_newline(void) {
   Lexer lexer = tokenize("\n", "test_file.py");
-  Token *token = Token_get(&lexer.tokens, lexer.token_idx);
+  TokenIndex token = lexer.token_idx;
   // Assertions
-  TEST_ASSERT_EQUAL_INT(NEWLINE, token->type);
-  TEST_ASSERT_EQUAL_STRING("\\n", token->lexeme);
-  Token_free(&lexer.tokens);
+  TEST_ASSERT_EQUAL_INT(NEWLINE, token_type(&lexer, token));
+  TEST_ASSERT_EQUAL_STRING("\\n", token_lexeme(&lexer, token));
+  TokenStream_free(&lexer.tokens);
 }
 
 void test_lexer_square_brackets(void) {
   Lexer lexer = tokenize("[]", "test_file.py");
-  Token *token = Token_get(&lexer.tokens, lexer.token_idx);
+  TokenIndex token = lexer.token_idx;
   // Assertions
-  TEST_ASSERT_EQUAL_INT(LSQB, token->type);
-  TEST_ASSERT_EQUAL_STRING("[", token->lexeme);
-  Token_free(&lexer.tokens);
+  TEST_ASSERT_EQUAL_INT(LSQB, token_type(&lexer, token));
+  TEST_ASSERT_EQUAL_STRING("[", token_lexeme(&lexer, token));
+  TokenStream_free(&lexer.tokens);
 }
 
 void test_lexer_endmarker(void) {
   Lexer lexer = tokenize("", "test_file.py");
-  Token *token = Token_get(&lexer.tokens, lexer.token_idx);
+  TokenIndex token = lexer.token_idx;
   // Assertions
-  TEST_ASSERT_EQUAL_INT(ENDMARKER, token->type);
-  TEST_ASSERT_EQUAL_STRING("EOF", token->lexeme);
-  Token_free(&lexer.tokens);
+  TEST_ASSERT_EQUAL_INT(ENDMARKER, token_type(&lexer, token));
+  TEST_ASSERT_EQUAL_STRING("EOF", token_lexeme(&lexer, token));
+  TokenStream_free(&lexer.tokens);
 }
 
 void test_lexer_augassign(void) {
   Lexer lexer = tokenize("+=", "test_file.py");
-  Token *token = Token_get(&lexer.tokens, lexer.token_idx);
+  TokenIndex token = lexer.token_idx;
   // Assertions
-  TEST_ASSERT_EQUAL_INT(OPERATOR, token->type);
-  TEST_ASSERT_EQUAL_STRING("+=", token->lexeme);
-  Token_free(&lexer.tokens);
+  TEST_ASSERT_EQUAL_INT(OPERATOR, token_type(&lexer, token));
+  TEST_ASSERT_EQUAL_STRING("+=", token_lexeme(&lexer, token));
+  TokenStream_free(&lexer.tokens);
 }
 
 void test_lexer_rarrow(void) {
   Lexer lexer = tokenize("->", "test_file.py");
-  Token *token = Token_get(&lexer.tokens, lexer.token_idx);
-  TEST_ASSERT_EQUAL(RARROW, token->type);
-  TEST_ASSERT_EQUAL_STRING("->", token->lexeme);
-  TEST_ASSERT_EQUAL(1, token->line);
-  TEST_ASSERT_EQUAL(1, token->col);
-  Token_free(&lexer.tokens);
+  TokenIndex token = lexer.token_idx;
+  TEST_ASSERT_EQUAL(RARROW, token_type(&lexer, token));
+  TEST_ASSERT_EQUAL_STRING("->", token_lexeme(&lexer, token));
+  TEST_ASSERT_EQUAL(1, token_line(&lexer, token));
+  TEST_ASSERT_EQUAL(1, token_col(&lexer, token));
+  TokenStream_free(&lexer.tokens);
+}
+
+void test_lexer_lexeme_view(void) {
+  const char *source = "name = 'hi'";
+  Lexer lexer = tokenize(source, "test_file.py");
+  TokenIndex name = lexer.token_idx;
+  TokenIndex str = name + 2;
+  // Identifiers and strings are views into the source until requested
+  TEST_ASSERT_NULL(lexer.tokens.lexemes);
+  TEST_ASSERT_EQUAL(0, lexer.tokens.offsets[name]);
+  TEST_ASSERT_EQUAL(4, lexer.tokens.lengths[name]);
+  TEST_ASSERT_EQUAL(8, lexer.tokens.offsets[str]);
+  TEST_ASSERT_EQUAL(2, lexer.tokens.lengths[str]);
+  TEST_ASSERT_TRUE(token_is(&lexer, name, "name"));
+  TEST_ASSERT_FALSE(token_is(&lexer, name, "nam"));
+  TEST_ASSERT_NULL(lexer.tokens.lexemes);
+  TEST_ASSERT_EQUAL_STRING("hi", token_lexeme(&lexer, str));
+  TEST_ASSERT_EQUAL_STRING("name", token_lexeme(&lexer, name));
+  // Materialized text is cached in the stream, names live in the intern table
+  TEST_ASSERT_EQUAL_PTR(lexer.tokens.lexemes[str], token_lexeme(&lexer, str));
+  TEST_ASSERT_EQUAL_PTR(
+      InternTable_name(&lexer.tokens.interned, token_name(&lexer, name)),
+      token_lexeme(&lexer, name));
+  TokenStream_free(&lexer.tokens);
+}
+
+void test_lexer_token_stream(void) {
+  Lexer lexer = tokenize("x = (1)\n", "test_file.py");
+  const TokenType expected[] = {IDENTIFIER, OPERATOR, LPAR,    NUMBER,
+                                RPAR,       NEWLINE,  ENDMARKER};
+  // Token kinds are laid out contiguously after the sentinel slot
+  TEST_ASSERT_EQUAL(ARRAYSIZE(expected) + 1, lexer.tokens.size);
+  for (size_t i = 0; i < ARRAYSIZE(expected); i++) {
+    TEST_ASSERT_EQUAL(expected[i], lexer.tokens.kinds[lexer.token_idx + i]);
+  }
+  TEST_ASSERT_EQUAL(ENDMARKER, token_type(&lexer, TOKEN_NONE));
+  TEST_ASSERT_EQUAL(6, token_col(&lexer, lexer.token_idx + 3));
+  TokenStream_free(&lexer.tokens);
+}
+
+void test_lexer_keyword_table(void) {
+  Lexer lexer = tokenize("False None True and as assert async await break "
+                         "class continue def del elif else except finally for "
+                         "from global if import in is lambda nonlocal not or "
+                         "pass raise return try while with yield match case",
+                         "test_file.py");
+  for (TokenIndex i = lexer.token_idx; i + 1 < lexer.token_end; i++) {
+    TEST_ASSERT_EQUAL(KEYWORD, token_type(&lexer, i));
+  }
+  TEST_ASSERT_EQUAL(37, lexer.token_end - lexer.token_idx - 1);
+  TokenStream_free(&lexer.tokens);
+
+  // Near misses share a first/last character or length with a keyword
+  lexer = tokenize("classy clas iff Case nonlocals ca_e _if", "test_file.py");
+  for (TokenIndex i = lexer.token_idx; i + 1 < lexer.token_end; i++) {
+    TEST_ASSERT_EQUAL(IDENTIFIER, token_type(&lexer, i));
+  }
+  TokenStream_free(&lexer.tokens);
+}
+
+void test_lexer_operator_longest_match(void) {
+  Lexer lexer = tokenize("a//=b**c->d<<=e!x.y", "test_file.py");
+  const char *expected[] = {"a", "//=", "b", "**", "c", "->", "d", "<<",
+                            "=", "e", "!",  "x", ".",  "y", "EOF"};
+  TEST_ASSERT_EQUAL(ARRAYSIZE(expected), lexer.token_end - lexer.token_idx);
+  for (size_t i = 0; i < ARRAYSIZE(expected); i++) {
+    TEST_ASSERT_EQUAL_STRING(expected[i],
+                             token_lexeme(&lexer, lexer.token_idx + i));
+  }
+  TEST_ASSERT_EQUAL(RARROW, token_type(&lexer, lexer.token_idx + 5));
+  TokenStream_free(&lexer.tokens);
+}
+
+void test_lexer_subkinds(void) {
+  Lexer lexer = tokenize("def f(x):\n  x += 1 ** 2 != None", "test_file.py");
+  const TokenSubkind expected[] = {
+      KW_DEF,       SUB_NONE, OP_LPAR,    SUB_NONE, OP_RPAR,
+      OP_COLON,     SUB_NONE, SUB_NONE,   OP_PLUS_EQ, SUB_NONE,
+      OP_STAR_STAR, SUB_NONE, OP_BANG_EQ, KW_NONE,  SUB_NONE,
+  };
+  TEST_ASSERT_EQUAL(ARRAYSIZE(expected), lexer.token_end - lexer.token_idx);
+  for (size_t i = 0; i < ARRAYSIZE(expected); i++) {
+    TEST_ASSERT_EQUAL(expected[i], token_subkind(&lexer, lexer.token_idx + i));
+  }
+
+  // Synthetic tokens are tagged from their text
+  TokenIndex def = create_token_from_str(&lexer, "def", KEYWORD);
+  TEST_ASSERT_EQUAL(KW_DEF, token_subkind(&lexer, def));
+  TokenIndex op = create_token_from_str(&lexer, "//", OPERATOR);
+  TEST_ASSERT_EQUAL(OP_SLASH_SLASH, token_subkind(&lexer, op));
+  TokenStream_free(&lexer.tokens);
+}
+
+void test_lexer_literal_values(void) {
+  Lexer lexer =
+      tokenize("99_000 1_0.5 99999999999999999999 'a\\tb\\q' 'plain' x",
+               "test_file.py");
+  TokenIndex token = lexer.token_idx;
+
+  const TokenValue *value = token_value(&lexer, token);
+  TEST_ASSERT_EQUAL(VALUE_INT, value->kind);
+  TEST_ASSERT_EQUAL_INT64(99000, value->int_val);
+  TEST_ASSERT_FALSE(value->overflow);
+
+  value = token_value(&lexer, token + 1);
+  TEST_ASSERT_EQUAL(VALUE_FLOAT, value->kind);
+  TEST_ASSERT_TRUE(value->float_val == 10.5);
+
+  value = token_value(&lexer, token + 2);
+  TEST_ASSERT_EQUAL(VALUE_INT, value->kind);
+  TEST_ASSERT_TRUE(value->overflow);
+  TEST_ASSERT_EQUAL_INT64(INT64_MAX, value->int_val);
+
+  // Known escapes are resolved, unknown ones kept as written
+  value = token_value(&lexer, token + 3);
+  TEST_ASSERT_EQUAL(VALUE_STR, value->kind);
+  TEST_ASSERT_EQUAL_STRING("a\tb\\q", value->str_val);
+  TEST_ASSERT_EQUAL(5, value->length);
+  TEST_ASSERT_EQUAL_STRING("a\tb\\q", token_string(&lexer, token + 3));
+
+  // Strings without escapes are read in place from the source
+  value = token_value(&lexer, token + 4);
+  TEST_ASSERT_EQUAL(VALUE_STR, value->kind);
+  TEST_ASSERT_NULL(value->str_val);
+  TEST_ASSERT_EQUAL(5, value->length);
+  const char *plain = token_string(&lexer, token + 4);
+  TEST_ASSERT_EQUAL_PTR(lexer.source + token_offset(&lexer, token + 4), plain);
+  TEST_ASSERT_EQUAL_MEMORY("plain", plain, 5);
+
+  TEST_ASSERT_NULL(token_value(&lexer, token + 5));
+  TokenStream_free(&lexer.tokens);
+}
+
+void test_lexer_scan_kernels(void) {
+  // Long enough to exercise the 16 and 32 byte paths and their tails
+  char source[200];
+  for (size_t i = 0; i < sizeof(source); i++) {
+    source[i] = "ab_Z9 \t\"\n\x80@[`{/"[(i * 7 + i / 13) % 15];
+  }
+
+  const ScanKernels *kernels[4];
+  size_t count = scan_kernels_available(kernels, ARRAYSIZE(kernels));
+  TEST_ASSERT_TRUE(count >= 1);
+  const ScanKernels *scalar = kernels[0];
+
+  for (size_t k = 1; k < count; k++) {
+    for (size_t pos = 0; pos < 64; pos++) {
+      for (size_t end = pos; end <= sizeof(source); end += 5) {
+        size_t expected_width = 0;
+        size_t width = 0;
+        TEST_ASSERT_EQUAL(scalar->find_byte(source, pos, end, '\n'),
+                          kernels[k]->find_byte(source, pos, end, '\n'));
+        TEST_ASSERT_EQUAL(scalar->ident_end(source, pos, end),
+                          kernels[k]->ident_end(source, pos, end));
+        TEST_ASSERT_EQUAL(
+            scalar->blank_end(source, pos, end, &expected_width),
+            kernels[k]->blank_end(source, pos, end, &width));
+        TEST_ASSERT_EQUAL(expected_width, width);
+      }
+    }
+  }
+
+  // Runs longer than a vector
+  memset(source, ' ', 70);
+  source[3] = '\t';
+  source[70] = 'x';
+  for (size_t k = 0; k < count; k++) {
+    size_t width = 0;
+    TEST_ASSERT_EQUAL(70, kernels[k]->blank_end(source, 0, 100, &width));
+    TEST_ASSERT_EQUAL(73, width);
+  }
+}
+
+void test_lexer_parallel_matches_serial(void) {
+  // Strings spanning lines and comments holding quotes make most newlines
+  // unsafe to split at
+  const char *snippet = "def f(a, b):\n"
+                        "\tx = 'multi\n# not a comment\n' # it's a comment\n"
+                        "    return a //= b -> \"#\"\n"
+                        "\n";
+  size_t snippet_length = strlen(snippet);
+  size_t repeat = (1024 * 1024) / snippet_length;
+  char *source = malloc(snippet_length * repeat + 16);
+  TEST_ASSERT_NOT_NULL(source);
+  for (size_t i = 0; i < repeat; i++) {
+    memcpy(source + i * snippet_length, snippet, snippet_length);
+  }
+  strcpy(source + snippet_length * repeat, "y = 'open");
+
+  Lexer serial = tokenize(source, "test_file.py");
+  for (size_t jobs = 2; jobs <= 4; jobs++) {
+    Lexer parallel = tokenize_parallel(source, "test_file.py", jobs);
+    TEST_ASSERT_EQUAL(serial.tokens.size, parallel.tokens.size);
+    TEST_ASSERT_EQUAL(serial.token_end, parallel.token_end);
+    for (TokenIndex i = 1; i < serial.tokens.size; i++) {
+      TEST_ASSERT_EQUAL(serial.tokens.kinds[i], parallel.tokens.kinds[i]);
+      TEST_ASSERT_EQUAL(serial.tokens.offsets[i], parallel.tokens.offsets[i]);
+      TEST_ASSERT_EQUAL(serial.tokens.lengths[i], parallel.tokens.lengths[i]);
+      TEST_ASSERT_EQUAL(token_line(&serial, i), token_line(&parallel, i));
+      TEST_ASSERT_EQUAL(token_col(&serial, i), token_col(&parallel, i));
+      TEST_ASSERT_EQUAL(serial.tokens.idents[i], parallel.tokens.idents[i]);
+      TEST_ASSERT_EQUAL(serial.tokens.names[i], parallel.tokens.names[i]);
+    }
+    TokenStream_free(&parallel.tokens);
+  }
+
+  TokenStream_free(&serial.tokens);
+  free(source);
+}
+
+void test_lexer_streaming_matches_serial(void) {
+  // Enough blocks to fill the ring while the consumer is slow to take them
+  const char *snippet = "def f(a, b):\n"
+                        "\tx = 'multi\n# not a comment\n' # it's a comment\n"
+                        "    return a //= b -> \"#\"\n";
+  size_t snippet_length = strlen(snippet);
+  size_t repeat = (512 * 1024) / snippet_length;
+  char *source = malloc(snippet_length * repeat + 16);
+  TEST_ASSERT_NOT_NULL(source);
+  for (size_t i = 0; i < repeat; i++) {
+    memcpy(source + i * snippet_length, snippet, snippet_length);
+  }
+  strcpy(source + snippet_length * repeat, "# last");
+
+  Lexer serial = tokenize(source, "test_file.py");
+  Lexer streamed = tokenize_streaming(source, "test_file.py");
+  lexer_stream_pull(&streamed, 10);
+  TEST_ASSERT_TRUE(streamed.tokens.size > 10);
+  lexer_stream_finish(&streamed);
+
+  TEST_ASSERT_NULL(streamed.stream);
+  TEST_ASSERT_EQUAL(serial.token_end, streamed.token_end);
+  TEST_ASSERT_EQUAL(serial.tokens.line_count, streamed.tokens.line_count);
+  for (TokenIndex i = 1; i < serial.token_end; i++) {
+    TEST_ASSERT_EQUAL(serial.tokens.kinds[i], streamed.tokens.kinds[i]);
+    TEST_ASSERT_EQUAL(serial.tokens.offsets[i], streamed.tokens.offsets[i]);
+    TEST_ASSERT_EQUAL(serial.tokens.lengths[i], streamed.tokens.lengths[i]);
+    TEST_ASSERT_EQUAL(serial.tokens.idents[i], streamed.tokens.idents[i]);
+    TEST_ASSERT_EQUAL(serial.tokens.names[i], streamed.tokens.names[i]);
+    TEST_ASSERT_EQUAL(token_line(&serial, i), token_line(&streamed, i));
+  }
+
+  TokenStream_free(&streamed.tokens);
+  TokenStream_free(&serial.tokens);
+  free(source);
+}
+
+void test_lexer_line_table(void) {
+  const char *source = "x = 1\n# note\nif x:\n    y = 'a'\n";
+  Lexer lexer = tokenize(source, "test_file.py");
+  // One entry per line start, including the empty line after the last newline
+  TEST_ASSERT_EQUAL(5, lexer.tokens.line_count);
+  TEST_ASSERT_EQUAL(13, lexer.tokens.line_starts[2]);
+
+  TokenIndex y = lexer.token_idx + 8;
+  TEST_ASSERT_EQUAL_STRING("y", token_lexeme(&lexer, y));
+  TEST_ASSERT_EQUAL(4, token_line(&lexer, y));
+  TEST_ASSERT_EQUAL(5, token_col(&lexer, y));
+  TEST_ASSERT_EQUAL(2, token_ident(&lexer, y));
+  // String columns point at the opening quote
+  TEST_ASSERT_EQUAL(9, token_col(&lexer, y + 2));
+
+  size_t length = 0;
+  const char *line = source_line(&lexer, 3, &length);
+  TEST_ASSERT_EQUAL(5, length);
+  TEST_ASSERT_EQUAL_STRING_LEN("if x:", line, length);
+
+  TokenIndex eof = lexer.token_end - 1;
+  TEST_ASSERT_EQUAL(5, token_line(&lexer, eof));
+  TEST_ASSERT_EQUAL(1, token_col(&lexer, eof));
+
+  TokenIndex synthetic = create_token_from_str(&lexer, "main", IDENTIFIER);
+  TEST_ASSERT_EQUAL(0, token_line(&lexer, synthetic));
+  token_locate(&lexer, synthetic, token_offset(&lexer, y), 2);
+  TEST_ASSERT_EQUAL(4, token_line(&lexer, synthetic));
+  TokenStream_free(&lexer.tokens);
+}
+
+void test_lexer_deep_indentation(void) {
+  // 65537 levels would wrap to 1 in a 16-bit indentation field
+  size_t spaces = 2 * 65537;
+  char *source = malloc(spaces + 16);
+  memcpy(source, "if x:\n", 6);
+  memset(source + 6, ' ', spaces);
+  strcpy(source + 6 + spaces, "y = 1\n");
+
+  Lexer lexer = tokenize(source, "test_file.py");
+  TokenIndex y = lexer.token_idx + 4;
+  TEST_ASSERT_EQUAL_STRING("y", token_lexeme(&lexer, y));
+  TEST_ASSERT_EQUAL(65537, token_ident(&lexer, y));
+  TEST_ASSERT_EQUAL(0, token_ident(&lexer, lexer.token_idx));
+
+  TokenStream_free(&lexer.tokens);
+  free(source);
+}
+
+// Replaces `edit->old_length` bytes at `edit->start` with `text`
+static char *edit_source(const char *source, SourceEdit *edit,
+                         const char *text) {
+  size_t length = strlen(source);
+  edit->new_length = strlen(text);
+  char *edited = malloc(length - edit->old_length + edit->new_length + 1);
+  memcpy(edited, source, edit->start);
+  memcpy(edited + edit->start, text, edit->new_length);
+  strcpy(edited + edit->start + edit->new_length,
+         source + edit->start + edit->old_length);
+  return edited;
+}
+
+void test_lexer_retokenize_matches_tokenize(void) {
+  struct {
+    size_t start;
+    size_t old_length;
+    const char *text;
+  } edits[] = {
+      {4, 1, "42"},              // Literal on the first line
+      {25, 0, "  z = 'a\nb'\n"}, // New line in the block
+      {0, 0, "# head\n"},        // Comment before everything
+      {37, 4, ""},               // Part of a line and its newline
+      {9, 0, "'"},               // Opens a string running to the end
+  };
+  SourceEdit initial = {0};
+  char *source = edit_source(
+      "", &initial, "x = 1\nif x:\n  y = x + 1\n# done\nprint(y)\n");
+  Lexer lexer = tokenize(source, "test_file.py");
+
+  for (size_t e = 0; e < ARRAYSIZE(edits); e++) {
+    SourceEdit edit = {.start = edits[e].start,
+                       .old_length = edits[e].old_length};
+    char *edited = edit_source(source, &edit, edits[e].text);
+    TokenSplice splice = retokenize(&lexer, edited, edit);
+    free(source);
+    source = edited;
+
+    Lexer fresh = tokenize(source, "test_file.py");
+    TEST_ASSERT_EQUAL(fresh.token_end, lexer.token_end);
+    TEST_ASSERT_EQUAL(fresh.tokens.line_count, lexer.tokens.line_count);
+    if (e == 0) {
+      // The rest of `x = 42` was lexed again but kept
+      TEST_ASSERT_EQUAL(3, splice.first);
+      TEST_ASSERT_EQUAL(1, splice.removed);
+      TEST_ASSERT_EQUAL(1, splice.inserted);
+    }
+    for (TokenIndex i = 1; i < fresh.token_end; i++) {
+      TEST_ASSERT_EQUAL(fresh.tokens.kinds[i], lexer.tokens.kinds[i]);
+      TEST_ASSERT_EQUAL(fresh.tokens.subkinds[i], lexer.tokens.subkinds[i]);
+      TEST_ASSERT_EQUAL(fresh.tokens.offsets[i], lexer.tokens.offsets[i]);
+      TEST_ASSERT_EQUAL(fresh.tokens.lengths[i], lexer.tokens.lengths[i]);
+      TEST_ASSERT_EQUAL(fresh.tokens.idents[i], lexer.tokens.idents[i]);
+      TEST_ASSERT_EQUAL(token_line(&fresh, i), token_line(&lexer, i));
+      TEST_ASSERT_EQUAL(token_col(&fresh, i), token_col(&lexer, i));
+      TEST_ASSERT_EQUAL_STRING(token_lexeme(&fresh, i),
+                               token_lexeme(&lexer, i));
+      if (token_value(&fresh, i))
+        TEST_ASSERT_EQUAL(token_value(&fresh, i)->length,
+                          token_value(&lexer, i)->length);
+    }
+    TokenStream_free(&fresh.tokens);
+  }
+
+  TokenStream_free(&lexer.tokens);
+  free(source);
+}
+
+void test_lexer_retokenize_reuses_literal_storage(void) {
+  // Arrange: a string literal with an escape, decoded into the stream
+  SourceEdit initial = {0};
+  char *source = edit_source("", &initial, "s = 'a\\tb'\nn = 1\n");
+  Lexer lexer = tokenize(source, "test_file.py");
+  TokenIndex string = 3;
+  uint32_t values = lexer.tokens.values_size;
+  char lexeme[256];
+  char text[sizeof(lexeme) + 2];
+
+  // Act: rewrite the literal many times over, asking for its lexeme each time
+  for (int e = 0; e < 4000; e++) {
+    snprintf(lexeme, sizeof(lexeme), "%0*d\\t", 100 + e % 100, e);
+    snprintf(text, sizeof(text), "'%s'", lexeme);
+    SourceEdit edit = {.start = 4,
+                       .old_length = lexer.tokens.lengths[string] + 2};
+    char *edited = edit_source(source, &edit, text);
+    retokenize(&lexer, edited, edit);
+    free(source);
+    source = edited;
+    TEST_ASSERT_EQUAL_STRING(lexeme, token_lexeme(&lexer, string));
+  }
+
+  // Assert: the slots and text of replaced literals were reused
+  TEST_ASSERT_EQUAL(values, lexer.tokens.values_size);
+  TEST_ASSERT_TRUE(lexer.tokens.strings_dead < 64 * 1024 + 2 * sizeof(text));
+  const TokenValue *value = token_value(&lexer, string);
+  TEST_ASSERT_EQUAL(200, value->length);
+  TEST_ASSERT_EQUAL('\t', value->str_val[199]);
+
+  TokenStream_free(&lexer.tokens);
+  free(source);
+}
+
+void test_lexer_interned_names(void) {
+  Lexer lexer = tokenize("total = count + total\nif count: total = 'count'\n",
+                         "test_file.py");
+  TokenIndex total = lexer.token_idx;
+  TokenIndex count = total + 2;
+  NameId total_id = token_name(&lexer, total);
+  NameId count_id = token_name(&lexer, count);
+  TEST_ASSERT_NOT_EQUAL(NAME_NONE, total_id);
+  TEST_ASSERT_NOT_EQUAL(total_id, count_id);
+  TEST_ASSERT_EQUAL(total_id, token_name(&lexer, total + 4));
+
+  // Keywords are interned too, other tokens are not
+  TokenIndex keyword = total + 6;
+  TEST_ASSERT_EQUAL(KEYWORD, token_type(&lexer, keyword));
+  TEST_ASSERT_NOT_EQUAL(NAME_NONE, token_name(&lexer, keyword));
+  TEST_ASSERT_EQUAL(count_id, token_name(&lexer, keyword + 1));
+  TEST_ASSERT_EQUAL(NAME_NONE, token_name(&lexer, total + 1));
+  TEST_ASSERT_EQUAL(NAME_NONE, token_name(&lexer, keyword + 5));
+  TEST_ASSERT_EQUAL(3, InternTable_count(&lexer.tokens.interned));
+
+  TEST_ASSERT_EQUAL(count_id, InternTable_find(&lexer.tokens.interned,
+                                               "count", strlen("count")));
+  TEST_ASSERT_EQUAL(NAME_NONE, InternTable_find(&lexer.tokens.interned,
+                                                "coun", strlen("coun")));
+
+  // Synthetic identifiers share the ids of the source ones
+  TokenIndex synthetic = create_token_from_str(&lexer, "total", IDENTIFIER);
+  TEST_ASSERT_EQUAL(total_id, token_name(&lexer, synthetic));
+  TokenStream_free(&lexer.tokens);
+}
+
+void test_lexer_mapped_source(void) {
+  // A file filling whole pages must still come back NUL-terminated
+  const char *path = "ceeify_mapped_source_test.py";
+  size_t length = (size_t)sysconf(_SC_PAGESIZE);
+  FILE *out = fopen(path, "w");
+  TEST_ASSERT_NOT_NULL(out);
+  for (size_t i = 0; i + 6 <= length; i += 6) {
+    fputs("x = 1\n", out);
+  }
+  for (size_t i = length / 6 * 6; i < length; i++) {
+    fputc('#', out);
+  }
+  fclose(out);
+
+  SourceFile source = {0};
+  TEST_ASSERT_TRUE(source_file_open(&source, path));
+  TEST_ASSERT_EQUAL(length, source.length);
+  TEST_ASSERT_TRUE(source.map_size > source.length);
+  TEST_ASSERT_EQUAL('\0', source.text[source.length]);
+
+  Lexer lexer = tokenize(source.text, path);
+  // Four tokens per "x = 1\n" line, plus the ENDMARKER
+  TEST_ASSERT_EQUAL(length / 6 * 4 + 1, lexer.token_end - lexer.token_idx);
+  TokenStream_free(&lexer.tokens);
+
+  source_file_close(&source);
+  TEST_ASSERT_NULL(source.text);
+  remove(path);
 }
 
 #endif
@@ -2,20 +2,25 @@
 #ifndef TEST_PARSER_H_
 #define TEST_PARSER_H_
 
+#include "ast_snapshot.h"
 #include "parser.h"
 #include "utils.h"
 #include <unity.h>
 
+static const char *link_lexeme(Parser *parser, NodeIndex index) {
+  return token_lexeme(&parser->lexer, AST_get(&parser->ast, index)->token);
+}
+
 void test_parser_single_number(void) {
   // Arrane
   Lexer lexer = tokenize("123", "test_file.py");
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
   // Assert
   TEST_ASSERT_EQUAL_INT(LITERAL, node->type);
-  TEST_ASSERT_EQUAL_STRING("123", node->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("123", token_lexeme(&parser.lexer, node->token));
   // Cleanup
   parser_free(&parser);
 }
@@ -25,17 +30,16 @@ void test_parse_arithmetic_expression(void) {
   Lexer lexer = tokenize("3 + 5 * 2", "test_file.py");
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *result = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *result = AST_pop(&parser.ast, &main->def.body);
   // Assert
   TEST_ASSERT_NOT_NULL(result);
-  TEST_ASSERT_EQUAL_STRING("+", result->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("3", result->bin_op.left->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("*", result->bin_op.right->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("5",
-                           result->bin_op.right->bin_op.left->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("2",
-                           result->bin_op.right->bin_op.right->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("+", token_lexeme(&parser.lexer, result->token));
+  TEST_ASSERT_EQUAL_STRING("3", link_lexeme(&parser, result->bin_op.left));
+  TEST_ASSERT_EQUAL_STRING("*", link_lexeme(&parser, result->bin_op.right));
+  ASTNode *right = AST_get(&parser.ast, result->bin_op.right);
+  TEST_ASSERT_EQUAL_STRING("5", link_lexeme(&parser, right->bin_op.left));
+  TEST_ASSERT_EQUAL_STRING("2", link_lexeme(&parser, right->bin_op.right));
   // Cleanup
   parser_free(&parser);
 }
@@ -43,19 +47,19 @@ void test_parse_arithmetic_expression(void) {
 void test_expression_parentheses_override_precedence(void) {
   Lexer lexer = tokenize("(3 + 5) * 2", "test_file.py");
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *expr = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *expr = AST_pop(&parser.ast, &main->def.body);
   TEST_ASSERT_EQUAL_INT(BINARY_OPERATION, expr->type);
-  TEST_ASSERT_EQUAL_STRING("*", expr->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("*", token_lexeme(&parser.lexer, expr->token));
 
   // left: (3 + 5)
-  ASTNode *left = expr->bin_op.left;
-  TEST_ASSERT_EQUAL_STRING("+", left->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("3", left->bin_op.left->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("5", left->bin_op.right->token->lexeme);
+  ASTNode *left = AST_get(&parser.ast, expr->bin_op.left);
+  TEST_ASSERT_EQUAL_STRING("+", token_lexeme(&parser.lexer, left->token));
+  TEST_ASSERT_EQUAL_STRING("3", link_lexeme(&parser, left->bin_op.left));
+  TEST_ASSERT_EQUAL_STRING("5", link_lexeme(&parser, left->bin_op.right));
 
   // right: 2
-  TEST_ASSERT_EQUAL_STRING("2", expr->bin_op.right->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("2", link_lexeme(&parser, expr->bin_op.right));
 
   parser_free(&parser);
 }
@@ -64,54 +68,54 @@ void test_expression_parentheses_override_precedence(void) {
 void test_parse_variable_assignment(void) {
   Lexer lexer = tokenize("x = 42", "test_file.py");
   Parser parser = parse(&lexer);
-  ASTNode *node = ASTNode_pop(&parser.ast);
-  ASTNode *target = ASTNode_pop(&node->assign.targets);
+  ASTNode *node = AST_pop(&parser.ast, &parser.program);
+  ASTNode *target = AST_pop(&parser.ast, &node->assign.targets);
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, node->type);
   TEST_ASSERT_EQUAL_INT(VARIABLE, target->type);
-  TEST_ASSERT_EQUAL_INT(LITERAL, node->assign.value->type);
-  TEST_ASSERT_EQUAL_STRING("=", node->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("x", target->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("42", node->assign.value->token->lexeme);
+  TEST_ASSERT_EQUAL_INT(LITERAL,
+                        AST_get(&parser.ast, node->assign.value)->type);
+  TEST_ASSERT_EQUAL_STRING("=", token_lexeme(&parser.lexer, node->token));
+  TEST_ASSERT_EQUAL_STRING("x", token_lexeme(&parser.lexer, target->token));
+  TEST_ASSERT_EQUAL_STRING("42", link_lexeme(&parser, node->assign.value));
   parser_free(&parser);
 }
 
 void test_parse_multiple_variable_assignment(void) {
   Lexer lexer = tokenize("x, y, z = 42", "test_file.py");
   Parser parser = parse(&lexer);
-  ASTNode *node = ASTNode_pop(&parser.ast);
+  ASTNode *node = AST_pop(&parser.ast, &parser.program);
 
-  for (size_t current = node->assign.targets.head; current != SIZE_MAX;
-       current = node->assign.targets.elements[current].next) {
-    ASTNode *el = node->assign.targets.elements[current].data;
+  for (uint32_t i = 0; i < node->assign.targets.count; i++) {
+    ASTNode *el = AST_child(&parser.ast, node->assign.targets, i);
     TEST_ASSERT_EQUAL_INT(VARIABLE, el->type);
   }
 
-  ASTNode *target = ASTNode_pop(&node->assign.targets);
+  ASTNode *target = AST_pop(&parser.ast, &node->assign.targets);
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, node->type);
-  TEST_ASSERT_EQUAL_INT(LITERAL, node->assign.value->type);
-  TEST_ASSERT_EQUAL_STRING("=", node->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("z", target->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("42", node->assign.value->token->lexeme);
+  TEST_ASSERT_EQUAL_INT(LITERAL,
+                        AST_get(&parser.ast, node->assign.value)->type);
+  TEST_ASSERT_EQUAL_STRING("=", token_lexeme(&parser.lexer, node->token));
+  TEST_ASSERT_EQUAL_STRING("z", token_lexeme(&parser.lexer, target->token));
+  TEST_ASSERT_EQUAL_STRING("42", link_lexeme(&parser, node->assign.value));
   parser_free(&parser);
 }
 
 void test_import_assignment(void) {
   Lexer lexer = tokenize("import x,y,z", "test_file.py");
   Parser parser = parse(&lexer);
-  ASTNode *node = ASTNode_pop(&parser.ast);
+  ASTNode *node = AST_pop(&parser.ast, &parser.program);
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(IMPORT, node->type);
 
-  for (size_t current = node->assign.targets.head; current != SIZE_MAX;
-       current = node->assign.targets.elements[current].next) {
-    ASTNode *el = node->assign.targets.elements[current].data;
+  for (uint32_t i = 0; i < node->assign.targets.count; i++) {
+    ASTNode *el = AST_child(&parser.ast, node->assign.targets, i);
     TEST_ASSERT_EQUAL_INT(VARIABLE, el->type);
   }
 
-  ASTNode *name = ASTNode_pop(&node->collection);
-  TEST_ASSERT_EQUAL_STRING("z", name->token->lexeme);
+  ASTNode *name = AST_pop(&parser.ast, &node->collection);
+  TEST_ASSERT_EQUAL_STRING("z", token_lexeme(&parser.lexer, name->token));
   parser_free(&parser);
 }
 
@@ -120,15 +124,15 @@ void test_compare_expression(void) {
   Lexer lexer = tokenize("1 <= a < 10", "test_file.py");
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
   // Assert
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(COMPARE, node->type);
-  ASTNode *compare = ASTNode_pop(&node->compare.comparators);
-  TEST_ASSERT_EQUAL_STRING("10", compare->token->lexeme);
-  compare = ASTNode_pop(&node->compare.comparators);
-  TEST_ASSERT_EQUAL_STRING("a", compare->token->lexeme);
+  ASTNode *compare = AST_pop(&parser.ast, &node->compare.comparators);
+  TEST_ASSERT_EQUAL_STRING("10", token_lexeme(&parser.lexer, compare->token));
+  compare = AST_pop(&parser.ast, &node->compare.comparators);
+  TEST_ASSERT_EQUAL_STRING("a", token_lexeme(&parser.lexer, compare->token));
   parser_free(&parser);
 }
 
@@ -137,27 +141,27 @@ void test_if_statement(void) {
                          "\ty = 5\n",
                          "test_file.py");
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(IF, node->type);
   // Type assert
-  ASTNode *condition = node->ctrl_stmt.test;
+  ASTNode *condition = AST_get(&parser.ast, node->ctrl_stmt.test);
   TEST_ASSERT_NOT_NULL(condition);
   TEST_ASSERT_EQUAL_INT(COMPARE, condition->type);
 
   // Check left side of compare (x) and right side (10)
-  TEST_ASSERT_EQUAL_STRING("x", condition->compare.left->token->lexeme);
-  ASTNode *comp = ASTNode_pop(&condition->compare.comparators);
-  TEST_ASSERT_EQUAL_STRING("10", comp->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("x", link_lexeme(&parser, condition->compare.left));
+  ASTNode *comp = AST_pop(&parser.ast, &condition->compare.comparators);
+  TEST_ASSERT_EQUAL_STRING("10", token_lexeme(&parser.lexer, comp->token));
 
   // The body should be stored on the right
-  ASTNode *body = ASTNode_pop(&node->ctrl_stmt.body);
-  ASTNode *y = ASTNode_pop(&body->assign.targets);
+  ASTNode *body = AST_pop(&parser.ast, &node->ctrl_stmt.body);
+  ASTNode *y = AST_pop(&parser.ast, &body->assign.targets);
   TEST_ASSERT_NOT_NULL(body);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, body->type);
-  TEST_ASSERT_EQUAL_STRING("y", y->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("5", body->assign.value->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("y", token_lexeme(&parser.lexer, y->token));
+  TEST_ASSERT_EQUAL_STRING("5", link_lexeme(&parser, body->assign.value));
   // cleanup
   parser_free(&parser);
 }
@@ -171,51 +175,55 @@ void test_if_elif_statement(void) {
   Parser parser = parse(&lexer);
 
   // Pop the top-level node
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(IF, node->type);
 
   //
   // --- check main IF block ---
   //
-  ASTNode *condition = node->ctrl_stmt.test;
+  ASTNode *condition = AST_get(&parser.ast, node->ctrl_stmt.test);
   TEST_ASSERT_NOT_NULL(condition);
   TEST_ASSERT_EQUAL_INT(COMPARE, condition->type);
-  TEST_ASSERT_EQUAL_STRING("x", condition->compare.left->token->lexeme);
-  ASTNode *comp = ASTNode_pop(&condition->compare.comparators);
-  TEST_ASSERT_EQUAL_STRING("10", comp->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("x", link_lexeme(&parser, condition->compare.left));
+  ASTNode *comp = AST_pop(&parser.ast, &condition->compare.comparators);
+  TEST_ASSERT_EQUAL_STRING("10", token_lexeme(&parser.lexer, comp->token));
 
   // check if-body: y = 5
-  ASTNode *body_stmt = ASTNode_pop(&node->ctrl_stmt.body);
+  ASTNode *body_stmt = AST_pop(&parser.ast, &node->ctrl_stmt.body);
   TEST_ASSERT_NOT_NULL(body_stmt);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, body_stmt->type);
-  ASTNode *target = ASTNode_pop(&body_stmt->assign.targets);
-  TEST_ASSERT_EQUAL_STRING("y", target->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("5", body_stmt->assign.value->token->lexeme);
+  ASTNode *target = AST_pop(&parser.ast, &body_stmt->assign.targets);
+  TEST_ASSERT_EQUAL_STRING("y", token_lexeme(&parser.lexer, target->token));
+  TEST_ASSERT_EQUAL_STRING("5", link_lexeme(&parser, body_stmt->assign.value));
 
   //
   // --- check ELIF block (should appear in orelse list) ---
   //
-  ASTNode *elif_node = ASTNode_pop(&node->ctrl_stmt.orelse);
+  ASTNode *elif_node = AST_pop(&parser.ast, &node->ctrl_stmt.orelse);
   TEST_ASSERT_NOT_NULL(elif_node);
   TEST_ASSERT_EQUAL_INT(IF, elif_node->type);
 
   // condition: x < 20
-  ASTNode *elif_condition = elif_node->ctrl_stmt.test;
+  ASTNode *elif_condition = AST_get(&parser.ast, elif_node->ctrl_stmt.test);
   TEST_ASSERT_NOT_NULL(elif_condition);
   TEST_ASSERT_EQUAL_INT(COMPARE, elif_condition->type);
-  TEST_ASSERT_EQUAL_STRING("x", elif_condition->compare.left->token->lexeme);
-  ASTNode *elif_comp = ASTNode_pop(&elif_condition->compare.comparators);
-  TEST_ASSERT_EQUAL_STRING("20", elif_comp->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING(
+      "x", link_lexeme(&parser, elif_condition->compare.left));
+  ASTNode *elif_comp =
+      AST_pop(&parser.ast, &elif_condition->compare.comparators);
+  TEST_ASSERT_EQUAL_STRING("20", token_lexeme(&parser.lexer, elif_comp->token));
 
   // body: y = 15
-  ASTNode *elif_body_stmt = ASTNode_pop(&elif_node->ctrl_stmt.body);
+  ASTNode *elif_body_stmt = AST_pop(&parser.ast, &elif_node->ctrl_stmt.body);
   TEST_ASSERT_NOT_NULL(elif_body_stmt);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, elif_body_stmt->type);
-  ASTNode *elif_target = ASTNode_pop(&elif_body_stmt->assign.targets);
-  TEST_ASSERT_EQUAL_STRING("y", elif_target->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("15", elif_body_stmt->assign.value->token->lexeme);
+  ASTNode *elif_target = AST_pop(&parser.ast, &elif_body_stmt->assign.targets);
+  TEST_ASSERT_EQUAL_STRING("y",
+                           token_lexeme(&parser.lexer, elif_target->token));
+  TEST_ASSERT_EQUAL_STRING(
+      "15", link_lexeme(&parser, elif_body_stmt->assign.value));
 
   // cleanup
   parser_free(&parser);
@@ -231,44 +239,46 @@ void test_if_else_statement(void) {
   Parser parser = parse(&lexer);
 
   // Pop the top-level node
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(IF, node->type);
 
   //
   // --- check IF condition ---
   //
-  ASTNode *condition = node->ctrl_stmt.test;
+  ASTNode *condition = AST_get(&parser.ast, node->ctrl_stmt.test);
   TEST_ASSERT_NOT_NULL(condition);
   TEST_ASSERT_EQUAL_INT(COMPARE, condition->type);
-  TEST_ASSERT_EQUAL_STRING("x", condition->compare.left->token->lexeme);
-  ASTNode *comp = ASTNode_pop(&condition->compare.comparators);
-  TEST_ASSERT_EQUAL_STRING("10", comp->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("x", link_lexeme(&parser, condition->compare.left));
+  ASTNode *comp = AST_pop(&parser.ast, &condition->compare.comparators);
+  TEST_ASSERT_EQUAL_STRING("10", token_lexeme(&parser.lexer, comp->token));
 
   //
   // --- check IF body: y = 5 ---
   //
-  ASTNode *body_stmt = ASTNode_pop(&node->ctrl_stmt.body);
+  ASTNode *body_stmt = AST_pop(&parser.ast, &node->ctrl_stmt.body);
   TEST_ASSERT_NOT_NULL(body_stmt);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, body_stmt->type);
-  ASTNode *target = ASTNode_pop(&body_stmt->assign.targets);
-  TEST_ASSERT_EQUAL_STRING("y", target->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("5", body_stmt->assign.value->token->lexeme);
+  ASTNode *target = AST_pop(&parser.ast, &body_stmt->assign.targets);
+  TEST_ASSERT_EQUAL_STRING("y", token_lexeme(&parser.lexer, target->token));
+  TEST_ASSERT_EQUAL_STRING("5", link_lexeme(&parser, body_stmt->assign.value));
 
   //
   // --- check ELSE block ---
   //
-  ASTNode *else_stmt = ASTNode_pop(&node->ctrl_stmt.orelse);
+  ASTNode *else_stmt = AST_pop(&parser.ast, &node->ctrl_stmt.orelse);
   TEST_ASSERT_NOT_NULL(else_stmt);
 
   // `else` is NOT another IF node — it is a normal statement
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, else_stmt->type);
 
   // expected: y = 100
-  ASTNode *else_target = ASTNode_pop(&else_stmt->assign.targets);
-  TEST_ASSERT_EQUAL_STRING("y", else_target->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("100", else_stmt->assign.value->token->lexeme);
+  ASTNode *else_target = AST_pop(&parser.ast, &else_stmt->assign.targets);
+  TEST_ASSERT_EQUAL_STRING("y",
+                           token_lexeme(&parser.lexer, else_target->token));
+  TEST_ASSERT_EQUAL_STRING(
+      "100", link_lexeme(&parser, else_stmt->assign.value));
 
   // cleanup
   parser_free(&parser);
@@ -280,28 +290,28 @@ void test_while_statement(void) {
                          "  x = x + 1\n",
                          "test_file.py");
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(WHILE, node->type);
   // Assert
-  ASTNode *condition = node->ctrl_stmt.test;
+  ASTNode *condition = AST_get(&parser.ast, node->ctrl_stmt.test);
   TEST_ASSERT_NOT_NULL(condition);
   TEST_ASSERT_EQUAL_INT(COMPARE, condition->type);
-  TEST_ASSERT_EQUAL_STRING("x", condition->compare.left->token->lexeme);
-  ASTNode *comp = ASTNode_pop(&condition->compare.comparators);
-  TEST_ASSERT_EQUAL_STRING("10", comp->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("x", link_lexeme(&parser, condition->compare.left));
+  ASTNode *comp = AST_pop(&parser.ast, &condition->compare.comparators);
+  TEST_ASSERT_EQUAL_STRING("10", token_lexeme(&parser.lexer, comp->token));
 
   //
   // --- check WHILE body: x = x + 1 ---
   //
-  ASTNode *body_stmt = ASTNode_pop(&node->ctrl_stmt.body);
+  ASTNode *body_stmt = AST_pop(&parser.ast, &node->ctrl_stmt.body);
   TEST_ASSERT_NOT_NULL(body_stmt);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, body_stmt->type);
-  ASTNode *target = ASTNode_pop(&body_stmt->assign.targets);
-  TEST_ASSERT_EQUAL_STRING("x", target->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING(
-      "1", body_stmt->assign.value->bin_op.right->token->lexeme);
+  ASTNode *target = AST_pop(&parser.ast, &body_stmt->assign.targets);
+  TEST_ASSERT_EQUAL_STRING("x", token_lexeme(&parser.lexer, target->token));
+  ASTNode *value = AST_get(&parser.ast, body_stmt->assign.value);
+  TEST_ASSERT_EQUAL_STRING("1", link_lexeme(&parser, value->bin_op.right));
 
   // cleanup
   parser_free(&parser);
@@ -315,36 +325,38 @@ void test_while_else_statement(void) {
                          "  y = 100\n",
                          "test_file.py");
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(WHILE, node->type);
 
   // Check WHILE condition
-  ASTNode *condition = node->ctrl_stmt.test;
+  ASTNode *condition = AST_get(&parser.ast, node->ctrl_stmt.test);
   TEST_ASSERT_NOT_NULL(condition);
   TEST_ASSERT_EQUAL_INT(COMPARE, condition->type);
-  TEST_ASSERT_EQUAL_STRING("x", condition->compare.left->token->lexeme);
-  ASTNode *comp = ASTNode_pop(&condition->compare.comparators);
-  TEST_ASSERT_EQUAL_STRING("10", comp->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("x", link_lexeme(&parser, condition->compare.left));
+  ASTNode *comp = AST_pop(&parser.ast, &condition->compare.comparators);
+  TEST_ASSERT_EQUAL_STRING("10", token_lexeme(&parser.lexer, comp->token));
 
   // Check WHILE body: x = x + 1
-  ASTNode *body_stmt = ASTNode_pop(&node->ctrl_stmt.body);
+  ASTNode *body_stmt = AST_pop(&parser.ast, &node->ctrl_stmt.body);
   TEST_ASSERT_NOT_NULL(body_stmt);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, body_stmt->type);
-  ASTNode *target = ASTNode_pop(&body_stmt->assign.targets);
-  TEST_ASSERT_EQUAL_STRING("x", target->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING(
-      "1", body_stmt->assign.value->bin_op.right->token->lexeme);
+  ASTNode *target = AST_pop(&parser.ast, &body_stmt->assign.targets);
+  TEST_ASSERT_EQUAL_STRING("x", token_lexeme(&parser.lexer, target->token));
+  ASTNode *value = AST_get(&parser.ast, body_stmt->assign.value);
+  TEST_ASSERT_EQUAL_STRING("1", link_lexeme(&parser, value->bin_op.right));
 
   // Check ELSE block
-  ASTNode *else_stmt = ASTNode_pop(&node->ctrl_stmt.orelse);
+  ASTNode *else_stmt = AST_pop(&parser.ast, &node->ctrl_stmt.orelse);
   TEST_ASSERT_NOT_NULL(else_stmt);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, else_stmt->type);
 
-  ASTNode *else_target = ASTNode_pop(&else_stmt->assign.targets);
-  TEST_ASSERT_EQUAL_STRING("y", else_target->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("100", else_stmt->assign.value->token->lexeme);
+  ASTNode *else_target = AST_pop(&parser.ast, &else_stmt->assign.targets);
+  TEST_ASSERT_EQUAL_STRING("y",
+                           token_lexeme(&parser.lexer, else_target->token));
+  TEST_ASSERT_EQUAL_STRING(
+      "100", link_lexeme(&parser, else_stmt->assign.value));
 
   // Cleanup
   parser_free(&parser);
@@ -354,25 +366,26 @@ void test_parse_augmented_assignment(void) {
   // Arrange & Act
   Lexer lexer = tokenize("a += 69", "test_file.py");
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
   // Assert
   TEST_ASSERT_NOT_NULL(node);
   // Check node type: augmented assignment
   TEST_ASSERT_EQUAL_INT(AUG_ASSIGNMENT, node->type);
-  TEST_ASSERT_NOT_NULL(node->token);
-  TEST_ASSERT_EQUAL_STRING("+=", node->token->lexeme);
+  TEST_ASSERT_NOT_EQUAL(TOKEN_NONE, node->token);
+  TEST_ASSERT_EQUAL_STRING("+=", token_lexeme(&parser.lexer, node->token));
 
   // Check the target (left side)
-  ASTNode *target = node->aug_assign.target;
+  ASTNode *target = AST_get(&parser.ast, node->aug_assign.target);
   TEST_ASSERT_NOT_NULL(target);
   TEST_ASSERT_EQUAL_INT(VARIABLE, target->type);
-  TEST_ASSERT_EQUAL_STRING("a", target->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("a", token_lexeme(&parser.lexer, target->token));
 
   // Check the value (right side)
-  TEST_ASSERT_NOT_NULL(node->aug_assign.value);
-  TEST_ASSERT_EQUAL_INT(LITERAL, node->aug_assign.value->type);
-  TEST_ASSERT_EQUAL_STRING("69", node->aug_assign.value->token->lexeme);
+  TEST_ASSERT_NOT_NULL(AST_get(&parser.ast, node->aug_assign.value));
+  TEST_ASSERT_EQUAL_INT(LITERAL,
+                        AST_get(&parser.ast, node->aug_assign.value)->type);
+  TEST_ASSERT_EQUAL_STRING("69", link_lexeme(&parser, node->aug_assign.value));
   parser_free(&parser);
 }
 
@@ -383,41 +396,42 @@ void test_parse_function_declaration(void) {
                          "test_file.py");
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *node = ASTNode_pop(&parser.ast);
+  ASTNode *node = AST_pop(&parser.ast, &parser.program);
   // Assert
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(FUNCTION_DEF, node->type);
   // Function name
-  TEST_ASSERT_NOT_NULL(node->token);
-  TEST_ASSERT_EQUAL_STRING("add", node->def.name->token->lexeme);
+  TEST_ASSERT_NOT_EQUAL(TOKEN_NONE, node->token);
+  TEST_ASSERT_EQUAL_STRING("add", link_lexeme(&parser, node->def.name));
   //
   // ---- PARAMETERS ----
   //
-  ASTNode *param_y = ASTNode_pop(&node->def.params);
+  ASTNode *param_y = AST_pop(&parser.ast, &node->def.params);
   TEST_ASSERT_NOT_NULL(param_y);
   TEST_ASSERT_EQUAL_INT(VARIABLE, param_y->type);
-  TEST_ASSERT_EQUAL_STRING("y", param_y->token->lexeme);
-  ASTNode *param_x = ASTNode_pop(&node->def.params);
+  TEST_ASSERT_EQUAL_STRING("y", token_lexeme(&parser.lexer, param_y->token));
+  ASTNode *param_x = AST_pop(&parser.ast, &node->def.params);
   TEST_ASSERT_NOT_NULL(param_x);
   TEST_ASSERT_EQUAL_INT(VARIABLE, param_x->type);
-  TEST_ASSERT_EQUAL_STRING("x", param_x->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("x", token_lexeme(&parser.lexer, param_x->token));
   //
   // ---- BODY ----
   //
-  ASTNode *body_stmt = ASTNode_pop(&node->def.body);
+  ASTNode *body_stmt = AST_pop(&parser.ast, &node->def.body);
   TEST_ASSERT_NOT_NULL(body_stmt);
   // Body should begin with a return statement
   TEST_ASSERT_EQUAL_INT(RETURN, body_stmt->type);
-  TEST_ASSERT_NOT_NULL(body_stmt->token); // "return"
+  TEST_ASSERT_NOT_EQUAL(TOKEN_NONE, body_stmt->token); // "return"
   //
   // return expression: x + y
   //
-  ASTNode *ret_expr = body_stmt->bin_op.left; // or body_stmt->return.value
+  // or body_stmt->return.value
+  ASTNode *ret_expr = AST_get(&parser.ast, body_stmt->bin_op.left);
   TEST_ASSERT_NOT_NULL(ret_expr);
   TEST_ASSERT_EQUAL_INT(BINARY_OPERATION, ret_expr->type);
-  TEST_ASSERT_EQUAL_STRING("+", ret_expr->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("x", ret_expr->bin_op.left->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("y", ret_expr->bin_op.right->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("+", token_lexeme(&parser.lexer, ret_expr->token));
+  TEST_ASSERT_EQUAL_STRING("x", link_lexeme(&parser, ret_expr->bin_op.left));
+  TEST_ASSERT_EQUAL_STRING("y", link_lexeme(&parser, ret_expr->bin_op.right));
   parser_free(&parser);
 }
 
@@ -426,23 +440,23 @@ void test_parse_function_call(void) {
   Lexer lexer = tokenize("add(1, 2)", "test_file.py");
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
   // Assert: CALL node
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(CALL, node->type);
   // Callee name
-  TEST_ASSERT_NOT_NULL(node->token);
-  TEST_ASSERT_EQUAL_STRING("add", node->token->lexeme);
-  ASTNode *arg2 = ASTNode_pop(&node->call.args);
-  ASTNode *arg1 = ASTNode_pop(&node->call.args);
+  TEST_ASSERT_NOT_EQUAL(TOKEN_NONE, node->token);
+  TEST_ASSERT_EQUAL_STRING("add", token_lexeme(&parser.lexer, node->token));
+  ASTNode *arg2 = AST_pop(&parser.ast, &node->call.args);
+  ASTNode *arg1 = AST_pop(&parser.ast, &node->call.args);
   // Check arguments
   TEST_ASSERT_NOT_NULL(arg1);
   TEST_ASSERT_NOT_NULL(arg2);
   TEST_ASSERT_EQUAL_INT(LITERAL, arg1->type);
-  TEST_ASSERT_EQUAL_STRING("1", arg1->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("1", token_lexeme(&parser.lexer, arg1->token));
   TEST_ASSERT_EQUAL_INT(LITERAL, arg2->type);
-  TEST_ASSERT_EQUAL_STRING("2", arg2->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("2", token_lexeme(&parser.lexer, arg2->token));
   // Cleanup
   parser_free(&parser);
 }
@@ -452,15 +466,15 @@ void test_parse_function_call_no_args(void) {
   Lexer lexer = tokenize("foo()", "test_file.py");
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
   // Assert
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(CALL, node->type);
   // function name
-  TEST_ASSERT_EQUAL_STRING("foo", node->call.func->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("foo", link_lexeme(&parser, node->call.func));
   // args should be empty
-  TEST_ASSERT_EQUAL_INT(SIZE_MAX, node->call.args.head);
+  TEST_ASSERT_EQUAL_INT(0, node->call.args.count);
   // Cleanup
   parser_free(&parser);
 }
@@ -470,17 +484,17 @@ void test_parse_nested_function_call(void) {
   Lexer lexer = tokenize("foo(bar(1))", "test_file.py");
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
   // Assert
   TEST_ASSERT_EQUAL_INT(CALL, node->type);
-  TEST_ASSERT_EQUAL_STRING("foo", node->call.func->token->lexeme);
-  ASTNode *inner = ASTNode_pop(&node->call.args);
+  TEST_ASSERT_EQUAL_STRING("foo", link_lexeme(&parser, node->call.func));
+  ASTNode *inner = AST_pop(&parser.ast, &node->call.args);
   TEST_ASSERT_NOT_NULL(inner);
   TEST_ASSERT_EQUAL_INT(CALL, inner->type);
-  TEST_ASSERT_EQUAL_STRING("bar", inner->call.func->token->lexeme);
-  ASTNode *inner_arg = ASTNode_pop(&inner->call.args);
-  TEST_ASSERT_EQUAL_STRING("1", inner_arg->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("bar", link_lexeme(&parser, inner->call.func));
+  ASTNode *inner_arg = AST_pop(&parser.ast, &inner->call.args);
+  TEST_ASSERT_EQUAL_STRING("1", token_lexeme(&parser.lexer, inner_arg->token));
   parser_free(&parser);
 }
 
@@ -488,19 +502,19 @@ void test_parse_call_inside_expression(void) {
   Lexer lexer = tokenize("x = foo(1) + 2", "test_file.py");
   Parser parser = parse(&lexer);
 
-  ASTNode *assign = ASTNode_pop(&parser.ast);
+  ASTNode *assign = AST_pop(&parser.ast, &parser.program);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, assign->type);
 
-  ASTNode *expr = assign->assign.value;
+  ASTNode *expr = AST_get(&parser.ast, assign->assign.value);
   TEST_ASSERT_EQUAL_INT(BINARY_OPERATION, expr->type);
-  TEST_ASSERT_EQUAL_STRING("+", expr->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("+", token_lexeme(&parser.lexer, expr->token));
 
-  ASTNode *call = expr->bin_op.left;
+  ASTNode *call = AST_get(&parser.ast, expr->bin_op.left);
   TEST_ASSERT_EQUAL_INT(CALL, call->type);
-  TEST_ASSERT_EQUAL_STRING("foo", call->call.func->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("foo", link_lexeme(&parser, call->call.func));
 
-  ASTNode *arg = ASTNode_pop(&call->call.args);
-  TEST_ASSERT_EQUAL_STRING("1", arg->token->lexeme);
+  ASTNode *arg = AST_pop(&parser.ast, &call->call.args);
+  TEST_ASSERT_EQUAL_STRING("1", token_lexeme(&parser.lexer, arg->token));
 
   parser_free(&parser);
 }
@@ -510,15 +524,15 @@ void test_parse_annotated_assignment(void) {
   Lexer lexer = tokenize("x: int = 10", "test_file.py");
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *node = ASTNode_pop(&parser.ast);
+  ASTNode *node = AST_pop(&parser.ast, &parser.program);
   // Assert
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, node->type);
-  ASTNode *target = ASTNode_pop(&node->assign.targets);
-  TEST_ASSERT_EQUAL_STRING("x", target->token->lexeme);
-  TEST_ASSERT_NOT_NULL(target->child);
-  TEST_ASSERT_EQUAL_STRING("int", target->child->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("10", node->assign.value->token->lexeme);
+  ASTNode *target = AST_pop(&parser.ast, &node->assign.targets);
+  TEST_ASSERT_EQUAL_STRING("x", token_lexeme(&parser.lexer, target->token));
+  TEST_ASSERT_NOT_NULL(AST_get(&parser.ast, target->child));
+  TEST_ASSERT_EQUAL_STRING("int", link_lexeme(&parser, target->child));
+  TEST_ASSERT_EQUAL_STRING("10", link_lexeme(&parser, node->assign.value));
   // Cleanup
   parser_free(&parser);
 }
@@ -530,22 +544,22 @@ void test_parse_function_def_with_annotations(void) {
                          "test_file.py");
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *node = ASTNode_pop(&parser.ast);
+  ASTNode *node = AST_pop(&parser.ast, &parser.program);
 
   // Assert
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(FUNCTION_DEF, node->type);
 
   // Check parameter list
-  ASTNode *param_v = ASTNode_pop(&node->def.params);
+  ASTNode *param_v = AST_pop(&parser.ast, &node->def.params);
   TEST_ASSERT_NOT_NULL(param_v);
   TEST_ASSERT_EQUAL_INT(VARIABLE, param_v->type);
-  TEST_ASSERT_EQUAL_STRING("v", param_v->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("v", token_lexeme(&parser.lexer, param_v->token));
 
   // Verify the annotation on the parameter
-  TEST_ASSERT_NOT_NULL(param_v->child);
-  TEST_ASSERT_EQUAL_INT(VARIABLE, param_v->child->type);
-  TEST_ASSERT_EQUAL_STRING("float", param_v->child->token->lexeme);
+  TEST_ASSERT_NOT_NULL(AST_get(&parser.ast, param_v->child));
+  TEST_ASSERT_EQUAL_INT(VARIABLE, AST_get(&parser.ast, param_v->child)->type);
+  TEST_ASSERT_EQUAL_STRING("float", link_lexeme(&parser, param_v->child));
   parser_free(&parser);
 }
 
@@ -558,31 +572,31 @@ void test_parse_class(void) {
 
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *node = ASTNode_pop(&parser.ast);
+  ASTNode *node = AST_pop(&parser.ast, &parser.program);
 
   // Assert: node exists and is a class
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL(CLASS_DEF, node->type);
 
   // Assert: class name
-  TEST_ASSERT_NOT_NULL(node->def.name);
-  TEST_ASSERT_EQUAL(VARIABLE, node->def.name->type);
-  TEST_ASSERT_EQUAL_STRING("Point", node->def.name->token->lexeme);
+  TEST_ASSERT_NOT_NULL(AST_get(&parser.ast, node->def.name));
+  TEST_ASSERT_EQUAL(VARIABLE, AST_get(&parser.ast, node->def.name)->type);
+  TEST_ASSERT_EQUAL_STRING("Point", link_lexeme(&parser, node->def.name));
 
   // Assert: params unused for class
-  TEST_ASSERT_EQUAL(0, node->def.params.size);
+  TEST_ASSERT_EQUAL(0, node->def.params.count);
 
   // Assert: class body exists
-  ASTNode *y = ASTNode_pop(&node->def.body);
-  ASTNode *x = ASTNode_pop(&node->def.body);
+  ASTNode *y = AST_pop(&parser.ast, &node->def.body);
+  ASTNode *x = AST_pop(&parser.ast, &node->def.body);
 
   TEST_ASSERT_NOT_NULL(x);
   TEST_ASSERT_NOT_NULL(y);
 
   TEST_ASSERT_EQUAL(VARIABLE, x->type);
   TEST_ASSERT_EQUAL(VARIABLE, y->type);
-  TEST_ASSERT_EQUAL_STRING("x", x->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("y", y->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("x", token_lexeme(&parser.lexer, x->token));
+  TEST_ASSERT_EQUAL_STRING("y", token_lexeme(&parser.lexer, y->token));
 
   // Cleanup
   parser_free(&parser);
@@ -598,50 +612,56 @@ void test_parse_match_statement(void) {
                          "test_file.py");
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
   // Assuming 'main' is a module/function, we get the match node from its body
-  ASTNode *match_node = ASTNode_pop(&main->def.body);
+  ASTNode *match_node = AST_pop(&parser.ast, &main->def.body);
 
   // Assert: Match Node
   TEST_ASSERT_NOT_NULL(match_node);
   TEST_ASSERT_EQUAL_INT(MATCH, match_node->type);
 
   // Assert: Match Subject (The 'test' field)
-  TEST_ASSERT_NOT_NULL(match_node->ctrl_stmt.test);
-  TEST_ASSERT_EQUAL_INT(VARIABLE, match_node->ctrl_stmt.test->type);
-  TEST_ASSERT_EQUAL_STRING("x", match_node->ctrl_stmt.test->token->lexeme);
+  ASTNode *subject = AST_get(&parser.ast, match_node->ctrl_stmt.test);
+  TEST_ASSERT_NOT_NULL(subject);
+  TEST_ASSERT_EQUAL_INT(VARIABLE, subject->type);
+  TEST_ASSERT_EQUAL_STRING(
+      "x", link_lexeme(&parser, match_node->ctrl_stmt.test));
 
   // --- CASE 2 (The Wildcard case '_') ---
   // Popping from the body gives us the LAST case first
-  ASTNode *case_wildcard = ASTNode_pop(&match_node->ctrl_stmt.body);
+  ASTNode *case_wildcard = AST_pop(&parser.ast, &match_node->ctrl_stmt.body);
   TEST_ASSERT_NOT_NULL(case_wildcard);
   TEST_ASSERT_EQUAL_INT(CASE, case_wildcard->type);
 
   // In your JSON, the pattern '_' is in 'orelse' for the CASE node
   // Note: Adjust this if your parser puts the pattern in 'test'
-  ASTNode *pattern_wild = ASTNode_pop(&case_wildcard->ctrl_stmt.orelse);
-  TEST_ASSERT_EQUAL_STRING("_", pattern_wild->token->lexeme);
+  ASTNode *pattern_wild =
+      AST_pop(&parser.ast, &case_wildcard->ctrl_stmt.orelse);
+  TEST_ASSERT_EQUAL_STRING("_",
+                           token_lexeme(&parser.lexer, pattern_wild->token));
 
-  ASTNode *body_wild = ASTNode_pop(&case_wildcard->ctrl_stmt.body);
+  ASTNode *body_wild = AST_pop(&parser.ast, &case_wildcard->ctrl_stmt.body);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, body_wild->type);
-  ASTNode *target_wild = ASTNode_pop(&body_wild->assign.targets);
-  TEST_ASSERT_EQUAL_STRING("y", target_wild->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("0", body_wild->assign.value->token->lexeme);
+  ASTNode *target_wild = AST_pop(&parser.ast, &body_wild->assign.targets);
+  TEST_ASSERT_EQUAL_STRING("y",
+                           token_lexeme(&parser.lexer, target_wild->token));
+  TEST_ASSERT_EQUAL_STRING("0", link_lexeme(&parser, body_wild->assign.value));
 
   // --- CASE 1 (The literal case '1') ---
   // Popping again gives us the first case
-  ASTNode *case_literal = ASTNode_pop(&match_node->ctrl_stmt.body);
+  ASTNode *case_literal = AST_pop(&parser.ast, &match_node->ctrl_stmt.body);
   TEST_ASSERT_NOT_NULL(case_literal);
 
   // In your JSON, '1' is stored in 'orelse' of the CASE node
-  ASTNode *pattern_lit = ASTNode_pop(&case_literal->ctrl_stmt.orelse);
-  TEST_ASSERT_EQUAL_STRING("1", pattern_lit->token->lexeme);
+  ASTNode *pattern_lit = AST_pop(&parser.ast, &case_literal->ctrl_stmt.orelse);
+  TEST_ASSERT_EQUAL_STRING("1",
+                           token_lexeme(&parser.lexer, pattern_lit->token));
 
-  ASTNode *body_lit = ASTNode_pop(&case_literal->ctrl_stmt.body);
+  ASTNode *body_lit = AST_pop(&parser.ast, &case_literal->ctrl_stmt.body);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, body_lit->type);
-  ASTNode *target_lit = ASTNode_pop(&body_lit->assign.targets);
-  TEST_ASSERT_EQUAL_STRING("y", target_lit->token->lexeme);
-  TEST_ASSERT_EQUAL_STRING("10", body_lit->assign.value->token->lexeme);
+  ASTNode *target_lit = AST_pop(&parser.ast, &body_lit->assign.targets);
+  TEST_ASSERT_EQUAL_STRING("y", token_lexeme(&parser.lexer, target_lit->token));
+  TEST_ASSERT_EQUAL_STRING("10", link_lexeme(&parser, body_lit->assign.value));
 
   // Cleanup
   parser_free(&parser);
@@ -653,30 +673,30 @@ void test_parse_tuple_literal(void) {
 
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
 
   // Assert: node is a TUPLE
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(TUPLE, node->type);
 
   // Assert: tuple elements (reverse pop order)
-  ASTNode *el3 = ASTNode_pop(&node->collection);
-  ASTNode *el2 = ASTNode_pop(&node->collection);
-  ASTNode *el1 = ASTNode_pop(&node->collection);
+  ASTNode *el3 = AST_pop(&parser.ast, &node->collection);
+  ASTNode *el2 = AST_pop(&parser.ast, &node->collection);
+  ASTNode *el1 = AST_pop(&parser.ast, &node->collection);
 
   TEST_ASSERT_NOT_NULL(el1);
   TEST_ASSERT_NOT_NULL(el2);
   TEST_ASSERT_NOT_NULL(el3);
 
   TEST_ASSERT_EQUAL_INT(LITERAL, el1->type);
-  TEST_ASSERT_EQUAL_STRING("1", el1->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("1", token_lexeme(&parser.lexer, el1->token));
 
   TEST_ASSERT_EQUAL_INT(VARIABLE, el2->type);
-  TEST_ASSERT_EQUAL_STRING("x", el2->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("x", token_lexeme(&parser.lexer, el2->token));
 
   TEST_ASSERT_EQUAL_INT(LITERAL, el3->type);
-  TEST_ASSERT_EQUAL_STRING("3", el3->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("3", token_lexeme(&parser.lexer, el3->token));
 
   // Cleanup
   parser_free(&parser);
@@ -688,18 +708,19 @@ void test_parse_from_import(void) {
 
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *node = ASTNode_pop(&parser.ast);
+  ASTNode *node = AST_pop(&parser.ast, &parser.program);
 
   // Assert
   TEST_ASSERT_NOT_NULL(node);
   TEST_ASSERT_EQUAL_INT(IMPORT_FROM, node->type);
-  TEST_ASSERT_EQUAL_STRING("from", node->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("from", token_lexeme(&parser.lexer, node->token));
   // The imported name should be in the collection
-  TEST_ASSERT_NOT_NULL(node->parent);
-  TEST_ASSERT_EQUAL_STRING("datetime", node->parent->token->lexeme);
-  ASTNode *imported_name = ASTNode_pop(&node->collection);
+  TEST_ASSERT_NOT_NULL(AST_get(&parser.ast, node->parent));
+  TEST_ASSERT_EQUAL_STRING("datetime", link_lexeme(&parser, node->parent));
+  ASTNode *imported_name = AST_pop(&parser.ast, &node->collection);
   TEST_ASSERT_NOT_NULL(imported_name);
-  TEST_ASSERT_EQUAL_STRING("datetime", imported_name->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("datetime",
+                           token_lexeme(&parser.lexer, imported_name->token));
 
   // Cleanup
   parser_free(&parser);
@@ -711,8 +732,8 @@ void test_parse_list_literal(void) {
 
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
 
   // Assert: node is a LIST
   TEST_ASSERT_NOT_NULL(node);
@@ -720,9 +741,9 @@ void test_parse_list_literal(void) {
       LIST_EXPR, node->type); // Ensure LIST is defined in your ASTNodeType enum
 
   // Assert: list elements (assuming reverse pop order like your tuple test)
-  ASTNode *el3 = ASTNode_pop(&node->collection);
-  ASTNode *el2 = ASTNode_pop(&node->collection);
-  ASTNode *el1 = ASTNode_pop(&node->collection);
+  ASTNode *el3 = AST_pop(&parser.ast, &node->collection);
+  ASTNode *el2 = AST_pop(&parser.ast, &node->collection);
+  ASTNode *el1 = AST_pop(&parser.ast, &node->collection);
 
   TEST_ASSERT_NOT_NULL(el1);
   TEST_ASSERT_NOT_NULL(el2);
@@ -730,15 +751,15 @@ void test_parse_list_literal(void) {
 
   // Check element 1: Literal 1
   TEST_ASSERT_EQUAL_INT(LITERAL, el1->type);
-  TEST_ASSERT_EQUAL_STRING("1", el1->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("1", token_lexeme(&parser.lexer, el1->token));
 
   // Check element 2: Variable x
   TEST_ASSERT_EQUAL_INT(VARIABLE, el2->type);
-  TEST_ASSERT_EQUAL_STRING("x", el2->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("x", token_lexeme(&parser.lexer, el2->token));
 
   // Check element 3: Literal 3
   TEST_ASSERT_EQUAL_INT(LITERAL, el3->type);
-  TEST_ASSERT_EQUAL_STRING("3", el3->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("3", token_lexeme(&parser.lexer, el3->token));
 
   // Cleanup
   parser_free(&parser);
@@ -750,23 +771,23 @@ void test_parse_list_comprehension(void) {
 
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
 
   // Assert
   TEST_ASSERT_EQUAL_INT(LIST_COMPREHENSION, node->type);
 
   // 1. Verify the element expression (the first 'i')
-  TEST_ASSERT_NOT_NULL(node->list_comp.expr);
-  TEST_ASSERT_EQUAL_STRING("i", node->list_comp.expr->token->lexeme);
+  TEST_ASSERT_NOT_NULL(AST_get(&parser.ast, node->list_comp.expr));
+  TEST_ASSERT_EQUAL_STRING("i", link_lexeme(&parser, node->list_comp.expr));
 
   // 2. Verify the target variable (the 'i' in 'for i')
-  TEST_ASSERT_NOT_NULL(node->list_comp.target);
-  TEST_ASSERT_EQUAL_STRING("i", node->list_comp.target->token->lexeme);
+  TEST_ASSERT_NOT_NULL(AST_get(&parser.ast, node->list_comp.target));
+  TEST_ASSERT_EQUAL_STRING("i", link_lexeme(&parser, node->list_comp.target));
 
   // 3. Verify the iterable (the 'x' in 'in x')
-  TEST_ASSERT_NOT_NULL(node->list_comp.iter);
-  TEST_ASSERT_EQUAL_STRING("x", node->list_comp.iter->token->lexeme);
+  TEST_ASSERT_NOT_NULL(AST_get(&parser.ast, node->list_comp.iter));
+  TEST_ASSERT_EQUAL_STRING("x", link_lexeme(&parser, node->list_comp.iter));
 
   // Clean
   parser_free(&parser);
@@ -778,14 +799,16 @@ void test_parse_subscript(void) {
 
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *main = ASTNode_pop(&parser.ast);
-  ASTNode *node = ASTNode_pop(&main->def.body);
+  ASTNode *main = AST_pop(&parser.ast, &parser.program);
+  ASTNode *node = AST_pop(&parser.ast, &main->def.body);
 
   // Assert
   TEST_ASSERT_EQUAL_INT(SUBSCRIPT, node->type);
-  TEST_ASSERT_EQUAL_STRING("item", node->subscript.value->token->lexeme);
-  TEST_ASSERT_EQUAL_INT(LITERAL, node->subscript.slice->type);
-  TEST_ASSERT_EQUAL_STRING("amount", node->subscript.slice->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("item", link_lexeme(&parser, node->subscript.value));
+  TEST_ASSERT_EQUAL_INT(LITERAL,
+                        AST_get(&parser.ast, node->subscript.slice)->type);
+  TEST_ASSERT_EQUAL_STRING(
+      "amount", link_lexeme(&parser, node->subscript.slice));
 
   // Clean
   parser_free(&parser);
@@ -798,39 +821,452 @@ void test_parse_generator_expression(void) {
                          "test_file.py");
   // Act
   Parser parser = parse(&lexer);
-  ASTNode *assign = ASTNode_pop(&parser.ast);
+  ASTNode *assign = AST_pop(&parser.ast, &parser.program);
 
   // Assert: top level is an assignment
   TEST_ASSERT_NOT_NULL(assign);
   TEST_ASSERT_EQUAL_INT(ASSIGNMENT, assign->type);
   TEST_ASSERT_EQUAL_STRING(
       "total_spent",
-      assign->assign.targets.elements[assign->assign.targets.head]
-          .data->token->lexeme);
+      token_lexeme(&parser.lexer,
+                   AST_child(&parser.ast, assign->assign.targets, 0)->token));
 
   // Assert: RHS is a call to sum(...)
-  ASTNode *call = assign->assign.value;
+  ASTNode *call = AST_get(&parser.ast, assign->assign.value);
   TEST_ASSERT_EQUAL_INT(CALL, call->type);
-  TEST_ASSERT_EQUAL_STRING("sum", call->call.func->token->lexeme);
+  TEST_ASSERT_EQUAL_STRING("sum", link_lexeme(&parser, call->call.func));
 
   // Assert: sole argument is a generator expression
-  TEST_ASSERT_EQUAL_INT(1, call->call.args.size);
-  ASTNode *genexp = call->call.args.elements[call->call.args.head].data;
+  TEST_ASSERT_EQUAL_INT(1, call->call.args.count);
+  ASTNode *genexp = AST_child(&parser.ast, call->call.args, 0);
   TEST_ASSERT_EQUAL_INT(LIST_COMPREHENSION,
                         genexp->type); // or GENERATOR_EXPR once you add it
 
   // Assert: genexp result expression is a binary operation (item[...] *
   // self.days_count)
-  TEST_ASSERT_EQUAL_INT(BINARY_OPERATION, genexp->list_comp.expr->type);
-  TEST_ASSERT_EQUAL_STRING("*", genexp->list_comp.expr->token->lexeme);
+  TEST_ASSERT_EQUAL_INT(BINARY_OPERATION,
+                        AST_get(&parser.ast, genexp->list_comp.expr)->type);
+  TEST_ASSERT_EQUAL_STRING("*", link_lexeme(&parser, genexp->list_comp.expr));
 
   // Assert: loop target and iterable
-  TEST_ASSERT_EQUAL_STRING("item", genexp->list_comp.target->token->lexeme);
-  TEST_ASSERT_EQUAL_INT(ATTRIBUTE, genexp->list_comp.iter->type);
-  TEST_ASSERT_EQUAL_STRING("daily_expenses",
-                           genexp->list_comp.iter->attribute.attr);
+  TEST_ASSERT_EQUAL_STRING(
+      "item", link_lexeme(&parser, genexp->list_comp.target));
+  ASTNode *iter = AST_get(&parser.ast, genexp->list_comp.iter);
+  TEST_ASSERT_EQUAL_INT(ATTRIBUTE, iter->type);
+  TEST_ASSERT_EQUAL_STRING("daily_expenses", iter->attribute.attr);
+
+  // Clean
+  parser_free(&parser);
+}
+
+void test_parse_child_spans(void) {
+  // Arrange
+  Lexer lexer = tokenize("def f(a, b):\n"
+                         "  g(a, h(b))\n"
+                         "  return a\n",
+                         "test_file.py");
+  // Act
+  Parser parser = parse(&lexer);
+
+  // Assert: lists are contiguous spans of the shared child array
+  TEST_ASSERT_EQUAL_INT(1, parser.program.count);
+  ASTNode *func = AST_child(&parser.ast, parser.program, 0);
+  TEST_ASSERT_EQUAL_INT(FUNCTION_DEF, func->type);
+  TEST_ASSERT_EQUAL_INT(2, func->def.params.count);
+  TEST_ASSERT_EQUAL_INT(2, func->def.body.count);
+
+  // Assert: nested lists are committed before the list holding them
+  ASTNode *call = AST_child(&parser.ast, func->def.body, 0);
+  ASTNode *inner = AST_child(&parser.ast, call->call.args, 1);
+  TEST_ASSERT_EQUAL_INT(CALL, inner->type);
+  TEST_ASSERT_EQUAL_INT(1, inner->call.args.count);
+  TEST_ASSERT_TRUE(inner->call.args.start < call->call.args.start);
+
+  // Act: grow a span that does not end the child array
+  NodeSpan params = func->def.params;
+  AST_append(&parser.ast, &func->def.params, inner);
+
+  // Assert: it moved to the end, keeping its children in order
+  TEST_ASSERT_EQUAL_INT(3, func->def.params.count);
+  TEST_ASSERT_EQUAL_INT(parser.ast.children_size - 3, func->def.params.start);
+  TEST_ASSERT_EQUAL_PTR(AST_child(&parser.ast, params, 0),
+                        AST_child(&parser.ast, func->def.params, 0));
+  TEST_ASSERT_EQUAL_PTR(AST_child(&parser.ast, params, 1),
+                        AST_child(&parser.ast, func->def.params, 1));
+  TEST_ASSERT_EQUAL_PTR(inner, AST_last(&parser.ast, func->def.params));
+
+  // Clean
+  parser_free(&parser);
+}
+
+void test_parse_compact_nodes(void) {
+  // Arrange
+  Lexer lexer = tokenize("x = 1\n", "test_file.py");
+  // Act
+  Parser parser = parse(&lexer);
+  ASTNode *assign = AST_child(&parser.ast, parser.program, 0);
+  ASTNode *target = AST_child(&parser.ast, assign->assign.targets, 0);
+
+  // Assert: small kinds do not pay for the largest payload
+  TEST_ASSERT_TRUE(node_size(VARIABLE) < node_size(ASSIGNMENT));
+  TEST_ASSERT_TRUE(node_size(LITERAL) < sizeof(ASTNode));
+  TEST_ASSERT_TRUE(node_size(LIST_COMPREHENSION) <= sizeof(ASTNode));
+
+  // Assert: nodes are packed back to back in creation order
+  size_t words = (node_size(VARIABLE) + AST_NODE_ALIGN - 1) / AST_NODE_ALIGN;
+  TEST_ASSERT_EQUAL(AST_index(&parser.ast, target) + words,
+                    AST_index(&parser.ast, assign));
+  TEST_ASSERT_EQUAL_INT(LITERAL,
+                        AST_get(&parser.ast, assign->assign.value)->type);
+
+  // Clean
+  parser_free(&parser);
+}
+
+// Reparses `before` into `after`, which differs from it by `edit`, and checks
+// the result against parsing `after` from scratch
+static Parser assert_reparse(Parser parser, const char *after,
+                             SourceEdit edit) {
+  reparse(&parser, after, edit);
+
+  Lexer lexer = tokenize(after, "test_file.py");
+  Parser fresh = parse(&lexer);
+  char *expected = dump_program(&fresh, fresh.program);
+  char *actual = dump_program(&parser, parser.program);
+  TEST_ASSERT_EQUAL_STRING(expected, actual);
+  TEST_ASSERT_EQUAL(fresh.statements.count, parser.statements.count);
+  free(expected);
+  free(actual);
+  parser_free(&fresh);
+  return parser;
+}
+
+void test_reparse_matches_parse(void) {
+  // Arrange
+  const char *before = "def f(a):\n  return a\nx = f(1)\nprint(x)\n"
+                       "y = x + 2\n";
+  const char *longer = "def f(a):\n  return a\nx = f(10)\nprint(x)\n"
+                       "y = x + 2\n";
+  const char *added = "def f(a):\n  return a\nx = f(10)\nz = 3\n"
+                      "print(x)\ny = x + 2\n";
+  const char *body = "def f(a, b):\n  return a * b\nx = f(10)\nz = 3\n"
+                     "print(x)\ny = x + 2\n";
+  Lexer lexer = tokenize(before, "test_file.py");
+  Parser parser = parse(&lexer);
+  NodeIndex first = parser.ast.children[parser.statements.start];
+  NodeIndex last = AST_index(&parser.ast,
+                             AST_last(&parser.ast, parser.statements));
+
+  // Act & Assert: a literal growing inside the third statement
+  SourceEdit edit = {.start = strstr(before, "1)") - before,
+                     .old_length = 1,
+                     .new_length = 2};
+  parser = assert_reparse(parser, longer, edit);
+  TEST_ASSERT_EQUAL(first, parser.ast.children[parser.statements.start]);
+  TEST_ASSERT_EQUAL_PTR(AST_node(&parser.ast, last),
+                        AST_last(&parser.ast, parser.statements));
+  TEST_ASSERT_EQUAL_STRING("=", link_lexeme(&parser, last));
+
+  // Act & Assert: a new statement
+  edit = (SourceEdit){.start = strstr(longer, "print") - longer,
+                      .new_length = strlen("z = 3\n")};
+  parser = assert_reparse(parser, added, edit);
+  TEST_ASSERT_EQUAL(5, parser.statements.count);
+  TEST_ASSERT_EQUAL_PTR(AST_node(&parser.ast, last),
+                        AST_last(&parser.ast, parser.statements));
+
+  // Act & Assert: the function gains a parameter and its body changes
+  edit = (SourceEdit){.start = strstr(added, ")") - added,
+                      .new_length = strlen(", b):\n  return a * b"),
+                      .old_length = strlen("):\n  return a")};
+  parser = assert_reparse(parser, body, edit);
+  TEST_ASSERT_EQUAL_PTR(AST_node(&parser.ast, last),
+                        AST_last(&parser.ast, parser.statements));
+
+  // Clean
+  parser_free(&parser);
+}
+
+void test_reparse_grows_node_reservation(void) {
+  // Arrange
+  const char *before = "x = 1\n";
+  const char *line = "y = x + 2\n";
+  size_t lines = 4096;
+  size_t length = strlen(line);
+  char *after = malloc(strlen(before) + lines * length + 1);
+  strcpy(after, before);
+  for (size_t i = 0; i < lines; i++)
+    memcpy(after + strlen(before) + i * length, line, length + 1);
+  Lexer lexer = tokenize(before, "test_file.py");
+  Parser parser = parse(&lexer);
+  uint32_t reserved = parser.ast.capacity;
+  TEST_ASSERT_LESS_THAN(AST_words_for(lines), reserved);
+
+  // Act & Assert: the appended statements need more room than was reserved
+  SourceEdit edit = {.start = strlen(before),
+                     .new_length = lines * length};
+  parser = assert_reparse(parser, after, edit);
+  TEST_ASSERT_EQUAL(lines + 1, parser.statements.count);
+  TEST_ASSERT_GREATER_THAN(reserved, parser.ast.capacity);
+
+  // Clean
+  parser_free(&parser);
+  free(after);
+}
+
+void test_parse_streaming_matches_parse(void) {
+  // Arrange: several lexer blocks worth of statements
+  const char *snippet = "def f(a):\n  return a + 1\nx = f(2)\nprint(x)\n";
+  size_t snippet_length = strlen(snippet);
+  size_t repeat = (200 * 1024) / snippet_length;
+  char *source = malloc(snippet_length * repeat + 1);
+  TEST_ASSERT_NOT_NULL(source);
+  for (size_t i = 0; i < repeat; i++) {
+    memcpy(source + i * snippet_length, snippet, snippet_length);
+  }
+  source[snippet_length * repeat] = '\0';
+
+  // Act
+  Lexer lexer = tokenize(source, "test_file.py");
+  Parser serial = parse(&lexer);
+  Lexer streamed_lexer = tokenize_streaming(source, "test_file.py");
+  Parser streamed = parse(&streamed_lexer);
+
+  // Assert
+  TEST_ASSERT_NULL(streamed.lexer.stream);
+  TEST_ASSERT_EQUAL(serial.lexer.tokens.size, streamed.lexer.tokens.size);
+  TEST_ASSERT_EQUAL(3 * repeat, streamed.statements.count);
+  char *expected = dump_program(&serial, serial.program);
+  char *actual = dump_program(&streamed, streamed.program);
+  TEST_ASSERT_EQUAL_STRING(expected, actual);
+
+  // Clean
+  free(expected);
+  free(actual);
+  parser_free(&serial);
+  parser_free(&streamed);
+  free(source);
+}
+
+void test_parse_parallel_matches_parse(void) {
+  // Arrange: enough definitions for several chunks, with top-level code in
+  // between
+  const char *snippet = "def f(a):\n  return a + 1\n"
+                        "class C:\n  n = 1\n"
+                        "x = f(2)\n"
+                        "if x > 1:\n  y = f(x)\nelse:\n  y = 0\n"
+                        "print(x)\n";
+  size_t snippet_length = strlen(snippet);
+  size_t repeat = 2000;
+  char *source = malloc(snippet_length * repeat + 1);
+  TEST_ASSERT_NOT_NULL(source);
+  for (size_t i = 0; i < repeat; i++) {
+    memcpy(source + i * snippet_length, snippet, snippet_length);
+  }
+  source[snippet_length * repeat] = '\0';
+
+  Lexer lexer = tokenize(source, "test_file.py");
+  Parser serial = parse(&lexer);
+  char *expected = dump_program(&serial, serial.program);
+
+  for (size_t jobs = 2; jobs <= 4; jobs++) {
+    // Act
+    Lexer parallel_lexer = tokenize(source, "test_file.py");
+    Parser parallel = parse_parallel(&parallel_lexer, jobs);
+
+    // Assert
+    TEST_ASSERT_EQUAL(5 * repeat, parallel.statements.count);
+    char *actual = dump_program(&parallel, parallel.program);
+    TEST_ASSERT_EQUAL_STRING(expected, actual);
+
+    free(actual);
+    parser_free(&parallel);
+  }
+
+  // Clean
+  free(expected);
+  parser_free(&serial);
+  free(source);
+}
+
+void test_parse_deeply_nested_expression(void) {
+  // Arrange: nesting far deeper than a recursive parser could follow
+  const size_t depth = 100000;
+  char *source = malloc(6 * depth + 64);
+  TEST_ASSERT_NOT_NULL(source);
+  char *p = source;
+  p += sprintf(p, "x = ");
+  memset(p, '(', depth);
+  p += depth;
+  *p++ = '1';
+  memset(p, ')', depth);
+  p += depth;
+  p += sprintf(p, "\ny = ");
+  memset(p, '-', depth);
+  p += depth;
+  p += sprintf(p, "1\n");
+  memset(p, '\n', depth);
+  p += depth;
+  p += sprintf(p, "z = 2");
+  for (size_t i = 0; i < depth / 4; i++) {
+    p += sprintf(p, "**2");
+  }
+  p += sprintf(p, "\n");
+
+  // Act
+  Lexer lexer = tokenize(source, "test_file.py");
+  Parser parser = parse(&lexer);
+
+  // Assert
+  TEST_ASSERT_EQUAL(3, parser.statements.count);
+  ASTNode *x = AST_child(&parser.ast, parser.statements, 0);
+  TEST_ASSERT_EQUAL(LITERAL, AST_get(&parser.ast, x->assign.value)->type);
+
+  ASTNode *y = AST_child(&parser.ast, parser.statements, 1);
+  size_t unary = 0;
+  for (ASTNode *node = AST_get(&parser.ast, y->assign.value);
+       node->type == UNARY_OPERATION;
+       node = AST_get(&parser.ast, node->bin_op.right)) {
+    unary++;
+  }
+  TEST_ASSERT_EQUAL(depth, unary);
+
+  // Exponentiation nests to the right
+  ASTNode *z = AST_child(&parser.ast, parser.statements, 2);
+  size_t powers = 0;
+  for (ASTNode *node = AST_get(&parser.ast, z->assign.value);
+       node->type == BINARY_OPERATION;
+       node = AST_get(&parser.ast, node->bin_op.right)) {
+    powers++;
+  }
+  TEST_ASSERT_EQUAL(depth / 4, powers);
+
+  // Clean
+  parser_free(&parser);
+  free(source);
+}
+
+void test_ast_snapshot_round_trip(void) {
+  // Arrange
+  const char *path = "ceeify_snapshot_test.ast";
+  Lexer lexer = tokenize("import math\n"
+                         "class Point:\n"
+                         "  x = 1\n"
+                         "def f(a: int) -> int:\n"
+                         "  if 0 < a <= 3:\n"
+                         "    return a.real\n"
+                         "  return f(a - 1) * 2\n"
+                         "odd = [n for n in range(9) if n > 2]\n"
+                         "s = \"tab\\there\"\n"
+                         "print(f(3))\n",
+                         "test_file.py");
+  Parser parser = parse(&lexer);
+  char *expected = dump_program(&parser, parser.program);
+
+  // Act
+  TEST_ASSERT_TRUE(ast_snapshot_save(&parser, path));
+  ASTSnapshot snapshot = {0};
+  Parser loaded = {0};
+  TEST_ASSERT_TRUE(ast_snapshot_detect(path));
+  TEST_ASSERT_TRUE(ast_snapshot_open(&snapshot, path, &loaded));
+
+  // Assert
+  TEST_ASSERT_EQUAL(parser.lexer.tokens.size, loaded.lexer.tokens.size);
+  TEST_ASSERT_EQUAL(parser.statements.count, loaded.statements.count);
+  TEST_ASSERT_EQUAL_STRING("test_file.py", loaded.lexer.filename);
+  char *actual = dump_program(&loaded, loaded.program);
+  TEST_ASSERT_EQUAL_STRING(expected, actual);
+
+  // Literals and names come back without lexing again
+  TokenIndex string = TOKEN_NONE;
+  for (TokenIndex t = TOKEN_NONE + 1; t < loaded.lexer.token_end; t++) {
+    if (token_type(&loaded.lexer, t) == STRING)
+      string = t;
+  }
+  TEST_ASSERT_EQUAL_STRING("tab\there",
+                           token_value(&loaded.lexer, string)->str_val);
+  const char *name = "odd";
+  TEST_ASSERT_NOT_EQUAL(
+      NAME_NONE,
+      InternTable_find(&loaded.lexer.tokens.interned, name, strlen(name)));
+
+  // The loaded tree still grows like a parsed one
+  TokenIndex extra = create_token_from_str(&loaded.lexer, "extra", IDENTIFIER);
+  TEST_ASSERT_EQUAL_STRING("extra", token_lexeme(&loaded.lexer, extra));
+  ASTNode *node = node_new(&loaded, extra, VARIABLE);
+  AST_append(&loaded.ast, &loaded.program, node);
+  TEST_ASSERT_EQUAL_PTR(node, AST_last(&loaded.ast, loaded.program));
+
+  // Clean
+  free(expected);
+  free(actual);
+  parser_free(&loaded);
+  ast_snapshot_close(&snapshot);
+  parser_free(&parser);
+  remove(path);
+}
+
+void test_serialize_program_streams_json(void) {
+  // Arrange
+  Lexer lexer = tokenize("x = 1\n", "test_file.py");
+  Parser parser = parse(&lexer);
+  char *expected = dump_program(&parser, parser.program);
+  FILE *file = tmpfile();
+  TEST_ASSERT_NOT_NULL(file);
+
+  // Act
+  JsonWriter compact = json_writer_string(true);
+  NodeSpan first = {.start = parser.program.start, .count = 1};
+  serialize_program(&compact, &parser, first);
+  char *actual_compact = json_writer_take(&compact);
+  JsonWriter json = json_writer_file(file, false);
+  serialize_program(&json, &parser, parser.program);
+  TEST_ASSERT_TRUE(json_writer_flush(&json));
+  json_writer_free(&json);
+
+  JsonWriter values = json_writer_string(true);
+  json_begin_object(&values);
+  json_field_string(&values, "s", "q\"\\\n\x01");
+  json_field_string(&values, "missing", NULL);
+  json_key(&values, "n");
+  json_begin_array(&values);
+  json_number(&values, -3);
+  json_number(&values, 0.1);
+  json_number(&values, 1e300);
+  json_bool(&values, true);
+  json_null(&values);
+  json_end_array(&values);
+  json_end_object(&values);
+  char *actual_values = json_writer_take(&values);
+
+  // Assert
+  TEST_ASSERT_EQUAL_STRING(
+      "[{\"type\":\"ASSIGNMENT\",\"depth\":1,\"ctx\":\"STORE\","
+      "\"targets\":[{\"type\":\"VARIABLE\",\"depth\":1,\"ctx\":\"STORE\","
+      "\"token\":{\"type\":\"IDENTIFIER\",\"lexeme\":\"x\",\"line\":1,"
+      "\"col\":1,\"ident\":0}}],"
+      "\"value\":{\"type\":\"LITERAL\",\"depth\":1,\"ctx\":\"LOAD\","
+      "\"token\":{\"type\":\"NUMBER\",\"lexeme\":\"1\",\"line\":1,"
+      "\"col\":5,\"ident\":0}}}]",
+      actual_compact);
+
+  size_t length = (size_t)ftell(file);
+  TEST_ASSERT_EQUAL(strlen(expected), length);
+  char *written = calloc(length + 1, 1);
+  rewind(file);
+  TEST_ASSERT_EQUAL(length, fread(written, 1, length, file));
+  TEST_ASSERT_EQUAL_STRING(expected, written);
+
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"s\":\"q\\\"\\\\\\n\\u0001\",\"n\":[-3,0.1,1e+300,true,null]}",
+      actual_values);
 
   // Clean
+  free(expected);
+  free(actual_compact);
+  free(actual_values);
+  free(written);
+  fclose(file);
   parser_free(&parser);
 }
 
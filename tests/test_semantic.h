@@ -1,6 +1,7 @@
 #ifndef TEST_SEMANTIC_H_
 #define TEST_SEMANTIC_H_
 #pragma once
+#include "class_layout.h"
 #include "semantic.h"
 #include <unity.h>
 
@@ -90,13 +91,13 @@ void test_semantic_function_declaration(void) {
   SemanticError err = sa_get_error(&sa);
   TEST_ASSERT_FALSE(sa_has_error(&sa));
   TEST_ASSERT_EQUAL(SEM_OK, err.type);
-  Symbol *fn = sa_lookup(&sa, "add");
+  Symbol *fn = sa_lookup(&sa, sa_name(&sa, "add"));
   TEST_ASSERT_NOT_NULL(fn);
   TEST_ASSERT_EQUAL(FUNCTION, fn->kind);
   TEST_ASSERT_NOT_NULL(fn->decl_node);
   sa.current_scope = fn->scope;
-  Symbol *px = sa_lookup(&sa, "x");
-  Symbol *py = sa_lookup(&sa, "y");
+  Symbol *px = sa_lookup(&sa, sa_name(&sa, "x"));
+  Symbol *py = sa_lookup(&sa, sa_name(&sa, "y"));
   TEST_ASSERT_NOT_NULL(px);
   TEST_ASSERT_NOT_NULL(py);
   TEST_ASSERT_EQUAL(VAR, px->kind);
@@ -248,12 +249,12 @@ void test_semantic_class_inheritance_and_init(void) {
   TEST_ASSERT_FALSE(sa_has_error(&sa));
 
   // Assert: Animal class exists
-  Symbol *animal = sa_lookup(&sa, "Animal");
+  Symbol *animal = sa_lookup(&sa, sa_name(&sa, "Animal"));
   TEST_ASSERT_NOT_NULL(animal);
   TEST_ASSERT_EQUAL(CLASS, animal->kind);
 
   // Assert: Dog class exists
-  Symbol *dog = sa_lookup(&sa, "Dog");
+  Symbol *dog = sa_lookup(&sa, sa_name(&sa, "Dog"));
   TEST_ASSERT_NOT_NULL(dog);
   TEST_ASSERT_EQUAL(CLASS, dog->kind);
 
@@ -262,7 +263,7 @@ void test_semantic_class_inheritance_and_init(void) {
   if (animal->scope) {
     animal_name = sa_lookup(
         (SemanticAnalyzer *)&(SemanticAnalyzer){.current_scope = animal->scope},
-        "name");
+        sa_name(&sa, "name"));
   }
   TEST_ASSERT_NOT_NULL(animal_name);
   TEST_ASSERT_EQUAL(VAR, animal_name->kind);
@@ -273,7 +274,7 @@ void test_semantic_class_inheritance_and_init(void) {
   if (dog->scope) {
     dog_tails = sa_lookup(
         (SemanticAnalyzer *)&(SemanticAnalyzer){.current_scope = dog->scope},
-        "tails");
+        sa_name(&sa, "tails"));
   }
   TEST_ASSERT_NOT_NULL(dog_tails);
   TEST_ASSERT_EQUAL(VAR, dog_tails->kind);
@@ -282,12 +283,12 @@ void test_semantic_class_inheritance_and_init(void) {
   // Assert: inherited field is visible in Dog
   Symbol *dog_name = NULL;
   if (dog->scope) {
-    dog_name = sa_lookup_member(dog, "name");
+    dog_name = sa_lookup_member(dog, sa_name(&sa, "name"));
   }
   TEST_ASSERT_NOT_NULL(dog_name);
   TEST_ASSERT_EQUAL(STR, dog_name->dtype);
 
-  Symbol *init_method = sa_lookup_member(dog, "__init__");
+  Symbol *init_method = sa_lookup_member(dog, sa_name(&sa, "__init__"));
   TEST_ASSERT_NOT_NULL(init_method);
   // Cleanup
   parser_free(&parser);
@@ -355,4 +356,397 @@ void test_semantic_match_duplicate_binding(void) {
   parser_free(&parser);
 }
 
+void test_semantic_many_globals(void) {
+  // Arrange: enough globals to grow the scope index several times
+  enum { GLOBALS = 500 };
+  char *source = malloc(GLOBALS * 16 + 64);
+  TEST_ASSERT_NOT_NULL(source);
+  size_t length = 0;
+  for (int i = 0; i < GLOBALS; i++) {
+    length += (size_t)sprintf(source + length, "v%d = %d\n", i, i);
+  }
+  strcpy(source + length, "def f(v7: int) -> int:\n    return v7 + v8\n");
+  Lexer lexer = tokenize(source, "test.py");
+  Parser parser = parse(&lexer);
+
+  // Act
+  SemanticAnalyzer sa = analyze_program(&parser);
+
+  // Assert
+  TEST_ASSERT_FALSE(sa_has_error(&sa));
+  TEST_ASSERT_EQUAL(GLOBALS + 1, sa.current_scope->count);
+  for (int i = 0; i < GLOBALS; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "v%d", i);
+    Symbol *sym = sa_lookup(&sa, sa_name(&sa, name));
+    TEST_ASSERT_NOT_NULL(sym);
+    TEST_ASSERT_EQUAL_STRING(name, sym->name);
+    TEST_ASSERT_EQUAL(0, sym->scope_level);
+  }
+  TEST_ASSERT_NULL(sa_lookup(&sa, sa_name(&sa, "v500")));
+
+  // The parameter shadows the global inside the function only
+  Symbol *fn = sa_lookup(&sa, sa_name(&sa, "f"));
+  TEST_ASSERT_NOT_NULL(fn);
+  sa.current_scope = fn->scope;
+  TEST_ASSERT_EQUAL(1, sa_lookup(&sa, sa_name(&sa, "v7"))->scope_level);
+  TEST_ASSERT_EQUAL(0, sa_lookup(&sa, sa_name(&sa, "v8"))->scope_level);
+  TEST_ASSERT_NULL(sa_lookup_local(&sa, sa_name(&sa, "v8")));
+  // Cleanup
+  parser_free(&parser);
+  free(source);
+}
+
+void test_semantic_cached_types(void) {
+  // Arrange
+  Lexer lexer = tokenize("x = 1 + 2.5\ny = x * 2\n", "test.py");
+  Parser parser = parse(&lexer);
+
+  // Act
+  SemanticAnalyzer sa = analyze_program(&parser);
+
+  // Assert: types and symbols are resolved once and kept on the nodes
+  TEST_ASSERT_FALSE(sa_has_error(&sa));
+  ASTNode *second = AST_last(&parser.ast, parser.program);
+  ASTNode *product = AST_get(&parser.ast, second->assign.value);
+  ASTNode *use = AST_get(&parser.ast, product->bin_op.left);
+  TEST_ASSERT_EQUAL(FLOAT, product->dtype);
+  TEST_ASSERT_EQUAL(FLOAT, use->dtype);
+  TEST_ASSERT_EQUAL_PTR(sa_lookup(&sa, sa_name(&sa, "x")), use->symbol);
+
+  // Invalidation clears the node and its ancestors only
+  sa_invalidate_type(&sa, use);
+  TEST_ASSERT_EQUAL(UNKNOWN, use->dtype);
+  TEST_ASSERT_EQUAL(UNKNOWN, product->dtype);
+  TEST_ASSERT_EQUAL(INT, AST_get(&parser.ast, product->bin_op.right)->dtype);
+  TEST_ASSERT_EQUAL(FLOAT, sa_infer_type(&sa, product));
+  TEST_ASSERT_EQUAL(FLOAT, use->dtype);
+  // Cleanup
+  parser_free(&parser);
+}
+
+void test_semantic_parallel_bodies_match_serial(void) {
+  // Arrange: annotated functions calling one defined after them, enough of
+  // them to be checked on several threads. Two bodies have errors.
+  enum { FUNCTIONS = 600 };
+  char *source = malloc(FUNCTIONS * 96 + 128);
+  TEST_ASSERT_NOT_NULL(source);
+  char messages[2][1024];
+  size_t jobs[2] = {1, 4};
+  for (int pass = 0; pass < 2; pass++) {
+    size_t length = 0;
+    for (int i = 0; i < FUNCTIONS; i++) {
+      const char *result = i == 300 ? "missing" : i == 450 ? "\"s\"" : "b";
+      length += (size_t)sprintf(source + length,
+                                "def f%d(a: int) -> int:\n"
+                                "    b = a + %d\n"
+                                "    c = later(b)\n"
+                                "    return %s\n",
+                                i, i, result);
+    }
+    strcpy(source + length, "def later(x: int) -> int:\n    return x\n");
+    Lexer lexer = tokenize(source, "test.py");
+    Parser parser = parse(&lexer);
+
+    // Act
+    SemanticAnalyzer sa = analyze_program_parallel(&parser, jobs[pass]);
+
+    // Assert: both errors are reported, in source order
+    TEST_ASSERT_TRUE(sa_has_error(&sa));
+    TEST_ASSERT_EQUAL(2, sa_error_count(&sa));
+    TEST_ASSERT_EQUAL(SEM_UNDEFINED_VARIABLE, sa_get_error(&sa).type);
+    TEST_ASSERT_NOT_NULL(strstr(sa_get_error(&sa).message, "f300"));
+    TEST_ASSERT_EQUAL(SEM_TYPE_MISMATCH, sa_error_at(&sa, 1).type);
+    TEST_ASSERT_NOT_NULL(strstr(sa_error_at(&sa, 1).message, "f450"));
+    snprintf(messages[pass], sizeof(messages[pass]), "%s\n%s",
+             sa_get_error(&sa).message, sa_error_at(&sa, 1).message);
+    Symbol *fn = sa_lookup(&sa, sa_name(&sa, "f0"));
+    TEST_ASSERT_NOT_NULL(fn);
+    TEST_ASSERT_EQUAL(INT, fn->dtype);
+    // Cleanup
+    parser_free(&parser);
+  }
+  TEST_ASSERT_EQUAL_STRING(messages[0], messages[1]);
+  free(source);
+}
+
+void test_semantic_parallel_calls_share_helper(void) {
+  // Arrange: deferred bodies on several threads calling one helper whose
+  // parameters are not annotated
+  enum { FUNCTIONS = 1000 };
+  char *source = malloc(FUNCTIONS * 64 + 128);
+  TEST_ASSERT_NOT_NULL(source);
+  size_t jobs[2] = {1, 4};
+  for (int pass = 0; pass < 2; pass++) {
+    size_t length = (size_t)sprintf(source, "def helper(x, y):\n"
+                                            "    return x\n");
+    for (int i = 0; i < FUNCTIONS; i++) {
+      length += (size_t)sprintf(source + length,
+                                "def f%d(a: int) -> int:\n"
+                                "    return helper(a, %d)\n",
+                                i, i);
+    }
+    Lexer lexer = tokenize(source, "test.py");
+    Parser parser = parse(&lexer);
+
+    // Act
+    SemanticAnalyzer sa = analyze_program_parallel(&parser, jobs[pass]);
+
+    // Assert: only the helper's own errors, its nodes left as declared
+    TEST_ASSERT_EQUAL(2, sa_error_count(&sa));
+    TEST_ASSERT_NOT_NULL(
+        strstr(sa_error_at(&sa, 1).detail, "parameter 'y'"));
+    Symbol *helper = sa_lookup(&sa, sa_name(&sa, "helper"));
+    TEST_ASSERT_NOT_NULL(helper);
+    NodeSpan params =
+        AST_get(&parser.ast, helper->decl_node->parent)->def.params;
+    for (uint32_t i = 0; i < params.count; i++) {
+      ASTNode *param = AST_child(&sa.parser.ast, params, i);
+      TEST_ASSERT_EQUAL(UNKNOWN, param->dtype);
+      TEST_ASSERT_TRUE(param->symbol->failed);
+    }
+    // Cleanup
+    parser_free(&parser);
+  }
+  free(source);
+}
+
+void test_semantic_resolved_bindings(void) {
+  // Arrange
+  Lexer lexer = tokenize("x = 1\n"
+                         "def f(a: int) -> int:\n"
+                         "    b: int = a + x\n"
+                         "    b = 2\n"
+                         "    return f(b)\n",
+                         "test.py");
+  Parser parser = parse(&lexer);
+
+  // Act
+  SemanticAnalyzer sa = analyze_program(&parser);
+
+  // Assert: every name carries the symbol it resolved to
+  TEST_ASSERT_FALSE(sa_has_error(&sa));
+  ASTNode *def = AST_last(&parser.ast, parser.program);
+  Symbol *f = AST_get(&parser.ast, def->def.name)->symbol;
+  TEST_ASSERT_NOT_NULL(f);
+  TEST_ASSERT_EQUAL(0, f->scope_level);
+  TEST_ASSERT_EQUAL(1, f->index);
+  TEST_ASSERT_EQUAL_PTR(sa_lookup(&sa, sa_name(&sa, "f")), f);
+
+  ASTNode *param = AST_child(&parser.ast, def->def.params, 0);
+  Symbol *a = param->symbol;
+  TEST_ASSERT_NOT_NULL(a);
+  TEST_ASSERT_EQUAL(1, a->scope_level);
+  TEST_ASSERT_EQUAL(0, a->index);
+
+  ASTNode *decl = AST_child(&parser.ast, def->def.body, 0);
+  ASTNode *b_store = AST_child(&parser.ast, decl->assign.targets, 0);
+  Symbol *b = b_store->symbol;
+  TEST_ASSERT_NOT_NULL(b);
+  TEST_ASSERT_EQUAL_PTR(b_store, b->decl_node);
+  TEST_ASSERT_EQUAL(1, b->index);
+  ASTNode *value = AST_get(&parser.ast, decl->assign.value);
+  TEST_ASSERT_EQUAL_PTR(a, AST_get(&parser.ast, value->bin_op.left)->symbol);
+  Symbol *x = AST_get(&parser.ast, value->bin_op.right)->symbol;
+  TEST_ASSERT_NOT_NULL(x);
+  TEST_ASSERT_EQUAL(0, x->scope_level);
+
+  ASTNode *reassign = AST_child(&parser.ast, def->def.body, 1);
+  TEST_ASSERT_EQUAL_PTR(
+      b, AST_child(&parser.ast, reassign->assign.targets, 0)->symbol);
+  ASTNode *call =
+      AST_get(&parser.ast, AST_child(&parser.ast, def->def.body, 2)->child);
+  TEST_ASSERT_EQUAL_PTR(f, call->symbol);
+  TEST_ASSERT_EQUAL_PTR(b, AST_child(&parser.ast, call->call.args, 0)->symbol);
+  // Cleanup
+  parser_free(&parser);
+}
+
+void test_semantic_class_layout(void) {
+  // Arrange
+  Lexer lexer = tokenize("class Animal:\n"
+                         "    name: str\n"
+                         "    legs: int\n"
+                         "\n"
+                         "class Dog(Animal):\n"
+                         "    tails: int\n"
+                         "\n"
+                         "    def __init__(self, name: str):\n"
+                         "        self.name = name\n"
+                         "        self.butt = 1\n"
+                         "\n"
+                         "    def speak(self):\n"
+                         "        return 2\n",
+                         "test.py");
+  Parser parser = parse(&lexer);
+
+  // Act
+  SemanticAnalyzer sa = analyze_program(&parser);
+
+  // Assert: base fields keep their offsets and owner in the derived layout
+  TEST_ASSERT_FALSE(sa_has_error(&sa));
+  Symbol *animal = sa_lookup(&sa, sa_name(&sa, "Animal"));
+  Symbol *dog = sa_lookup(&sa, sa_name(&sa, "Dog"));
+  TEST_ASSERT_NOT_NULL(dog);
+  TEST_ASSERT_NOT_NULL(dog->layout);
+  TEST_ASSERT_EQUAL(4, dog->layout->field_count);
+  TEST_ASSERT_EQUAL(2, dog->layout->method_count);
+  TEST_ASSERT_EQUAL(2, animal->layout->field_count);
+  TEST_ASSERT_NULL(class_layout_find(animal->layout, sa_name(&sa, "tails")));
+
+  const ClassMember *legs =
+      class_layout_find(dog->layout, sa_name(&sa, "legs"));
+  TEST_ASSERT_NOT_NULL(legs);
+  TEST_ASSERT_EQUAL(1, legs->offset);
+  TEST_ASSERT_EQUAL_PTR(animal, legs->owner);
+  TEST_ASSERT_EQUAL_PTR(sa_lookup_member(animal, sa_name(&sa, "name")),
+                        sa_lookup_member(dog, sa_name(&sa, "name")));
+
+  // Assert: fields assigned through self join the table of the class
+  const ClassMember *butt =
+      class_layout_find(dog->layout, sa_name(&sa, "butt"));
+  TEST_ASSERT_NOT_NULL(butt);
+  TEST_ASSERT_EQUAL(3, butt->offset);
+  TEST_ASSERT_EQUAL_PTR(dog, butt->owner);
+
+  // Assert: methods record whether they take the instance
+  const ClassMember *speak =
+      class_layout_find(dog->layout, sa_name(&sa, "speak"));
+  TEST_ASSERT_NOT_NULL(speak);
+  TEST_ASSERT_TRUE(speak->is_method);
+  TEST_ASSERT_TRUE(speak->takes_self);
+  TEST_ASSERT_EQUAL(1, speak->offset);
+  TEST_ASSERT_EQUAL_PTR(dog, speak->owner);
+  // Cleanup
+  parser_free(&parser);
+}
+
+void test_semantic_self_reference_by_name(void) {
+  // Arrange
+  Lexer lexer = tokenize("class A:\n"
+                         "    def m(self):\n"
+                         "        return self\n",
+                         "test.py");
+  Parser parser = parse(&lexer);
+  SemanticAnalyzer sa = analyze_program(&parser);
+  TEST_ASSERT_FALSE(sa_has_error(&sa));
+  Symbol *a = sa_lookup(&sa, sa_name(&sa, "A"));
+  ASTNode *class_def = AST_get(&parser.ast, a->decl_node->parent);
+  ASTNode *def = AST_last(&parser.ast, class_def->def.body);
+  ASTNode *use =
+      AST_get(&parser.ast, AST_last(&parser.ast, def->def.body)->child);
+
+  // Act: an unbound use whose token index is the name id of self, but whose
+  // text is another name
+  NameId self = sa_name(&sa, "self");
+  TEST_ASSERT_NOT_EQUAL(self, token_name(&parser.lexer, self));
+  sa.current_scope = AST_get(&parser.ast, def->def.name)->symbol->scope;
+  TokenIndex token = use->token;
+  use->symbol = NULL;
+  bool real = is_self_reference(&sa, use);
+  use->token = self;
+  bool other = is_self_reference(&sa, use);
+  use->token = token;
+
+  // Assert: only the text of the token decides
+  TEST_ASSERT_TRUE(real);
+  TEST_ASSERT_FALSE(other);
+  TEST_ASSERT_FALSE(sa.read_failed);
+  // Cleanup
+  parser_free(&parser);
+}
+
+void test_semantic_reports_every_error(void) {
+  // Arrange: three independent errors, and statements using what the failed
+  // ones defined
+  Lexer lexer = tokenize("y = missing\n"
+                         "z = y + 1\n"
+                         "def f(a: int) -> int:\n"
+                         "    b = a + \"s\"\n"
+                         "    c = b * 2\n"
+                         "    return c\n"
+                         "def g():\n"
+                         "    q = 1\n"
+                         "    q = \"str\"\n"
+                         "    return q\n"
+                         "w = f(1)\n",
+                         "test.py");
+  Parser parser = parse(&lexer);
+
+  // Act
+  SemanticAnalyzer sa = analyze_program(&parser);
+
+  // Assert: each error once, in source order, nothing that follows from one
+  TEST_ASSERT_EQUAL(3, sa_error_count(&sa));
+  SemanticError first = sa_error_at(&sa, 0);
+  TEST_ASSERT_EQUAL(SEM_UNDEFINED_VARIABLE, first.type);
+  TEST_ASSERT_EQUAL_STRING("name 'missing' is not defined", first.detail);
+  TEST_ASSERT_NOT_NULL(strstr(first.message, "line 1, in <module>"));
+
+  SemanticError second = sa_error_at(&sa, 1);
+  TEST_ASSERT_EQUAL(SEM_TYPE_MISMATCH, second.type);
+  TEST_ASSERT_EQUAL_STRING(
+      "unsupported operand type(s) for +: 'int' and 'str'", second.detail);
+  TEST_ASSERT_NOT_NULL(strstr(second.message, "line 4, in f\n"));
+  TEST_ASSERT_NOT_NULL(strstr(second.message, "\n              ^\n"));
+
+  SemanticError third = sa_error_at(&sa, 2);
+  TEST_ASSERT_EQUAL(SEM_TYPE_MISMATCH, third.type);
+  TEST_ASSERT_NOT_NULL(strstr(third.message, "in g\n"));
+  TEST_ASSERT_EQUAL(SEM_OK, sa_error_at(&sa, 3).type);
+  // Cleanup
+  parser_free(&parser);
+}
+
+void test_semantic_reports_unannotated_parameters(void) {
+  // Arrange: tests/mock/function_declaration.py
+  Lexer lexer = tokenize("def fun(x, y):\n"
+                         "    return x + y",
+                         "function_declaration.py");
+  Parser parser = parse(&lexer);
+
+  // Act
+  SemanticAnalyzer sa = analyze_program(&parser);
+
+  // Assert: one error per parameter, none from the body using them
+  TEST_ASSERT_EQUAL(2, sa_error_count(&sa));
+  SemanticError first = sa_error_at(&sa, 0);
+  TEST_ASSERT_EQUAL(SEM_TYPE_MISMATCH, first.type);
+  TEST_ASSERT_EQUAL_STRING(
+      "cannot infer type of parameter 'x'; add a type annotation",
+      first.detail);
+  TEST_ASSERT_NOT_NULL(strstr(first.message, "line 1, in fun\n"));
+  TEST_ASSERT_NOT_NULL(strstr(first.message, "\n            ^\n"));
+
+  SemanticError second = sa_error_at(&sa, 1);
+  TEST_ASSERT_EQUAL(SEM_TYPE_MISMATCH, second.type);
+  TEST_ASSERT_EQUAL_STRING(
+      "cannot infer type of parameter 'y'; add a type annotation",
+      second.detail);
+  TEST_ASSERT_NOT_NULL(strstr(second.message, "line 1, in fun\n"));
+  TEST_ASSERT_NOT_NULL(strstr(second.message, "\n               ^\n"));
+  TEST_ASSERT_EQUAL(SEM_OK, sa_error_at(&sa, 2).type);
+  // Cleanup
+  parser_free(&parser);
+}
+
+void test_semantic_module_statement_frame(void) {
+  // Arrange: the call runs from the synthetic main
+  Lexer lexer = tokenize("x: int = 1\n"
+                         "print(missing)\n",
+                         "test.py");
+  Parser parser = parse(&lexer);
+
+  // Act
+  SemanticAnalyzer sa = analyze_program(&parser);
+
+  // Assert: reported as module code, as Python does
+  TEST_ASSERT_EQUAL(1, sa_error_count(&sa));
+  SemanticError error = sa_error_at(&sa, 0);
+  TEST_ASSERT_EQUAL(SEM_UNDEFINED_VARIABLE, error.type);
+  TEST_ASSERT_NOT_NULL(strstr(error.message, "line 2, in <module>\n"));
+  // Cleanup
+  parser_free(&parser);
+}
+
 #endif // TEST_SEMANTIC_H_
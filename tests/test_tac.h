@@ -189,7 +189,7 @@ void test_tac_if_statement_no_else(void) {
   TACProgram tac = tac_generate(&sa);
   // Assert
   TEST_ASSERT_NOT_NULL(tac.instructions);
-  TEST_ASSERT_TRUE(tac.count >= 8);
+  TEST_ASSERT_TRUE(tac.count >= 9);
 
   // 0: CONST 1
   TEST_ASSERT_EQUAL_INT(TAC_CONST, tac.instructions[0].op);
@@ -203,20 +203,23 @@ void test_tac_if_statement_no_else(void) {
   // 3: LOAD x
   TEST_ASSERT_EQUAL_INT(TAC_LOAD, tac.instructions[3].op);
 
-  // 3: JZ L0
+  // 4: JZ L0
   TEST_ASSERT_EQUAL_INT(TAC_JZ, tac.instructions[4].op);
 
-  // 4: CONST 2
+  // 5: CONST 2
   TEST_ASSERT_EQUAL_INT(TAC_CONST, tac.instructions[5].op);
 
-  // 5: STORE y
-  TEST_ASSERT_EQUAL_INT(TAC_LABEL, tac.instructions[6].op);
+  // 6: STORE y
+  TEST_ASSERT_EQUAL_INT(TAC_STORE, tac.instructions[6].op);
+
+  // 7: LABEL L0
+  TEST_ASSERT_EQUAL_INT(TAC_LABEL, tac.instructions[7].op);
 
-  // 6: LABEL L0
-  TEST_ASSERT_EQUAL_INT(TAC_RETURN, tac.instructions[7].op);
+  // 8: RETURN
+  TEST_ASSERT_EQUAL_INT(TAC_RETURN, tac.instructions[8].op);
 
   // Jump must target the label
-  TEST_ASSERT_EQUAL_STRING(tac.instructions[6].label,
+  TEST_ASSERT_EQUAL_STRING(tac.instructions[7].label,
                            tac.instructions[4].label);
   // Cleanup
   parser_free(&parser);
@@ -321,4 +324,35 @@ void test_tac_if_else_statement(void) {
   parser_free(&parser);
 }
 
+void test_tac_dump_keeps_embedded_nul(void) {
+  // Arrange: two strings that only differ past a NUL
+  Lexer lexer = tokenize("s = \"a\\0b\"\nt = \"a\\0c\"\n", "test.py");
+  Parser parser = parse(&lexer);
+  SemanticAnalyzer sa = analyze_program(&parser);
+  TACProgram tac = tac_generate(&sa);
+  FILE *file = tmpfile();
+  TEST_ASSERT_NOT_NULL(file);
+
+  // Act
+  char *expected = tac_dump_program(&tac);
+  TEST_ASSERT_TRUE(tac_dump_program_to(&tac, file, false));
+
+  // Assert: both constants are kept whole, the file holds the same text
+  TEST_ASSERT_EQUAL(2, tac.constants.count);
+  TEST_ASSERT_NOT_NULL(strstr(expected, "\"a\\u0000b\""));
+  TEST_ASSERT_NOT_NULL(strstr(expected, "\"a\\u0000c\""));
+  size_t length = strlen(expected);
+  char *actual = malloc(length + 1);
+  rewind(file);
+  TEST_ASSERT_EQUAL(length, fread(actual, 1, length + 1, file));
+  actual[length] = '\0';
+  TEST_ASSERT_EQUAL_STRING(expected, actual);
+
+  // Cleanup
+  free(actual);
+  free(expected);
+  fclose(file);
+  parser_free(&parser);
+}
+
 #endif // TEST_TAC_H_
\ No newline at end of file